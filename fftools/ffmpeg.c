@@ -100,6 +100,7 @@ atomic_uint nb_output_dumped = 0;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *sched_stats_avio = NULL;
 
 InputFile   **input_files   = NULL;
 int        nb_input_files   = 0;
@@ -336,10 +337,15 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&vstats_filename);
     of_enc_stats_close();
 
+    avio_closep(&sched_stats_avio);
+
     hw_device_free_all();
 
     av_freep(&filter_nbthreads);
 
+    av_workpool_set_default(NULL);
+    av_workpool_free(&thread_pool);
+
     av_freep(&input_files);
     av_freep(&output_files);
 
@@ -852,6 +858,32 @@ static int check_keyboard_interaction(int64_t cur_time)
 /*
  * The following code is the main loop of the file converter
  */
+static void print_sched_stats(Scheduler *sch, int is_last_report)
+{
+    AVBPrint buf;
+    int ret;
+
+    if (!sched_stats_avio)
+        return;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    sch_print_stats(sch, &buf);
+    if (av_bprint_is_complete(&buf)) {
+        avio_write(sched_stats_avio, buf.str, buf.len);
+        avio_flush(sched_stats_avio);
+    }
+
+    av_bprint_finalize(&buf, NULL);
+
+    if (is_last_report) {
+        if ((ret = avio_closep(&sched_stats_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing scheduler stats log, loss of information possible: %s\n",
+                   av_err2str(ret));
+    }
+}
+
 static int transcode(Scheduler *sch)
 {
     int ret = 0;
@@ -881,10 +913,14 @@ static int transcode(Scheduler *sch)
 
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time, transcode_ts);
+
+        print_sched_stats(sch, 0);
     }
 
     ret = sch_stop(sch, &transcode_ts);
 
+    print_sched_stats(sch, 1);
+
     /* write the trailer if needed */
     for (int i = 0; i < nb_output_files; i++) {
         int err = of_write_trailer(output_files[i]);
@@ -47,6 +47,7 @@
 #include "libavutil/rational.h"
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/workpool.h"
 
 #include "libswresample/swresample.h"
 
@@ -712,10 +713,14 @@ extern int print_stats;
 extern int64_t stats_period;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
+extern AVIOContext *sched_stats_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int filter_pipeline;
+extern int filter_share_prefix;
+extern AVWorkPool *thread_pool;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
@@ -129,6 +129,14 @@ typedef struct InputFilterPriv {
     int                 drop_warned;
     uint64_t            nb_dropped;
 
+    /* with -filter_share_prefix, simple filtergraph inputs are connected to
+     * their source only in fg_finalise_bindings(), after common filter
+     * prefixes have been split off into shared filtergraphs */
+    int                 connect_pending;
+    SchedulerNode       src;
+    InputStream        *ist;
+    ViewSpecifier       vs;
+
     // parameters configured for this input
     int                 format;
 
@@ -246,6 +254,11 @@ typedef struct OutputFilterPriv {
     FPSConvContext          fps;
 
     unsigned                flags;
+
+    // this output feeds another filtergraph rather than an encoder
+    int                     to_filter;
+    // duration of the last video frame sent, in tb_out
+    int64_t                 last_duration;
 } OutputFilterPriv;
 
 static OutputFilterPriv *ofp_from_ofilter(OutputFilter *ofilter)
@@ -704,10 +717,18 @@ static int ifilter_bind_ist(InputFilter *ifilter, InputStream *ist,
     if (ret < 0)
         return ret;
 
-    ret = sch_connect(fgp->sch,
-                      src, SCH_FILTER_IN(fgp->sch_idx, ifp->index));
-    if (ret < 0)
-        return ret;
+    if (fgp->is_simple && filter_share_prefix &&
+        ifp->type_src != AVMEDIA_TYPE_SUBTITLE) {
+        ifp->connect_pending = 1;
+        ifp->src             = src;
+        ifp->ist             = ist;
+        ifp->vs              = vs ? *vs : (ViewSpecifier){ .type = VIEW_SPECIFIER_TYPE_NONE };
+    } else {
+        ret = sch_connect(fgp->sch,
+                          src, SCH_FILTER_IN(fgp->sch_idx, ifp->index));
+        if (ret < 0)
+            return ret;
+    }
 
     if (ifp->type_src == AVMEDIA_TYPE_SUBTITLE) {
         ifp->sub2video.frame = av_frame_alloc();
@@ -920,6 +941,8 @@ static int ofilter_bind_ifilter(OutputFilter *ofilter, InputFilterPriv *ifp,
     ofilter->bound = 1;
     av_freep(&ofilter->linklabel);
 
+    ofp->to_filter = 1;
+
     ofp->name = av_strdup(opts->name);
     if (!ofp->name)
         return AVERROR(EINVAL);
@@ -1411,10 +1434,311 @@ static int bind_inputs(FilterGraph *fg)
     return 0;
 }
 
+typedef struct PrefixCandidate {
+    FilterGraph *fg;
+    // the individual filters of the graph description
+    char       **filters;
+    int       nb_filters;
+    int          grouped;
+} PrefixCandidate;
+
+/* Split a filtergraph description that is a single chain of unlabeled filters
+ * into the descriptions of the individual filters. Leaves *nb_filters at 0 for
+ * any other kind of description. */
+static int chain_split(const char *desc, char ***pfilters, int *nb_filters)
+{
+    const char *p = desc;
+
+    while (1) {
+        const char *start;
+        char *tok, *filter;
+        size_t len;
+        int ret;
+
+        p    += strspn(p, " \n\t\r");
+        start = p;
+
+        tok = av_get_token(&p, "[],;");
+        if (!tok)
+            return AVERROR(ENOMEM);
+        av_free(tok);
+
+        len = p - start;
+        while (len && strchr(" \n\t\r", start[len - 1]))
+            len--;
+
+        if (!len || (*p && *p != ','))
+            goto not_chain;
+
+        filter = av_strndup(start, len);
+        if (!filter)
+            return AVERROR(ENOMEM);
+
+        ret = av_dynarray_add_nofree(pfilters, nb_filters, filter);
+        if (ret < 0) {
+            av_free(filter);
+            return ret;
+        }
+
+        if (!*p)
+            return 0;
+        p++;
+    }
+
+not_chain:
+    for (int i = 0; i < *nb_filters; i++)
+        av_freep(&(*pfilters)[i]);
+    av_freep(pfilters);
+    *nb_filters = 0;
+    return 0;
+}
+
+static int prefix_is_trivial(char * const *filters, int nb_filters)
+{
+    for (int i = 0; i < nb_filters; i++)
+        if (strcmp(filters[i], "null") && strcmp(filters[i], "anull"))
+            return 0;
+    return 1;
+}
+
+static int ifilter_bind_shared(InputFilterPriv *ifp, FilterGraph *fg_src, int out_idx)
+{
+    FilterGraphPriv     *fgp = fgp_from_fg(ifp->ifilter.graph);
+    FilterGraphPriv *fgp_src = fgp_from_fg(fg_src);
+    OutputFilterPriv *ofp_src = ofp_from_ofilter(fg_src->outputs[out_idx]);
+    InputStream         *ist = ifp->ist;
+    OutputFilterOptions opts;
+    int ret;
+
+    // the stream is now read by the shared filtergraph instead
+    for (int i = 0; i < ist->nb_filters; i++) {
+        if (ist->filters[i] == &ifp->ifilter) {
+            memmove(&ist->filters[i], &ist->filters[i + 1],
+                    (ist->nb_filters - i - 1) * sizeof(*ist->filters));
+            ist->nb_filters--;
+            break;
+        }
+    }
+
+    ifp->connect_pending = 0;
+    ifp->ist             = NULL;
+
+    // the input options have been applied by the shared filtergraph; keep
+    // only the framerate hint and reinitializing on parameter changes
+    av_frame_free(&ifp->opts.fallback);
+    ifp->opts.trim_start_us = AV_NOPTS_VALUE;
+    ifp->opts.trim_end_us   = INT64_MAX;
+    ifp->opts.crop_top      = 0;
+    ifp->opts.crop_bottom   = 0;
+    ifp->opts.crop_left     = 0;
+    ifp->opts.crop_right    = 0;
+    ifp->opts.flags        &= IFILTER_FLAG_REINIT;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.name = fgp->log_name;
+
+    ret = ofilter_bind_ifilter(&ofp_src->ofilter, ifp, &opts);
+    if (ret < 0)
+        return ret;
+
+    // keep the timestamps exactly as they would be inside a single graph
+    ofp_src->enc_timebase = (AVRational){ ENC_TIME_BASE_FILTER, 0 };
+
+    return sch_connect(fgp->sch, SCH_FILTER_OUT(fgp_src->sch_idx, out_idx),
+                                 SCH_FILTER_IN(fgp->sch_idx, ifp->index));
+}
+
+static int fg_create_shared(PrefixCandidate **group, int nb_group, int nb_prefix)
+{
+    FilterGraph        *fg0 = group[0]->fg;
+    FilterGraphPriv   *fgp0 = fgp_from_fg(fg0);
+    InputFilterPriv   *ifp0 = ifp_from_ifilter(fg0->inputs[0]);
+    FilterGraph     *fg_src;
+    AVBPrint bp;
+    char *desc;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (int i = 0; i < nb_prefix; i++)
+        av_bprintf(&bp, "%s,", group[0]->filters[i]);
+    av_bprintf(&bp, "%s=%d", ifp0->type == AVMEDIA_TYPE_AUDIO ? "asplit" : "split",
+               nb_group);
+
+    ret = av_bprint_finalize(&bp, &desc);
+    if (ret < 0)
+        return ret;
+
+    ret = fg_create(NULL, desc, fgp0->sch);
+    if (ret < 0)
+        return ret;
+    fg_src = filtergraphs[nb_filtergraphs - 1];
+
+    if (fg_src->nb_inputs != 1 || fg_src->nb_outputs != nb_group) {
+        av_log(fg_src, AV_LOG_ERROR, "Unexpected layout of shared filtergraph '%s'\n",
+               fgp_from_fg(fg_src)->graph_desc);
+        return AVERROR_BUG;
+    }
+
+    fgp_from_fg(fg_src)->nb_threads = fgp0->nb_threads;
+
+    av_log(fg_src, AV_LOG_VERBOSE, "Sharing filtergraph '%s' between %d outputs\n",
+           fgp_from_fg(fg_src)->graph_desc, nb_group);
+
+    ret = ifilter_bind_ist(fg_src->inputs[0], ifp0->ist, &ifp0->vs);
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < nb_group; i++) {
+        FilterGraph     *fg = group[i]->fg;
+        FilterGraphPriv *fgp = fgp_from_fg(fg);
+        AVBPrint suffix;
+
+        av_bprint_init(&suffix, 0, AV_BPRINT_SIZE_UNLIMITED);
+        for (int j = nb_prefix; j < group[i]->nb_filters; j++)
+            av_bprintf(&suffix, "%s%s", j > nb_prefix ? "," : "",
+                       group[i]->filters[j]);
+        if (!suffix.len)
+            av_bprintf(&suffix, "%s",
+                       ifp0->type == AVMEDIA_TYPE_AUDIO ? "anull" : "null");
+
+        av_freep(&fgp->graph_desc);
+        ret = av_bprint_finalize(&suffix, &desc);
+        if (ret < 0)
+            return ret;
+        fgp->graph_desc = desc;
+
+        ret = ifilter_bind_shared(ifp_from_ifilter(fg->inputs[0]), fg_src, i);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int same_source(const InputFilterPriv *a, const InputFilterPriv *b)
+{
+    return a->ist == b->ist && a->type == b->type &&
+           a->src.type       == b->src.type &&
+           a->src.idx        == b->src.idx  &&
+           a->src.idx_stream == b->src.idx_stream;
+}
+
+/* Find simple filtergraphs that process the same input stream and start with
+ * the same filters, and move those filters into a single shared filtergraph
+ * whose outputs feed the rest of each of them. */
+static int fg_share_prefixes(void)
+{
+    PrefixCandidate  *cand = NULL;
+    PrefixCandidate **group = NULL;
+    int nb_cand = 0;
+    int ret = 0;
+
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        FilterGraph *fg = ost->fg_simple;
+        PrefixCandidate *c;
+
+        if (!fg || !ifp_from_ifilter(fg->inputs[0])->connect_pending ||
+            fgp_from_fg(fg)->have_sources)
+            continue;
+
+        c = av_dynarray2_add((void**)&cand, &nb_cand, sizeof(*cand), NULL);
+        if (!c) {
+            ret = AVERROR(ENOMEM);
+            goto finish;
+        }
+        memset(c, 0, sizeof(*c));
+        c->fg = fg;
+
+        ret = chain_split(fgp_from_fg(fg)->graph_desc, &c->filters, &c->nb_filters);
+        if (ret < 0)
+            goto finish;
+    }
+
+    group = av_calloc(nb_cand, sizeof(*group));
+    if (nb_cand && !group) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    for (int i = 0; i < nb_cand; i++) {
+        const InputFilterPriv *ifp = ifp_from_ifilter(cand[i].fg->inputs[0]);
+        int nb_group = 0, nb_prefix;
+
+        if (cand[i].grouped || !cand[i].nb_filters)
+            continue;
+
+        // graphs are grouped by their first filter
+        for (int j = i; j < nb_cand; j++) {
+            if (!cand[j].grouped && cand[j].nb_filters &&
+                same_source(ifp, ifp_from_ifilter(cand[j].fg->inputs[0])) &&
+                !strcmp(cand[i].filters[0], cand[j].filters[0]))
+                group[nb_group++] = &cand[j];
+        }
+        if (nb_group < 2)
+            continue;
+
+        nb_prefix = cand[i].nb_filters;
+        for (int j = 1; j < nb_group; j++) {
+            int k = 0;
+
+            while (k < nb_prefix && k < group[j]->nb_filters &&
+                   !strcmp(cand[i].filters[k], group[j]->filters[k]))
+                k++;
+            nb_prefix = k;
+        }
+
+        if (prefix_is_trivial(cand[i].filters, nb_prefix))
+            continue;
+
+        for (int j = 0; j < nb_group; j++)
+            group[j]->grouped = 1;
+
+        ret = fg_create_shared(group, nb_group, nb_prefix);
+        if (ret < 0)
+            goto finish;
+    }
+
+    // connect the remaining simple filtergraphs directly to their sources
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        FilterGraph *fg = ost->fg_simple;
+        InputFilterPriv *ifp;
+
+        if (!fg)
+            continue;
+
+        ifp = ifp_from_ifilter(fg->inputs[0]);
+        if (!ifp->connect_pending)
+            continue;
+
+        ret = sch_connect(fgp_from_fg(fg)->sch, ifp->src,
+                          SCH_FILTER_IN(fgp_from_fg(fg)->sch_idx, ifp->index));
+        if (ret < 0)
+            goto finish;
+        ifp->connect_pending = 0;
+    }
+
+finish:
+    for (int i = 0; i < nb_cand; i++) {
+        for (int j = 0; j < cand[i].nb_filters; j++)
+            av_freep(&cand[i].filters[j]);
+        av_freep(&cand[i].filters);
+    }
+    av_freep(&cand);
+    av_freep(&group);
+
+    return ret;
+}
+
 int fg_finalise_bindings(void)
 {
     int ret;
 
+    if (filter_share_prefix) {
+        ret = fg_share_prefixes();
+        if (ret < 0)
+            return ret;
+    }
+
     for (int i = 0; i < nb_filtergraphs; i++) {
         ret = bind_inputs(filtergraphs[i]);
         if (ret < 0)
@@ -1960,6 +2284,9 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
         fgt->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    if (filter_pipeline)
+        fgt->graph->thread_type |= AVFILTER_THREAD_PIPELINE;
+
     hw_device = hw_device_for_filter();
 
     ret = graph_parse(fg, fgt->graph, graph_desc, &inputs, &outputs, hw_device);
@@ -2488,6 +2815,25 @@ static int close_output(OutputFilterPriv *ofp, FilterGraphThread *fgt)
         }
     }
 
+    // a downstream filtergraph needs the EOF timestamp to close its input,
+    // the same as it gets from a decoder
+    if (ofp->to_filter && fgt->got_frame) {
+        AVFrame *frame = fgt->frame;
+
+        av_frame_unref(frame);
+
+        frame->opaque    = (void*)(intptr_t)FRAME_OPAQUE_EOF;
+        frame->pts       = ofp->next_pts;
+        frame->time_base = ofp->tb_out;
+        // next_pts only advances by one tick per video frame
+        if (ofp->ofilter.type == AVMEDIA_TYPE_VIDEO && ofp->last_duration > 0)
+            frame->pts += ofp->last_duration - 1;
+
+        ret = sch_filter_send(fgp->sch, fgp->sch_idx, ofp->index, frame);
+        if (ret < 0 && ret != AVERROR_EOF)
+            return ret;
+    }
+
     fgt->eof_out[ofp->index] = 1;
 
     ret = sch_filter_send(fgp->sch, fgp->sch_idx, ofp->index, NULL);
@@ -2522,6 +2868,8 @@ static int fg_output_frame(OutputFilterPriv *ofp, FilterGraphThread *fgt,
                 return ret;
 
             frame_out->pts = ofp->next_pts;
+            ofp->last_duration = av_rescale_q(frame_in->duration,
+                                              frame_in->time_base, ofp->tb_out);
 
             if (ofp->fps.dropped_keyframe) {
                 frame_out->flags |= AV_FRAME_FLAG_KEY;
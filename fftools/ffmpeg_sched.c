@@ -32,6 +32,7 @@
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
@@ -60,6 +61,23 @@ typedef struct SchWaiter {
     int                 choked_next;
 } SchWaiter;
 
+typedef struct SchTaskStats {
+    // all times are in microseconds, as returned by av_gettime_relative()
+    atomic_int_least64_t  start;
+    atomic_int_least64_t  end;
+    // time spent waiting for input
+    atomic_int_least64_t  idle;
+    // time spent passing output downstream, including waiting for space
+    atomic_int_least64_t  blocked;
+
+    atomic_uint_least64_t nb_in;
+    atomic_uint_least64_t nb_out;
+
+    // state at the previous sch_print_stats() call, used for computing rates
+    uint64_t              last_nb_out;
+    int64_t               last_time;
+} SchTaskStats;
+
 typedef struct SchTask {
     Scheduler          *parent;
     SchedulerNode       node;
@@ -69,6 +87,8 @@ typedef struct SchTask {
 
     pthread_t           thread;
     int                 thread_running;
+
+    SchTaskStats        stats;
 } SchTask;
 
 typedef struct SchDecOutput {
@@ -311,6 +331,9 @@ struct Scheduler {
     pthread_mutex_t     schedule_lock;
 
     atomic_int_least64_t last_dts;
+
+    // time at which sch_start() was called, in av_gettime_relative() units
+    int64_t             start_time;
 };
 
 /**
@@ -372,7 +395,7 @@ static void waiter_uninit(SchWaiter *w)
 }
 
 static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_size,
-                       enum QueueType type)
+                       enum QueueType type, unsigned flags)
 {
     ThreadQueue *tq;
 
@@ -393,7 +416,8 @@ static int queue_alloc(ThreadQueue **ptq, unsigned nb_streams, unsigned queue_si
     }
 
     tq = tq_alloc(nb_streams, queue_size,
-                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES);
+                  (type == QUEUE_PACKETS) ? THREAD_QUEUE_PACKETS : THREAD_QUEUE_FRAMES,
+                  flags);
     if (!tq)
         return AVERROR(ENOMEM);
 
@@ -432,6 +456,33 @@ static void task_init(Scheduler *sch, SchTask *task, enum SchedulerNodeType type
 
     task->func      = func;
     task->func_arg  = func_arg;
+
+    atomic_init(&task->stats.start,   0);
+    atomic_init(&task->stats.end,     0);
+    atomic_init(&task->stats.idle,    0);
+    atomic_init(&task->stats.blocked, 0);
+    atomic_init(&task->stats.nb_in,   0);
+    atomic_init(&task->stats.nb_out,  0);
+}
+
+static void task_stats_add(atomic_int_least64_t *time, int64_t start,
+                           atomic_uint_least64_t *nb_items, int add_item)
+{
+    atomic_fetch_add_explicit(time, av_gettime_relative() - start,
+                              memory_order_relaxed);
+    if (add_item)
+        atomic_fetch_add_explicit(nb_items, 1, memory_order_relaxed);
+}
+
+static ThreadQueue *task_queue(const Scheduler *sch, SchedulerNode node)
+{
+    switch (node.type) {
+    case SCH_NODE_TYPE_MUX:         return sch->mux[node.idx].queue;
+    case SCH_NODE_TYPE_DEC:         return sch->dec[node.idx].queue;
+    case SCH_NODE_TYPE_ENC:         return sch->enc[node.idx].queue;
+    case SCH_NODE_TYPE_FILTER_IN:   return sch->filters[node.idx].queue;
+    default:                        return NULL;
+    }
 }
 
 static int64_t trailing_dts(const Scheduler *sch, int count_finished)
@@ -761,7 +812,7 @@ int sch_add_dec(Scheduler *sch, SchThreadFunc func, void *ctx, int send_end_ts)
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS);
+    ret = queue_alloc(&dec->queue, 1, 0, QUEUE_PACKETS, 0);
     if (ret < 0)
         return ret;
 
@@ -805,7 +856,10 @@ int sch_add_enc(Scheduler *sch, SchThreadFunc func, void *ctx,
     if (!enc->send_pkt)
         return AVERROR(ENOMEM);
 
-    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES);
+    // encoder input is sent either from its single source thread or
+    // under the lock of its sync queue
+    ret = queue_alloc(&enc->queue, 1, 0, QUEUE_FRAMES,
+                      THREAD_QUEUE_SINGLE_PRODUCER);
     if (ret < 0)
         return ret;
 
@@ -853,7 +907,7 @@ int sch_add_filtergraph(Scheduler *sch, unsigned nb_inputs, unsigned nb_outputs,
     if (ret < 0)
         return ret;
 
-    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES);
+    ret = queue_alloc(&fg->queue, fg->nb_inputs + 1, 0, QUEUE_FRAMES, 0);
     if (ret < 0)
         return ret;
 
@@ -1537,7 +1591,7 @@ static int start_prepare(Scheduler *sch)
         }
 
         ret = queue_alloc(&mux->queue, mux->nb_streams, mux->queue_size,
-                          QUEUE_PACKETS);
+                          QUEUE_PACKETS, 0);
         if (ret < 0)
             return ret;
     }
@@ -1599,6 +1653,8 @@ int sch_start(Scheduler *sch)
     av_assert0(sch->state == SCH_STATE_UNINIT);
     sch->state = SCH_STATE_STARTED;
 
+    sch->start_time = av_gettime_relative();
+
     for (unsigned i = 0; i < sch->nb_mux; i++) {
         SchMux *mux = &sch->mux[i];
 
@@ -1654,6 +1710,97 @@ fail:
     return ret;
 }
 
+static void print_json_string(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
+static void print_task_stats(const Scheduler *sch, AVBPrint *bp, SchTask *task,
+                             const char *type, unsigned idx, int64_t now)
+{
+    SchTaskStats *st = &task->stats;
+    const AVClass *class = *(const AVClass**)task->func_arg;
+    ThreadQueue      *tq = task_queue(sch, task->node);
+    int64_t start   = atomic_load(&st->start);
+    int64_t end     = atomic_load(&st->end);
+    int64_t idle    = atomic_load_explicit(&st->idle,    memory_order_relaxed);
+    int64_t blocked = atomic_load_explicit(&st->blocked, memory_order_relaxed);
+    uint64_t nb_in  = atomic_load_explicit(&st->nb_in,   memory_order_relaxed);
+    uint64_t nb_out = atomic_load_explicit(&st->nb_out,  memory_order_relaxed);
+    int64_t busy = 0;
+    double  rate = 0.0;
+
+    if (start) {
+        int64_t last_time = st->last_time ? st->last_time : start;
+        int64_t cur_time  = end ? end : now;
+
+        busy = FFMAX(cur_time - start - idle - blocked, 0);
+
+        if (cur_time > last_time)
+            rate = (nb_out - st->last_nb_out) * 1e6 / (cur_time - last_time);
+
+        st->last_time   = cur_time;
+        st->last_nb_out = nb_out;
+    }
+
+    av_bprintf(bp, "{\"type\":\"%s\",\"index\":%u,\"name\":", type, idx);
+    print_json_string(bp, class->item_name(task->func_arg));
+    av_bprintf(bp, ",\"state\":\"%s\"", !start ? "pending"  :
+                                          end    ? "finished" : "running");
+    av_bprintf(bp, ",\"busy\":%.6f,\"idle\":%.6f,\"blocked\":%.6f",
+               busy / 1e6, idle / 1e6, blocked / 1e6);
+    av_bprintf(bp, ",\"in\":%"PRIu64",\"out\":%"PRIu64",\"out_rate\":%.3f",
+               nb_in, nb_out, rate);
+
+    if (tq) {
+        ThreadQueueStats qs;
+
+        tq_get_stats(tq, &qs);
+        av_bprintf(bp, ",\"queue\":{\"depth\":%zu,\"size\":%zu,"
+                   "\"recv_wait\":%.6f,\"send_wait\":%.6f}",
+                   qs.nb_queued, qs.queue_size,
+                   qs.recv_wait / 1e6, qs.send_wait / 1e6);
+    }
+
+    av_bprint_chars(bp, '}', 1);
+}
+
+void sch_print_stats(Scheduler *sch, AVBPrint *bp)
+{
+    int64_t now = av_gettime_relative();
+    int first = 1;
+
+#define PRINT_TASKS(type, arr, nb)                                      \
+    for (unsigned i = 0; i < sch->nb; i++) {                            \
+        if (!first)                                                     \
+            av_bprint_chars(bp, ',', 1);                                \
+        print_task_stats(sch, bp, &sch->arr[i].task, type, i, now);     \
+        first = 0;                                                      \
+    }
+
+    av_bprintf(bp, "{\"time\":%.6f,\"nodes\":[",
+               sch->start_time ? (now - sch->start_time) / 1e6 : 0.0);
+
+    PRINT_TASKS("demux",  demux,   nb_demux);
+    PRINT_TASKS("dec",    dec,     nb_dec);
+    PRINT_TASKS("filter", filters, nb_filters);
+    PRINT_TASKS("enc",    enc,     nb_enc);
+    PRINT_TASKS("mux",    mux,     nb_mux);
+
+#undef PRINT_TASKS
+
+    av_bprintf(bp, "]}\n");
+}
+
 int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts)
 {
     int ret;
@@ -2026,15 +2173,11 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
     return 0;
 }
 
-int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
-                   unsigned flags)
+static int demux_send(Scheduler *sch, SchDemux *d, AVPacket *pkt,
+                      unsigned flags)
 {
-    SchDemux *d;
     int terminate;
 
-    av_assert0(demux_idx < sch->nb_demux);
-    d = &sch->demux[demux_idx];
-
     terminate = waiter_wait(sch, &d->waiter);
     if (terminate)
         return AVERROR_EXIT;
@@ -2048,6 +2191,25 @@ int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
     return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
 }
 
+int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
+                   unsigned flags)
+{
+    SchDemux *d;
+    int64_t start = av_gettime_relative();
+    int is_flush = pkt->stream_index == -1;
+    int ret;
+
+    av_assert0(demux_idx < sch->nb_demux);
+    d = &sch->demux[demux_idx];
+
+    ret = demux_send(sch, d, pkt, flags);
+
+    task_stats_add(&d->task.stats.blocked, start,
+                   &d->task.stats.nb_out, ret >= 0 && !is_flush);
+
+    return ret;
+}
+
 static int demux_done(Scheduler *sch, unsigned demux_idx)
 {
     SchDemux *d = &sch->demux[demux_idx];
@@ -2073,6 +2235,7 @@ static int demux_done(Scheduler *sch, unsigned demux_idx)
 int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
 {
     SchMux *mux;
+    int64_t start = av_gettime_relative();
     int ret, stream_idx;
 
     av_assert0(mux_idx < sch->nb_mux);
@@ -2080,6 +2243,10 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
 
     ret = tq_receive(mux->queue, &stream_idx, pkt);
     pkt->stream_index = stream_idx;
+
+    task_stats_add(&mux->task.stats.idle, start,
+                   &mux->task.stats.nb_in, ret >= 0);
+
     return ret;
 }
 
@@ -2157,6 +2324,7 @@ static int mux_done(Scheduler *sch, unsigned mux_idx)
 int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
 {
     SchDec *dec;
+    int64_t start = av_gettime_relative();
     int ret, dummy;
 
     av_assert0(dec_idx < sch->nb_dec);
@@ -2180,6 +2348,9 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
     if (ret >= 0 && !pkt->data && !pkt->side_data_elems && dec->queue_end_ts)
         dec->expect_end_ts = 1;
 
+    task_stats_add(&dec->task.stats.idle, start,
+                   &dec->task.stats.nb_in, ret >= 0);
+
     return ret;
 }
 
@@ -2230,17 +2401,13 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx,
-                 unsigned out_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, SchDec *dec,
+                    unsigned out_idx, AVFrame *frame)
 {
-    SchDec *dec;
     SchDecOutput *o;
     int ret;
     unsigned nb_done = 0;
 
-    av_assert0(dec_idx < sch->nb_dec);
-    dec = &sch->dec[dec_idx];
-
     av_assert0(out_idx < dec->nb_outputs);
     o = &dec->outputs[out_idx];
 
@@ -2274,6 +2441,24 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     return (nb_done == o->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx,
+                 unsigned out_idx, AVFrame *frame)
+{
+    SchDec *dec;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    dec = &sch->dec[dec_idx];
+
+    ret = dec_send(sch, dec, out_idx, frame);
+
+    task_stats_add(&dec->task.stats.blocked, start,
+                   &dec->task.stats.nb_out, ret >= 0);
+
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
@@ -2302,6 +2487,7 @@ static int dec_done(Scheduler *sch, unsigned dec_idx)
 int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
 {
     SchEnc *enc;
+    int64_t start = av_gettime_relative();
     int ret, dummy;
 
     av_assert0(enc_idx < sch->nb_enc);
@@ -2310,6 +2496,9 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
     ret = tq_receive(enc->queue, &dummy, frame);
     av_assert0(dummy <= 0);
 
+    task_stats_add(&enc->task.stats.idle, start,
+                   &enc->task.stats.nb_in, ret >= 0);
+
     return ret;
 }
 
@@ -2343,14 +2532,10 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, SchEnc *enc, AVPacket *pkt)
 {
-    SchEnc *enc;
     int ret;
 
-    av_assert0(enc_idx < sch->nb_enc);
-    enc = &sch->enc[enc_idx];
-
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         uint8_t *finished = &enc->dst_finished[i];
         AVPacket *to_send = pkt;
@@ -2376,6 +2561,23 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    SchEnc *enc;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+
+    ret = enc_send(sch, enc, pkt);
+
+    task_stats_add(&enc->task.stats.blocked, start,
+                   &enc->task.stats.nb_out, ret >= 0);
+
+    return ret;
+}
+
 static int enc_done(Scheduler *sch, unsigned enc_idx)
 {
     SchEnc *enc = &sch->enc[enc_idx];
@@ -2392,14 +2594,9 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int filter_receive(Scheduler *sch, SchFilterGraph *fg,
+                          unsigned *in_idx, AVFrame *frame)
 {
-    SchFilterGraph *fg;
-
-    av_assert0(fg_idx < sch->nb_filters);
-    fg = &sch->filters[fg_idx];
-
     av_assert0(*in_idx <= fg->nb_inputs);
 
     // update scheduling to account for desired input stream, if it changed
@@ -2436,6 +2633,24 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    SchFilterGraph *fg;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    fg = &sch->filters[fg_idx];
+
+    ret = filter_receive(sch, fg, in_idx, frame);
+
+    task_stats_add(&fg->task.stats.idle, start,
+                   &fg->task.stats.nb_in, ret >= 0);
+
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2461,6 +2676,8 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
 {
     SchFilterGraph *fg;
     SchedulerNode  dst;
+    int64_t start = av_gettime_relative();
+    int ret;
 
     av_assert0(fg_idx < sch->nb_filters);
     fg = &sch->filters[fg_idx];
@@ -2468,9 +2685,14 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
     av_assert0(out_idx < fg->nb_outputs);
     dst = fg->outputs[out_idx].dst;
 
-    return (dst.type == SCH_NODE_TYPE_ENC)                                    ?
-           send_to_enc   (sch, &sch->enc[dst.idx],                     frame) :
-           send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
+    ret = (dst.type == SCH_NODE_TYPE_ENC)                                    ?
+          send_to_enc   (sch, &sch->enc[dst.idx],                     frame) :
+          send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
+
+    task_stats_add(&fg->task.stats.blocked, start,
+                   &fg->task.stats.nb_out, ret >= 0 && frame);
+
+    return ret;
 }
 
 static int filter_done(Scheduler *sch, unsigned fg_idx)
@@ -2524,6 +2746,22 @@ static int task_cleanup(Scheduler *sch, SchedulerNode node)
     }
 }
 
+static void task_log_stats(const Scheduler *sch, const SchTask *task)
+{
+    ThreadQueue *tq = task_queue(sch, task->node);
+    ThreadQueueStats stats;
+
+    if (!tq)
+        return;
+
+    tq_get_stats(tq, &stats);
+    av_log(task->func_arg, AV_LOG_VERBOSE,
+           "Input queue: waited %.3fs for input (%"PRIu64" times), "
+           "senders waited %.3fs for space (%"PRIu64" times)\n",
+           stats.recv_wait / 1e6, stats.nb_recv_waits,
+           stats.send_wait / 1e6, stats.nb_send_waits);
+}
+
 static void *task_wrapper(void *arg)
 {
     SchTask  *task = arg;
@@ -2531,6 +2769,8 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    atomic_store(&task->stats.start, av_gettime_relative());
+
     ret = task->func(task->func_arg);
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
@@ -2539,6 +2779,10 @@ static void *task_wrapper(void *arg)
     err = task_cleanup(sch, task->node);
     ret = err_merge(ret, err);
 
+    task_log_stats(sch, task);
+
+    atomic_store(&task->stats.end, av_gettime_relative());
+
     // EOF is considered normal termination
     if (ret == AVERROR_EOF)
         ret = 0;
@@ -27,6 +27,8 @@
 
 #include "ffmpeg_utils.h"
 
+#include "libavutil/bprint.h"
+
 /*
  * This file contains the API for the transcode scheduler.
  *
@@ -149,6 +151,19 @@ int sch_stop(Scheduler *sch, int64_t *finish_ts);
  */
 int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts);
 
+/**
+ * Print a snapshot of per-node profiling information to bp, as a single line
+ * of JSON terminated by a newline.
+ *
+ * For every demuxer, decoder, filtergraph, encoder and muxer this contains the
+ * time the node has spent busy, waiting for input (idle) and passing its output
+ * downstream (blocked), the number of items it has received and sent, its
+ * output rate since the previous call, and the state of its input queue.
+ *
+ * Must not be called from multiple threads concurrently.
+ */
+void sch_print_stats(Scheduler *sch, AVBPrint *bp);
+
 /**
  * Add a demuxer to the scheduler.
  *
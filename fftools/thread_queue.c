@@ -16,17 +16,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "libavutil/avassert.h"
-#include "libavutil/container_fifo.h"
+#include "libavutil/common.h"
 #include "libavutil/error.h"
-#include "libavutil/fifo.h"
 #include "libavutil/frame.h"
-#include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "libavcodec/packet.h"
 
@@ -37,17 +37,52 @@ enum {
     FINISHED_RECV = (1 << 1),
 };
 
+typedef struct QueueSlot {
+    /* pos + 1 once the item for position pos has been written to this slot,
+     * the next position that may be written here otherwise */
+    atomic_uint     seq;
+    unsigned int    stream_idx;
+    /* preallocated AVFrame or AVPacket, items are moved in and out of it */
+    void           *obj;
+} QueueSlot;
+
 struct ThreadQueue {
-    int              *finished;
+    atomic_int       *finished;
     unsigned int    nb_streams;
 
     enum ThreadQueueType type;
-
-    AVContainerFifo *fifo;
-    AVFifo          *fifo_stream_index;
-
+    unsigned int         flags;
+
+    QueueSlot       *slots;
+    /* number of slots minus one, the number of slots is a power of two */
+    unsigned int     mask;
+    /* maximum number of items stored in the queue */
+    unsigned int     queue_size;
+
+    /* position of the next item to be written, claimed by the producers */
+    atomic_uint      tail;
+    /* position of the next item to be read, only written by the consumer */
+    atomic_uint      head;
+
+    /* set while the consumer is waiting (or about to wait) for items */
+    atomic_int       recv_waiting;
+    /* number of producers waiting (or about to wait) for free space */
+    atomic_int       send_waiting;
+
+    /* number of items read since the producers were last woken up;
+     * only accessed by the consumer */
+    unsigned int     nb_read;
+    /* waiting producers are woken up once this many slots have been freed,
+     * or when the consumer is about to block itself */
+    unsigned int     wake_batch;
+
+    ThreadQueueStats stats;
+
+    /* protects the stats and all changes to the finished flags; the ring
+     * itself is accessed without it */
     pthread_mutex_t lock;
-    pthread_cond_t  cond;
+    pthread_cond_t  cond_send;
+    pthread_cond_t  cond_recv;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -57,36 +92,56 @@ void tq_free(ThreadQueue **ptq)
     if (!tq)
         return;
 
-    av_container_fifo_free(&tq->fifo);
-    av_fifo_freep2(&tq->fifo_stream_index);
+    if (tq->slots) {
+        for (unsigned int i = 0; i <= tq->mask; i++) {
+            if (tq->type == THREAD_QUEUE_FRAMES)
+                av_frame_free((AVFrame**)&tq->slots[i].obj);
+            else
+                av_packet_free((AVPacket**)&tq->slots[i].obj);
+        }
+    }
+    av_freep(&tq->slots);
 
     av_freep(&tq->finished);
 
-    pthread_cond_destroy(&tq->cond);
+    pthread_cond_destroy(&tq->cond_recv);
+    pthread_cond_destroy(&tq->cond_send);
     pthread_mutex_destroy(&tq->lock);
 
     av_freep(ptq);
 }
 
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type)
+                      enum ThreadQueueType type, unsigned int flags)
 {
     ThreadQueue *tq;
+    unsigned int nb_slots;
     int ret;
 
+    if (!queue_size || queue_size > INT_MAX / 2)
+        return NULL;
+
     tq = av_mallocz(sizeof(*tq));
     if (!tq)
         return NULL;
 
-    ret = pthread_cond_init(&tq->cond, NULL);
+    ret = pthread_cond_init(&tq->cond_send, NULL);
     if (ret) {
         av_freep(&tq);
         return NULL;
     }
 
+    ret = pthread_cond_init(&tq->cond_recv, NULL);
+    if (ret) {
+        pthread_cond_destroy(&tq->cond_send);
+        av_freep(&tq);
+        return NULL;
+    }
+
     ret = pthread_mutex_init(&tq->lock, NULL);
     if (ret) {
-        pthread_cond_destroy(&tq->cond);
+        pthread_cond_destroy(&tq->cond_recv);
+        pthread_cond_destroy(&tq->cond_send);
         av_freep(&tq);
         return NULL;
     }
@@ -94,18 +149,36 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
     tq->finished = av_calloc(nb_streams, sizeof(*tq->finished));
     if (!tq->finished)
         goto fail;
+    for (unsigned int i = 0; i < nb_streams; i++)
+        atomic_init(&tq->finished[i], 0);
     tq->nb_streams = nb_streams;
 
-    tq->type = type;
+    tq->type  = type;
+    tq->flags = flags;
 
-    tq->fifo = (type == THREAD_QUEUE_FRAMES) ?
-               av_container_fifo_alloc_avframe(0) : av_container_fifo_alloc_avpacket(0);
-    if (!tq->fifo)
-        goto fail;
+    nb_slots = 1U << av_ceil_log2(queue_size);
 
-    tq->fifo_stream_index = av_fifo_alloc2(queue_size, sizeof(unsigned), 0);
-    if (!tq->fifo_stream_index)
+    tq->slots = av_calloc(nb_slots, sizeof(*tq->slots));
+    if (!tq->slots)
         goto fail;
+    tq->mask       = nb_slots - 1;
+    tq->queue_size = queue_size;
+    tq->wake_batch = FFMAX(queue_size / 4, 1);
+
+    for (unsigned int i = 0; i < nb_slots; i++) {
+        QueueSlot *slot = &tq->slots[i];
+
+        atomic_init(&slot->seq, i);
+        slot->obj = (type == THREAD_QUEUE_FRAMES) ?
+                    (void*)av_frame_alloc() : (void*)av_packet_alloc();
+        if (!slot->obj)
+            goto fail;
+    }
+
+    atomic_init(&tq->tail,         0);
+    atomic_init(&tq->head,         0);
+    atomic_init(&tq->recv_waiting, 0);
+    atomic_init(&tq->send_waiting, 0);
 
     return tq;
 fail:
@@ -113,59 +186,172 @@ fail:
     return NULL;
 }
 
-int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+static void obj_move_ref(const ThreadQueue *tq, void *dst, void *src)
 {
-    int *finished;
-    int ret;
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_move_ref(dst, src);
+    else
+        av_packet_move_ref(dst, src);
+}
 
-    av_assert0(stream_idx < tq->nb_streams);
-    finished = &tq->finished[stream_idx];
+static void obj_unref(const ThreadQueue *tq, void *obj)
+{
+    if (tq->type == THREAD_QUEUE_FRAMES)
+        av_frame_unref(obj);
+    else
+        av_packet_unref(obj);
+}
 
-    pthread_mutex_lock(&tq->lock);
+/* Try to write an item to the ring, may be called from any producer thread. */
+static int ring_write(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    QueueSlot *slot;
+    unsigned int pos = atomic_load_explicit(&tq->tail, memory_order_relaxed);
+
+    while (1) {
+        unsigned int seq;
+        int diff;
+
+        slot = &tq->slots[pos & tq->mask];
+        seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        diff = (int)(seq - pos);
+
+        if (diff < 0)
+            return AVERROR(EAGAIN);
 
-    if (*finished & FINISHED_SEND) {
-        ret = AVERROR(EINVAL);
-        goto finish;
+        if (diff > 0) {
+            // another producer claimed this position, retry with the new tail
+            pos = atomic_load_explicit(&tq->tail, memory_order_relaxed);
+            continue;
+        }
+
+        // the ring may have more slots than items allowed in the queue
+        if (pos - (unsigned int)atomic_load(&tq->head) >= tq->queue_size)
+            return AVERROR(EAGAIN);
+
+        if (tq->flags & THREAD_QUEUE_SINGLE_PRODUCER) {
+            atomic_store_explicit(&tq->tail, pos + 1, memory_order_relaxed);
+            break;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&tq->tail, &pos, pos + 1,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+            break;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo_stream_index))
-        pthread_cond_wait(&tq->cond, &tq->lock);
+    slot->stream_idx = stream_idx;
+    obj_move_ref(tq, slot->obj, data);
+
+    // publish the item; sequentially consistent so that the following check
+    // of recv_waiting cannot be reordered before it
+    atomic_store(&slot->seq, pos + 1);
+
+    return 0;
+}
+
+/* Try to read an item from the ring, must only be called by the consumer. */
+static int ring_read(ThreadQueue *tq, unsigned int *stream_idx, void *data)
+{
+    unsigned int pos = atomic_load_explicit(&tq->head, memory_order_relaxed);
+    QueueSlot  *slot = &tq->slots[pos & tq->mask];
+
+    if ((unsigned int)atomic_load(&slot->seq) != pos + 1)
+        return AVERROR(EAGAIN);
+
+    *stream_idx = slot->stream_idx;
+    obj_move_ref(tq, data, slot->obj);
+
+    atomic_store_explicit(&slot->seq, pos + tq->mask + 1, memory_order_release);
+    atomic_store(&tq->head, pos + 1);
+
+    tq->nb_read++;
+
+    return 0;
+}
+
+static void wake_senders(ThreadQueue *tq)
+{
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond_send);
+    pthread_mutex_unlock(&tq->lock);
+
+    tq->nb_read = 0;
+}
+
+static int send_wait(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    atomic_int *finished = &tq->finished[stream_idx];
+    int64_t wait_start = 0;
+    int ret;
+
+    pthread_mutex_lock(&tq->lock);
+
+    atomic_fetch_add(&tq->send_waiting, 1);
 
-    if (*finished & FINISHED_RECV) {
-        ret = AVERROR_EOF;
-        *finished |= FINISHED_SEND;
-    } else {
-        ret = av_fifo_write(tq->fifo_stream_index, &stream_idx, 1);
-        if (ret < 0)
-            goto finish;
+    while (1) {
+        if (atomic_load(finished) & FINISHED_RECV) {
+            atomic_fetch_or(finished, FINISHED_SEND);
+            ret = AVERROR_EOF;
+            break;
+        }
 
-        ret = av_container_fifo_write(tq->fifo, data, 0);
-        if (ret < 0)
-            goto finish;
+        ret = ring_write(tq, stream_idx, data);
+        if (ret != AVERROR(EAGAIN))
+            break;
 
-        pthread_cond_broadcast(&tq->cond);
+        if (!wait_start) {
+            wait_start = av_gettime_relative();
+            tq->stats.nb_send_waits++;
+        }
+        pthread_cond_wait(&tq->cond_send, &tq->lock);
     }
 
-finish:
+    atomic_fetch_sub(&tq->send_waiting, 1);
+
+    if (wait_start)
+        tq->stats.send_wait += av_gettime_relative() - wait_start;
+
     pthread_mutex_unlock(&tq->lock);
 
     return ret;
 }
 
-static int receive_locked(ThreadQueue *tq, int *stream_idx,
-                          void *data)
+int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
-    unsigned int nb_finished = 0;
+    int finished;
+    int ret;
 
-    while (av_container_fifo_read(tq->fifo, data, 0) >= 0) {
-        unsigned idx;
-        int ret;
+    av_assert0(stream_idx < tq->nb_streams);
+    finished = atomic_load(&tq->finished[stream_idx]);
+
+    if (finished & FINISHED_SEND)
+        return AVERROR(EINVAL);
+
+    ret = (finished & FINISHED_RECV) ? AVERROR(EAGAIN) :
+          ring_write(tq, stream_idx, data);
+    if (ret == AVERROR(EAGAIN))
+        ret = send_wait(tq, stream_idx, data);
+    if (ret < 0)
+        return ret;
+
+    if (atomic_load(&tq->recv_waiting)) {
+        pthread_mutex_lock(&tq->lock);
+        pthread_cond_signal(&tq->cond_recv);
+        pthread_mutex_unlock(&tq->lock);
+    }
+
+    return 0;
+}
 
-        ret = av_fifo_read(tq->fifo_stream_index, &idx, 1);
-        av_assert0(ret >= 0);
-        if (tq->finished[idx] & FINISHED_RECV) {
-            (tq->type == THREAD_QUEUE_FRAMES) ?
-            av_frame_unref(data) : av_packet_unref(data);
+static int receive_item(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    unsigned int idx;
+    int ret;
+
+    while ((ret = ring_read(tq, &idx, data)) >= 0) {
+        if (atomic_load(&tq->finished[idx]) & FINISHED_RECV) {
+            obj_unref(tq, data);
             continue;
         }
 
@@ -173,14 +359,25 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         return 0;
     }
 
+    return ret;
+}
+
+/* Must be called with the lock held and only once all items written before
+ * the finished flags were set have been read. */
+static int receive_eof_locked(ThreadQueue *tq, int *stream_idx)
+{
+    unsigned int nb_finished = 0;
+
     for (unsigned int i = 0; i < tq->nb_streams; i++) {
-        if (!tq->finished[i])
+        int finished = atomic_load(&tq->finished[i]);
+
+        if (!finished)
             continue;
 
         /* return EOF to the consumer at most once for each stream */
-        if (!(tq->finished[i] & FINISHED_RECV)) {
-            tq->finished[i] |= FINISHED_RECV;
-            *stream_idx   = i;
+        if (!(finished & FINISHED_RECV)) {
+            atomic_fetch_or(&tq->finished[i], FINISHED_RECV);
+            *stream_idx = i;
             return AVERROR_EOF;
         }
 
@@ -190,36 +387,71 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
     return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
 }
 
-int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+static int receive_wait(ThreadQueue *tq, int *stream_idx, void *data)
 {
+    int64_t wait_start = 0;
     int ret;
 
-    *stream_idx = -1;
-
     pthread_mutex_lock(&tq->lock);
 
-    while (1) {
-        size_t can_read = av_container_fifo_can_read(tq->fifo);
-
-        ret = receive_locked(tq, stream_idx, data);
+    // producers check this after publishing an item, so the ring must be
+    // checked again after setting it and before sleeping
+    atomic_store(&tq->recv_waiting, 1);
 
-        // signal other threads if the fifo state changed
-        if (can_read != av_container_fifo_can_read(tq->fifo))
-            pthread_cond_broadcast(&tq->cond);
+    while (1) {
+        ret = receive_item(tq, stream_idx, data);
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        // finished flags only change under the lock, so once every claimed
+        // slot has been read no item sent before them can still arrive
+        if ((unsigned int)atomic_load(&tq->tail) ==
+            (unsigned int)atomic_load_explicit(&tq->head, memory_order_relaxed)) {
+            ret = receive_eof_locked(tq, stream_idx);
+            if (ret != AVERROR(EAGAIN))
+                break;
+        }
 
-        if (ret == AVERROR(EAGAIN)) {
-            pthread_cond_wait(&tq->cond, &tq->lock);
-            continue;
+        // do not leave producers waiting for a full batch while we sleep
+        if (atomic_load(&tq->send_waiting)) {
+            pthread_cond_broadcast(&tq->cond_send);
+            tq->nb_read = 0;
         }
 
-        break;
+        if (!wait_start) {
+            wait_start = av_gettime_relative();
+            tq->stats.nb_recv_waits++;
+        }
+        pthread_cond_wait(&tq->cond_recv, &tq->lock);
     }
 
+    atomic_store(&tq->recv_waiting, 0);
+
+    if (wait_start)
+        tq->stats.recv_wait += av_gettime_relative() - wait_start;
+
     pthread_mutex_unlock(&tq->lock);
 
     return ret;
 }
 
+int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    int ret;
+
+    *stream_idx = -1;
+
+    ret = receive_item(tq, stream_idx, data);
+    if (ret == AVERROR(EAGAIN))
+        ret = receive_wait(tq, stream_idx, data);
+
+    // wake up the producers once enough space has been freed
+    if (tq->nb_read >= tq->wake_batch && atomic_load(&tq->send_waiting))
+        wake_senders(tq);
+
+    return ret;
+}
+
 void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
@@ -229,8 +461,8 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
     /* mark the stream as send-finished;
      * next time the consumer thread tries to read this stream it will get
      * an EOF and recv-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_SEND;
-    pthread_cond_broadcast(&tq->cond);
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_SEND);
+    pthread_cond_broadcast(&tq->cond_recv);
 
     pthread_mutex_unlock(&tq->lock);
 }
@@ -244,8 +476,25 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
     /* mark the stream as recv-finished;
      * next time the producer thread tries to send for this stream, it will
      * get an EOF and send-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_RECV;
-    pthread_cond_broadcast(&tq->cond);
+    atomic_fetch_or(&tq->finished[stream_idx], FINISHED_RECV);
+    pthread_cond_broadcast(&tq->cond_send);
+    pthread_cond_broadcast(&tq->cond_recv);
 
     pthread_mutex_unlock(&tq->lock);
 }
+
+void tq_get_stats(ThreadQueue *tq, ThreadQueueStats *stats)
+{
+    unsigned int head, tail;
+
+    pthread_mutex_lock(&tq->lock);
+    *stats = tq->stats;
+    pthread_mutex_unlock(&tq->lock);
+
+    // load head first, so that the difference can never be negative
+    head = atomic_load(&tq->head);
+    tail = atomic_load(&tq->tail);
+
+    stats->nb_queued  = FFMIN(tail - head, tq->queue_size);
+    stats->queue_size = tq->queue_size;
+}
@@ -19,6 +19,7 @@
 #ifndef FFTOOLS_THREAD_QUEUE_H
 #define FFTOOLS_THREAD_QUEUE_H
 
+#include <stdint.h>
 #include <string.h>
 
 enum ThreadQueueType {
@@ -26,29 +27,77 @@ enum ThreadQueueType {
     THREAD_QUEUE_PACKETS,
 };
 
+enum ThreadQueueFlags {
+    /**
+     * tq_send() and tq_send_finish() are never called concurrently, e.g.
+     * because all items are sent from a single thread. Allows the queue to
+     * skip synchronization between producers.
+     */
+    THREAD_QUEUE_SINGLE_PRODUCER = (1 << 0),
+};
+
+/**
+ * Queue occupancy and time spent blocked in a queue. All times are in
+ * microseconds.
+ */
+typedef struct ThreadQueueStats {
+    /**
+     * Number of items currently in the queue.
+     */
+    size_t   nb_queued;
+    /**
+     * Maximum number of items in the queue, as passed to tq_alloc().
+     */
+    size_t   queue_size;
+
+    /**
+     * Total time producers spent waiting for free space in tq_send().
+     */
+    int64_t  send_wait;
+    /**
+     * Number of tq_send() calls that had to wait.
+     */
+    uint64_t nb_send_waits;
+    /**
+     * Total time the consumer spent waiting for items in tq_receive().
+     */
+    int64_t  recv_wait;
+    /**
+     * Number of tq_receive() calls that had to wait.
+     */
+    uint64_t nb_recv_waits;
+} ThreadQueueStats;
+
 typedef struct ThreadQueue ThreadQueue;
 
 /**
  * Allocate a queue for sending data between threads.
  *
+ * The queue is a lock-free ring of preallocated items, data is moved in and
+ * out of it by reference. Sending and receiving only take a lock when they
+ * need to block. Blocked producers are woken up in batches as the consumer
+ * frees space, so that they are not rescheduled for every single item.
+ *
+ * tq_receive() and tq_receive_finish() must only ever be called from a single
+ * consumer thread at a time.
+ *
  * @param nb_streams number of streams for which a distinct EOF state is
  *                   maintained
  * @param queue_size number of items that can be stored in the queue without
  *                   blocking
+ * @param flags      a combination of ThreadQueueFlags
  */
 ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
-                      enum ThreadQueueType type);
+                      enum ThreadQueueType type, unsigned int flags);
 void         tq_free(ThreadQueue **tq);
 
 /**
  * Send an item for the given stream to the queue.
  *
- * @param data the item to send, its contents will be moved using the callback
- *             provided to tq_alloc(); on failure the item will be left
- *             untouched
+ * @param data the item to send, its contents will be moved into the queue;
+ *             on failure the item will be left untouched
  * @return
  * - 0 the item was successfully sent
- * - AVERROR(ENOMEM) could not allocate an item for writing to the FIFO
  * - AVERROR(EINVAL) the sending side has previously been marked as finished
  * - AVERROR_EOF the receiving side has marked the given stream as finished
  */
@@ -63,8 +112,7 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx);
  *
  * @param stream_idx the index of the stream that was processed or -1 will be
  *                   written here
- * @param data the data item will be written here on success using the
- *             callback provided to tq_alloc()
+ * @param data the data item will be moved here on success
  * @return
  * - 0 a data item was successfully read; *stream_idx contains a non-negative
  *   stream index
@@ -78,4 +126,10 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Get the current queue occupancy and the time spent blocked in the queue so
+ * far. May be called from any thread.
+ */
+void tq_get_stats(ThreadQueue *tq, ThreadQueueStats *stats);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
@@ -115,49 +115,59 @@ static av_always_inline float quantize_and_encode_band_cost_template(
     } else {
         off = aac_cb_maxval[cb];
     }
+
+    /* Look up the codewords and the dequantized magnitudes of the whole band
+     * first, so that its distortion can be computed in one go. */
     for (int i = 0; i < size; i += dim) {
         const float *vec;
         int *quants = s->qcoefs + i;
         int curidx = 0;
         int curbits;
-        float quantized, rd = 0.0f;
         for (int j = 0; j < dim; j++) {
             curidx *= aac_cb_range[cb];
             curidx += quants[j] + off;
         }
         curbits =  ff_aac_spectral_bits[cb-1][curidx];
         vec     = &ff_aac_codebook_vectors[cb-1][curidx*dim];
-        if (BT_UNSIGNED) {
-            for (int j = 0; j < dim; j++) {
+        for (int j = 0; j < dim; j++) {
+            float qval = fabsf(vec[j]);
+            if (BT_ESC && vec[j] == 64.0f) { //FIXME: slow
                 float t = fabsf(in[i+j]);
-                float di;
-                if (BT_ESC && vec[j] == 64.0f) { //FIXME: slow
-                    if (t >= CLIPPED_ESCAPE) {
-                        quantized = CLIPPED_ESCAPE;
-                        curbits += 21;
-                    } else {
-                        int c = av_clip_uintp2(quant(t, Q, ROUNDING), 13);
-                        quantized = c*cbrtf(c)*IQ;
-                        curbits += av_log2(c)*2 - 4 + 1;
-                    }
+                if (t >= CLIPPED_ESCAPE) {
+                    qval = 165140.0f;
+                    curbits += 21;
                 } else {
-                    quantized = vec[j]*IQ;
+                    int c = av_clip_uintp2(quant(t, Q, ROUNDING), 13);
+                    qval = c*cbrtf(c);
+                    curbits += av_log2(c)*2 - 4 + 1;
                 }
-                di = t - quantized;
-                if (out)
-                    out[i+j] = in[i+j] >= 0 ? quantized : -quantized;
-                if (vec[j] != 0.0f)
-                    curbits++;
-                qenergy += quantized*quantized;
-                rd += di*di;
             }
-        } else {
+            if (BT_UNSIGNED && vec[j] != 0.0f)
+                curbits++;
+            s->qvals[i+j] = qval;
+        }
+        s->qidx [i/dim] = curidx;
+        s->qbits[i/dim] = curbits;
+    }
+
+    s->aacdsp.quant_dist(s->qdist, s->qenergy, in, s->qvals, size, IQ);
+
+    for (int i = 0; i < size; i += dim) {
+        int curidx  = s->qidx [i/dim];
+        int curbits = s->qbits[i/dim];
+        float rd = 0.0f;
+        for (int j = 0; j < dim; j++) {
+            qenergy += s->qenergy[i+j];
+            rd      += s->qdist[i+j];
+        }
+        if (out) {
             for (int j = 0; j < dim; j++) {
-                quantized = vec[j]*IQ;
-                qenergy += quantized*quantized;
-                if (out)
-                    out[i+j] = quantized;
-                rd += (in[i+j] - quantized)*(in[i+j] - quantized);
+                if (BT_UNSIGNED) {
+                    float quantized = s->qvals[i+j]*IQ;
+                    out[i+j] = in[i+j] >= 0 ? quantized : -quantized;
+                } else {
+                    out[i+j] = ff_aac_codebook_vectors[cb-1][curidx*dim+j]*IQ;
+                }
             }
         }
         cost    += rd * lambda + curbits;
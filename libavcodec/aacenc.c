@@ -821,42 +821,75 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
-static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
-                            const AVFrame *frame, int *got_packet_ptr)
-{
-    AACEncContext *s = avctx->priv_data;
-    float **samples = s->planar_samples, *samples2, *la, *overlap;
-    ChannelElement *cpe;
+/* maximum of the aac_frame_parallel option */
+#define AAC_MAX_FRAME_PARALLEL 8
+
+typedef struct AACQuantizerSearch {
     SingleChannelElement *sce;
-    IndividualChannelStream *ics;
-    int i, its, ch, w, chans, tag, start_ch, ret, frame_bits;
-    int target_bits, rate_bits, too_many_bits, too_few_bits;
-    int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
-    int chan_el_counter[4];
+    FFPsyChannel *psy_ch;               ///< psy analysis of the frame, if not the current one
+    int channel;
+    enum RawDataBlockType type;
+    int bitres_alloc;                   ///< psy bit allocation for the channel
+    int cutoff;                         ///< psy cutoff set by the search
+} AACQuantizerSearch;
+
+/**
+ * Frame analysed ahead of its encoding in frame-parallel mode.
+ */
+typedef struct AACEncFrame {
+    ChannelElement *cpe;
+    FFPsyChannel *psy_ch;               ///< psy analysis of all channels
     FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
+    AACQuantizerSearch search[AAC_MAX_CHANNELS];
+    int target_bits;                    ///< bits psy allocates to the frame
+    int searched;                       ///< quantizers searched, but not written yet
+} AACEncFrame;
 
-    /* add current frame to queue */
-    if (frame) {
-        if ((ret = ff_af_queue_add(&s->afq, frame)) < 0)
-            return ret;
-    } else {
-        if (!s->afq.remaining_samples || (!s->afq.frame_alloc && !s->afq.frame_count))
-            return 0;
+static int search_for_quantizers_job(AVCodecContext *avctx, void *arg,
+                                     int jobnr, int threadnr)
+{
+    AACEncContext *s = avctx->priv_data;
+    AACQuantizerSearch *job = (AACQuantizerSearch *)arg + jobnr;
+    AACEncContext *ctx = s;
+    FFPsyChannel *psy_ch;
+
+    if (s->nb_slice_ctx) {
+        ctx = s->slice_ctx[threadnr];
+        memcpy(ctx, s, offsetof(AACEncContext, qcoefs));
     }
 
-    copy_input_samples(s, frame);
-    if (s->psypp)
-        ff_psy_preprocess(s->psypp, s->planar_samples, s->channels);
+    psy_ch = ctx->psy.ch;
+    if (job->psy_ch)
+        ctx->psy.ch = job->psy_ch;
+    ctx->cur_channel      = job->channel;
+    ctx->cur_type         = job->type;
+    ctx->psy.bitres.alloc = job->bitres_alloc;
+    s->coder->search_for_quantizers(avctx, ctx, job->sce, s->lambda);
+    job->cutoff = ctx->psy.cutoff;
+    ctx->psy.ch = psy_ch;
+
+    return 0;
+}
 
-    if (!avctx->frame_num)
-        return 0;
+/*
+ * Decide the windows of all channels of a frame and transform them.
+ */
+static int apply_psy_windows(AVCodecContext *avctx, AACEncContext *s,
+                             ChannelElement *cpes, FFPsyWindowInfo *windows,
+                             const AVFrame *frame)
+{
+    float **samples = s->planar_samples, *samples2, *la, *overlap;
+    ChannelElement *cpe;
+    SingleChannelElement *sce;
+    IndividualChannelStream *ics;
+    int i, ch, w, chans, tag, start_ch;
 
     start_ch = 0;
     for (i = 0; i < s->chan_map[0]; i++) {
         FFPsyWindowInfo* wi = windows + start_ch;
         tag      = s->chan_map[i+1];
         chans    = tag == TYPE_CPE ? 2 : 1;
-        cpe      = &s->cpe[i];
+        cpe      = &cpes[i];
         for (ch = 0; ch < chans; ch++) {
             int k;
             float clip_avoidance_factor;
@@ -940,6 +973,150 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         }
         start_ch += chans;
     }
+
+    return 0;
+}
+
+/*
+ * Clear the coding decisions of a channel element before its quantizers
+ * are searched.
+ */
+static void reset_element(ChannelElement *cpe, int chans)
+{
+    int ch, w;
+
+    cpe->common_window = 0;
+    memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
+    memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
+    for (ch = 0; ch < chans; ch++) {
+        SingleChannelElement *sce = &cpe->ch[ch];
+        memset(&sce->tns, 0, sizeof(TemporalNoiseShaping));
+        for (w = 0; w < 128; w++)
+            if (sce->band_type[w] > RESERVED_BT)
+                sce->band_type[w] = 0;
+    }
+}
+
+/*
+ * Run the psy analysis of a channel element, add the bits it targets to
+ * target_bits and set the bit allocation of its quantizer searches.
+ */
+static void analyze_element(AVCodecContext *avctx, AACEncContext *s,
+                            ChannelElement *cpe, FFPsyWindowInfo *wi,
+                            AACQuantizerSearch *search, int start_ch,
+                            int chans, int *target_bits)
+{
+    const float *coeffs[2];
+    int ch;
+
+    for (ch = 0; ch < chans; ch++)
+        coeffs[ch] = cpe->ch[ch].coeffs;
+    s->psy.bitres.alloc = -1;
+    s->psy.bitres.bits = s->last_frame_pb_count / s->channels;
+    s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
+    if (s->psy.bitres.alloc > 0) {
+        /* Lambda unused here on purpose, we need to take psy's unscaled allocation */
+        *target_bits += s->psy.bitres.alloc
+            * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
+        s->psy.bitres.alloc /= chans;
+    }
+    for (ch = 0; ch < chans; ch++)
+        search[ch].bitres_alloc = s->psy.bitres.alloc;
+}
+
+static void prepare_searches(AVCodecContext *avctx, AACEncContext *s,
+                             ChannelElement *cpe, AACQuantizerSearch *search,
+                             FFPsyChannel *psy_ch, int start_ch, int chans, int tag)
+{
+    int ch;
+
+    s->cur_type = tag;
+    for (ch = 0; ch < chans; ch++) {
+        AACQuantizerSearch *job = &search[ch];
+        s->cur_channel = start_ch + ch;
+        if (s->options.pns && s->coder->mark_pns)
+            s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
+        job->sce     = &cpe->ch[ch];
+        job->psy_ch  = psy_ch;
+        job->channel = start_ch + ch;
+        job->type    = tag;
+    }
+}
+
+/*
+ * Analyse the current frame into the next free entry of the frame-parallel
+ * queue. The windows are decided on s->cpe, which carries the state of the
+ * channels from one analysed frame to the next, and then copied into the
+ * entry, which the quantizer search and the bitstream writing work on.
+ */
+static int queue_frame(AVCodecContext *avctx, AACEncContext *s, const AVFrame *frame)
+{
+    AACEncFrame *f = &s->frames[(s->frames_head + s->nb_queued_frames) %
+                                s->options.frame_parallel];
+    int i, chans, tag, start_ch, ret;
+
+    if ((ret = apply_psy_windows(avctx, s, s->cpe, f->windows, frame)) < 0)
+        return ret;
+    memcpy(f->cpe, s->cpe, s->chan_map[0] * sizeof(*f->cpe));
+
+    start_ch       = 0;
+    f->target_bits = 0;
+    for (i = 0; i < s->chan_map[0]; i++) {
+        tag   = s->chan_map[i+1];
+        chans = tag == TYPE_CPE ? 2 : 1;
+        reset_element(&f->cpe[i], chans);
+        analyze_element(avctx, s, &f->cpe[i], f->windows + start_ch,
+                        f->search + start_ch, start_ch, chans, &f->target_bits);
+        prepare_searches(avctx, s, &f->cpe[i], f->search + start_ch,
+                         f->psy_ch, start_ch, chans, tag);
+        start_ch += chans;
+    }
+    memcpy(f->psy_ch, s->psy.ch, s->channels * sizeof(*f->psy_ch));
+    f->searched = 0;
+    s->nb_queued_frames++;
+
+    return 0;
+}
+
+/*
+ * Search the quantizers of all channels of all queued frames at once.
+ */
+static void search_queued_frames(AVCodecContext *avctx, AACEncContext *s)
+{
+    AACQuantizerSearch search[AAC_MAX_FRAME_PARALLEL * AAC_MAX_CHANNELS];
+    int i, nb_jobs = 0;
+
+    for (i = 0; i < s->nb_queued_frames; i++) {
+        AACEncFrame *f = &s->frames[(s->frames_head + i) % s->options.frame_parallel];
+        if (f->searched)
+            continue;
+        memcpy(search + nb_jobs, f->search, s->channels * sizeof(*search));
+        nb_jobs    += s->channels;
+        f->searched = 1;
+    }
+    avctx->execute2(avctx, search_for_quantizers_job, search, NULL, nb_jobs);
+    s->psy.cutoff = search[nb_jobs - 1].cutoff;
+}
+
+/*
+ * Write a frame, searching its quantizers again until it fits the rate
+ * control constraints. Frames of the frame-parallel mode have psy_ch set and
+ * are not analysed again.
+ */
+static int encode_frame(AVCodecContext *avctx, AACEncContext *s,
+                        AVPacket *avpkt, AACEncFrame *f)
+{
+    ChannelElement *cpe;
+    SingleChannelElement *sce;
+    int i, its, ch, w, chans, tag, start_ch, ret, frame_bits;
+    int target_bits, rate_bits, too_many_bits, too_few_bits, nb_searched;
+    int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
+    int chan_el_counter[4];
+
+    /* TNS, PNS and the stereo tools read the psy analysis of the frame */
+    if (f->psy_ch)
+        memcpy(s->psy.ch, f->psy_ch, s->channels * sizeof(*s->psy.ch));
+
     if ((ret = ff_alloc_packet(avctx, avpkt, 8192 * s->channels)) < 0)
         return ret;
     frame_bits = its = 0;
@@ -948,44 +1125,56 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
         if ((avctx->frame_num & 0xFF)==1 && !(avctx->flags & AV_CODEC_FLAG_BITEXACT))
             put_bitstream_info(s, LIBAVCODEC_IDENT);
-        start_ch = 0;
-        target_bits = 0;
         memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        if (f->searched) {
+            /* searched along with the other queued frames */
+            target_bits = f->target_bits;
+            f->searched = 0;
+        } else {
+            start_ch = 0;
+            target_bits = f->psy_ch ? f->target_bits : 0;
+            nb_searched = 0;
+            for (i = 0; i < s->chan_map[0]; i++) {
+                FFPsyWindowInfo* wi = f->windows + start_ch;
+                tag      = s->chan_map[i+1];
+                chans    = tag == TYPE_CPE ? 2 : 1;
+                cpe      = &f->cpe[i];
+                reset_element(cpe, chans);
+                if (!f->psy_ch)
+                    analyze_element(avctx, s, cpe, wi, f->search + start_ch,
+                                    start_ch, chans, &target_bits);
+                prepare_searches(avctx, s, cpe, f->search + start_ch, f->psy_ch,
+                                 start_ch, chans, tag);
+                start_ch += chans;
+
+                /* The search may set the psy cutoff the analysis of the next
+                 * element uses, until it has done so in the first frame. */
+                if (!s->lambda_count) {
+                    avctx->execute2(avctx, search_for_quantizers_job, f->search + nb_searched,
+                                    NULL, start_ch - nb_searched);
+                    s->psy.cutoff = f->search[start_ch - 1].cutoff;
+                    nb_searched = start_ch;
+                }
+            }
+
+            /* Otherwise the quantizer search of each channel only depends on the
+             * psy analysis of its own element, so all channels are searched at once. */
+            if (nb_searched < s->channels) {
+                avctx->execute2(avctx, search_for_quantizers_job, f->search + nb_searched,
+                                NULL, s->channels - nb_searched);
+                s->psy.cutoff = f->search[s->channels - 1].cutoff;
+            }
+        }
+
+        start_ch = 0;
         for (i = 0; i < s->chan_map[0]; i++) {
-            FFPsyWindowInfo* wi = windows + start_ch;
-            const float *coeffs[2];
+            FFPsyWindowInfo* wi = f->windows + start_ch;
             tag      = s->chan_map[i+1];
             chans    = tag == TYPE_CPE ? 2 : 1;
-            cpe      = &s->cpe[i];
-            cpe->common_window = 0;
-            memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
-            memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
+            cpe      = &f->cpe[i];
             put_bits(&s->pb, 3, tag);
             put_bits(&s->pb, 4, chan_el_counter[tag]++);
-            for (ch = 0; ch < chans; ch++) {
-                sce = &cpe->ch[ch];
-                coeffs[ch] = sce->coeffs;
-                memset(&sce->tns, 0, sizeof(TemporalNoiseShaping));
-                for (w = 0; w < 128; w++)
-                    if (sce->band_type[w] > RESERVED_BT)
-                        sce->band_type[w] = 0;
-            }
-            s->psy.bitres.alloc = -1;
-            s->psy.bitres.bits = s->last_frame_pb_count / s->channels;
-            s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
-            if (s->psy.bitres.alloc > 0) {
-                /* Lambda unused here on purpose, we need to take psy's unscaled allocation */
-                target_bits += s->psy.bitres.alloc
-                    * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
-                s->psy.bitres.alloc /= chans;
-            }
             s->cur_type = tag;
-            for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                if (s->options.pns && s->coder->mark_pns)
-                    s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
-            }
             if (chans > 1
                 && wi[0].window_type[0] == wi[1].window_type[0]
                 && wi[0].window_shape   == wi[1].window_shape) {
@@ -1101,7 +1290,7 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     for (i = 0; i < s->chan_map[0]; i++) {
                         // Must restore coeffs
                         chans = tag == TYPE_CPE ? 2 : 1;
-                        cpe = &s->cpe[i];
+                        cpe = &f->cpe[i];
                         for (ch = 0; ch < chans; ch++)
                             memcpy(cpe->ch[ch].coeffs, cpe->ch[ch].pcoeffs, sizeof(cpe->ch[ch].coeffs));
                     }
@@ -1127,10 +1316,68 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
     avpkt->flags |= AV_PKT_FLAG_KEY;
 
+    return 0;
+}
+
+static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                            const AVFrame *frame, int *got_packet_ptr)
+{
+    AACEncContext *s = avctx->priv_data;
+    AACEncFrame cur = { .cpe = s->cpe }, *f = &cur;
+    int i, ch, ret, analyze = 1;
+
+    /* add current frame to queue */
+    if (frame) {
+        if ((ret = ff_af_queue_add(&s->afq, frame)) < 0)
+            return ret;
+    } else {
+        /* each queued frame removes a frame_size of samples once written */
+        analyze = s->afq.remaining_samples > s->nb_queued_frames * avctx->frame_size &&
+                  (s->afq.frame_alloc || s->afq.frame_count);
+        if (!analyze && !s->nb_queued_frames)
+            return 0;
+    }
+
+    if (analyze) {
+        copy_input_samples(s, frame);
+        if (s->psypp)
+            ff_psy_preprocess(s->psypp, s->planar_samples, s->channels);
+
+        if (!avctx->frame_num)
+            return 0;
+    }
+
+    /* The first frame sets the psy cutoff and is encoded on its own. */
+    if (s->frames && s->lambda_count) {
+        if (analyze && (ret = queue_frame(avctx, s, frame)) < 0)
+            return ret;
+        f = &s->frames[s->frames_head];
+        if (!f->searched) {
+            if (frame && s->nb_queued_frames < s->options.frame_parallel)
+                return 0;
+            search_queued_frames(avctx, s);
+        }
+    } else if ((ret = apply_psy_windows(avctx, s, s->cpe, cur.windows, frame)) < 0) {
+        return ret;
+    }
+
+    if ((ret = encode_frame(avctx, s, avpkt, f)) < 0)
+        return ret;
+
+    if (f != &cur) {
+        /* TNS starts from the bands coded in the last written frame */
+        for (i = 0; i < s->chan_map[0]; i++)
+            for (ch = 0; ch < 2; ch++)
+                s->cpe[i].ch[ch].ics.max_sfb = f->cpe[i].ch[ch].ics.max_sfb;
+        s->frames_head = (s->frames_head + 1) % s->options.frame_parallel;
+        s->nb_queued_frames--;
+    }
+
     *got_packet_ptr = 1;
     return 0;
 }
 
+
 static av_cold int aac_encode_end(AVCodecContext *avctx)
 {
     AACEncContext *s = avctx->priv_data;
@@ -1147,6 +1394,16 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     av_freep(&s->cpe);
     av_freep(&s->fdsp);
     ff_af_queue_close(&s->afq);
+    for (int i = 0; i < s->nb_slice_ctx; i++)
+        av_freep(&s->slice_ctx[i]);
+    av_freep(&s->slice_ctx);
+    if (s->frames) {
+        for (int i = 0; i < s->options.frame_parallel; i++) {
+            av_freep(&s->frames[i].cpe);
+            av_freep(&s->frames[i].psy_ch);
+        }
+        av_freep(&s->frames);
+    }
     return 0;
 }
 
@@ -1179,6 +1436,17 @@ static av_cold int alloc_buffers(AVCodecContext *avctx, AACEncContext *s)
     for(ch = 0; ch < s->channels; ch++)
         s->planar_samples[ch] = s->buffer.samples + 3 * 1024 * ch;
 
+    if (s->options.frame_parallel > 1) {
+        s->frames = av_calloc(s->options.frame_parallel, sizeof(*s->frames));
+        if (!s->frames)
+            return AVERROR(ENOMEM);
+        for (int i = 0; i < s->options.frame_parallel; i++) {
+            if (!FF_ALLOCZ_TYPED_ARRAY(s->frames[i].cpe,    s->chan_map[0]) ||
+                !FF_ALLOCZ_TYPED_ARRAY(s->frames[i].psy_ch, s->channels))
+                return AVERROR(ENOMEM);
+        }
+    }
+
     return 0;
 }
 
@@ -1303,6 +1571,18 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
 
     ff_af_queue_init(avctx, &s->afq);
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1) {
+        s->slice_ctx = av_calloc(avctx->thread_count, sizeof(*s->slice_ctx));
+        if (!s->slice_ctx)
+            return AVERROR(ENOMEM);
+        s->nb_slice_ctx = avctx->thread_count;
+        for (i = 0; i < s->nb_slice_ctx; i++) {
+            s->slice_ctx[i] = av_mallocz(sizeof(*s->slice_ctx[i]));
+            if (!s->slice_ctx[i])
+                return AVERROR(ENOMEM);
+        }
+    }
+
     return 0;
 }
 
@@ -1316,6 +1596,7 @@ static const AVOption aacenc_options[] = {
     {"aac_pns", "Perceptual noise substitution", offsetof(AACEncContext, options.pns), AV_OPT_TYPE_BOOL, {.i64 = 1}, -1, 1, AACENC_FLAGS},
     {"aac_tns", "Temporal noise shaping", offsetof(AACEncContext, options.tns), AV_OPT_TYPE_BOOL, {.i64 = 1}, -1, 1, AACENC_FLAGS},
     {"aac_pce", "Forces the use of PCEs", offsetof(AACEncContext, options.pce), AV_OPT_TYPE_BOOL, {.i64 = 0}, -1, 1, AACENC_FLAGS},
+    {"aac_frame_parallel", "Number of frames whose quantizers are searched at once", offsetof(AACEncContext, options.frame_parallel), AV_OPT_TYPE_INT, {.i64 = 0}, 0, AAC_MAX_FRAME_PARALLEL, AACENC_FLAGS},
     FF_AAC_PROFILE_OPTS
     {NULL}
 };
@@ -1338,7 +1619,8 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
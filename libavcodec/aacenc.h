@@ -69,6 +69,7 @@ typedef struct AACEncOptions {
     int pce;
     int mid_side;
     int intensity_stereo;
+    int frame_parallel;
 } AACEncOptions;
 
 /**
@@ -210,17 +211,38 @@ typedef struct AACEncContext {
     enum RawDataBlockType cur_type;              ///< channel group type cur_channel belongs to
 
     AudioFrameQueue afq;
-    DECLARE_ALIGNED(32, int,   qcoefs)[96];      ///< quantized coefficients
-    DECLARE_ALIGNED(32, float, scoefs)[1024];    ///< scaled coefficients
-
-    uint16_t quantize_band_cost_cache_generation;
-    AACQuantizeBandCostCacheEntry quantize_band_cost_cache[256][128]; ///< memoization area for quantize_band_cost
-
     AACEncDSPContext aacdsp;
 
     struct {
         float *samples;
     } buffer;
+
+    /**
+     * Contexts the quantizer search runs in with slice threading, one per
+     * thread. All fields above qcoefs are copied from the main context
+     * before each search, the scratch buffers below are private.
+     */
+    struct AACEncContext **slice_ctx;
+    int nb_slice_ctx;
+
+    /**
+     * Frames analysed ahead in frame-parallel mode, in a ring of
+     * options.frame_parallel entries.
+     */
+    struct AACEncFrame *frames;
+    int frames_head;                             ///< index of the oldest queued frame
+    int nb_queued_frames;                        ///< number of frames analysed but not written
+
+    DECLARE_ALIGNED(32, int,   qcoefs)[96];      ///< quantized coefficients
+    DECLARE_ALIGNED(32, float, qvals)[96];       ///< dequantized magnitudes of qcoefs, without scale
+    DECLARE_ALIGNED(32, float, qdist)[96];       ///< squared quantization errors
+    DECLARE_ALIGNED(32, float, qenergy)[96];     ///< energies of the dequantized coefficients
+    int qidx[48];                                ///< codeword indices of qcoefs
+    int qbits[48];                               ///< codeword lengths of qcoefs, with sign and escape bits
+    DECLARE_ALIGNED(32, float, scoefs)[1024];    ///< scaled coefficients
+
+    uint16_t quantize_band_cost_cache_generation;
+    AACQuantizeBandCostCacheEntry quantize_band_cost_cache[256][128]; ///< memoization area for quantize_band_cost
 } AACEncContext;
 
 void ff_quantize_band_cost_cache_init(struct AACEncContext *s);
@@ -30,6 +30,13 @@ typedef struct AACEncDSPContext {
     void (*quant_bands)(int *out, const float *in, const float *scaled,
                         int size, int is_signed, int maxval, const float Q34,
                         const float rounding);
+    /**
+     * Compute the squared quantization error (|in| - qvals * IQ)^2 and the
+     * energy (qvals * IQ)^2 of the dequantized coefficients.
+     * size must be a multiple of 4.
+     */
+    void (*quant_dist)(float *dist, float *energy, const float *in,
+                       const float *qvals, int size, const float IQ);
 } AACEncDSPContext;
 
 void ff_aacenc_dsp_init_riscv(AACEncDSPContext *s);
@@ -58,10 +65,22 @@ static inline void quantize_bands(int *out, const float *in, const float *scaled
     }
 }
 
+static inline void quant_dist(float *dist, float *energy, const float *in,
+                              const float *qvals, int size, const float IQ)
+{
+    for (int i = 0; i < size; i++) {
+        float quantized = qvals[i] * IQ;
+        float di        = fabsf(in[i]) - quantized;
+        dist[i]   = di * di;
+        energy[i] = quantized * quantized;
+    }
+}
+
 static inline void ff_aacenc_dsp_init(AACEncDSPContext *s)
 {
     s->abs_pow34   = abs_pow34_v;
     s->quant_bands = quantize_bands;
+    s->quant_dist  = quant_dist;
 
 #if ARCH_RISCV
     ff_aacenc_dsp_init_riscv(s);
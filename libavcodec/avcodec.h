@@ -2365,6 +2365,48 @@ int avcodec_send_packet(AVCodecContext *avctx, const AVPacket *avpkt);
  */
 int avcodec_receive_frame(AVCodecContext *avctx, AVFrame *frame);
 
+/**
+ * Decode several packets and return the resulting frames in one call.
+ *
+ * This behaves like calling avcodec_send_packet() for each packet in turn and
+ * draining the output with avcodec_receive_frame() in between, but the decoder
+ * pulls the next packet directly when it needs more input. This avoids the
+ * per call overhead and the AVERROR(EAGAIN) round trip per packet, which
+ * dominate when the packets are small (PCM, subtitles, short audio frames).
+ * It may be freely mixed with the single packet API.
+ *
+ * Decoding stops when all packets were consumed and the decoder needs more
+ * input, when all frames were filled, or on error. Packets which were not
+ * consumed must be passed again in a later call, in the same order.
+ *
+ * @param avctx          codec context
+ * @param[in] pkts       array of packets to decode, same semantics as the
+ *                       avpkt parameter of avcodec_send_packet(); a flush
+ *                       packet may only be the last element
+ * @param[in,out] nb_pkts on input the number of packets in pkts, set to the
+ *                       number of packets consumed on return
+ * @param frames         array of frames allocated with av_frame_alloc(),
+ *                       filled from the start; frames which are used are
+ *                       unreferenced first. Passing the same frames to every
+ *                       call avoids allocating AVFrames, and the decoder's
+ *                       buffer pools recycle the data of the unreferenced
+ *                       frames.
+ * @param[in,out] nb_frames on input the number of frames in frames, set to
+ *                       the number of frames returned on return; these are
+ *                       valid whatever the return value is
+ *
+ * @retval 0                 success
+ * @retval AVERROR_EOF       the decoder has been fully flushed, and there will
+ *                           be no more output frames
+ * @retval AVERROR(EINVAL)   codec not opened, it is an encoder, or an invalid
+ *                           packet was passed
+ * @retval "another negative error code" legitimate decoding errors, the
+ *                           remaining packets may be passed to another call
+ */
+int avcodec_decode_packets(AVCodecContext *avctx,
+                           const AVPacket *const *pkts, int *nb_pkts,
+                           AVFrame **frames, int *nb_frames);
+
 /**
  * Supply a raw video or audio frame to the encoder. Use avcodec_receive_packet()
  * to retrieve buffered output packets.
@@ -819,6 +819,62 @@ fail:
     return ret;
 }
 
+int attribute_align_arg avcodec_decode_packets(AVCodecContext *avctx,
+                                               const AVPacket *const *pkts, int *nb_pkts,
+                                               AVFrame **frames, int *nb_frames)
+{
+    AVCodecInternal *avci = avctx->internal;
+    DecodeContext     *dc;
+    const int max_pkts   = *nb_pkts;
+    const int max_frames = *nb_frames;
+    int ret = 0;
+
+    *nb_pkts   = 0;
+    *nb_frames = 0;
+
+    if (!avcodec_is_open(avctx) || !av_codec_is_decoder(avctx->codec))
+        return AVERROR(EINVAL);
+    dc = decode_ctx(avci);
+
+    while (*nb_frames < max_frames) {
+        AVFrame *frame = frames[*nb_frames];
+
+        /* Refill the input slot before asking for output, so that the decoder
+         * picks the packet up itself instead of returning EAGAIN first. */
+        if (*nb_pkts < max_pkts && AVPACKET_IS_EMPTY(avci->buffer_pkt) &&
+            !dc->draining_started) {
+            const AVPacket *pkt = pkts[*nb_pkts];
+
+            if (pkt && !pkt->size && pkt->data)
+                return AVERROR(EINVAL);
+
+            if (pkt && (pkt->data || pkt->side_data_elems)) {
+                ret = av_packet_ref(avci->buffer_pkt, pkt);
+                if (ret < 0)
+                    return ret;
+            } else
+                dc->draining_started = 1;
+            (*nb_pkts)++;
+        }
+
+        av_frame_unref(frame);
+        ret = ff_decode_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN)) {
+            /* Only carry on if there is a packet left to move into the now
+             * empty input slot, anything else would not make progress. */
+            if (*nb_pkts < max_pkts && AVPACKET_IS_EMPTY(avci->buffer_pkt) &&
+                !dc->draining_started)
+                continue;
+            return 0;
+        }
+        if (ret < 0)
+            return ret;
+        (*nb_frames)++;
+    }
+
+    return 0;
+}
+
 static void get_subtitle_defaults(AVSubtitle *sub)
 {
     memset(sub, 0, sizeof(*sub));
@@ -165,11 +165,14 @@ av_cold int ff_ffv1_init_slice_contexts(FFV1Context *f)
         sc->sx           = sx;
         sc->sy           = sy;
 
-        sc->sample_buffer = av_malloc_array((f->width + 6), 3 * MAX_PLANES *
+        sc->sample_buffer = av_malloc_array((f->width + 6) * 3 * MAX_PLANES +
+                                            FFV1DSP_PADDING,
                                             sizeof(*sc->sample_buffer));
         sc->sample_buffer32 = av_malloc_array((f->width + 6), 3 * MAX_PLANES *
                                               sizeof(*sc->sample_buffer32));
-        if (!sc->sample_buffer || !sc->sample_buffer32)
+        sc->context_buffer = av_malloc_array(f->width + FFV1DSP_PADDING,
+                                             2 * sizeof(*sc->context_buffer));
+        if (!sc->sample_buffer || !sc->sample_buffer32 || !sc->context_buffer)
             return AVERROR(ENOMEM);
 
         sc->plane = ff_ffv1_planes_alloc();
@@ -270,6 +273,7 @@ av_cold void ff_ffv1_close(FFV1Context *s)
 
         av_freep(&sc->sample_buffer);
         av_freep(&sc->sample_buffer32);
+        av_freep(&sc->context_buffer);
         for(int p = 0; p < 4 ; p++) {
             av_freep(&sc->fltmap[p]);
             av_freep(&sc->fltmap32[p]);
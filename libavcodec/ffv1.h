@@ -30,6 +30,7 @@
 
 #include "libavutil/attributes.h"
 #include "avcodec.h"
+#include "ffv1dsp.h"
 #include "get_bits.h"
 #include "mathops.h"
 #include "progressframe.h"
@@ -73,6 +74,7 @@ typedef struct PlaneContext {
 typedef struct FFV1SliceContext {
     int16_t *sample_buffer;
     int32_t *sample_buffer32;
+    int32_t *context_buffer;             ///< per line contexts and residuals, see FFV1DSPContext
 
     int slice_width;
     int slice_height;
@@ -185,6 +187,8 @@ typedef struct FFV1Context {
      * NOT shared between frame threads.
      */
     uint8_t           frame_damaged;
+
+    FFV1DSPContext dsp;
 } FFV1Context;
 
 int ff_ffv1_common_init(AVCodecContext *avctx, FFV1Context *s);
@@ -84,12 +84,15 @@ static int is_input_end(RangeCoder *c, GetBitContext *gb, int ac)
 
 #define TYPE int16_t
 #define RENAME(name) name
+#define LINE_DSP 1
 #include "ffv1dec_template.c"
 #undef TYPE
 #undef RENAME
+#undef LINE_DSP
 
 #define TYPE int32_t
 #define RENAME(name) name ## 32
+#define LINE_DSP 0
 #include "ffv1dec_template.c"
 
 static int decode_plane(FFV1Context *f, FFV1SliceContext *sc,
@@ -602,6 +605,8 @@ static av_cold int decode_init(AVCodecContext *avctx)
     if ((ret = ff_ffv1_common_init(avctx, f)) < 0)
         return ret;
 
+    ff_ffv1dsp_init(&f->dsp);
+
     if (avctx->extradata_size > 0 && (ret = ff_ffv1_read_extra_header(f)) < 0)
         return ret;
 
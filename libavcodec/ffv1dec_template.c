@@ -31,6 +31,10 @@ RENAME(decode_line)(FFV1Context *f, FFV1SliceContext *sc,
     PlaneContext *const p = &sc->plane[plane_index];
     RangeCoder *const c   = &sc->c;
     const int16_t (*quant_table)[256] = f->quant_tables[p->quant_table_index];
+#if LINE_DSP
+    const int five = quant_table[3][127] || quant_table[4][127];
+    int32_t *const top_context = sc->context_buffer;
+#endif
     int x;
     int run_count = 0;
     int run_mode  = 0;
@@ -58,6 +62,10 @@ RENAME(decode_line)(FFV1Context *f, FFV1SliceContext *sc,
         return 0;
     }
 
+#if LINE_DSP
+    f->dsp.top_context[five](top_context, sample[0], sample[1], quant_table, w);
+#endif
+
     for (x = 0; x < w; x++) {
         int diff, context, sign;
 
@@ -66,8 +74,15 @@ RENAME(decode_line)(FFV1Context *f, FFV1SliceContext *sc,
                 return AVERROR_INVALIDDATA;
         }
 
+#if LINE_DSP
+        context = top_context[x] +
+                  quant_table[0][(sample[1][x - 1] - sample[0][x - 1]) & MAX_QUANT_TABLE_MASK];
+        if (five)
+            context += quant_table[3][(sample[1][x - 2] - sample[1][x - 1]) & MAX_QUANT_TABLE_MASK];
+#else
         context = RENAME(get_context)(quant_table,
                                       sample[1] + x, sample[0] + x, sample[1] + x);
+#endif
         if (context < 0) {
             context = -context;
             sign    = 1;
@@ -0,0 +1,97 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "ffv1dsp.h"
+#include "mathops.h"
+
+static av_always_inline void context_pred(int32_t *context, int32_t *diff,
+                                          const int16_t *src, const int16_t *last,
+                                          const int16_t *last2,
+                                          const int16_t (*q)[256], int w,
+                                          int five)
+{
+    for (int x = 0; x < w; x++) {
+        const int LT = last[x - 1];
+        const int T  = last[x];
+        const int RT = last[x + 1];
+        const int L  = src[x - 1];
+        int ctx = q[0][(L - LT) & 0xFF] + q[1][(LT - T) & 0xFF] +
+                  q[2][(T - RT) & 0xFF];
+
+        if (five)
+            ctx += q[3][(src[x - 2] - L) & 0xFF] + q[4][(last2[x] - T) & 0xFF];
+
+        context[x] = ctx;
+        diff[x]    = src[x] - mid_pred(L, L + T - LT, T);
+    }
+}
+
+static void context_pred3_c(int32_t *context, int32_t *diff,
+                            const int16_t *src, const int16_t *last,
+                            const int16_t *last2,
+                            const int16_t (*quant_table)[256], int w)
+{
+    context_pred(context, diff, src, last, last2, quant_table, w, 0);
+}
+
+static void context_pred5_c(int32_t *context, int32_t *diff,
+                            const int16_t *src, const int16_t *last,
+                            const int16_t *last2,
+                            const int16_t (*quant_table)[256], int w)
+{
+    context_pred(context, diff, src, last, last2, quant_table, w, 1);
+}
+
+static av_always_inline void top_context(int32_t *context, const int16_t *last,
+                                         const int16_t *last2,
+                                         const int16_t (*q)[256], int w,
+                                         int five)
+{
+    for (int x = 0; x < w; x++) {
+        const int T = last[x];
+        int ctx = q[1][(last[x - 1] - T) & 0xFF] + q[2][(T - last[x + 1]) & 0xFF];
+
+        if (five)
+            ctx += q[4][(last2[x] - T) & 0xFF];
+
+        context[x] = ctx;
+    }
+}
+
+static void top_context3_c(int32_t *context, const int16_t *last,
+                           const int16_t *last2,
+                           const int16_t (*quant_table)[256], int w)
+{
+    top_context(context, last, last2, quant_table, w, 0);
+}
+
+static void top_context5_c(int32_t *context, const int16_t *last,
+                           const int16_t *last2,
+                           const int16_t (*quant_table)[256], int w)
+{
+    top_context(context, last, last2, quant_table, w, 1);
+}
+
+av_cold void ff_ffv1dsp_init(FFV1DSPContext *c)
+{
+    c->context_pred[0] = context_pred3_c;
+    c->context_pred[1] = context_pred5_c;
+    c->top_context[0]  = top_context3_c;
+    c->top_context[1]  = top_context5_c;
+}
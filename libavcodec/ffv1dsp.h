@@ -0,0 +1,61 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_FFV1DSP_H
+#define AVCODEC_FFV1DSP_H
+
+#include <stdint.h>
+
+/**
+ * Number of elements the line functions may write past w, and read past
+ * the end of the input lines.
+ */
+#define FFV1DSP_PADDING 16
+
+typedef struct FFV1DSPContext {
+    /**
+     * Compute the signed context and the median prediction residual of a
+     * line of samples.
+     * Index 0 uses the first three inputs of quant_table, index 1 all five.
+     *
+     * @param context     output, quantized context of each sample
+     * @param diff        output, src[x] minus its median prediction
+     * @param src         current line, src[-2] and src[-1] must be valid
+     * @param last        previous line, last[-1] and last[w] must be valid
+     * @param last2       line before last, only read by index 1
+     * @param quant_table context quantization tables, quant_table[0][-1]
+     *                    must be readable
+     */
+    void (*context_pred[2])(int32_t *context, int32_t *diff,
+                            const int16_t *src, const int16_t *last,
+                            const int16_t *last2,
+                            const int16_t (*quant_table)[256], int w);
+
+    /**
+     * Compute the part of the context that does not depend on the current
+     * line, i.e. everything but the terms of quant_table[0] and
+     * quant_table[3]. Index 0 and 1 as for context_pred.
+     */
+    void (*top_context[2])(int32_t *context, const int16_t *last,
+                           const int16_t *last2,
+                           const int16_t (*quant_table)[256], int w);
+} FFV1DSPContext;
+
+void ff_ffv1dsp_init(FFV1DSPContext *c);
+
+#endif /* AVCODEC_FFV1DSP_H */
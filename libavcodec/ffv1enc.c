@@ -263,12 +263,15 @@ static inline void put_vlc_symbol(PutBitContext *pb, VlcState *const state,
 
 #define TYPE int16_t
 #define RENAME(name) name
+#define LINE_DSP 1
 #include "ffv1enc_template.c"
 #undef TYPE
 #undef RENAME
+#undef LINE_DSP
 
 #define TYPE int32_t
 #define RENAME(name) name ## 32
+#define LINE_DSP 0
 #include "ffv1enc_template.c"
 
 static int encode_plane(FFV1Context *f, FFV1SliceContext *sc,
@@ -969,6 +972,8 @@ static av_cold int encode_init_internal(AVCodecContext *avctx)
     if ((ret = ff_ffv1_common_init(avctx, s)) < 0)
         return ret;
 
+    ff_ffv1dsp_init(&s->dsp);
+
     if (s->ac == 1) // Compatbility with common command line usage
         s->ac = AC_RANGE_CUSTOM_TAB;
     else if (s->ac == AC_RANGE_DEFAULT_TAB_FORCE)
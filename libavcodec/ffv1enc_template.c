@@ -62,12 +62,26 @@ RENAME(encode_line)(FFV1Context *f, FFV1SliceContext *sc,
         return 0;
     }
 
+#if LINE_DSP
+    const int16_t (*quant_table)[256] = f->quant_tables[p->quant_table_index];
+    int32_t *const contexts = sc->context_buffer;
+    int32_t *const diffs    = sc->context_buffer + f->width + FFV1DSP_PADDING;
+
+    f->dsp.context_pred[quant_table[3][127] || quant_table[4][127]](
+        contexts, diffs, sample[0], sample[1], sample[2], quant_table, w);
+#endif
+
     for (x = 0; x < w; x++) {
         int diff, context;
 
+#if LINE_DSP
+        context = contexts[x];
+        diff    = diffs[x];
+#else
         context = RENAME(get_context)(f->quant_tables[p->quant_table_index],
                                       sample[0] + x, sample[1] + x, sample[2] + x);
         diff    = sample[0][x] - RENAME(predict)(sample[0] + x, sample[1] + x);
+#endif
 
         if (context < 0) {
             context = -context;
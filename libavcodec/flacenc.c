@@ -91,6 +91,8 @@ typedef struct FlacSubframe {
 
     int32_t samples[FLAC_MAX_BLOCKSIZE];
     int32_t residual[FLAC_MAX_BLOCKSIZE+11];
+
+    uint64_t count;             ///< coded subframe size in bits
 } FlacSubframe;
 
 typedef struct FlacFrame {
@@ -101,11 +103,18 @@ typedef struct FlacFrame {
     uint8_t crc8;
     int ch_mode;
     int verbatim_only;
+    uint32_t frame_count;       ///< coded frame number
+
+    int64_t pts;
+    int64_t duration;
+    void *opaque;
+    AVBufferRef *opaque_ref;
+    uint8_t *buf;               ///< coded frame, max_framesize bytes
+    int size;                   ///< coded frame size or negative error code
 } FlacFrame;
 
 typedef struct FlacEncodeContext {
     AVClass *class;
-    PutBitContext pb;
     int channels;
     int samplerate;
     int sr_code[2];
@@ -117,10 +126,23 @@ typedef struct FlacEncodeContext {
     uint32_t frame_count;
     uint64_t sample_count;
     uint8_t md5sum[16];
-    FlacFrame frame;
     CompressionOptions options;
     AVCodecContext *avctx;
-    LPCContext lpc_ctx;
+
+    /**
+     * Frames are encoded in batches of up to nb_frames, one slice thread
+     * job per frame and channel. frames is used as a ring buffer holding
+     * nb_pending frames starting at first_frame, the first nb_coded of
+     * which have been encoded and wait for output.
+     */
+    FlacFrame *frames;
+    int nb_frames;
+    int first_frame;
+    int nb_pending;
+    int nb_coded;
+    LPCContext *lpc_ctx;        ///< one per slice thread
+    int nb_lpc_ctx;
+
     struct AVMD5 *md5ctx;
     uint8_t *md5_buffer;
     unsigned int md5_buffer_size;
@@ -464,24 +486,44 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
         }
     }
 
-    ret = ff_lpc_init(&s->lpc_ctx, avctx->frame_size,
-                      s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+    /* with slice threading, encode as many frames at once as there are
+       threads, otherwise one frame at a time without any delay */
+    if (avctx->active_thread_type & FF_THREAD_SLICE)
+        s->nb_frames = avctx->thread_count;
+    else
+        s->nb_frames = 1;
+    s->nb_lpc_ctx = s->nb_frames;
+
+    s->frames  = av_calloc(s->nb_frames,  sizeof(*s->frames));
+    s->lpc_ctx = av_calloc(s->nb_lpc_ctx, sizeof(*s->lpc_ctx));
+    if (!s->frames || !s->lpc_ctx)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_frames; i++) {
+        s->frames[i].buf = av_malloc(s->max_framesize);
+        if (!s->frames[i].buf)
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < s->nb_lpc_ctx; i++) {
+        ret = ff_lpc_init(&s->lpc_ctx[i], avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+    }
 
     ff_bswapdsp_init(&s->bdsp);
     ff_flacencdsp_init(&s->flac_dsp);
 
     dprint_compression_options(s);
 
-    return ret;
+    return 0;
 }
 
 
-static void init_frame(FlacEncodeContext *s, int nb_samples)
+static void init_frame(FlacEncodeContext *s, FlacFrame *frame, int nb_samples)
 {
     int i, ch;
-    FlacFrame *frame;
-
-    frame = &s->frame;
 
     for (i = 0; i < 16; i++) {
         if (nb_samples == ff_flac_blocksize_table[i]) {
@@ -521,15 +563,14 @@ static void init_frame(FlacEncodeContext *s, int nb_samples)
 /**
  * Copy channel-interleaved input samples into separate subframes.
  */
-static void copy_samples(FlacEncodeContext *s, const void *samples)
+static void copy_samples(FlacEncodeContext *s, FlacFrame *frame,
+                         const void *samples)
 {
     int i, j, ch;
-    FlacFrame *frame;
 
 #define COPY_SAMPLES(bits, shift0) do {                             \
     const int ## bits ## _t *samples0 = samples;                    \
     const int shift = shift0;                                       \
-    frame = &s->frame;                                              \
     for (i = 0, j = 0; i < frame->blocksize; i++)                   \
         for (ch = 0; ch < s->channels; ch++, j++)                   \
             frame->subframes[ch].samples[i] = samples0[j] >> shift; \
@@ -555,8 +596,8 @@ static uint64_t rice_count_exact(const int32_t *res, int n, int k)
 }
 
 
-static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
-                                     int pred_order)
+static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacFrame *frame,
+                                     FlacSubframe *sub, int pred_order)
 {
     int p, porder, psize;
     int i, part_end;
@@ -572,7 +613,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
     if (sub->type == FLAC_SUBFRAME_CONSTANT) {
         count += sub->obits;
     } else if (sub->type == FLAC_SUBFRAME_VERBATIM) {
-        count += s->frame.blocksize * sub->obits;
+        count += frame->blocksize * sub->obits;
     } else {
         /* warm-up samples */
         count += pred_order * sub->obits;
@@ -586,7 +627,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
 
         /* partition order */
         porder = sub->rc.porder;
-        psize  = s->frame.blocksize >> porder;
+        psize  = frame->blocksize >> porder;
         count += 4;
 
         /* residual */
@@ -597,7 +638,7 @@ static uint64_t subframe_count_exact(FlacEncodeContext *s, FlacSubframe *sub,
             count += sub->rc.coding_mode;
             count += rice_count_exact(&sub->residual[i], part_end - i, k);
             i = part_end;
-            part_end = FFMIN(s->frame.blocksize, part_end + psize);
+            part_end = FFMIN(frame->blocksize, part_end + psize);
         }
     }
 
@@ -758,19 +799,19 @@ static int get_max_p_order(int max_porder, int n, int order)
 }
 
 
-static uint64_t find_subframe_rice_params(FlacEncodeContext *s,
+static uint64_t find_subframe_rice_params(FlacEncodeContext *s, FlacFrame *frame,
                                           FlacSubframe *sub, int pred_order)
 {
     int pmin = get_max_p_order(s->options.min_partition_order,
-                               s->frame.blocksize, pred_order);
+                               frame->blocksize, pred_order);
     int pmax = get_max_p_order(s->options.max_partition_order,
-                               s->frame.blocksize, pred_order);
+                               frame->blocksize, pred_order);
 
     uint64_t bits = 8 + pred_order * sub->obits + 2 + sub->rc.coding_mode;
     if (sub->type == FLAC_SUBFRAME_LPC)
         bits += 4 + 5 + pred_order * s->options.lpc_coeff_precision;
     bits += calc_rice_params(&sub->rc, sub->rc_udata, sub->rc_sums, pmin, pmax, sub->residual,
-                             s->frame.blocksize, pred_order, s->options.exact_rice_parameters);
+                             frame->blocksize, pred_order, s->options.exact_rice_parameters);
     return bits;
 }
 
@@ -947,21 +988,20 @@ static int lpc_encode_choose_datapath(FlacEncodeContext *s, int32_t bps,
     sub->type = sub->type_code = FLAC_SUBFRAME_VERBATIM;    \
     if (sub->obits <= 32)                                   \
         memcpy(res, smp, n * sizeof(int32_t));              \
-    return subframe_count_exact(s, sub, 0);                 \
+    return subframe_count_exact(s, frame, sub, 0);                 \
 }
 
-static int encode_residual_ch(FlacEncodeContext *s, int ch)
+static int encode_residual_ch(FlacEncodeContext *s, FlacFrame *frame,
+                              LPCContext *lpc_ctx, int ch)
 {
     int i, n;
     int min_order, max_order, opt_order, omethod;
-    FlacFrame *frame;
     FlacSubframe *sub;
     int32_t coefs[MAX_LPC_ORDER][MAX_LPC_ORDER];
     int shift[MAX_LPC_ORDER];
     int32_t *res, *smp;
     int64_t *smp_33bps;
 
-    frame     = &s->frame;
     sub       = &frame->subframes[ch];
     res       = sub->residual;
     smp       = sub->samples;
@@ -975,7 +1015,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 break;
         if (i == n) {
             sub->type = sub->type_code = FLAC_SUBFRAME_CONSTANT;
-            return subframe_count_exact(s, sub, 0);
+            return subframe_count_exact(s, frame, sub, 0);
         }
     } else {
         for (i = 1; i < n; i++)
@@ -984,7 +1024,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         if (i == n) {
             sub->type = sub->type_code = FLAC_SUBFRAME_CONSTANT;
             res[0] = smp[0];
-            return subframe_count_exact(s, sub, 0);
+            return subframe_count_exact(s, frame, sub, 0);
         }
     }
 
@@ -1015,7 +1055,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                     continue;
             } else
                 encode_residual_fixed(res, smp, n, i);
-            bits[i] = find_subframe_rice_params(s, sub, i);
+            bits[i] = find_subframe_rice_params(s, frame, sub, i);
             if (bits[i] < bits[opt_order])
                 opt_order = i;
         }
@@ -1033,9 +1073,9 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 encode_residual_fixed_with_residual_limit(res, smp, n, sub->order);
             else
                 encode_residual_fixed(res, smp, n, sub->order);
-            find_subframe_rice_params(s, sub, sub->order);
+            find_subframe_rice_params(s, frame, sub, sub->order);
         }
-        return subframe_count_exact(s, sub, sub->order);
+        return subframe_count_exact(s, frame, sub, sub->order);
     }
 
     /* LPC */
@@ -1048,7 +1088,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         for (i = 0; i < n; i++)
             smp[i] = smp_33bps[i] >> 1;
 
-    opt_order = ff_lpc_calc_coefs(&s->lpc_ctx, smp, n, min_order, max_order,
+    opt_order = ff_lpc_calc_coefs(lpc_ctx, smp, n, min_order, max_order,
                                   s->options.lpc_coeff_precision, coefs, shift, s->options.lpc_type,
                                   s->options.lpc_passes, omethod,
                                   MIN_LPC_SHIFT, MAX_LPC_SHIFT, 0);
@@ -1070,7 +1110,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                 continue;
             if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, order+1, coefs[order], shift[order]))
                 continue;
-            bits[i] = find_subframe_rice_params(s, sub, order+1);
+            bits[i] = find_subframe_rice_params(s, frame, sub, order+1);
             if (bits[i] < bits[opt_index]) {
                 opt_index = i;
                 opt_order = order;
@@ -1085,7 +1125,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         for (i = min_order-1; i < max_order; i++) {
             if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, i+1, coefs[i], shift[i]))
                 continue;
-            bits[i] = find_subframe_rice_params(s, sub, i+1);
+            bits[i] = find_subframe_rice_params(s, frame, sub, i+1);
             if (bits[i] < bits[opt_order])
                 opt_order = i;
         }
@@ -1104,7 +1144,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
                     continue;
                 if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, i+1, coefs[i], shift[i]))
                     continue;
-                bits[i] = find_subframe_rice_params(s, sub, i+1);
+                bits[i] = find_subframe_rice_params(s, frame, sub, i+1);
                 if (bits[i] < bits[opt_order])
                     opt_order = i;
             }
@@ -1142,7 +1182,7 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
 
                 if(lpc_encode_choose_datapath(s, sub->obits, res, smp, smp_33bps, n, opt_order, lpc_try, shift[opt_order-1]))
                     continue;
-                score = find_subframe_rice_params(s, sub, opt_order);
+                score = find_subframe_rice_params(s, frame, sub, opt_order);
                 if (score < best_score) {
                     best_score = score;
                     memcpy(coefs[opt_order-1], lpc_try, sizeof(*coefs));
@@ -1164,13 +1204,13 @@ static int encode_residual_ch(FlacEncodeContext *s, int ch)
         DEFAULT_TO_VERBATIM();
     }
 
-    find_subframe_rice_params(s, sub, sub->order);
+    find_subframe_rice_params(s, frame, sub, sub->order);
 
-    return subframe_count_exact(s, sub, sub->order);
+    return subframe_count_exact(s, frame, sub, sub->order);
 }
 
 
-static int count_frame_header(FlacEncodeContext *s)
+static int count_frame_header(FlacEncodeContext *s, FlacFrame *frame)
 {
     uint8_t av_unused tmp;
     int count;
@@ -1188,12 +1228,12 @@ static int count_frame_header(FlacEncodeContext *s)
     count = 32;
 
     /* coded frame number */
-    PUT_UTF8(s->frame_count, tmp, count += 8;)
+    PUT_UTF8(frame->frame_count, tmp, count += 8;)
 
     /* explicit block size */
-    if (s->frame.bs_code[0] == 6)
+    if (frame->bs_code[0] == 6)
         count += 8;
-    else if (s->frame.bs_code[0] == 7)
+    else if (frame->bs_code[0] == 7)
         count += 16;
 
     /* explicit sample rate */
@@ -1206,15 +1246,15 @@ static int count_frame_header(FlacEncodeContext *s)
 }
 
 
-static int encode_frame(FlacEncodeContext *s)
+static int count_frame(FlacEncodeContext *s, FlacFrame *frame)
 {
     int ch;
     uint64_t count;
 
-    count = count_frame_header(s);
+    count = count_frame_header(s, frame);
 
     for (ch = 0; ch < s->channels; ch++)
-        count += encode_residual_ch(s, ch);
+        count += frame->subframes[ch].count;
 
     count += (8 - (count & 7)) & 7; // byte alignment
     count += 16;                    // CRC-16
@@ -1226,17 +1266,29 @@ static int encode_frame(FlacEncodeContext *s)
 }
 
 
-static void remove_wasted_bits(FlacEncodeContext *s)
+static int encode_frame(FlacEncodeContext *s, FlacFrame *frame,
+                        LPCContext *lpc_ctx)
+{
+    int ch;
+
+    for (ch = 0; ch < s->channels; ch++)
+        frame->subframes[ch].count = encode_residual_ch(s, frame, lpc_ctx, ch);
+
+    return count_frame(s, frame);
+}
+
+
+static void remove_wasted_bits(FlacEncodeContext *s, FlacFrame *frame)
 {
     int ch, i, wasted_bits;
 
     for (ch = 0; ch < s->channels; ch++) {
-        FlacSubframe *sub = &s->frame.subframes[ch];
+        FlacSubframe *sub = &frame->subframes[ch];
 
         if (sub->obits > 32) {
             int64_t v = 0;
-            for (i = 0; i < s->frame.blocksize; i++) {
-                v |= s->frame.samples_33bps[i];
+            for (i = 0; i < frame->blocksize; i++) {
+                v |= frame->samples_33bps[i];
                 if (v & 1)
                     break;
             }
@@ -1248,12 +1300,12 @@ static void remove_wasted_bits(FlacEncodeContext *s)
 
             /* If any wasted bits are found, samples are moved
              * from frame.samples_33bps to frame.subframes[ch] */
-            for (i = 0; i < s->frame.blocksize; i++)
-                sub->samples[i] = s->frame.samples_33bps[i] >> v;
+            for (i = 0; i < frame->blocksize; i++)
+                sub->samples[i] = frame->samples_33bps[i] >> v;
             wasted_bits = v;
         } else {
             int32_t v = 0;
-            for (i = 0; i < s->frame.blocksize; i++) {
+            for (i = 0; i < frame->blocksize; i++) {
                 v |= sub->samples[i];
                 if (v & 1)
                     break;
@@ -1264,7 +1316,7 @@ static void remove_wasted_bits(FlacEncodeContext *s)
 
             v = ff_ctz(v);
 
-            for (i = 0; i < s->frame.blocksize; i++)
+            for (i = 0; i < frame->blocksize; i++)
                 sub->samples[i] >>= v;
             wasted_bits = v;
         }
@@ -1336,14 +1388,12 @@ static int estimate_stereo_mode(const int32_t *left_ch, const int32_t *right_ch,
 /**
  * Perform stereo channel decorrelation.
  */
-static void channel_decorrelation(FlacEncodeContext *s)
+static void channel_decorrelation(FlacEncodeContext *s, FlacFrame *frame)
 {
-    FlacFrame *frame;
     int32_t *left, *right;
     int64_t *side_33bps;
     int n;
 
-    frame      = &s->frame;
     n          = frame->blocksize;
     left       = frame->subframes[0].samples;
     right      = frame->subframes[1].samples;
@@ -1410,40 +1460,38 @@ static void write_utf8(PutBitContext *pb, uint32_t val)
 }
 
 
-static void write_frame_header(FlacEncodeContext *s)
+static void write_frame_header(FlacEncodeContext *s, FlacFrame *frame,
+                               PutBitContext *pb)
 {
-    FlacFrame *frame;
     int crc;
 
-    frame = &s->frame;
-
-    put_bits(&s->pb, 16, 0xFFF8);
-    put_bits(&s->pb, 4, frame->bs_code[0]);
-    put_bits(&s->pb, 4, s->sr_code[0]);
+    put_bits(pb, 16, 0xFFF8);
+    put_bits(pb, 4, frame->bs_code[0]);
+    put_bits(pb, 4, s->sr_code[0]);
 
     if (frame->ch_mode == FLAC_CHMODE_INDEPENDENT)
-        put_bits(&s->pb, 4, s->channels-1);
+        put_bits(pb, 4, s->channels-1);
     else
-        put_bits(&s->pb, 4, frame->ch_mode + FLAC_MAX_CHANNELS - 1);
+        put_bits(pb, 4, frame->ch_mode + FLAC_MAX_CHANNELS - 1);
 
-    put_bits(&s->pb, 3, s->bps_code);
-    put_bits(&s->pb, 1, 0);
-    write_utf8(&s->pb, s->frame_count);
+    put_bits(pb, 3, s->bps_code);
+    put_bits(pb, 1, 0);
+    write_utf8(pb, frame->frame_count);
 
     if (frame->bs_code[0] == 6)
-        put_bits(&s->pb, 8, frame->bs_code[1]);
+        put_bits(pb, 8, frame->bs_code[1]);
     else if (frame->bs_code[0] == 7)
-        put_bits(&s->pb, 16, frame->bs_code[1]);
+        put_bits(pb, 16, frame->bs_code[1]);
 
     if (s->sr_code[0] == 12)
-        put_bits(&s->pb, 8, s->sr_code[1]);
+        put_bits(pb, 8, s->sr_code[1]);
     else if (s->sr_code[0] > 12)
-        put_bits(&s->pb, 16, s->sr_code[1]);
+        put_bits(pb, 16, s->sr_code[1]);
 
-    flush_put_bits(&s->pb);
-    crc = av_crc(av_crc_get_table(AV_CRC_8_ATM), 0, s->pb.buf,
-                 put_bytes_output(&s->pb));
-    put_bits(&s->pb, 8, crc);
+    flush_put_bits(pb);
+    crc = av_crc(av_crc_get_table(AV_CRC_8_ATM), 0, pb->buf,
+                 put_bytes_output(pb));
+    put_bits(pb, 8, crc);
 }
 
 
@@ -1466,83 +1514,84 @@ static inline void set_sr_golomb_flac(PutBitContext *pb, int i, int k)
 }
 
 
-static void write_subframes(FlacEncodeContext *s)
+static void write_subframes(FlacEncodeContext *s, FlacFrame *frame,
+                           PutBitContext *pb)
 {
     int ch;
 
     for (ch = 0; ch < s->channels; ch++) {
-        FlacSubframe *sub = &s->frame.subframes[ch];
+        FlacSubframe *sub = &frame->subframes[ch];
         int p, porder, psize;
         int32_t *part_end;
         int32_t *res       =  sub->residual;
-        int32_t *frame_end = &sub->residual[s->frame.blocksize];
+        int32_t *frame_end = &sub->residual[frame->blocksize];
 
         /* subframe header */
-        put_bits(&s->pb, 1, 0);
-        put_bits(&s->pb, 6, sub->type_code);
-        put_bits(&s->pb, 1, !!sub->wasted);
+        put_bits(pb, 1, 0);
+        put_bits(pb, 6, sub->type_code);
+        put_bits(pb, 1, !!sub->wasted);
         if (sub->wasted)
-            put_bits(&s->pb, sub->wasted, 1);
+            put_bits(pb, sub->wasted, 1);
 
         /* subframe */
         if (sub->type == FLAC_SUBFRAME_CONSTANT) {
             if(sub->obits == 33)
-                put_sbits63(&s->pb, 33, s->frame.samples_33bps[0]);
+                put_sbits63(pb, 33, frame->samples_33bps[0]);
             else if(sub->obits == 32)
-                put_bits32(&s->pb, res[0]);
+                put_bits32(pb, res[0]);
             else
-                put_sbits(&s->pb, sub->obits, res[0]);
+                put_sbits(pb, sub->obits, res[0]);
         } else if (sub->type == FLAC_SUBFRAME_VERBATIM) {
             if (sub->obits == 33) {
-                int64_t *res64 = s->frame.samples_33bps;
-                int64_t *frame_end64 = &s->frame.samples_33bps[s->frame.blocksize];
+                int64_t *res64 = frame->samples_33bps;
+                int64_t *frame_end64 = &frame->samples_33bps[frame->blocksize];
                 while (res64 < frame_end64)
-                    put_sbits63(&s->pb, 33, (*res64++));
+                    put_sbits63(pb, 33, (*res64++));
             } else if (sub->obits == 32) {
                 while (res < frame_end)
-                    put_bits32(&s->pb, *res++);
+                    put_bits32(pb, *res++);
             } else {
                 while (res < frame_end)
-                    put_sbits(&s->pb, sub->obits, *res++);
+                    put_sbits(pb, sub->obits, *res++);
             }
         } else {
             /* warm-up samples */
             if (sub->obits == 33) {
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits63(&s->pb, 33, s->frame.samples_33bps[i]);
+                    put_sbits63(pb, 33, frame->samples_33bps[i]);
                 res += sub->order;
             } else if (sub->obits == 32) {
                 for (int i = 0; i < sub->order; i++)
-                    put_bits32(&s->pb, *res++);
+                    put_bits32(pb, *res++);
             } else {
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits(&s->pb, sub->obits, *res++);
+                    put_sbits(pb, sub->obits, *res++);
             }
 
             /* LPC coefficients */
             if (sub->type == FLAC_SUBFRAME_LPC) {
                 int cbits = s->options.lpc_coeff_precision;
-                put_bits( &s->pb, 4, cbits-1);
-                put_sbits(&s->pb, 5, sub->shift);
+                put_bits( pb, 4, cbits-1);
+                put_sbits(pb, 5, sub->shift);
                 for (int i = 0; i < sub->order; i++)
-                    put_sbits(&s->pb, cbits, sub->coefs[i]);
+                    put_sbits(pb, cbits, sub->coefs[i]);
             }
 
             /* rice-encoded block */
-            put_bits(&s->pb, 2, sub->rc.coding_mode - 4);
+            put_bits(pb, 2, sub->rc.coding_mode - 4);
 
             /* partition order */
             porder  = sub->rc.porder;
-            psize   = s->frame.blocksize >> porder;
-            put_bits(&s->pb, 4, porder);
+            psize   = frame->blocksize >> porder;
+            put_bits(pb, 4, porder);
 
             /* residual */
             part_end  = &sub->residual[psize];
             for (p = 0; p < 1 << porder; p++) {
                 int k = sub->rc.params[p];
-                put_bits(&s->pb, sub->rc.coding_mode, k);
+                put_bits(pb, sub->rc.coding_mode, k);
                 while (res < part_end)
-                    set_sr_golomb_flac(&s->pb, *res++, k);
+                    set_sr_golomb_flac(pb, *res++, k);
                 part_end = FFMIN(frame_end, part_end + psize);
             }
         }
@@ -1550,31 +1599,35 @@ static void write_subframes(FlacEncodeContext *s)
 }
 
 
-static void write_frame_footer(FlacEncodeContext *s)
+static void write_frame_footer(PutBitContext *pb)
 {
     int crc;
-    flush_put_bits(&s->pb);
-    crc = av_bswap16(av_crc(av_crc_get_table(AV_CRC_16_ANSI), 0, s->pb.buf,
-                            put_bytes_output(&s->pb)));
-    put_bits(&s->pb, 16, crc);
-    flush_put_bits(&s->pb);
+    flush_put_bits(pb);
+    crc = av_bswap16(av_crc(av_crc_get_table(AV_CRC_16_ANSI), 0, pb->buf,
+                            put_bytes_output(pb)));
+    put_bits(pb, 16, crc);
+    flush_put_bits(pb);
 }
 
 
-static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
+static int write_frame(FlacEncodeContext *s, FlacFrame *frame,
+                       uint8_t *buf, int size)
 {
-    init_put_bits(&s->pb, avpkt->data, avpkt->size);
-    write_frame_header(s);
-    write_subframes(s);
-    write_frame_footer(s);
-    return put_bytes_output(&s->pb);
+    PutBitContext pb;
+
+    init_put_bits(&pb, buf, size);
+    write_frame_header(s, frame, &pb);
+    write_subframes(s, frame, &pb);
+    write_frame_footer(&pb);
+    return put_bytes_output(&pb);
 }
 
 
-static int update_md5_sum(FlacEncodeContext *s, const void *samples)
+static int update_md5_sum(FlacEncodeContext *s, const void *samples,
+                          int nb_samples)
 {
     const uint8_t *buf;
-    int buf_size = s->frame.blocksize * s->channels *
+    int buf_size = nb_samples * s->channels *
                    ((s->avctx->bits_per_raw_sample + 7) / 8);
 
     if (s->avctx->bits_per_raw_sample > 16 || HAVE_BIGENDIAN) {
@@ -1595,7 +1648,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++) {
+        for (i = 0; i < nb_samples * s->channels; i++) {
             int32_t v = samples0[i] >> 8;
             AV_WL24(tmp + 3*i, v);
         }
@@ -1606,7 +1659,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++)
+        for (i = 0; i < nb_samples * s->channels; i++)
             AV_WL32(tmp + 4*i, samples0[i]);
         buf = s->md5_buffer;
     }
@@ -1616,85 +1669,185 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 }
 
 
-static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
-                             const AVFrame *frame, int *got_packet_ptr)
+static FlacFrame *get_frame(FlacEncodeContext *s, int idx)
 {
-    FlacEncodeContext *s;
-    int frame_bytes, out_bytes, ret;
+    return &s->frames[(s->first_frame + idx) % s->nb_frames];
+}
 
-    s = avctx->priv_data;
 
-    /* when the last block is reached, update the header in extradata */
-    if (!frame) {
-        s->max_framesize = s->max_encoded_framesize;
-        av_md5_final(s->md5ctx, s->md5sum);
-        write_streaminfo(s, avctx->extradata);
+static int prepare_frame_job(AVCodecContext *avctx, void *arg,
+                             int jobnr, int threadnr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacFrame *frame     = get_frame(s, jobnr);
 
-        if (!s->flushed) {
-            uint8_t *side_data = av_packet_new_side_data(avpkt, AV_PKT_DATA_NEW_EXTRADATA,
-                                                         avctx->extradata_size);
-            if (!side_data)
-                return AVERROR(ENOMEM);
-            memcpy(side_data, avctx->extradata, avctx->extradata_size);
+    channel_decorrelation(s, frame);
 
-            avpkt->pts = s->next_pts;
+    remove_wasted_bits(s, frame);
 
-            *got_packet_ptr = 1;
-            s->flushed = 1;
-        }
+    return 0;
+}
 
-        return 0;
-    }
 
-    /* change max_framesize for small final frame */
-    if (frame->nb_samples < s->frame.blocksize) {
-        s->max_framesize = flac_get_max_frame_size(frame->nb_samples,
-                                                   s->channels,
-                                                   avctx->bits_per_raw_sample);
-    }
+static int encode_channel_job(AVCodecContext *avctx, void *arg,
+                              int jobnr, int threadnr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacFrame *frame     = get_frame(s, jobnr / s->channels);
+    int ch               = jobnr % s->channels;
 
-    init_frame(s, frame->nb_samples);
+    frame->subframes[ch].count = encode_residual_ch(s, frame,
+                                                    &s->lpc_ctx[threadnr], ch);
+    return 0;
+}
 
-    copy_samples(s, frame->data[0]);
 
-    channel_decorrelation(s);
+static int write_frame_job(AVCodecContext *avctx, void *arg,
+                           int jobnr, int threadnr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacFrame *frame     = get_frame(s, jobnr);
+    int max_framesize, frame_bytes;
 
-    remove_wasted_bits(s);
+    /* the final frame may be smaller than the others */
+    max_framesize = flac_get_max_frame_size(frame->blocksize, s->channels,
+                                            avctx->bits_per_raw_sample);
 
-    frame_bytes = encode_frame(s);
+    frame_bytes = count_frame(s, frame);
 
     /* Fall back on verbatim mode if the compressed frame is larger than it
        would be if encoded uncompressed. */
-    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
-        s->frame.verbatim_only = 1;
-        frame_bytes = encode_frame(s);
+    if (frame_bytes < 0 || frame_bytes > max_framesize) {
+        frame->verbatim_only = 1;
+        frame_bytes = encode_frame(s, frame, NULL);
         if (frame_bytes < 0) {
             av_log(avctx, AV_LOG_ERROR, "Bad frame count\n");
+            frame->size = frame_bytes;
             return frame_bytes;
         }
     }
 
-    if ((ret = ff_get_encode_buffer(avctx, avpkt, frame_bytes, 0)) < 0)
-        return ret;
+    frame->size = write_frame(s, frame, frame->buf, frame_bytes);
+    return 0;
+}
+
+
+/**
+ * Encode all pending frames. Frames are independent of each other, and
+ * so are the channels of a frame once decorrelated, so both are run as
+ * separate slice thread jobs.
+ */
+static int encode_pending_frames(AVCodecContext *avctx)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    int i;
 
-    out_bytes = write_frame(s, avpkt);
+    avctx->execute2(avctx, prepare_frame_job,  NULL, NULL, s->nb_pending);
+    avctx->execute2(avctx, encode_channel_job, NULL, NULL,
+                    s->nb_pending * s->channels);
+    avctx->execute2(avctx, write_frame_job,    NULL, NULL, s->nb_pending);
 
-    s->frame_count++;
-    s->sample_count += frame->nb_samples;
-    if ((ret = update_md5_sum(s, frame->data[0])) < 0) {
-        av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
-        return ret;
+    for (i = 0; i < s->nb_pending; i++) {
+        FlacFrame *frame = get_frame(s, i);
+        if (frame->size < 0)
+            return frame->size;
     }
-    if (out_bytes > s->max_encoded_framesize)
-        s->max_encoded_framesize = out_bytes;
-    if (out_bytes < s->min_framesize)
-        s->min_framesize = out_bytes;
+    s->nb_coded = s->nb_pending;
+
+    return 0;
+}
+
 
-    s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
+static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
+                             const AVFrame *frame, int *got_packet_ptr)
+{
+    FlacEncodeContext *s;
+    FlacFrame *f;
+    int ret;
+
+    s = avctx->priv_data;
+
+    if (frame) {
+        f = get_frame(s, s->nb_pending);
+
+        init_frame(s, f, frame->nb_samples);
+
+        copy_samples(s, f, frame->data[0]);
+
+        f->frame_count = s->frame_count++;
+        f->pts         = frame->pts;
+        f->duration    = frame->duration ? frame->duration :
+                         ff_samples_to_time_base(avctx, frame->nb_samples);
+        if (avctx->flags & AV_CODEC_FLAG_COPY_OPAQUE) {
+            ret = av_buffer_replace(&f->opaque_ref, frame->opaque_ref);
+            if (ret < 0)
+                return ret;
+            f->opaque = frame->opaque;
+        }
+        s->nb_pending++;
+
+        s->sample_count += frame->nb_samples;
+        if ((ret = update_md5_sum(s, frame->data[0], frame->nb_samples)) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+            return ret;
+        }
+
+        s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
+    }
+
+    if (!s->nb_coded && s->nb_pending &&
+        (s->nb_pending == s->nb_frames || !frame)) {
+        if ((ret = encode_pending_frames(avctx)) < 0)
+            return ret;
+    }
 
-    av_shrink_packet(avpkt, out_bytes);
+    /* output the oldest encoded frame */
+    if (s->nb_coded) {
+        f = get_frame(s, 0);
+
+        if ((ret = ff_get_encode_buffer(avctx, avpkt, f->size, 0)) < 0)
+            return ret;
+        memcpy(avpkt->data, f->buf, f->size);
+
+        avpkt->pts         = f->pts;
+        avpkt->duration    = f->duration;
+        avpkt->opaque      = f->opaque;
+        avpkt->opaque_ref  = f->opaque_ref;
+        f->opaque_ref      = NULL;
+
+        if (f->size > s->max_encoded_framesize)
+            s->max_encoded_framesize = f->size;
+        if (f->size < s->min_framesize)
+            s->min_framesize = f->size;
+
+        s->first_frame = (s->first_frame + 1) % s->nb_frames;
+        s->nb_pending--;
+        s->nb_coded--;
+
+        *got_packet_ptr = 1;
+        return 0;
+    }
+
+    /* when the last block is reached, update the header in extradata */
+    if (!frame) {
+        s->max_framesize = s->max_encoded_framesize;
+        av_md5_final(s->md5ctx, s->md5sum);
+        write_streaminfo(s, avctx->extradata);
+
+        if (!s->flushed) {
+            uint8_t *side_data = av_packet_new_side_data(avpkt, AV_PKT_DATA_NEW_EXTRADATA,
+                                                         avctx->extradata_size);
+            if (!side_data)
+                return AVERROR(ENOMEM);
+            memcpy(side_data, avctx->extradata, avctx->extradata_size);
+
+            avpkt->pts = s->next_pts;
+
+            *got_packet_ptr = 1;
+            s->flushed = 1;
+        }
+    }
 
-    *got_packet_ptr = 1;
     return 0;
 }
 
@@ -1705,7 +1858,18 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
-    ff_lpc_end(&s->lpc_ctx);
+    if (s->frames) {
+        for (int i = 0; i < s->nb_frames; i++) {
+            av_freep(&s->frames[i].buf);
+            av_buffer_unref(&s->frames[i].opaque_ref);
+        }
+        av_freep(&s->frames);
+    }
+    if (s->lpc_ctx) {
+        for (int i = 0; i < s->nb_lpc_ctx; i++)
+            ff_lpc_end(&s->lpc_ctx[i]);
+        av_freep(&s->lpc_ctx);
+    }
     return 0;
 }
 
@@ -1755,6 +1919,7 @@ const FFCodec ff_flac_encoder = {
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                       AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
@@ -1762,5 +1927,5 @@ const FFCodec ff_flac_encoder = {
     .close          = flac_encode_close,
     CODEC_SAMPLEFMTS(AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32),
     .p.priv_class   = &flac_encoder_class,
-    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_EOF_FLUSH,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
 };
@@ -2744,7 +2744,14 @@ static void hls_decode_neighbour(HEVCLocalContext *lc,
     lc->ctb_up_left_flag = ((x_ctb > 0) && (y_ctb > 0)  && (ctb_addr_in_slice-1 >= sps->ctb_width) && (pps->tile_id[ctb_addr_ts] == pps->tile_id[pps->ctb_addr_rs_to_ts[ctb_addr_rs-1 - sps->ctb_width]]));
 }
 
-static int hls_decode_entry(HEVCContext *s, GetBitContext *gb)
+/**
+ * Decode the CTBs of a slice segment without tiles or WPP entry points.
+ *
+ * @param pipelined if set, the in-loop filters are left to the filter jobs of
+ *                  hls_slice_data_pipelined() and the CTB progress is reported
+ *                  in wpp_progress[0] instead
+ */
+static int hls_decode_entry(HEVCContext *s, GetBitContext *gb, int pipelined)
 {
     HEVCLocalContext *const lc = &s->local_ctx[0];
     const HEVCLayerContext *const l = &s->layers[s->cur_layer];
@@ -2769,7 +2776,7 @@ static int hls_decode_entry(HEVCContext *s, GetBitContext *gb)
         ret = ff_hevc_cabac_init(lc, pps, ctb_addr_ts, slice_data, slice_size, 0);
         if (ret < 0) {
             l->tab_slice_address[ctb_addr_rs] = -1;
-            return ret;
+            goto end;
         }
 
         hls_sao_param(lc, l, pps, sps,
@@ -2782,20 +2789,31 @@ static int hls_decode_entry(HEVCContext *s, GetBitContext *gb)
         more_data = hls_coding_quadtree(lc, l, pps, sps, x_ctb, y_ctb, sps->log2_ctb_size, 0);
         if (more_data < 0) {
             l->tab_slice_address[ctb_addr_rs] = -1;
-            return more_data;
+            ret = more_data;
+            goto end;
         }
 
 
         ctb_addr_ts++;
         ff_hevc_save_states(lc, pps, ctb_addr_ts);
-        ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
+        if (pipelined)
+            ff_thread_progress_report(&s->wpp_progress[0], ctb_addr_ts);
+        else
+            ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
     }
 
-    if (x_ctb + ctb_size >= sps->width &&
+    if (!pipelined &&
+        x_ctb + ctb_size >= sps->width &&
         y_ctb + ctb_size >= sps->height)
         ff_hevc_hls_filter(lc, l, pps, x_ctb, y_ctb, ctb_size);
 
-    return ctb_addr_ts;
+    ret = ctb_addr_ts;
+end:
+    if (pipelined) {
+        atomic_store(&s->filter_ctb_end, ctb_addr_ts);
+        ff_thread_progress_report(&s->wpp_progress[0], INT_MAX);
+    }
+    return ret;
 }
 
 static int hls_decode_entry_wpp(AVCodecContext *avctx, void *hevc_lclist,
@@ -2919,27 +2937,10 @@ static int wpp_progress_init(HEVCContext *s, unsigned count)
     return 0;
 }
 
-static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
+static int local_ctx_init(HEVCContext *s, unsigned count)
 {
-    const HEVCPPS *const pps = s->pps;
-    const HEVCSPS *const sps = pps->sps;
-    const uint8_t *data = nal->data;
-    int length          = nal->size;
-    int *ret;
-    int64_t offset;
-    int64_t startheader, cmpt = 0;
-    int i, j, res = 0;
-
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * sps->ctb_width >= sps->ctb_width * sps->ctb_height) {
-        av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
-            s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
-            sps->ctb_width, sps->ctb_height
-        );
-        return AVERROR_INVALIDDATA;
-    }
-
-    if (s->avctx->thread_count > s->nb_local_ctx) {
-        HEVCLocalContext *tmp = av_malloc_array(s->avctx->thread_count, sizeof(*s->local_ctx));
+    if (count > s->nb_local_ctx) {
+        HEVCLocalContext *tmp = av_malloc_array(count, sizeof(*s->local_ctx));
 
         if (!tmp)
             return AVERROR(ENOMEM);
@@ -2948,7 +2949,7 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         av_free(s->local_ctx);
         s->local_ctx = tmp;
 
-        for (unsigned i = s->nb_local_ctx; i < s->avctx->thread_count; i++) {
+        for (unsigned i = s->nb_local_ctx; i < count; i++) {
             tmp = &s->local_ctx[i];
 
             memset(tmp, 0, sizeof(*tmp));
@@ -2958,9 +2959,35 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
             tmp->common_cabac_state = &s->cabac;
         }
 
-        s->nb_local_ctx = s->avctx->thread_count;
+        s->nb_local_ctx = count;
+    }
+
+    return 0;
+}
+
+static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
+{
+    const HEVCPPS *const pps = s->pps;
+    const HEVCSPS *const sps = pps->sps;
+    const uint8_t *data = nal->data;
+    int length          = nal->size;
+    int *ret;
+    int64_t offset;
+    int64_t startheader, cmpt = 0;
+    int i, j, res = 0;
+
+    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * sps->ctb_width >= sps->ctb_width * sps->ctb_height) {
+        av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
+            s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
+            sps->ctb_width, sps->ctb_height
+        );
+        return AVERROR_INVALIDDATA;
     }
 
+    res = local_ctx_init(s, s->avctx->thread_count);
+    if (res < 0)
+        return res;
+
     offset = s->sh.data_offset;
 
     for (j = 0, cmpt = 0, startheader = offset + s->sh.entry_point_offset[0]; j < nal->skipped_bytes; j++) {
@@ -3021,6 +3048,119 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     return res;
 }
 
+/*
+ * CTB level pipelining of slice segments without tiles or WPP entry points.
+ *
+ * Task 0 parses and reconstructs the CTBs in order and reports the number of
+ * decoded CTBs in wpp_progress[0]. Task n > 0 runs the deblocking and SAO
+ * calls triggered by the CTBs of the n-th CTB row of the slice, i.e. the same
+ * ff_hevc_hls_filters() calls as the serial decoder, and reports its progress
+ * in wpp_progress[n]. A filter row stays three CTBs behind the row above, so
+ * that the pixels it deblocks and SAO filters are never touched by the row
+ * above at the same time, and it only reads reconstructed samples the
+ * decoding task no longer predicts from.
+ *
+ * The tasks are not tied to the execute2() jobs: each job takes the next task
+ * when it starts and after finishing one, so a task only ever waits for tasks
+ * that are already running or done, whatever the order and the concurrency
+ * the jobs are run with.
+ *
+ * @return 1 if the row starts after the end of the slice, 0 otherwise
+ */
+static int hls_filter_row_pipelined(HEVCLocalContext *lc, const HEVCContext *s,
+                                    int task)
+{
+    const HEVCLayerContext *const l = &s->layers[s->cur_layer];
+    const HEVCPPS   *const pps = s->pps;
+    const HEVCSPS   *const sps = pps->sps;
+    const int ctb_size  = 1 << sps->log2_ctb_size;
+    const int ctb_row   = s->sh.slice_ctb_addr_rs / sps->ctb_width + task - 1;
+    const int ctb_start = FFMAX(ctb_row * sps->ctb_width, s->sh.slice_ctb_addr_rs);
+    const int ctb_end   = (ctb_row + 1) * sps->ctb_width;
+    int past_end = 0;
+
+    for (int ctb_addr = ctb_start; ctb_addr < ctb_end; ctb_addr++) {
+        const int x_ctb = (ctb_addr % sps->ctb_width) << sps->log2_ctb_size;
+        const int y_ctb = ctb_row << sps->log2_ctb_size;
+        const int x     = ctb_addr % sps->ctb_width;
+
+        ff_thread_progress_await(&s->wpp_progress[0], ctb_addr + 1);
+        if (task > 1)
+            ff_thread_progress_await(&s->wpp_progress[task - 1],
+                                     FFMIN(x + 3, sps->ctb_width));
+
+        /* Casting const away here is safe, because it is an atomic operation. */
+        if (ctb_addr >= atomic_load((atomic_int*)&s->filter_ctb_end)) {
+            past_end = ctb_addr == ctb_start;
+            break;
+        }
+
+        ff_hevc_hls_filters(lc, l, pps, x_ctb, y_ctb, ctb_size);
+        if (ctb_addr == sps->ctb_size - 1)
+            ff_hevc_hls_filter(lc, l, pps, x_ctb, y_ctb, ctb_size);
+
+        ff_thread_progress_report(&s->wpp_progress[task], x + 1);
+    }
+    ff_thread_progress_report(&s->wpp_progress[task], INT_MAX);
+
+    return past_end;
+}
+
+static int hls_slice_entry_pipelined(AVCodecContext *avctx, void *hevc_lclist,
+                                     int job, int thread)
+{
+    HEVCLocalContext *lc = &((HEVCLocalContext*)hevc_lclist)[thread + 1];
+    HEVCContext *const s = avctx->priv_data;
+    int ret = 0;
+    int task;
+
+    while ((task = atomic_fetch_add(&s->pipeline_task, 1)) < s->nb_pipeline_tasks) {
+        if (!task)
+            ret = hls_decode_entry(s, s->data_gb, 1);
+        else if (hls_filter_row_pipelined(lc, s, task))
+            break;
+    }
+
+    return ret;
+}
+
+static int hls_slice_data_pipelined(HEVCContext *s, GetBitContext *gb)
+{
+    const HEVCSPS *const sps = s->pps->sps;
+    const int nb_rows = sps->ctb_height - s->sh.slice_ctb_addr_rs / sps->ctb_width;
+    const int nb_jobs = FFMIN(s->avctx->thread_count, nb_rows + 1);
+    int *ret;
+    int res;
+
+    // the decoding task keeps using local_ctx[0], the jobs get their own
+    res = local_ctx_init(s, s->avctx->thread_count + 1);
+    if (res < 0)
+        return res;
+
+    res = wpp_progress_init(s, nb_rows + 1);
+    if (res < 0)
+        return res;
+
+    ret = av_calloc(nb_jobs, sizeof(*ret));
+    if (!ret)
+        return AVERROR(ENOMEM);
+
+    s->data_gb = gb;
+    s->nb_pipeline_tasks = nb_rows + 1;
+    atomic_store(&s->pipeline_task, 0);
+    atomic_store(&s->filter_ctb_end, INT_MAX);
+    s->avctx->execute2(s->avctx, hls_slice_entry_pipelined, s->local_ctx, ret, nb_jobs);
+
+    // only the job that ran the decoding task returns something else than 0
+    res = 0;
+    for (int i = 0; i < nb_jobs; i++)
+        if (ret[i])
+            res = ret[i];
+
+    av_free(ret);
+    return res;
+}
+
 static int decode_slice_data(HEVCContext *s, const HEVCLayerContext *l,
                              const H2645NAL *nal, GetBitContext *gb)
 {
@@ -3072,7 +3212,11 @@ static int decode_slice_data(HEVCContext *s, const HEVCLayerContext *l,
         pps->num_tile_rows == 1 && pps->num_tile_columns == 1)
         return hls_slice_data_wpp(s, nal);
 
-    return hls_decode_entry(s, gb);
+    if (s->avctx->active_thread_type == FF_THREAD_SLICE &&
+        s->avctx->thread_count > 1 && !pps->tiles_enabled_flag)
+        return hls_slice_data_pipelined(s, gb);
+
+    return hls_decode_entry(s, gb, 0);
 }
 
 static int set_side_data(HEVCContext *s)
@@ -4112,6 +4256,7 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     s->eos = 1;
 
     atomic_init(&s->wpp_err, 0);
+    atomic_init(&s->filter_ctb_end, 0);
 
     if (!avctx->internal->is_copy) {
         const AVPacketSideData *sd;
@@ -551,6 +551,13 @@ typedef struct HEVCContext {
 
     atomic_int wpp_err;
 
+    /** slice data and number of decoded CTBs of the pipelined slice decoding */
+    GetBitContext *data_gb;
+    atomic_int     filter_ctb_end;
+    /** next task of the pipelined slice decoding and number of tasks */
+    atomic_int     pipeline_task;
+    int            nb_pipeline_tasks;
+
     const uint8_t *data;
 
     H2645Packet pkt;
@@ -70,6 +70,7 @@
 #include "encode.h"
 #include "bytestream.h"
 #include "jpeg2000.h"
+#include "jpeg2000htenc.h"
 #include "version.h"
 #include "libavutil/common.h"
 #include "libavutil/mem.h"
@@ -87,6 +88,20 @@
 #define CODEC_JP2 1
 #define CODEC_J2K 0
 
+/**
+ * A code-block to be coded by tier-1, with its position in the
+ * coefficients of the component.
+ */
+typedef struct Jpeg2000CblkJob {
+    Jpeg2000Component *comp;
+    Jpeg2000Band *band;
+    Jpeg2000Cblk *cblk;
+    int x0, x1, y0, y1;
+    int bandpos;
+    int gbandno;                ///< index of the band in the quantization parameters
+    int lev;
+} Jpeg2000CblkJob;
+
 static int lut_nmsedec_ref [1<<NMSEDEC_BITS],
            lut_nmsedec_ref0[1<<NMSEDEC_BITS],
            lut_nmsedec_sig [1<<NMSEDEC_BITS],
@@ -144,6 +159,15 @@ typedef struct {
     int prog;
     int nlayers;
     char *lr_str;
+    int ht;
+
+    // slice threading: the DWT runs per tile component and tier-1 per code-block
+    Jpeg2000T1Context *t1;       ///< one per thread
+    int nb_t1;
+    Jpeg2000CblkJob *cblk_jobs;
+    int nb_cblk_jobs;
+    int *dwt_ret;
+    Jpeg2000HTEncContext *ht_enc; ///< one per thread, HT block coder state
 } Jpeg2000EncoderContext;
 
 
@@ -307,7 +331,7 @@ static int put_siz(Jpeg2000EncoderContext *s)
 
     bytestream_put_be16(&s->buf, JPEG2000_SIZ);
     bytestream_put_be16(&s->buf, 38 + 3 * s->ncomponents); // Lsiz
-    bytestream_put_be16(&s->buf, 0); // Rsiz
+    bytestream_put_be16(&s->buf, s->ht ? 1 << 14 : 0); // Rsiz, bit 14 signals the CAP marker
     bytestream_put_be32(&s->buf, s->width); // width
     bytestream_put_be32(&s->buf, s->height); // height
     bytestream_put_be32(&s->buf, 0); // X0Siz
@@ -327,6 +351,28 @@ static int put_siz(Jpeg2000EncoderContext *s)
     return 0;
 }
 
+static int put_cap(Jpeg2000EncoderContext *s)
+{
+    Jpeg2000QuantStyle *qntsty = &s->qntsty;
+    int i, B = 0, ccap15;
+
+    if (s->buf_end - s->buf < 10)
+        return -1;
+
+    // B is the largest number of magnitude bit-planes of any band
+    for (i = 0; i < 3 * s->codsty.nreslevels - 2; i++)
+        B = FFMAX(B, qntsty->expn[i] + qntsty->nguardbits - 1);
+    ccap15 = FFMAX(B - 8, 0);
+    if (s->codsty.transform != FF_DWT53)
+        ccap15 |= 1 << 5; // HTIRV
+
+    bytestream_put_be16(&s->buf, JPEG2000_CAP);
+    bytestream_put_be16(&s->buf, 8); // Lcap
+    bytestream_put_be32(&s->buf, 1 << (31 - 14)); // Pcap, Part 15 capabilities
+    bytestream_put_be16(&s->buf, ccap15); // Ccap15, HTONLY, single HT set, RGNFREE, HOMOGENEOUS
+    return 0;
+}
+
 static int put_cod(Jpeg2000EncoderContext *s)
 {
     Jpeg2000CodingStyle *codsty = &s->codsty;
@@ -354,7 +400,7 @@ static int put_cod(Jpeg2000EncoderContext *s)
     bytestream_put_byte(&s->buf, codsty->nreslevels - 1); // num of decomp. levels
     bytestream_put_byte(&s->buf, codsty->log2_cblk_width-2); // cblk width
     bytestream_put_byte(&s->buf, codsty->log2_cblk_height-2); // cblk height
-    bytestream_put_byte(&s->buf, 0); // cblk style
+    bytestream_put_byte(&s->buf, codsty->cblk_style); // cblk style
     bytestream_put_byte(&s->buf, codsty->transform == FF_DWT53); // transformation
     return 0;
 }
@@ -596,6 +642,7 @@ static void init_luts(void)
                                     << 1, 0);
     }
     ff_jpeg2000_init_tier1_luts();
+    ff_jpeg2000_ht_init_tables();
 }
 
 /* tier-1 routines */
@@ -704,7 +751,7 @@ static void encode_clnpass(Jpeg2000T1Context *t1, int width, int height, int ban
         }
 }
 
-static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg2000Cblk *cblk, Jpeg2000Tile *tile,
+static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg2000Cblk *cblk,
                         int width, int height, int bandpos, int lev)
 {
     int pass_t = 2, passno, x, y, max=0, nmsedec, bpno;
@@ -764,6 +811,111 @@ static void encode_cblk(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1, Jpeg20
     }
 }
 
+static int64_t get_lambda_prime(Jpeg2000EncoderContext *s, const Jpeg2000Band *band,
+                                int bandpos, int lev)
+{
+    int64_t dwt_norm = dwt_norms[s->codsty.transform == FF_DWT53][bandpos][lev] * (int64_t)band->i_stepsize >> 15;
+    return av_rescale(s->lambda, 1 << WMSEDEC_SHIFT, dwt_norm * dwt_norm);
+}
+
+/**
+ * Code a code-block with a single HT cleanup pass. Unlike EBCOT the pass
+ * cannot be truncated afterwards, so the least significant bit-plane to
+ * code is chosen here from estimated rates and the exact distortions.
+ */
+static void encode_cblk_ht(Jpeg2000EncoderContext *s, Jpeg2000T1Context *t1,
+                           Jpeg2000HTEncContext *ht, const Jpeg2000CblkJob *job)
+{
+    Jpeg2000Cblk *cblk = job->cblk;
+    const int width  = job->x1 - job->x0;
+    const int height = job->y1 - job->y0;
+    const int M_b = s->qntsty.expn[job->gbandno] + s->qntsty.nguardbits - 1;
+    int64_t disto[32] = { 0 };
+    int64_t cost[32]  = { 0 }; // estimated rate in half bits
+    int x, y, p, nplanes, pmin, max = 0;
+
+    cblk->npasses     = 0;
+    cblk->ninclpasses = 0;
+    cblk->nonzerobits = 0;
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            max = FFMAX(max, FFABS(t1->data[y * t1->stride + x]));
+    if (!(max >> NMSEDEC_FRACBITS))
+        return;
+    nplanes = FFMIN(av_log2(max) + 1 - NMSEDEC_FRACBITS, M_b);
+
+    // the exponent bound of the quads must not exceed M_b - p
+    for (pmin = 0; pmin < nplanes; pmin++) {
+        int mu = max >> (pmin + NMSEDEC_FRACBITS);
+        if (pmin < M_b && av_log2(2 * mu - 1) + 1 <= M_b - pmin)
+            break;
+    }
+    if (pmin == nplanes)
+        return;
+
+    for (y = 0; y < height; y += 2) {
+        for (x = 0; x < width; x += 2) {
+            int a[4] = { 0 }, qmax = 0, i;
+
+            for (i = 0; i < 4; i++) {
+                int xx = x + (i >> 1), yy = y + (i & 1);
+                if (xx < width && yy < height)
+                    a[i] = FFABS(t1->data[yy * t1->stride + xx]);
+                qmax = FFMAX(qmax, a[i]);
+            }
+            for (p = pmin; p < nplanes; p++) {
+                const int sh = p + NMSEDEC_FRACBITS;
+                int nsig = 0;
+
+                if (!(qmax >> sh)) {
+                    cost[p]++;
+                    continue;
+                }
+                for (i = 0; i < 4; i++) {
+                    int mu = a[i] >> sh;
+                    if (mu) {
+                        int64_t err = a[i] - ((2 * mu + 1) << (sh - 1));
+                        disto[p] += (int64_t)a[i] * a[i] - err * err;
+                        nsig++;
+                    }
+                }
+                cost[p] += 2 * (3 + nsig * (av_log2(2 * (qmax >> sh) - 1) + 1));
+            }
+        }
+    }
+
+    p = pmin;
+    if (s->lambda && !s->compression_rate_enc) {
+        int64_t lambda_prime = get_lambda_prime(s, job->band, job->bandpos, job->lev);
+        int64_t best = 0;
+
+        p = nplanes;
+        for (int i = pmin; i < nplanes; i++) {
+            // distortion in wmsedec units, rate in bytes as in getcut()
+            int64_t j = 2 * disto[i] - av_rescale(lambda_prime, cost[i], 16);
+            if (j >= best) {
+                best = j;
+                p    = i;
+            }
+        }
+    }
+
+    for (; p < nplanes; p++) {
+        int ret = ff_jpeg2000_encode_htj2k(ht, cblk->data + 1, 8192, t1->data, t1->stride,
+                                           width, height, p + NMSEDEC_FRACBITS);
+        if (ret >= 0) {
+            cblk->nonzerobits           = p + 1;
+            cblk->npasses               = 1;
+            cblk->ninclpasses           = 1;
+            cblk->passes[0].rate        = ret;
+            cblk->passes[0].disto       = 2 * disto[p];
+            cblk->passes[0].flushed_len = 0;
+            return;
+        }
+    }
+}
+
 /* tier-2 routines: */
 
 static void putnumpasses(Jpeg2000EncoderContext *s, int n)
@@ -1384,8 +1536,7 @@ static void truncpasses(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile)
                     Jpeg2000Band *band = reslevel->band + bandno;
                     Jpeg2000Prec *prec = band->prec + precno;
 
-                    int64_t dwt_norm = dwt_norms[codsty->transform == FF_DWT53][bandpos][lev] * (int64_t)band->i_stepsize >> 15;
-                    int64_t lambda_prime = av_rescale(s->lambda, 1 << WMSEDEC_SHIFT, dwt_norm * dwt_norm);
+                    int64_t lambda_prime = get_lambda_prime(s, band, bandpos, lev);
                     for (cblkno = 0; cblkno < prec->nb_codeblocks_height * prec->nb_codeblocks_width; cblkno++){
                         Jpeg2000Cblk *cblk = prec->cblk + cblkno;
 
@@ -1402,21 +1553,63 @@ static void truncpasses(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile)
     }
 }
 
-static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno)
+static int dwt_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    Jpeg2000EncoderContext *s = avctx->priv_data;
+    Jpeg2000Component *comp = s->tile[jobnr / s->ncomponents].comp + jobnr % s->ncomponents;
+
+    return ff_dwt_encode(&comp->dwt, comp->i_data);
+}
+
+static int tier1_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    Jpeg2000EncoderContext *s = avctx->priv_data;
+    const Jpeg2000CblkJob *job = &s->cblk_jobs[jobnr];
+    const Jpeg2000Component *comp = job->comp;
+    const int w = comp->coord[0][1] - comp->coord[0][0];
+    Jpeg2000T1Context *t1 = &s->t1[threadnr];
+    int y, x;
+
+    t1->stride = (1<<s->codsty.log2_cblk_width) + 2;
+
+    if (s->codsty.transform == FF_DWT53){
+        for (y = job->y0; y < job->y1; y++){
+            int *ptr = t1->data + (y-job->y0)*t1->stride;
+            for (x = job->x0; x < job->x1; x++){
+                *ptr++ = comp->i_data[w * y + x] * (1 << NMSEDEC_FRACBITS);
+            }
+        }
+    } else{
+        for (y = job->y0; y < job->y1; y++){
+            int *ptr = t1->data + (y-job->y0)*t1->stride;
+            for (x = job->x0; x < job->x1; x++){
+                *ptr = (comp->i_data[w * y + x]);
+                *ptr = (int64_t)*ptr * (int64_t)(16384 * 65536 / job->band->i_stepsize) >> 15 - NMSEDEC_FRACBITS;
+                ptr++;
+            }
+        }
+    }
+    if (s->ht)
+        encode_cblk_ht(s, t1, &s->ht_enc[threadnr], job);
+    else
+        encode_cblk(s, t1, job->cblk, job->x1 - job->x0, job->y1 - job->y0,
+                    job->bandpos, job->lev);
+    return 0;
+}
+
+/**
+ * List the code-blocks of all tiles for tier-1; the layout only depends on
+ * the encoder parameters so this is done once.
+ */
+static int init_cblk_jobs(Jpeg2000EncoderContext *s)
 {
-    int compno, reslevelno, bandno, ret;
-    Jpeg2000T1Context t1;
     Jpeg2000CodingStyle *codsty = &s->codsty;
+    int tileno, compno, reslevelno, bandno, nb_allocated = 0;
+
+    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++){
     for (compno = 0; compno < s->ncomponents; compno++){
         Jpeg2000Component *comp = s->tile[tileno].comp + compno;
 
-        t1.stride = (1<<codsty->log2_cblk_width) + 2;
-
-        av_log(s->avctx, AV_LOG_DEBUG,"dwt\n");
-        if ((ret = ff_dwt_encode(&comp->dwt, comp->i_data)) < 0)
-            return ret;
-        av_log(s->avctx, AV_LOG_DEBUG,"after dwt -> tier1\n");
-
         for (reslevelno = 0; reslevelno < codsty->nreslevels; reslevelno++){
             Jpeg2000ResLevel *reslevel = comp->reslevel + reslevelno;
 
@@ -1444,23 +1637,14 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
                                 band->coord[0][1]) - band->coord[0][0] + xx0;
 
                     for (cblkx = 0; cblkx < prec->nb_codeblocks_width; cblkx++, cblkno++){
-                        int y, x;
-                        if (codsty->transform == FF_DWT53){
-                            for (y = yy0; y < yy1; y++){
-                                int *ptr = t1.data + (y-yy0)*t1.stride;
-                                for (x = xx0; x < xx1; x++){
-                                    *ptr++ = comp->i_data[(comp->coord[0][1] - comp->coord[0][0]) * y + x] * (1 << NMSEDEC_FRACBITS);
-                                }
-                            }
-                        } else{
-                            for (y = yy0; y < yy1; y++){
-                                int *ptr = t1.data + (y-yy0)*t1.stride;
-                                for (x = xx0; x < xx1; x++){
-                                    *ptr = (comp->i_data[(comp->coord[0][1] - comp->coord[0][0]) * y + x]);
-                                    *ptr = (int64_t)*ptr * (int64_t)(16384 * 65536 / band->i_stepsize) >> 15 - NMSEDEC_FRACBITS;
-                                    ptr++;
-                                }
-                            }
+                        Jpeg2000CblkJob *job;
+
+                        if (s->nb_cblk_jobs == nb_allocated) {
+                            int ret;
+                            nb_allocated = FFMAX(2 * nb_allocated, 256);
+                            ret = av_reallocp_array(&s->cblk_jobs, nb_allocated, sizeof(*s->cblk_jobs));
+                            if (ret < 0)
+                                return ret;
                         }
                         if (!prec->cblk[cblkno].data)
                             prec->cblk[cblkno].data = av_malloc(1 + 8192);
@@ -1468,8 +1652,19 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
                             prec->cblk[cblkno].passes = av_malloc_array(JPEG2000_MAX_PASSES, sizeof (*prec->cblk[cblkno].passes));
                         if (!prec->cblk[cblkno].data || !prec->cblk[cblkno].passes)
                             return AVERROR(ENOMEM);
-                        encode_cblk(s, &t1, prec->cblk + cblkno, tile, xx1 - xx0, yy1 - yy0,
-                                    bandpos, codsty->nreslevels - reslevelno - 1);
+
+                        job = &s->cblk_jobs[s->nb_cblk_jobs++];
+                        job->comp    = comp;
+                        job->band    = band;
+                        job->cblk    = prec->cblk + cblkno;
+                        job->x0      = xx0;
+                        job->x1      = xx1;
+                        job->y0      = yy0;
+                        job->y1      = yy1;
+                        job->bandpos = bandpos;
+                        job->gbandno = reslevelno ? 3 * reslevelno - 3 + bandpos : 0;
+                        job->lev     = codsty->nreslevels - reslevelno - 1;
+
                         xx0 = xx1;
                         xx1 = FFMIN(xx1 + (1 << band->log2_cblk_width), band->coord[0][1] - band->coord[0][0] + x0);
                     }
@@ -1478,8 +1673,14 @@ static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno
                 }
             }
         }
-        av_log(s->avctx, AV_LOG_DEBUG, "after tier1\n");
     }
+    }
+    return 0;
+}
+
+static int encode_tile(Jpeg2000EncoderContext *s, Jpeg2000Tile *tile, int tileno)
+{
+    int ret;
 
     av_log(s->avctx, AV_LOG_DEBUG, "rate control\n");
     if (s->compression_rate_enc)
@@ -1554,6 +1755,16 @@ static int encode_frame(AVCodecContext *avctx, AVPacket *pkt,
 
     reinit(s);
 
+    av_log(s->avctx, AV_LOG_DEBUG, "dwt\n");
+    avctx->execute2(avctx, dwt_job, NULL, s->dwt_ret,
+                    s->numXtiles * s->numYtiles * s->ncomponents);
+    for (int i = 0; i < s->numXtiles * s->numYtiles * s->ncomponents; i++)
+        if (s->dwt_ret[i] < 0)
+            return s->dwt_ret[i];
+    av_log(s->avctx, AV_LOG_DEBUG, "after dwt -> tier1\n");
+    avctx->execute2(avctx, tier1_job, NULL, NULL, s->nb_cblk_jobs);
+    av_log(s->avctx, AV_LOG_DEBUG, "after tier1\n");
+
     if (s->format == CODEC_JP2) {
         av_assert0(s->buf == pkt->data);
 
@@ -1635,6 +1846,8 @@ static int encode_frame(AVCodecContext *avctx, AVPacket *pkt,
     bytestream_put_be16(&s->buf, JPEG2000_SOC);
     if ((ret = put_siz(s)) < 0)
         return ret;
+    if (s->ht && (ret = put_cap(s)) < 0)
+        return ret;
     if ((ret = put_cod(s)) < 0)
         return ret;
     if ((ret = put_qcd(s, 0)) < 0)
@@ -1751,6 +1964,12 @@ static av_cold int j2kenc_init(AVCodecContext *avctx)
 
     qntsty->nguardbits       = 1;
 
+    if (s->ht) {
+        codsty->cblk_style = JPEG2000_CTSY_HTJ2K_F;
+        // the HT cleanup pass needs one more bit-plane of headroom
+        qntsty->nguardbits = 2;
+    }
+
     if ((s->tile_width  & (s->tile_width -1)) ||
         (s->tile_height & (s->tile_height-1))) {
         av_log(avctx, AV_LOG_WARNING, "Tile dimension not a power of 2\n");
@@ -1788,6 +2007,19 @@ static av_cold int j2kenc_init(AVCodecContext *avctx)
     init_quantization(s);
     if ((ret=init_tiles(s)) < 0)
         return ret;
+    if ((ret = init_cblk_jobs(s)) < 0)
+        return ret;
+
+    s->dwt_ret = av_calloc(s->numXtiles * s->numYtiles * s->ncomponents, sizeof(*s->dwt_ret));
+    s->nb_t1   = avctx->active_thread_type == FF_THREAD_SLICE ? avctx->thread_count : 1;
+    s->t1      = av_calloc(s->nb_t1, sizeof(*s->t1));
+    if (!s->dwt_ret || !s->t1)
+        return AVERROR(ENOMEM);
+    if (s->ht) {
+        s->ht_enc = av_calloc(s->nb_t1, sizeof(*s->ht_enc));
+        if (!s->ht_enc)
+            return AVERROR(ENOMEM);
+    }
 
     av_log(s->avctx, AV_LOG_DEBUG, "after init\n");
 
@@ -1799,6 +2031,10 @@ static int j2kenc_destroy(AVCodecContext *avctx)
     Jpeg2000EncoderContext *s = avctx->priv_data;
 
     cleanup(s);
+    av_freep(&s->cblk_jobs);
+    av_freep(&s->dwt_ret);
+    av_freep(&s->t1);
+    av_freep(&s->ht_enc);
     return 0;
 }
 
@@ -1824,6 +2060,7 @@ static const AVOption options[] = {
     { "pcrl",          NULL,                0,                     AV_OPT_TYPE_CONST,  { .i64 = JPEG2000_PGOD_PCRL }, 0,         0,           VE, .unit = "prog" },
     { "cprl",          NULL,                0,                     AV_OPT_TYPE_CONST,  { .i64 = JPEG2000_PGOD_CPRL }, 0,         0,           VE, .unit = "prog" },
     { "layer_rates",   "Layer Rates",       OFFSET(lr_str),        AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, VE },
+    { "ht",            "Use the High-Throughput (HTJ2K) block coder", OFFSET(ht), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, VE },
     { NULL }
 };
 
@@ -1840,7 +2077,7 @@ const FFCodec ff_jpeg2000_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_JPEG2000,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE |
-                      AV_CODEC_CAP_FRAME_THREADS,
+                      AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(Jpeg2000EncoderContext),
     .init           = j2kenc_init,
     FF_CODEC_ENCODE_CB(encode_frame),
@@ -92,6 +92,120 @@ static void sd_1d53(int *p, int i0, int i1)
         p[2*i] += (p[2*i-1] + p[2*i+1] + 2) >> 2;
 }
 
+/* Vertical passes of the encoder work on DWT_COLS neighbouring columns at
+ * once, interleaved in the column buffer, so that every lifting step is a
+ * run of independent lanes the compiler turns into SIMD, and the image is
+ * read and written in rows instead of one column at a time. */
+#define COL(p, i) ((p) + (i) * DWT_COLS)
+
+static void sd_cols53(int *p, int i0, int i1, int n)
+{
+    int i, k;
+
+    if (i1 <= i0 + 1) {
+        if (i0 == 1)
+            for (k = 0; k < n; k++)
+                COL(p, 1)[k] *= 2;
+        return;
+    }
+
+    for (k = 0; k < n; k++) {
+        COL(p, i0 - 1)[k] = COL(p, i0 + 1)[k];
+        COL(p, i1)[k]     = COL(p, i1 - 2)[k];
+        COL(p, i0 - 2)[k] = COL(p, i0 + 2)[k];
+        COL(p, i1 + 1)[k] = COL(p, i1 - 3)[k];
+    }
+
+    for (i = ((i0+1)>>1) - 1; i < (i1+1)>>1; i++) {
+        const int *a = COL(p, 2*i), *c = COL(p, 2*i+2);
+        int *b = COL(p, 2*i+1);
+        for (k = 0; k < n; k++)
+            b[k] -= (a[k] + c[k]) >> 1;
+    }
+    for (i = ((i0+1)>>1); i < (i1+1)>>1; i++) {
+        const int *a = COL(p, 2*i-1), *c = COL(p, 2*i+1);
+        int *b = COL(p, 2*i);
+        for (k = 0; k < n; k++)
+            b[k] += (a[k] + c[k] + 2) >> 2;
+    }
+}
+
+static void sd_cols97_int(int *p, int i0, int i1, int n)
+{
+    int i, k;
+
+    if (i1 <= i0 + 1) {
+        if (i0 == 1)
+            for (k = 0; k < n; k++)
+                COL(p, 1)[k] = (COL(p, 1)[k] * I_LFTG_X + (1<<14)) >> 15;
+        else
+            for (k = 0; k < n; k++)
+                COL(p, 0)[k] = (COL(p, 0)[k] * I_LFTG_K + (1<<15)) >> 16;
+        return;
+    }
+
+    for (i = 1; i <= 4; i++)
+        for (k = 0; k < n; k++) {
+            COL(p, i0 - i)[k]     = COL(p, i0 + i)[k];
+            COL(p, i1 + i - 1)[k] = COL(p, i1 - i - 1)[k];
+        }
+    i0++; i1++;
+
+    for (i = (i0>>1) - 2; i < (i1>>1) + 1; i++) {
+        const int *a = COL(p, 2*i), *c = COL(p, 2*i+2);
+        int *b = COL(p, 2*i+1);
+        for (k = 0; k < n; k++) {
+            const int64_t sum = a[k] + c[k];
+            b[k] -= sum;
+            b[k] -= (I_LFTG_ALPHA_PRIME * sum + (1 << 15)) >> 16;
+        }
+    }
+    for (i = (i0>>1) - 1; i < (i1>>1) + 1; i++) {
+        const int *a = COL(p, 2*i-1), *c = COL(p, 2*i+1);
+        int *b = COL(p, 2*i);
+        for (k = 0; k < n; k++)
+            b[k] -= (I_LFTG_BETA  * (a[k] + c[k]) + (1 << 15)) >> 16;
+    }
+    for (i = (i0>>1) - 1; i < (i1>>1); i++) {
+        const int *a = COL(p, 2*i), *c = COL(p, 2*i+2);
+        int *b = COL(p, 2*i+1);
+        for (k = 0; k < n; k++)
+            b[k] += (I_LFTG_GAMMA * (a[k] + c[k]) + (1 << 15)) >> 16;
+    }
+    for (i = (i0>>1); i < (i1>>1); i++) {
+        const int *a = COL(p, 2*i-1), *c = COL(p, 2*i+1);
+        int *b = COL(p, 2*i);
+        for (k = 0; k < n; k++)
+            b[k] += (I_LFTG_DELTA * (a[k] + c[k]) + (1 << 15)) >> 16;
+    }
+}
+
+/* vertical analysis of all columns of a w wide image, lv rows, mv = y0 & 1 */
+static void ver_sd_int(int *cols, int *t, int w, int lh, int lv, int mv,
+                       void (*sd)(int *p, int i0, int i1, int n))
+{
+    int *l = cols + mv * DWT_COLS;
+
+    for (int lp = 0; lp < lh; lp += DWT_COLS) {
+        const int n = FFMIN(lh - lp, DWT_COLS);
+        int i, j = 0, k;
+
+        for (i = 0; i < lv; i++)
+            for (k = 0; k < n; k++)
+                COL(l, i)[k] = t[w*i + lp + k];
+
+        sd(cols, mv, mv + lv, n);
+
+        // copy back and deinterleave
+        for (i =   mv; i < lv; i+=2, j++)
+            for (k = 0; k < n; k++)
+                t[w*j + lp + k] = COL(l, i)[k];
+        for (i = 1-mv; i < lv; i+=2, j++)
+            for (k = 0; k < n; k++)
+                t[w*j + lp + k] = COL(l, i)[k];
+    }
+}
+
 static void dwt_encode53(DWTContext *s, int *t)
 {
     int lev,
@@ -108,21 +222,7 @@ static void dwt_encode53(DWTContext *s, int *t)
         int *l;
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
-
-            for (i = 0; i < lv; i++)
-                l[i] = t[w*i + lp];
-
-            sd_1d53(line, mv, mv + lv);
-
-            // copy back and deinterleave
-            for (i =   mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
-            for (i = 1-mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
-        }
+        ver_sd_int(s->i_colbuf + 3 * DWT_COLS, t, w, lh, lv, mv, sd_cols53);
 
         // HOR_SD
         l = line + mh;
@@ -267,21 +367,7 @@ static void dwt_encode97_int(DWTContext *s, int *t)
         int *l;
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
-
-            for (i = 0; i < lv; i++)
-                l[i] = t[w*i + lp];
-
-            sd_1d97_int(line, mv, mv + lv);
-
-            // copy back and deinterleave
-            for (i =   mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
-            for (i = 1-mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
-        }
+        ver_sd_int(s->i_colbuf + 5 * DWT_COLS, t, w, lh, lv, mv, sd_cols97_int);
 
         // HOR_SD
         l = line + mh;
@@ -585,6 +671,14 @@ int ff_dwt_encode(DWTContext *s, void *t)
     if (s->ndeclevels == 0)
         return 0;
 
+    if (s->type != FF_DWT97 && !s->i_colbuf) {
+        int maxlen = FFMAX(s->linelen[s->ndeclevels - 1][0],
+                           s->linelen[s->ndeclevels - 1][1]);
+        s->i_colbuf = av_malloc_array((maxlen + 12) * DWT_COLS, sizeof(*s->i_colbuf));
+        if (!s->i_colbuf)
+            return AVERROR(ENOMEM);
+    }
+
     switch(s->type){
         case FF_DWT97:
             dwt_encode97_float(s, t); break;
@@ -623,4 +717,5 @@ void ff_dwt_destroy(DWTContext *s)
 {
     av_freep(&s->f_linebuf);
     av_freep(&s->i_linebuf);
+    av_freep(&s->i_colbuf);
 }
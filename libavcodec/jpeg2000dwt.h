@@ -33,6 +33,7 @@
 #define F_LFTG_K      1.230174104914001f
 #define F_LFTG_X      0.812893066115961f
 #define I_PRESHIFT 8
+#define DWT_COLS 8            ///< columns processed together by the encoder's vertical passes
 
 enum DWTType {
     FF_DWT97,
@@ -49,6 +50,7 @@ typedef struct DWTContext {
     uint8_t type;                        ///< 0 for 9/7; 1 for 5/3
     int32_t *i_linebuf;                  ///< int buffer used by transform
     float   *f_linebuf;                  ///< float buffer used by transform
+    int32_t *i_colbuf;                   ///< DWT_COLS interleaved columns, used by the encoder
 } DWTContext;
 
 /**
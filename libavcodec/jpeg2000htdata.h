@@ -0,0 +1,33 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_JPEG2000HTDATA_H
+#define AVCODEC_JPEG2000HTDATA_H
+
+#include <stdint.h>
+
+/**
+ * CxtVLC tables of the HT cleanup pass, indexed by (context << 7) | codeword
+ * with the 7-bit codeword read LSB first. Each entry packs
+ * (e_1 << 12) | (e_k << 8) | (rho << 4) | (length << 1) | u_off.
+ * Table 0 is used for the first line of quads, table 1 for the others.
+ */
+extern const uint16_t ff_jpeg2000_ht_vlc_table0[1024];
+extern const uint16_t ff_jpeg2000_ht_vlc_table1[1024];
+
+#endif /* AVCODEC_JPEG2000HTDATA_H */
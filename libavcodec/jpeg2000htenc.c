@@ -0,0 +1,425 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * HT (High-Throughput JPEG 2000) cleanup pass encoder, see Rec. ITU-T T.814.
+ *
+ * The cleanup segment is made of three bit-streams: MagSgn written forward
+ * from the start, MEL written forward after it and VLC written backward
+ * from the end. The coding decisions mirror jpeg2000htdec.c.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "jpeg2000htdata.h"
+#include "jpeg2000htenc.h"
+
+/* See Rec. ITU-T T.800, Table 2 */
+static const uint8_t mel_e[13] = { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 4, 5 };
+
+/**
+ * CxtVLC codewords indexed by [table][context][rho][eps], where eps is the
+ * set of samples whose exponent reaches the quad bound U, or 0 if U is not
+ * larger than kappa (u_off = 0). Each entry packs
+ * (e_k << 10) | (length << 7) | codeword, 0 if there is no codeword.
+ */
+static uint16_t enc_cxt_vlc[2][8][16][16];
+
+void ff_jpeg2000_ht_init_tables(void)
+{
+    for (int t = 0; t < 2; t++) {
+        const uint16_t *tab = t ? ff_jpeg2000_ht_vlc_table1 : ff_jpeg2000_ht_vlc_table0;
+
+        for (int i = 0; i < 1024; i++) {
+            int v     = tab[i];
+            int c     = i >> 7;
+            int cwd   = i & 0x7F;
+            int len   = (v & 0xF) >> 1;
+            int u_off = v & 1;
+            int rho   = (v >> 4) & 0xF;
+            int e_k   = (v >> 8) & 0xF;
+            int e_1   = v >> 12;
+
+            if (cwd >> len)
+                continue; // one of the copies of a shorter codeword
+
+            for (int eps = 0; eps < 16; eps++) {
+                uint16_t *dst = &enc_cxt_vlc[t][c][rho][eps];
+                int cost = len - av_popcount(e_k);
+
+                /* A set e_k bit means the decoder infers the MSB of the
+                 * sample from e_1, this is only valid with u_off = 1. */
+                if (u_off != !!eps || (eps & ~rho) || (eps & e_k) != e_1 ||
+                    (!u_off && e_k))
+                    continue;
+                if (*dst && ((*dst >> 7) & 7) - av_popcount(*dst >> 10) <= cost)
+                    continue;
+                *dst = (e_k << 10) | (len << 7) | cwd;
+            }
+        }
+    }
+}
+
+typedef struct MelWriter {
+    uint8_t *buf;
+    int pos, size;
+    int tmp, remaining;
+    int run, k;
+} MelWriter;
+
+typedef struct VlcWriter {
+    uint8_t *buf;               ///< end of the buffer, bytes are written backwards
+    int pos, size;
+    int tmp, used;
+    int last_gt_8f;
+} VlcWriter;
+
+typedef struct MagSgnWriter {
+    uint8_t *buf;
+    int pos, size;
+    uint32_t tmp;
+    int used, max;
+} MagSgnWriter;
+
+static void mel_put_bit(MelWriter *mel, int bit)
+{
+    mel->tmp = (mel->tmp << 1) | bit;
+    if (!--mel->remaining) {
+        if (mel->pos < mel->size)
+            mel->buf[mel->pos] = mel->tmp;
+        mel->pos++;
+        mel->remaining = mel->tmp == 0xFF ? 7 : 8;
+        mel->tmp = 0;
+    }
+}
+
+static void mel_encode(MelWriter *mel, int sym)
+{
+    if (!sym) {
+        if (++mel->run >= 1 << mel_e[mel->k]) {
+            mel_put_bit(mel, 1);
+            mel->run = 0;
+            mel->k   = FFMIN(mel->k + 1, 12);
+        }
+    } else {
+        mel_put_bit(mel, 0);
+        for (int t = mel_e[mel->k]; t > 0; t--)
+            mel_put_bit(mel, (mel->run >> (t - 1)) & 1);
+        mel->run = 0;
+        mel->k   = FFMAX(mel->k - 1, 0);
+    }
+}
+
+static void vlc_put_byte(VlcWriter *vlc, int byte)
+{
+    if (vlc->pos < vlc->size)
+        vlc->buf[-vlc->pos - 1] = byte;
+    vlc->pos++;
+}
+
+static void vlc_put(VlcWriter *vlc, unsigned cwd, int len)
+{
+    while (len > 0) {
+        int avail = 8 - vlc->last_gt_8f - vlc->used;
+        int t     = FFMIN(avail, len);
+
+        vlc->tmp  |= (cwd & ((1 << t) - 1)) << vlc->used;
+        vlc->used += t;
+        avail     -= t;
+        len       -= t;
+        cwd      >>= t;
+        if (!avail) {
+            if (vlc->last_gt_8f && vlc->tmp != 0x7F) {
+                // no stuffing bit needed, the byte takes one more bit
+                vlc->last_gt_8f = 0;
+                continue;
+            }
+            vlc_put_byte(vlc, vlc->tmp);
+            vlc->last_gt_8f = vlc->tmp > 0x8F;
+            vlc->tmp  = 0;
+            vlc->used = 0;
+        }
+    }
+}
+
+static void ms_put(MagSgnWriter *ms, uint32_t cwd, int len)
+{
+    while (len > 0) {
+        int t = FFMIN(ms->max - ms->used, len);
+
+        ms->tmp  |= (cwd & ((1U << t) - 1)) << ms->used;
+        ms->used += t;
+        cwd     >>= t;
+        len      -= t;
+        if (ms->used >= ms->max) {
+            if (ms->pos < ms->size)
+                ms->buf[ms->pos] = ms->tmp;
+            ms->pos++;
+            ms->max  = ms->tmp == 0xFF ? 7 : 8;
+            ms->tmp  = 0;
+            ms->used = 0;
+        }
+    }
+}
+
+static void ms_terminate(MagSgnWriter *ms)
+{
+    if (ms->used) {
+        // pad with 1s, which the decoder also reads past the end
+        ms->tmp |= (0xFF >> (8 - (ms->max - ms->used))) << ms->used;
+        if ((ms->tmp & 0xFF) != 0xFF) {
+            if (ms->pos < ms->size)
+                ms->buf[ms->pos] = ms->tmp;
+            ms->pos++;
+        }
+    } else if (ms->max == 7) {
+        ms->pos--; // drop a trailing 0xFF
+    }
+}
+
+/**
+ * Flush MEL and VLC, fusing their last bytes when the bits do not overlap.
+ */
+static void mel_vlc_terminate(MelWriter *mel, VlcWriter *vlc)
+{
+    int mel_mask, vlc_mask, vlc_tmp, fuse;
+
+    if (mel->run > 0)
+        mel_put_bit(mel, 1);
+
+    mel->tmp <<= mel->remaining;
+    mel_mask   = (0xFF << mel->remaining) & 0xFF;
+    vlc_mask   = 0xFF >> (8 - vlc->used);
+    if (!(mel_mask | vlc_mask))
+        return;
+
+    vlc_tmp = vlc->tmp & vlc_mask;
+    fuse    = mel->tmp | vlc_tmp;
+    if (!(((fuse ^ mel->tmp) & mel_mask) | ((fuse ^ vlc_tmp) & vlc_mask)) &&
+        fuse != 0xFF && vlc->pos > 1) {
+        if (mel->pos < mel->size)
+            mel->buf[mel->pos] = fuse;
+        mel->pos++;
+    } else {
+        if (mel->pos < mel->size)
+            mel->buf[mel->pos] = mel->tmp;
+        mel->pos++;
+        vlc_put_byte(vlc, vlc_tmp);
+    }
+}
+
+/** Code the u prefix, see Rec. ITU-T T.814, 7.3.6. */
+static void put_u_prefix(VlcWriter *vlc, int u)
+{
+    if (u == 1)
+        vlc_put(vlc, 1, 1);
+    else if (u == 2)
+        vlc_put(vlc, 2, 2);
+    else if (u <= 4)
+        vlc_put(vlc, 4, 3);
+    else
+        vlc_put(vlc, 0, 3);
+}
+
+static void put_u_suffix(VlcWriter *vlc, int u)
+{
+    if (u >= 33)
+        vlc_put(vlc, 28 + ((u - 33) & 3), 5);
+    else if (u >= 5)
+        vlc_put(vlc, u - 5, 5);
+    else if (u >= 3)
+        vlc_put(vlc, u - 3, 1);
+}
+
+static void put_u_extension(VlcWriter *vlc, int u)
+{
+    if (u >= 33)
+        vlc_put(vlc, (u - 33) >> 2, 4);
+}
+
+static void put_u_single(VlcWriter *vlc, int u)
+{
+    put_u_prefix(vlc, u);
+    put_u_suffix(vlc, u);
+    put_u_extension(vlc, u);
+}
+
+static void put_u_pair(VlcWriter *vlc, int u0, int u1)
+{
+    put_u_prefix(vlc, u0);
+    put_u_prefix(vlc, u1);
+    put_u_suffix(vlc, u0);
+    put_u_suffix(vlc, u1);
+    put_u_extension(vlc, u0);
+    put_u_extension(vlc, u1);
+}
+
+int ff_jpeg2000_encode_htj2k(Jpeg2000HTEncContext *ht, uint8_t *buf, int size,
+                             const int *data, int stride, int width, int height,
+                             int shift)
+{
+    const int quad_width  = (width  + 1) >> 1;
+    const int quad_height = (height + 1) >> 1;
+    MelWriter    mel = { .buf = ht->mel_buf, .size = sizeof(ht->mel_buf), .remaining = 8 };
+    VlcWriter    vlc = { .buf = ht->vlc_buf + sizeof(ht->vlc_buf), .size = sizeof(ht->vlc_buf),
+                         .tmp = 0xF, .used = 4, .last_gt_8f = 1 };
+    MagSgnWriter ms  = { .buf = buf, .size = size, .max = 8 };
+    uint8_t *E_cur = ht->E[0], *E_prev = ht->E[1];
+    int context = 0, scup, lcup;
+
+    if (quad_width > 512)
+        return AVERROR(EINVAL);
+
+    vlc_put_byte(&vlc, 0xFF);
+
+    for (int qy = 0; qy < quad_height; qy++) {
+        const int first = !qy;
+
+        /* gather the MagSgn values v = 2 * (mu - 1) + sign and exponents */
+        for (int qx = 0; qx < quad_width; qx++) {
+            int rho = 0;
+            for (int i = 0; i < 4; i++) {
+                int x = 2 * qx + (i >> 1), y = 2 * qy + (i & 1);
+                int n = 4 * qx + i;
+                uint32_t mu = 0;
+                int d = 0;
+
+                if (x < width && y < height) {
+                    d  = data[y * stride + x];
+                    mu = FFABS(d) >> shift;
+                }
+                if (mu) {
+                    ht->v[n] = 2 * (mu - 1) + (d < 0);
+                    E_cur[n] = av_log2(2 * mu - 1) + 1;
+                    rho     |= 1 << i;
+                } else {
+                    ht->v[n] = 0;
+                    E_cur[n] = 0;
+                }
+            }
+            ht->rho[qx] = rho;
+        }
+
+        for (int qx = 0; qx < quad_width; qx += 2) {
+            const int nb_quads = FFMIN(2, quad_width - qx);
+            int U[2], u[2], e_k[2];
+
+            for (int j = 0; j < nb_quads; j++) {
+                const int q   = qx + j;
+                const int rho = ht->rho[q];
+                int kappa = 1, emax = 0, eps = 0;
+
+                if (!first) {
+                    const uint8_t *En = E_prev + 4 * q;
+                    int c = (En[1] > 0) | (En[3] > 0) << 2;
+                    int max_e = FFMAX(En[1], En[3]);
+
+                    if (q > 0) {
+                        c    |= (En[-1] > 0) | (E_cur[4 * q - 1] || E_cur[4 * q - 2]) << 1;
+                        max_e = FFMAX(max_e, En[-1]);
+                    }
+                    if (q < quad_width - 1) {
+                        c    |= (En[5] > 0) << 2;
+                        max_e = FFMAX(max_e, En[5]);
+                    }
+                    context = c;
+                    if (av_popcount(rho) > 1)
+                        kappa = FFMAX(1, max_e - 1);
+                }
+
+                for (int i = 0; i < 4; i++)
+                    emax = FFMAX(emax, E_cur[4 * q + i]);
+                U[j] = FFMAX(emax, kappa);
+                u[j] = U[j] - kappa;
+                if (u[j])
+                    for (int i = 0; i < 4; i++)
+                        eps |= (E_cur[4 * q + i] == U[j]) << i;
+
+                if (!context)
+                    mel_encode(&mel, !!rho);
+                e_k[j] = 0;
+                if (context || rho) {
+                    int cwd = enc_cxt_vlc[!first][context][rho][eps];
+                    if (!cwd)
+                        return AVERROR_BUG;
+                    vlc_put(&vlc, cwd & 0x7F, (cwd >> 7) & 7);
+                    e_k[j] = cwd >> 10;
+                }
+
+                if (first) {
+                    context = (rho & 1) | (rho >> 1 & 1) | (rho >> 2 & 1) << 1 | (rho >> 3 & 1) << 2;
+                }
+            }
+
+            if (nb_quads == 2 && u[0] && u[1]) {
+                if (first) {
+                    mel_encode(&mel, u[0] > 2 && u[1] > 2);
+                    if (u[0] > 2 && u[1] > 2) {
+                        put_u_pair(&vlc, u[0] - 2, u[1] - 2);
+                    } else if (u[0] > 2) {
+                        put_u_prefix(&vlc, u[0]);
+                        vlc_put(&vlc, u[1] - 1, 1);
+                        put_u_suffix(&vlc, u[0]);
+                        put_u_extension(&vlc, u[0]);
+                    } else {
+                        put_u_pair(&vlc, u[0], u[1]);
+                    }
+                } else {
+                    put_u_pair(&vlc, u[0], u[1]);
+                }
+            } else if (u[0]) {
+                put_u_single(&vlc, u[0]);
+            } else if (nb_quads == 2 && u[1]) {
+                put_u_single(&vlc, u[1]);
+            }
+
+            for (int j = 0; j < nb_quads; j++) {
+                const int q = qx + j;
+                for (int i = 0; i < 4; i++) {
+                    if (ht->rho[q] >> i & 1) {
+                        int m = U[j] - (e_k[j] >> i & 1);
+                        ms_put(&ms, ht->v[4 * q + i], m);
+                    }
+                }
+            }
+        }
+
+        FFSWAP(uint8_t *, E_cur, E_prev);
+    }
+
+    mel_vlc_terminate(&mel, &vlc);
+    ms_terminate(&ms);
+
+    scup = mel.pos + vlc.pos;
+    lcup = ms.pos + scup;
+    if (mel.pos > mel.size || vlc.pos > vlc.size || scup > JPEG2000_HT_MAX_SCUP ||
+        lcup > size)
+        return AVERROR(ENOSPC);
+
+    memcpy(buf + ms.pos, mel.buf, mel.pos);
+    memcpy(buf + ms.pos + mel.pos, vlc.buf - vlc.pos, vlc.pos);
+
+    buf[lcup - 1] = scup >> 4;
+    buf[lcup - 2] = (buf[lcup - 2] & 0xF0) | (scup & 0xF);
+
+    return lcup;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_JPEG2000HTENC_H
+#define AVCODEC_JPEG2000HTENC_H
+
+#include <stdint.h>
+
+/**
+ * HT block encoder as specified in Rec. ITU-T T.814 | ISO/IEC 15444-15,
+ * producing a single HT cleanup segment per code-block.
+ */
+
+#define JPEG2000_HT_MAX_SCUP 4079 ///< maximum length of the MEL and VLC suffix
+
+typedef struct Jpeg2000HTEncContext {
+    uint8_t mel_buf[JPEG2000_HT_MAX_SCUP];
+    uint8_t vlc_buf[JPEG2000_HT_MAX_SCUP];
+    uint8_t E[2][4 * 512];      ///< sample exponents of the current and previous quad line
+    uint32_t v[4 * 512];        ///< MagSgn values of the current quad line
+    uint8_t rho[512];           ///< significance patterns of the current quad line
+} Jpeg2000HTEncContext;
+
+void ff_jpeg2000_ht_init_tables(void);
+
+/**
+ * Encode a code-block with the HT cleanup pass.
+ *
+ * @param data   signed samples, the coded magnitudes are |data| >> shift
+ * @param shift  number of discarded least significant magnitude bits
+ * @return the length of the cleanup segment (Lcup) written to buf,
+ *         or a negative error code if it does not fit into size bytes
+ */
+int ff_jpeg2000_encode_htj2k(Jpeg2000HTEncContext *ht, uint8_t *buf, int size,
+                             const int *data, int stride, int width, int height,
+                             int shift);
+
+#endif /* AVCODEC_JPEG2000HTENC_H */
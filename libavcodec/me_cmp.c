@@ -324,6 +324,18 @@ static inline int pix_abs8_c(MPVEncContext *unused, const uint8_t *pix1, const u
     return s;
 }
 
+#define SAD_X4(size)                                                           \
+static void sad ## size ## _x4_c(const uint8_t *pix1,                          \
+                                 const uint8_t *const ref[4],                  \
+                                 ptrdiff_t stride, int h, int scores[4])       \
+{                                                                              \
+    for (int i = 0; i < 4; i++)                                                \
+        scores[i] = pix_abs ## size ## _c(NULL, pix1, ref[i], stride, h);      \
+}
+
+SAD_X4(16)
+SAD_X4(8)
+
 static inline int pix_median_abs8_c(MPVEncContext *unused, const uint8_t *pix1, const uint8_t *pix2,
                              ptrdiff_t stride, int h)
 {
@@ -1023,6 +1035,8 @@ av_cold void ff_me_cmp_init(MECmpContext *c, AVCodecContext *avctx)
 #endif
     c->sad[0] = pix_abs16_c;
     c->sad[1] = pix_abs8_c;
+    c->sad_x4[0] = sad16_x4_c;
+    c->sad_x4[1] = sad8_x4_c;
     c->sse[0] = sse16_c;
     c->sse[1] = sse8_c;
     c->sse[2] = sse4_c;
@@ -52,6 +52,15 @@ typedef int (*me_cmp_func)(MPVEncContext *c,
                            const uint8_t *blk2 /* align 1 */, ptrdiff_t stride,
                            int h);
 
+/**
+ * Compare a block against four candidate blocks at once;
+ * scores[i] is set to the SAD between blk1 and ref[i].
+ * The same constraints on h as for me_cmp_func apply.
+ */
+typedef void (*me_cmp_x4_func)(const uint8_t *blk1 /* align width (8 or 16) */,
+                               const uint8_t *const ref[4] /* align 1 */,
+                               ptrdiff_t stride, int h, int scores[4]);
+
 typedef struct MECmpContext {
     int (*sum_abs_dctelem)(const int16_t *block /* align 16 */);
 
@@ -72,6 +81,8 @@ typedef struct MECmpContext {
 
     me_cmp_func pix_abs[2][4];
     me_cmp_func median_sad[6];
+
+    me_cmp_x4_func sad_x4[2]; ///< [0] 16xh, [1] 8xh
 } MECmpContext;
 
 void ff_me_cmp_init(MECmpContext *c, AVCodecContext *avctx);
@@ -31,6 +31,8 @@
 #include <stdio.h>
 #include <limits.h>
 
+#include "libavutil/mem.h"
+
 #include "avcodec.h"
 #include "h263.h"
 #include "mathops.h"
@@ -318,6 +320,11 @@ av_cold int ff_me_init(MotionEstContext *c, AVCodecContext *avctx,
         return AVERROR(EINVAL);
     }
 
+    if (mpvenc && c->motion_est == FF_ME_ITER) {
+        av_log(avctx, AV_LOG_ERROR, "Invalid motion estimation method\n");
+        return AVERROR(EINVAL);
+    }
+
     c->avctx = avctx;
 
     if (avctx->codec_id == AV_CODEC_ID_H261)
@@ -335,6 +342,9 @@ av_cold int ff_me_init(MotionEstContext *c, AVCodecContext *avctx,
 
     c->sse = mecc->sse[0];
     memcpy(c->pix_abs, mecc->pix_abs, sizeof(c->pix_abs));
+    memcpy(c->sad_x4,  mecc->sad_x4,  sizeof(c->sad_x4));
+    if (avctx->me_cmp == FF_CMP_SAD)
+        memcpy(c->me_cmp_x4, mecc->sad_x4, sizeof(c->me_cmp_x4));
 
     c->flags     = get_flags(c, 0, avctx->me_cmp     & FF_CMP_CHROMA);
     c->sub_flags = get_flags(c, 0, avctx->me_sub_cmp & FF_CMP_CHROMA);
@@ -889,6 +899,223 @@ static inline int get_penalty_factor(int lambda, int lambda2, int type){
     }
 }
 
+static int get_hier_slot(MPVMainEncContext *const m, const MPVPicture *const pics[3],
+                         const uint8_t *data, int number)
+{
+    MPVEncContext *const s = &m->s;
+    const int w = s->c.mb_width  * 8;
+    const int h = s->c.mb_height * 8;
+    int slot;
+
+    for (slot = 0; slot < FF_ARRAY_ELEMS(m->hier_buf); slot++) {
+        if (m->hier_buf[slot] && m->hier_pic_number[slot] == number)
+            return slot;
+    }
+
+    /* Reuse a slot which is not needed by the current picture or its
+     * references; there are always enough of them for all three. */
+    for (slot = 0; slot < FF_ARRAY_ELEMS(m->hier_buf); slot++) {
+        int used = 0;
+        for (int i = 0; i < 3; i++)
+            used |= m->hier_buf[slot] && pics[i] &&
+                    m->hier_pic_number[slot] == pics[i]->display_picture_number;
+        if (!used)
+            break;
+    }
+    av_assert1(slot < FF_ARRAY_ELEMS(m->hier_buf));
+
+    if (!m->hier_buf[slot]) {
+        m->hier_buf[slot] = av_malloc(w * h + (w / 2) * (h / 2));
+        if (!m->hier_buf[slot])
+            return AVERROR(ENOMEM);
+    }
+    s->mpvencdsp.shrink[1](m->hier_buf[slot], w, data, s->c.linesize, w, h);
+    s->mpvencdsp.shrink[1](m->hier_buf[slot] + w * h, w / 2,
+                           m->hier_buf[slot], w, w / 2, h / 2);
+    m->hier_pic_number[slot] = number;
+
+    return slot;
+}
+
+int ff_me_init_hier_pic(MPVMainEncContext *const m)
+{
+    MPVEncContext *const s = &m->s;
+    MotionEstContext *const c = &s->me;
+    const int w = s->c.mb_width  * 8;
+    const int h = s->c.mb_height * 8;
+    const MPVPicture *pics[3] = { s->c.cur_pic.ptr };
+    const uint8_t *data[3]    = { s->new_pic->data[0] };
+
+    memset(c->hier_pic, 0, sizeof(c->hier_pic));
+
+    /* The quarter resolution search uses 8x8 blocks */
+    if (s->c.mb_width < 2 || s->c.mb_height < 2)
+        return 0;
+
+    /* The pictures of the references are normally left over from when
+     * they were coded, the reconstruction is only used if they are not. */
+    if (s->c.pict_type != AV_PICTURE_TYPE_I) {
+        pics[1] = s->c.last_pic.ptr;
+        data[1] = s->c.last_pic.data[0];
+    }
+    if (s->c.pict_type == AV_PICTURE_TYPE_B) {
+        pics[2] = s->c.next_pic.ptr;
+        data[2] = s->c.next_pic.data[0];
+    }
+
+    for (int i = 0; i < 3; i++) {
+        int slot;
+
+        if (!pics[i])
+            continue;
+        slot = get_hier_slot(m, pics, data[i], pics[i]->display_picture_number);
+        if (slot < 0)
+            return slot;
+        c->hier_pic[i][0] = m->hier_buf[slot];
+        c->hier_pic[i][1] = m->hier_buf[slot] + w * h;
+    }
+
+    return 0;
+}
+
+/**
+ * Small diamond search on a low resolution picture.
+ * Blocks are 8x8 and scored as 4 * SAD, which roughly matches the SAD of
+ * the corresponding 16x16 block. lim is {xmin, xmax, ymin, ymax} and
+ * shift converts a vector into the units of the full resolution ones.
+ */
+static int hier_diamond_search(MotionEstContext *const c,
+                               const uint8_t *src, const uint8_t *ref,
+                               ptrdiff_t stride, const int lim[4], int shift,
+                               int *best, int dmin, int step)
+{
+    const uint8_t *mv_penalty = c->current_mv_penalty;
+    const int penalty_factor  = c->penalty_factor;
+
+    for (; step; step >>= 1) {
+        for (int iter = 0; iter < 16; iter++) {
+            const int x = best[0];
+            const int y = best[1];
+            const int cx[4] = { x - step, x + step, x, x };
+            const int cy[4] = { y, y, y - step, y + step };
+            const uint8_t *cand[4];
+            int scores[4], valid[4];
+            int moved = 0;
+
+            for (int i = 0; i < 4; i++) {
+                valid[i] = cx[i] >= lim[0] && cx[i] <= lim[1] &&
+                           cy[i] >= lim[2] && cy[i] <= lim[3];
+                cand[i]  = valid[i] ? ref + cx[i] + cy[i] * stride
+                                    : ref + x + y * stride;
+            }
+            c->sad_x4[1](src, cand, stride, 8, scores);
+
+            for (int i = 0; i < 4; i++) {
+                int d;
+                if (!valid[i])
+                    continue;
+                d = 4 * scores[i] +
+                    (mv_penalty[cx[i] * (1 << shift) - c->pred_x] +
+                     mv_penalty[cy[i] * (1 << shift) - c->pred_y]) * penalty_factor;
+                if (d < dmin) {
+                    dmin    = d;
+                    best[0] = cx[i];
+                    best[1] = cy[i];
+                    moved   = 1;
+                }
+            }
+            if (!moved)
+                break;
+        }
+    }
+    return dmin;
+}
+
+static void hier_set_limits(const MotionEstContext *c, int lim[4],
+                            int bx, int by, int w, int h, int level)
+{
+    lim[0] = FFMAX(-bx,        -(-c->xmin >> level));
+    lim[1] = FFMIN(w - 8 - bx,    c->xmax >> level);
+    lim[2] = FFMAX(-by,        -(-c->ymin >> level));
+    lim[3] = FFMIN(h - 8 - by,    c->ymax >> level);
+}
+
+/**
+ * Search the quarter and then the half resolution pictures, starting
+ * from the usual predictors, and set c->hier_mv to the result.
+ * @param ref 1 for the past, 2 for the future reference
+ */
+static void hier_motion_search(MPVEncContext *const s, int mb_x, int mb_y,
+                               int ref, int P[10][2],
+                               const int16_t (*last_mv)[2], int ref_mv_scale)
+{
+    MotionEstContext *const c = &s->me;
+    const uint8_t *mv_penalty = c->current_mv_penalty;
+    const int shift = 1 + s->c.quarter_sample;
+    const int xy    = mb_x + mb_y * s->c.mb_stride;
+    const int w1 = s->c.mb_width  * 8, h1 = s->c.mb_height * 8;
+    const int w2 = w1 / 2,             h2 = h1 / 2;
+    const int bx2 = av_clip(mb_x * 4 - 2, 0, w2 - 8);
+    const int by2 = av_clip(mb_y * 4 - 2, 0, h2 - 8);
+    const uint8_t *src, *ref_pic;
+    const uint8_t *cand[4];
+    int cand_mv[4][2], scores[4], lim[4], best[2] = { 0, 0 }, dmin = INT_MAX;
+
+    c->hier_mv[0] = c->hier_mv[1] = 0;
+    if (!c->hier_pic[ref][0])
+        return;
+
+    /* quarter resolution, 8x8 block centered on the macroblock */
+    hier_set_limits(c, lim, bx2, by2, w2, h2, 2);
+    src     = c->hier_pic[0][1]   + bx2 + by2 * w2;
+    ref_pic = c->hier_pic[ref][1] + bx2 + by2 * w2;
+
+    cand_mv[0][0] = cand_mv[0][1] = 0;
+    cand_mv[1][0] = P_LEFT[0] >> (shift + 2);
+    cand_mv[1][1] = P_LEFT[1] >> (shift + 2);
+    cand_mv[2][0] = ((last_mv[xy][0] * ref_mv_scale + (1 << 15)) >> 16) >> 2;
+    cand_mv[2][1] = ((last_mv[xy][1] * ref_mv_scale + (1 << 15)) >> 16) >> 2;
+    if (s->c.first_slice_line) {
+        cand_mv[3][0] = cand_mv[1][0];
+        cand_mv[3][1] = cand_mv[1][1];
+    } else {
+        cand_mv[3][0] = P_MEDIAN[0] >> (shift + 2);
+        cand_mv[3][1] = P_MEDIAN[1] >> (shift + 2);
+    }
+    for (int i = 0; i < 4; i++) {
+        cand_mv[i][0] = av_clip(cand_mv[i][0], lim[0], lim[1]);
+        cand_mv[i][1] = av_clip(cand_mv[i][1], lim[2], lim[3]);
+        cand[i] = ref_pic + cand_mv[i][0] + cand_mv[i][1] * w2;
+    }
+    c->sad_x4[1](src, cand, w2, 8, scores);
+    for (int i = 0; i < 4; i++) {
+        int d = 4 * scores[i] +
+                (mv_penalty[cand_mv[i][0] * (1 << (shift + 2)) - c->pred_x] +
+                 mv_penalty[cand_mv[i][1] * (1 << (shift + 2)) - c->pred_y]) * c->penalty_factor;
+        if (d < dmin) {
+            dmin    = d;
+            best[0] = cand_mv[i][0];
+            best[1] = cand_mv[i][1];
+        }
+    }
+    hier_diamond_search(c, src, ref_pic, w2, lim, shift + 2, best, dmin, 2);
+
+    /* half resolution, the block is the macroblock */
+    hier_set_limits(c, lim, mb_x * 8, mb_y * 8, w1, h1, 1);
+    src     = c->hier_pic[0][0]   + mb_x * 8 + mb_y * 8 * w1;
+    ref_pic = c->hier_pic[ref][0] + mb_x * 8 + mb_y * 8 * w1;
+
+    best[0] = av_clip(2 * best[0], lim[0], lim[1]);
+    best[1] = av_clip(2 * best[1], lim[2], lim[3]);
+    dmin = 4 * c->pix_abs[1][0](NULL, src, ref_pic + best[0] + best[1] * w1, w1, 8) +
+           (mv_penalty[best[0] * (1 << (shift + 1)) - c->pred_x] +
+            mv_penalty[best[1] * (1 << (shift + 1)) - c->pred_y]) * c->penalty_factor;
+    hier_diamond_search(c, src, ref_pic, w1, lim, shift + 1, best, dmin, 1);
+
+    c->hier_mv[0] = 2 * best[0];
+    c->hier_mv[1] = 2 * best[1];
+}
+
 void ff_estimate_p_frame_motion(MPVEncContext *const s,
                                 int mb_x, int mb_y)
 {
@@ -961,6 +1188,8 @@ void ff_estimate_p_frame_motion(MPVEncContext *const s,
             c->pred_x = P_LEFT[0];
             c->pred_y = P_LEFT[1];
         }
+        if (c->motion_est == FF_ME_HIER)
+            hier_motion_search(s, mb_x, mb_y, 1, P, s->p_mv_table, (1<<16)>>shift);
         dmin = ff_epzs_motion_search(s, &mx, &my, P, 0, 0, s->p_mv_table, (1<<16)>>shift, 0, 16);
     }
 
@@ -1161,6 +1390,8 @@ static int estimate_motion_b(MPVEncContext *const s, int mb_x, int mb_y,
             mv_scale = ((s->c.pb_time - s->c.pp_time) * (1 << 16)) / (s->c.pp_time<<shift);
         }
 
+        if (c->motion_est == FF_ME_HIER)
+            hier_motion_search(s, mb_x, mb_y, ref_index ? 2 : 1, P, s->p_mv_table, mv_scale);
         dmin = ff_epzs_motion_search(s, &mx, &my, P, 0, ref_index, s->p_mv_table, mv_scale, 0, 16);
     }
 
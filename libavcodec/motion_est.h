@@ -42,6 +42,8 @@ typedef struct MPVMainEncContext MPVMainEncContext;
 #define FF_ME_ZERO 0
 #define FF_ME_EPZS 1
 #define FF_ME_XONE 2
+#define FF_ME_ITER 3 ///< iterative search of the snow encoder, not supported by the shared code
+#define FF_ME_HIER 4 ///< EPZS seeded by a search on half and quarter resolution pictures
 
 /**
  * Motion estimation context.
@@ -91,6 +93,8 @@ typedef struct MotionEstContext {
 
     me_cmp_func pix_abs[2][4];
     me_cmp_func sse;
+    me_cmp_x4_func sad_x4[2];
+    me_cmp_x4_func me_cmp_x4[2];    ///< me_cmp on four candidates, NULL unless me_cmp is SAD
 
     op_pixels_func(*hpel_put)[4];
     op_pixels_func(*hpel_avg)[4];
@@ -103,6 +107,11 @@ typedef struct MotionEstContext {
                              int src_index, int ref_index,
                              int size, int h);
 
+    /* FF_ME_HIER */
+    const uint8_t *hier_pic[3][2];  ///< half and quarter resolution luma of the current
+                                    ///< picture and of the past and future reference
+    int hier_mv[2];                 ///< full-pel vector found on hier_pic
+
     uint32_t map[ME_MAP_SIZE];      ///< map to avoid duplicate evaluations
     uint32_t score_map[ME_MAP_SIZE];///< map to store the scores
 } MotionEstContext;
@@ -115,6 +124,13 @@ int ff_me_init(MotionEstContext *c, struct AVCodecContext *avctx,
 
 void ff_me_init_pic(MPVEncContext *s);
 
+/**
+ * Set up the low resolution pictures used by FF_ME_HIER for the
+ * current picture and its references in MotionEstContext.hier_pic.
+ * They are kept in MPVMainEncContext and reused by later pictures.
+ */
+int ff_me_init_hier_pic(MPVMainEncContext *m);
+
 void ff_estimate_p_frame_motion(MPVEncContext *s, int mb_x, int mb_y);
 void ff_estimate_b_frame_motion(MPVEncContext *s, int mb_x, int mb_y);
 
@@ -402,6 +402,69 @@ static int qpel_motion_search(MPVEncContext *const s,
     }\
 }
 
+/* Candidates of the diamond searches are scored four at a time with cmpf_x4
+ * when possible. A queued candidate whose map slot is already taken by
+ * another queued one flushes the queue first, so the search takes exactly
+ * the same decisions as with CHECK_MV(). */
+#define LOAD_MV_QUEUE\
+    int queue_x[4], queue_y[4], queue_index[4];\
+    unsigned queue_key[4];\
+    int nb_queued = 0;\
+
+#define FLUSH_MV_QUEUE \
+if (nb_queued) {\
+    const uint8_t *queue_ref[4];\
+    int scores[4];\
+    for (int k = 0; k < 4; k++) {\
+        const int k2 = k < nb_queued ? k : 0;\
+        queue_ref[k] = c->ref[ref_index][0] + queue_x[k2] + queue_y[k2] * c->stride;\
+    }\
+    cmpf_x4(c->src[src_index][0], queue_ref, c->stride, h, scores);\
+    for (int k = 0; k < nb_queued; k++) {\
+        const int qx = queue_x[k];\
+        const int qy = queue_y[k];\
+        map[queue_index[k]]      = queue_key[k];\
+        score_map[queue_index[k]]= scores[k];\
+        const int d = scores[k] + (mv_penalty[(qx*(1<<shift))-pred_x] + mv_penalty[(qy*(1<<shift))-pred_y])*penalty_factor;\
+        COPY3_IF_LT(dmin, d, best[0], qx, best[1], qy)\
+    }\
+    nb_queued = 0;\
+}
+
+#define QUEUE_MV(x,y)\
+{\
+    const unsigned key = ((unsigned)(y)<<ME_MAP_MV_BITS) + (x) + map_generation;\
+    const int index= (((unsigned)(y)<<ME_MAP_SHIFT) + (x))&(ME_MAP_SIZE-1);\
+    av_assert2((x) >= xmin);\
+    av_assert2((x) <= xmax);\
+    av_assert2((y) >= ymin);\
+    av_assert2((y) <= ymax);\
+    if(map[index]!=key){\
+        for (int k = 0; k < nb_queued; k++) {\
+            if (queue_index[k] == index) {\
+                FLUSH_MV_QUEUE\
+                break;\
+            }\
+        }\
+        if(map[index]!=key){\
+            queue_x    [nb_queued]= x;\
+            queue_y    [nb_queued]= y;\
+            queue_index[nb_queued]= index;\
+            queue_key  [nb_queued]= key;\
+            if (++nb_queued == 4)\
+                FLUSH_MV_QUEUE\
+        }\
+    }\
+}
+
+#define CHECK_MV_QUEUED(x,y)\
+{\
+    if (cmpf_x4)\
+        QUEUE_MV(x,y)\
+    else\
+        CHECK_MV(x,y)\
+}
+
 #define check(x,y,S,v)\
 if( (x)<(xmin<<(S)) ) av_log(NULL, AV_LOG_ERROR, "%d %d %d %d %d xmin" #v, xmin, (x), (y), s->c.mb_x, s->c.mb_y);\
 if( (x)>(xmax<<(S)) ) av_log(NULL, AV_LOG_ERROR, "%d %d %d %d %d xmax" #v, xmax, (x), (y), s->c.mb_x, s->c.mb_y);\
@@ -419,6 +482,7 @@ static av_always_inline int small_diamond_search(MPVEncContext *const s, int *be
 {
     MotionEstContext *const c = &s->me;
     me_cmp_func cmpf, chroma_cmpf;
+    me_cmp_x4_func cmpf_x4;
     int next_dir=-1;
     LOAD_COMMON
     LOAD_COMMON2
@@ -426,6 +490,7 @@ static av_always_inline int small_diamond_search(MPVEncContext *const s, int *be
 
     cmpf        = c->me_cmp[size];
     chroma_cmpf = c->me_cmp[size + 1];
+    cmpf_x4     = flags & (FLAG_CHROMA | FLAG_DIRECT) ? NULL : c->me_cmp_x4[size];
 
     { /* ensure that the best point is in the MAP as h/qpel refinement needs it */
         const unsigned key = ((unsigned)best[1]<<ME_MAP_MV_BITS) + best[0] + map_generation;
@@ -436,6 +501,68 @@ static av_always_inline int small_diamond_search(MPVEncContext *const s, int *be
         }
     }
 
+    if (cmpf_x4) {
+        /* The map slots of the four neighbours are always distinct, so
+         * they can be scored together without changing the result. */
+        const int stride = c->stride;
+        const uint8_t *const src = c->src[src_index][0];
+        const uint8_t *const ref = c->ref[ref_index][0];
+
+        for(;;){
+            static const int8_t dir_x[4] = { -1, 0, 1, 0 };
+            static const int8_t dir_y[4] = { 0, -1, 0, 1 };
+            const uint8_t *cand_ref[4];
+            int cand_dir[4], cand_index[4], scores[4];
+            unsigned cand_key[4];
+            int nb_cand = 0;
+            const int dir= next_dir;
+            const int x= best[0];
+            const int y= best[1];
+            next_dir=-1;
+
+            for (int i = 0; i < 4; i++) {
+                const int cx = x + dir_x[i];
+                const int cy = y + dir_y[i];
+                const unsigned key = ((unsigned)cy<<ME_MAP_MV_BITS) + cx + map_generation;
+                const int index= (((unsigned)cy<<ME_MAP_SHIFT) + cx)&(ME_MAP_SIZE-1);
+
+                if (dir == (i ^ 2) || cx < xmin || cx > xmax || cy < ymin || cy > ymax ||
+                    map[index] == key)
+                    continue;
+                cand_ref  [nb_cand] = ref + cx + cy * stride;
+                cand_dir  [nb_cand] = i;
+                cand_index[nb_cand] = index;
+                cand_key  [nb_cand] = key;
+                nb_cand++;
+            }
+            if (!nb_cand)
+                return dmin;
+            for (int i = nb_cand; i < 4; i++)
+                cand_ref[i] = cand_ref[0];
+            cmpf_x4(src, cand_ref, stride, h, scores);
+
+            for (int i = 0; i < nb_cand; i++) {
+                const int cx = x + dir_x[cand_dir[i]];
+                const int cy = y + dir_y[cand_dir[i]];
+                int d;
+
+                map[cand_index[i]]      = cand_key[i];
+                score_map[cand_index[i]]= scores[i];
+                d = scores[i] + (mv_penalty[(int)((unsigned)cx<<shift)-pred_x] + mv_penalty[(int)((unsigned)cy<<shift)-pred_y])*penalty_factor;
+                if(d<dmin){
+                    best[0]=cx;
+                    best[1]=cy;
+                    dmin=d;
+                    next_dir= cand_dir[i];
+                }
+            }
+
+            if(next_dir==-1){
+                return dmin;
+            }
+        }
+    }
+
     for(;;){
         int d;
         const int dir= next_dir;
@@ -774,13 +901,16 @@ static int var_diamond_search(MPVEncContext *const s, int *best, int dmin,
 {
     MotionEstContext *const c = &s->me;
     me_cmp_func cmpf, chroma_cmpf;
+    me_cmp_x4_func cmpf_x4;
     int dia_size;
     LOAD_COMMON
     LOAD_COMMON2
+    LOAD_MV_QUEUE
     unsigned map_generation = c->map_generation;
 
     cmpf        = c->me_cmp[size];
     chroma_cmpf = c->me_cmp[size + 1];
+    cmpf_x4     = flags & (FLAG_CHROMA | FLAG_DIRECT) ? NULL : c->me_cmp_x4[size];
 
     for(dia_size=1; dia_size<=c->dia_size; dia_size++){
         int dir, start, end;
@@ -793,7 +923,7 @@ static int var_diamond_search(MPVEncContext *const s, int *best, int dmin,
             int d;
 
 //check(x + dir,y + dia_size - dir,0, a0)
-            CHECK_MV(x + dir           , y + dia_size - dir);
+            CHECK_MV_QUEUED(x + dir           , y + dia_size - dir);
         }
 
         start= FFMAX(0, x + dia_size - xmax);
@@ -802,7 +932,7 @@ static int var_diamond_search(MPVEncContext *const s, int *best, int dmin,
             int d;
 
 //check(x + dia_size - dir, y - dir,0, a1)
-            CHECK_MV(x + dia_size - dir, y - dir           );
+            CHECK_MV_QUEUED(x + dia_size - dir, y - dir           );
         }
 
         start= FFMAX(0, -y + dia_size + ymin );
@@ -811,7 +941,7 @@ static int var_diamond_search(MPVEncContext *const s, int *best, int dmin,
             int d;
 
 //check(x - dir,y - dia_size + dir,0, a2)
-            CHECK_MV(x - dir           , y - dia_size + dir);
+            CHECK_MV_QUEUED(x - dir           , y - dia_size + dir);
         }
 
         start= FFMAX(0, -x + dia_size + xmin );
@@ -820,9 +950,11 @@ static int var_diamond_search(MPVEncContext *const s, int *best, int dmin,
             int d;
 
 //check(x - dia_size + dir, y + dir,0, a3)
-            CHECK_MV(x - dia_size + dir, y + dir           );
+            CHECK_MV_QUEUED(x - dia_size + dir, y + dir           );
         }
 
+        FLUSH_MV_QUEUE
+
         if(x!=best[0] || y!=best[1])
             dia_size=0;
     }
@@ -926,6 +1058,9 @@ static av_always_inline int epzs_motion_search_internal(MPVEncContext *const s,
         CHECK_MV(P_TOP[0]     >>shift, P_TOP[1]     >>shift)
         CHECK_MV(P_TOPRIGHT[0]>>shift, P_TOPRIGHT[1]>>shift)
     }
+    /* vector found on the low resolution pictures */
+    if (c->motion_est == FF_ME_HIER && !c->pre_pass && !(flags & FLAG_DIRECT))
+        CHECK_CLIPPED_MV(c->hier_mv[0], c->hier_mv[1])
     if(dmin>h*h*4){
         if(c->pre_pass){
             CHECK_CLIPPED_MV((last_mv[ref_mv_xy-1][0]*ref_mv_scale + (1<<15))>>16,
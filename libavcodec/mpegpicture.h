@@ -82,6 +82,8 @@ typedef struct MPVPicture {
     int field_picture;          ///< whether or not the picture was encoded in separate fields
 
     int b_frame_score;
+    int64_t lookahead_var;      ///< low resolution estimate of mb_var_sum, set by the encoder lookahead
+    int64_t lookahead_mc_var;   ///< low resolution estimate of mc_mb_var_sum against the previous input picture
 
     int reference;
     int shared;
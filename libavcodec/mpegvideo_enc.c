@@ -537,6 +537,20 @@ static av_cold int init_buffers(MPVMainEncContext *const m, AVCodecContext *avct
         }
     }
 
+    if (m->rc_lookahead) {
+        const size_t nb_blocks  = (s->c.width >> 4) * (size_t)(s->c.height >> 4);
+        const size_t plane_size = FFALIGN(s->c.width >> 1, 16) * (size_t)(s->c.height >> 1);
+
+        for (int i = 0; i < 2; i++) {
+            m->lookahead_buf[i] = av_mallocz(plane_size);
+            if (!m->lookahead_buf[i] ||
+                !FF_ALLOCZ_TYPED_ARRAY(m->lookahead_mv[i], nb_blocks))
+                return AVERROR(ENOMEM);
+        }
+        if (!FF_ALLOCZ_TYPED_ARRAY(m->lookahead_row, s->c.height >> 4))
+            return AVERROR(ENOMEM);
+    }
+
     return 0;
 }
 
@@ -795,6 +809,12 @@ av_cold int ff_mpv_encode_init(AVCodecContext *avctx)
         return AVERROR(EINVAL);
     }
 
+    if (m->rc_lookahead && (avctx->flags & AV_CODEC_FLAG_PASS2)) {
+        av_log(avctx, AV_LOG_WARNING,
+               "rc_lookahead is not used in the second pass, disabling it\n");
+        m->rc_lookahead = 0;
+    }
+
     if (m->scenechange_threshold < 1000000000 &&
         (avctx->flags & AV_CODEC_FLAG_CLOSED_GOP)) {
         av_log(avctx, AV_LOG_ERROR,
@@ -996,6 +1016,8 @@ av_cold int ff_mpv_encode_init(AVCodecContext *avctx)
     }
 
     avctx->has_b_frames = !s->c.low_delay;
+    /* pictures held back for the lookahead delay the output further */
+    avctx->delay       += m->rc_lookahead;
 
     s->c.encoding = 1;
 
@@ -1111,12 +1133,19 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
     ff_mpv_common_end(&s->c);
     av_refstruct_pool_uninit(&s->c.picture_pool);
 
-    for (int i = 0; i < MPVENC_MAX_B_FRAMES + 1; i++) {
+    for (int i = 0; i < FF_ARRAY_ELEMS(m->input_picture); i++)
         av_refstruct_unref(&m->input_picture[i]);
+    for (int i = 0; i < FF_ARRAY_ELEMS(m->reordered_input_picture); i++)
         av_refstruct_unref(&m->reordered_input_picture[i]);
-    }
     for (int i = 0; i < FF_ARRAY_ELEMS(m->tmp_frames); i++)
         av_frame_free(&m->tmp_frames[i]);
+    for (int i = 0; i < FF_ARRAY_ELEMS(m->hier_buf); i++)
+        av_freep(&m->hier_buf[i]);
+    for (int i = 0; i < 2; i++) {
+        av_freep(&m->lookahead_buf[i]);
+        av_freep(&m->lookahead_mv[i]);
+    }
+    av_freep(&m->lookahead_row);
 
     av_frame_free(&s->new_pic);
 
@@ -1262,6 +1291,151 @@ static int get_intra_count(MPVEncContext *const s, const uint8_t *src,
     return acc;
 }
 
+/**
+ * Estimate the intra and inter cost of one row of 8x8 blocks of the half
+ * resolution input picture. The intra cost is the block variance, the inter
+ * cost the SSE of the best match of a small search in the previous input
+ * picture; both are summed per pixel like mb_var and mc_mb_var.
+ */
+static int lookahead_row(AVCodecContext *avctx, void *arg, int y, int threadnr)
+{
+    MPVMainEncContext *const m = avctx->priv_data;
+    MPVEncContext     *const s = &m->s;
+    const int has_ref = *(const int *)arg;
+    const int bw = s->c.width  >> 4;
+    const int bh = s->c.height >> 4;
+    const ptrdiff_t stride = FFALIGN(s->c.width >> 1, 16);
+    const uint8_t *const cur = m->lookahead_buf[0] + 8 * y * stride;
+    const uint8_t *const ref = m->lookahead_buf[1] + 8 * y * stride;
+    int16_t (*const mv)[2]            = m->lookahead_mv[0] + y * bw;
+    const int16_t (*const prev_mv)[2] = (const int16_t (*)[2])m->lookahead_mv[1] + y * bw;
+    int64_t intra_sum = 0, inter_sum = 0, score = 0;
+
+    for (int x = 0; x < bw; x++) {
+        const uint8_t *const src = cur + 8 * x;
+        const int xmin = -8 * x, xmax = 8 * (bw - 1 - x);
+        const int ymin = -8 * y, ymax = 8 * (bh - 1 - y);
+        int sum = 0, sqr = 0, intra, inter;
+
+        for (int j = 0; j < 8; j++) {
+            for (int i = 0; i < 8; i++) {
+                const int v = src[i + j * stride];
+                sum += v;
+                sqr += v * v;
+            }
+        }
+        intra = sqr - (sum * sum >> 6);
+
+        if (has_ref) {
+            const uint8_t *cand[4];
+            int cand_mv[4][2] = {
+                { 0, 0 },
+                { x ? mv[x - 1][0] : 0, x ? mv[x - 1][1] : 0 },
+                { prev_mv[x][0], prev_mv[x][1] },
+                { x + 1 < bw ? prev_mv[x + 1][0] : 0, x + 1 < bw ? prev_mv[x + 1][1] : 0 },
+            };
+            int scores[4], best = INT_MAX, mx = 0, my = 0;
+
+            for (int i = 0; i < 4; i++) {
+                cand_mv[i][0] = av_clip(cand_mv[i][0], xmin, xmax);
+                cand_mv[i][1] = av_clip(cand_mv[i][1], ymin, ymax);
+                cand[i] = ref + 8 * x + cand_mv[i][0] + cand_mv[i][1] * stride;
+            }
+            s->me.sad_x4[1](src, cand, stride, 8, scores);
+            for (int i = 0; i < 4; i++) {
+                if (scores[i] < best) {
+                    best = scores[i];
+                    mx   = cand_mv[i][0];
+                    my   = cand_mv[i][1];
+                }
+            }
+
+            /* small diamond refinement */
+            for (int iter = 0; iter < 8; iter++) {
+                static const int8_t dia[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+                const uint8_t *const center = ref + 8 * x + mx + my * stride;
+                int dir = -1;
+
+                for (int i = 0; i < 4; i++) {
+                    const int nx = mx + dia[i][0], ny = my + dia[i][1];
+                    cand[i] = nx < xmin || nx > xmax || ny < ymin || ny > ymax ?
+                              center : center + dia[i][0] + dia[i][1] * stride;
+                }
+                s->me.sad_x4[1](src, cand, stride, 8, scores);
+                for (int i = 0; i < 4; i++) {
+                    if (scores[i] < best) {
+                        best = scores[i];
+                        dir  = i;
+                    }
+                }
+                if (dir < 0)
+                    break;
+                mx += dia[dir][0];
+                my += dia[dir][1];
+            }
+            mv[x][0] = mx;
+            mv[x][1] = my;
+            inter = s->sse_cmp[1](NULL, src, ref + 8 * x + mx + my * stride, stride, 8);
+        } else {
+            mv[x][0] = mv[x][1] = 0;
+            inter = intra;
+        }
+
+        intra_sum += (intra + 32) >> 6;
+        inter_sum += (inter + 32) >> 6;
+        /* same measure as the scene_change_score of the motion estimation,
+         * scaled to full resolution macroblocks */
+        score += (int)ff_sqrt(4 * inter) - (int)ff_sqrt(4 * intra);
+    }
+    m->lookahead_row[y][0] = intra_sum;
+    m->lookahead_row[y][1] = inter_sum;
+    m->lookahead_row[y][2] = score;
+
+    return 0;
+}
+
+/**
+ * Analyse a new input picture at half resolution for the rate control
+ * lookahead and mark it as an I-frame if it starts a new scene.
+ */
+static void lookahead_analyse(MPVMainEncContext *const m, MPVPicture *pic,
+                              const AVFrame *pic_arg)
+{
+    MPVEncContext *const s = &m->s;
+    const int bh = s->c.height >> 4;
+    int16_t (*const prev_mv)[2] = m->lookahead_mv[0];
+    int has_ref = pic->display_picture_number > 0;
+    int64_t var = 0, mc_var = 0, score = 0;
+
+    FFSWAP(uint8_t *, m->lookahead_buf[0], m->lookahead_buf[1]);
+    m->lookahead_mv[0] = m->lookahead_mv[1];
+    m->lookahead_mv[1] = prev_mv;
+
+    s->mpvencdsp.shrink[1](m->lookahead_buf[0], FFALIGN(s->c.width >> 1, 16),
+                           pic_arg->data[0], pic_arg->linesize[0],
+                           s->c.width >> 1, s->c.height >> 1);
+    s->c.avctx->execute2(s->c.avctx, lookahead_row, &has_ref, NULL, bh);
+    emms_c();
+
+    for (int y = 0; y < bh; y++) {
+        var    += m->lookahead_row[y][0];
+        mc_var += m->lookahead_row[y][1];
+        score  += m->lookahead_row[y][2];
+    }
+    pic->lookahead_var    = var;
+    pic->lookahead_mc_var = mc_var;
+
+    /* Content that is cheaper to code intra on every picture (noise, heavy
+     * motion) keeps the score above the threshold, only a jump is a cut. */
+    if (has_ref && score > m->scenechange_threshold &&
+        score > 2 * m->lookahead_score) {
+        ff_dlog(s->c.avctx, "Scene change in lookahead, picture %d %"PRId64" %"PRId64"\n",
+                pic->display_picture_number, var, mc_var);
+        pic->f->pict_type = AV_PICTURE_TYPE_I;
+    }
+    m->lookahead_score = score;
+}
+
 /**
  * Allocates new buffers for an AVFrame and copies the properties
  * from another AVFrame.
@@ -1304,8 +1478,9 @@ static int load_input_picture(MPVMainEncContext *const m, const AVFrame *pic_arg
     MPVPicture *pic = NULL;
     int64_t pts;
     int display_picture_number = 0, ret;
-    int encoding_delay = m->max_b_frames ? m->max_b_frames
-                                         : (s->c.low_delay ? 0 : 1);
+    int encoding_delay = (m->max_b_frames ? m->max_b_frames
+                                          : (s->c.low_delay ? 0 : 1)) +
+                         m->rc_lookahead;
     int flush_offset = 1;
     int direct = 1;
 
@@ -1412,6 +1587,9 @@ static int load_input_picture(MPVMainEncContext *const m, const AVFrame *pic_arg
 
         pic->display_picture_number = display_picture_number;
         pic->f->pts = pts; // we set this here to avoid modifying pic_arg
+
+        if (m->rc_lookahead)
+            lookahead_analyse(m, pic, pic_arg);
     } else if (!m->reordered_input_picture[1]) {
         /* Flushing: When the above check is true, the encoder is about to run
          * out of frames to encode. Check if there are input_pictures left;
@@ -1426,9 +1604,9 @@ static int load_input_picture(MPVMainEncContext *const m, const AVFrame *pic_arg
     }
 
     /* shift buffer entries */
-    for (int i = flush_offset; i <= MPVENC_MAX_B_FRAMES; i++)
+    for (int i = flush_offset; i < FF_ARRAY_ELEMS(m->input_picture); i++)
         m->input_picture[i - flush_offset] = m->input_picture[i];
-    for (int i = MPVENC_MAX_B_FRAMES + 1 - flush_offset; i <= MPVENC_MAX_B_FRAMES; i++)
+    for (int i = FF_ARRAY_ELEMS(m->input_picture) - flush_offset; i < FF_ARRAY_ELEMS(m->input_picture); i++)
         m->input_picture[i] = NULL;
 
     m->input_picture[encoding_delay] = pic;
@@ -3728,6 +3906,12 @@ static int encode_picture(MPVMainEncContext *const m, const AVPacket *pkt)
         update_qscale(m);
     }
 
+    if (s->me.motion_est == FF_ME_HIER) {
+        ret = ff_me_init_hier_pic(m);
+        if (ret < 0)
+            return ret;
+    }
+
     s->c.mb_intra = 0; //for the rate distortion & bit compare functions
     for (int i = 0; i < context_count; i++) {
         MPVEncContext *const slice = s->c.enc_contexts[i];
@@ -3743,6 +3927,7 @@ static int encode_picture(MPVMainEncContext *const m, const AVPacket *pkt)
                 return ret;
             slice->lambda  = s->lambda;
             slice->lambda2 = s->lambda2;
+            memcpy(slice->me.hier_pic, s->me.hier_pic, sizeof(s->me.hier_pic));
         }
         slice->me.temp = slice->me.scratchpad = slice->c.sc.scratchpad_buf;
         ff_me_init_pic(slice);
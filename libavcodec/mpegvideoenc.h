@@ -41,6 +41,7 @@
 #include "ratecontrol.h"
 
 #define MPVENC_MAX_B_FRAMES 16
+#define MPVENC_MAX_LOOKAHEAD 60
 
 typedef struct MPVEncContext {
     MpegEncContext c;           ///< the common base context
@@ -179,7 +180,7 @@ typedef struct MPVMainEncContext {
     int input_picture_number;      ///< used to set pic->display_picture_number
     int coded_picture_number;      ///< used to set pic->coded_picture_number
 
-    MPVPicture *input_picture[MPVENC_MAX_B_FRAMES + 1]; ///< next pictures in display order
+    MPVPicture *input_picture[MPVENC_MAX_B_FRAMES + MPVENC_MAX_LOOKAHEAD + 1]; ///< next pictures in display order
     MPVPicture *reordered_input_picture[MPVENC_MAX_B_FRAMES + 1]; ///< next pictures in coded order
 
     int64_t user_specified_pts;    ///< last non-zero pts from user-supplied AVFrame
@@ -200,6 +201,13 @@ typedef struct MPVMainEncContext {
 
     int scenechange_threshold;
 
+    /* rate control lookahead */
+    int rc_lookahead;              ///< number of pictures analysed ahead of the one being coded
+    uint8_t *lookahead_buf[2];     ///< half resolution luma of the current and previous input picture
+    int16_t (*lookahead_mv[2])[2]; ///< half resolution motion vectors of the current and previous input picture
+    int64_t (*lookahead_row)[3];   ///< per block row sums of intra cost, inter cost and scene change score
+    int64_t lookahead_score;       ///< scene change score of the previous input picture
+
     int noise_reduction;
 
     float border_masking;
@@ -235,6 +243,8 @@ typedef struct MPVMainEncContext {
 
     int me_penalty_compensation;
     int me_pre;                          ///< prepass for motion estimation
+    uint8_t *hier_buf[3];                ///< low resolution luma planes for FF_ME_HIER
+    int hier_pic_number[3];              ///< display_picture_number of the picture in hier_buf
 
     int64_t mb_var_sum;            ///< sum of MB variance for current frame
     int64_t mc_mb_var_sum;         ///< motion compensated MB variance for current frame
@@ -345,14 +355,16 @@ FF_MPV_OPT_CMP_FUNC, \
 #define FF_MPV_COMMON_BFRAME_OPTS \
 {"b_strategy", "Strategy to choose between I/P/B-frames",      FF_MPV_MAIN_OFFSET(b_frame_strategy), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, 2, FF_MPV_OPT_FLAGS }, \
 {"b_sensitivity", "Adjust sensitivity of b_frame_strategy 1",  FF_MPV_MAIN_OFFSET(b_sensitivity), AV_OPT_TYPE_INT, {.i64 = 40 }, 1, INT_MAX, FF_MPV_OPT_FLAGS }, \
-{"brd_scale", "Downscale frames for dynamic B-frame decision", FF_MPV_MAIN_OFFSET(brd_scale), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, 3, FF_MPV_OPT_FLAGS },
+{"brd_scale", "Downscale frames for dynamic B-frame decision", FF_MPV_MAIN_OFFSET(brd_scale), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, 3, FF_MPV_OPT_FLAGS }, \
+{"rc_lookahead", "Number of frames to analyse ahead for rate control and scene change detection", FF_MPV_MAIN_OFFSET(rc_lookahead), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, MPVENC_MAX_LOOKAHEAD, FF_MPV_OPT_FLAGS },
 
 #define FF_MPV_COMMON_MOTION_EST_OPTS \
 { "mv0",            "always try a mb with mv=<0,0>",                     0, AV_OPT_TYPE_CONST, { .i64 = FF_MPV_FLAG_MV0 },    0, 0, FF_MPV_OPT_FLAGS, .unit = "mpv_flags" },\
-{"motion_est", "motion estimation algorithm",                       FF_MPV_OFFSET(me.motion_est), AV_OPT_TYPE_INT, {.i64 = FF_ME_EPZS }, FF_ME_ZERO, FF_ME_XONE, FF_MPV_OPT_FLAGS, .unit = "motion_est" },   \
+{"motion_est", "motion estimation algorithm",                       FF_MPV_OFFSET(me.motion_est), AV_OPT_TYPE_INT, {.i64 = FF_ME_EPZS }, FF_ME_ZERO, FF_ME_HIER, FF_MPV_OPT_FLAGS, .unit = "motion_est" },   \
 { "zero", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = FF_ME_ZERO }, 0, 0, FF_MPV_OPT_FLAGS, .unit = "motion_est" }, \
 { "epzs", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = FF_ME_EPZS }, 0, 0, FF_MPV_OPT_FLAGS, .unit = "motion_est" }, \
 { "xone", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = FF_ME_XONE }, 0, 0, FF_MPV_OPT_FLAGS, .unit = "motion_est" }, \
+{ "hier", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = FF_ME_HIER }, 0, 0, FF_MPV_OPT_FLAGS, .unit = "motion_est" }, \
 {"mepc", "Motion estimation bitrate penalty compensation (1.0 = 256)", FF_MPV_MAIN_OFFSET(me_penalty_compensation), AV_OPT_TYPE_INT, {.i64 = 256 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS }, \
 {"mepre", "pre motion estimation", FF_MPV_MAIN_OFFSET(me_pre), AV_OPT_TYPE_INT, {.i64 = 0 }, INT_MIN, INT_MAX, FF_MPV_OPT_FLAGS }, \
 {"intra_penalty", "Penalty for intra blocks in block decision", FF_MPV_OFFSET(intra_penalty), AV_OPT_TYPE_INT, {.i64 = 0 }, 0, INT_MAX/2, FF_MPV_OPT_FLAGS }, \
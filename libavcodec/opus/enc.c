@@ -35,17 +35,45 @@
 #include "bytestream.h"
 #include "audio_frame_queue.h"
 #include "codec_internal.h"
+#include "vorbis_data.h"
+
+/* Coded channel of each channel in Vorbis order, for channel mapping family 1 */
+static const uint8_t opus_vorbis_mapping[8][8] = {
+    { 0 },
+    { 0, 1 },
+    { 0, 2, 1 },
+    { 0, 1, 2, 3 },
+    { 0, 4, 1, 2, 3 },
+    { 0, 4, 1, 2, 3, 5 },
+    { 0, 4, 1, 2, 3, 5, 6 },
+    { 0, 6, 1, 2, 3, 4, 5, 7 },
+};
+
+/* A mono or coupled stereo Opus stream, all streams are encoded in parallel */
+typedef struct OpusEncStream {
+    OpusPsyContext psyctx;
+    AVTXContext *tx[CELT_BLOCK_NB];
+    av_tx_fn tx_fn[CELT_BLOCK_NB];
+    CeltPVQ *pvq;
+
+    int channels;
+    int ch_map[OPUS_MAX_CHANNELS]; /* Input channel of each coded channel */
+
+    CeltFrame *frame;
+    OpusRangeCoder *rc;
+
+    /* Actual energy the decoder will have */
+    float last_quantized_energy[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
+
+    DECLARE_ALIGNED(32, float, scratch)[2048];
+} OpusEncStream;
 
 typedef struct OpusEncContext {
     AVClass *av_class;
     OpusEncOptions options;
-    OpusPsyContext psyctx;
     AVCodecContext *avctx;
     AudioFrameQueue afq;
     AVFloatDSPContext *dsp;
-    AVTXContext *tx[CELT_BLOCK_NB];
-    av_tx_fn tx_fn[CELT_BLOCK_NB];
-    CeltPVQ *pvq;
     struct FFBufQueue bufqueue;
 
     uint8_t enc_id[64];
@@ -55,17 +83,17 @@ typedef struct OpusEncContext {
 
     int channels;
 
-    CeltFrame *frame;
-    OpusRangeCoder *rc;
+    int mapping_family;
+    int nb_streams;
+    int nb_coupled_streams;
+    uint8_t mapping[255];
 
-    /* Actual energy the decoder will have */
-    float last_quantized_energy[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
-
-    DECLARE_ALIGNED(32, float, scratch)[2048];
+    OpusEncStream *streams;
 } OpusEncContext;
 
-static void opus_write_extradata(AVCodecContext *avctx)
+static void opus_write_extradata(OpusEncContext *s)
 {
+    AVCodecContext *avctx = s->avctx;
     uint8_t *bs = avctx->extradata;
 
     bytestream_put_buffer(&bs, "OpusHead", 8);
@@ -74,10 +102,16 @@ static void opus_write_extradata(AVCodecContext *avctx)
     bytestream_put_le16  (&bs, avctx->initial_padding);
     bytestream_put_le32  (&bs, avctx->sample_rate);
     bytestream_put_le16  (&bs, 0x0);
-    bytestream_put_byte  (&bs, 0x0); /* Default layout */
+    bytestream_put_byte  (&bs, s->mapping_family);
+    if (s->mapping_family) {
+        bytestream_put_byte  (&bs, s->nb_streams);
+        bytestream_put_byte  (&bs, s->nb_coupled_streams);
+        bytestream_put_buffer(&bs, s->mapping, s->channels);
+    }
 }
 
-static int opus_gen_toc(OpusEncContext *s, uint8_t *toc, int *size, int *fsize_needed)
+static int opus_gen_toc(OpusEncContext *s, OpusEncStream *st, uint8_t *toc,
+                        int *size, int *fsize_needed)
 {
     int tmp = 0x0, extended_toc = 0;
     static const int toc_cfg[][OPUS_MODE_NB][OPUS_BANDWITH_NB] = {
@@ -95,7 +129,7 @@ static int opus_gen_toc(OpusEncContext *s, uint8_t *toc, int *size, int *fsize_n
     if (!cfg)
         return 1;
     if (s->packet.frames == 2) {                                       /* 2 packets */
-        if (s->frame[0].framebits == s->frame[1].framebits) {          /* same size */
+        if (st->frame[0].framebits == st->frame[1].framebits) {        /* same size */
             tmp = 0x1;
         } else {                                                  /* different size */
             tmp = 0x2;
@@ -105,12 +139,12 @@ static int opus_gen_toc(OpusEncContext *s, uint8_t *toc, int *size, int *fsize_n
         tmp = 0x3;
         extended_toc = 1;
     }
-    tmp |= (s->channels > 1) << 2;                                /* Stereo or mono */
+    tmp |= (st->channels > 1) << 2;                               /* Stereo or mono */
     tmp |= (cfg - 1)         << 3;                           /* codec configuration */
     *toc++ = tmp;
     if (extended_toc) {
         for (int i = 0; i < (s->packet.frames - 1); i++)
-            *fsize_needed |= (s->frame[i].framebits != s->frame[i + 1].framebits);
+            *fsize_needed |= (st->frame[i].framebits != st->frame[i + 1].framebits);
         tmp = (*fsize_needed) << 7;                                /* vbr flag */
         tmp |= (0) << 6;                                       /* padding flag */
         tmp |= s->packet.frames;
@@ -120,42 +154,38 @@ static int opus_gen_toc(OpusEncContext *s, uint8_t *toc, int *size, int *fsize_n
     return 0;
 }
 
-static void celt_frame_setup_input(OpusEncContext *s, CeltFrame *f)
+/* The queued frames are only peeked at, as the streams share them. They are
+ * popped off once all streams have been encoded, except for the last one,
+ * which is needed for the overlap of the next frame. */
+static void celt_frame_setup_input(OpusEncContext *s, OpusEncStream *st,
+                                   CeltFrame *f, int index)
 {
     AVFrame *cur = NULL;
     const int subframesize = s->avctx->frame_size;
     int subframes = OPUS_BLOCK_SIZE(s->packet.framesize) / subframesize;
+    int offset = index*subframes;
 
-    cur = ff_bufqueue_get(&s->bufqueue);
+    cur = ff_bufqueue_peek(&s->bufqueue, offset);
 
     for (int ch = 0; ch < f->channels; ch++) {
         CeltBlock *b = &f->block[ch];
-        const void *input = cur->extended_data[ch];
+        const void *input = cur->extended_data[st->ch_map[ch]];
         size_t bps = av_get_bytes_per_sample(cur->format);
         memcpy(b->overlap, input, bps*cur->nb_samples);
     }
 
-    av_frame_free(&cur);
-
     for (int sf = 0; sf < subframes; sf++) {
-        if (sf != (subframes - 1))
-            cur = ff_bufqueue_get(&s->bufqueue);
-        else
-            cur = ff_bufqueue_peek(&s->bufqueue, 0);
+        cur = ff_bufqueue_peek(&s->bufqueue, offset + 1 + sf);
 
         for (int ch = 0; ch < f->channels; ch++) {
             CeltBlock *b = &f->block[ch];
-            const void *input = cur->extended_data[ch];
+            const void *input = cur->extended_data[st->ch_map[ch]];
             const size_t bps  = av_get_bytes_per_sample(cur->format);
             const size_t left = (subframesize - cur->nb_samples)*bps;
             const size_t len  = FFMIN(subframesize, cur->nb_samples)*bps;
             memcpy(&b->samples[sf*subframesize], input, len);
             memset(&b->samples[cur->nb_samples], 0, left);
         }
-
-        /* Last frame isn't popped off and freed yet - we need it for overlap */
-        if (sf != (subframes - 1))
-            av_frame_free(&cur);
     }
 }
 
@@ -195,9 +225,13 @@ static void celt_apply_preemph_filter(OpusEncContext *s, CeltFrame *f)
 }
 
 /* Create the window and do the mdct */
-static void celt_frame_mdct(OpusEncContext *s, CeltFrame *f)
+static void celt_frame_mdct(OpusEncContext *s, OpusEncStream *st, CeltFrame *f)
 {
-    float *win = s->scratch, *temp = s->scratch + 1920;
+    float *win = st->scratch, *temp = st->scratch + 1920;
+    /* The whole spectrum is processed at once, in multiples of 16 */
+    const int coeffs_len = FFALIGN(OPUS_BLOCK_SIZE(f->size), 16);
+    const int bands_end  = ff_celt_freq_bands[CELT_MAX_BANDS] << f->size;
+    float *sq = st->scratch, *gain = st->scratch + CELT_MAX_FRAME_SIZE;
 
     if (f->transient) {
         for (int ch = 0; ch < f->channels; ch++) {
@@ -209,7 +243,7 @@ static void celt_frame_mdct(OpusEncContext *s, CeltFrame *f)
                 s->dsp->vector_fmul_reverse(&win[CELT_OVERLAP], src2,
                                             ff_celt_window_padded, 128);
                 src1 = src2;
-                s->tx_fn[0](s->tx[0], b->coeffs + t, win, sizeof(float)*f->blocks);
+                st->tx_fn[0](st->tx[0], b->coeffs + t, win, sizeof(float)*f->blocks);
             }
         }
     } else {
@@ -231,32 +265,40 @@ static void celt_frame_mdct(OpusEncContext *s, CeltFrame *f)
                                         ff_celt_window_padded, 128);
             memcpy(win + lap_dst + blk_len, temp, CELT_OVERLAP*sizeof(float));
 
-            s->tx_fn[f->size](s->tx[f->size], b->coeffs, win, sizeof(float));
+            st->tx_fn[f->size](st->tx[f->size], b->coeffs, win, sizeof(float));
         }
     }
 
+    for (int i = bands_end; i < coeffs_len; i++)
+        gain[i] = 1.0f;
+
     for (int ch = 0; ch < f->channels; ch++) {
         CeltBlock *block = &f->block[ch];
+
+        s->dsp->vector_fmul(sq, block->coeffs, block->coeffs, coeffs_len);
+
         for (int i = 0; i < CELT_MAX_BANDS; i++) {
             float ener = 0.0f;
             int band_offset = ff_celt_freq_bands[i] << f->size;
             int band_size   = ff_celt_freq_range[i] << f->size;
-            float *coeffs   = &block->coeffs[band_offset];
 
             for (int j = 0; j < band_size; j++)
-                ener += coeffs[j]*coeffs[j];
+                ener += sq[band_offset + j];
 
             block->lin_energy[i] = sqrtf(ener) + FLT_EPSILON;
             ener = 1.0f/block->lin_energy[i];
 
             for (int j = 0; j < band_size; j++)
-                coeffs[j] *= ener;
+                gain[band_offset + j] = ener;
 
             block->energy[i] = log2f(block->lin_energy[i]) - ff_celt_mean_energy[i];
 
             /* CELT_ENERGY_SILENCE is what the decoder uses and its not -infinity */
             block->energy[i] = FFMAX(block->energy[i], CELT_ENERGY_SILENCE);
         }
+
+        /* Normalize the bands */
+        s->dsp->vector_fmul(block->coeffs, block->coeffs, gain, coeffs_len);
     }
 }
 
@@ -422,20 +464,20 @@ static void celt_quant_final(OpusEncContext *s, OpusRangeCoder *rc, CeltFrame *f
     }
 }
 
-static void celt_encode_frame(OpusEncContext *s, OpusRangeCoder *rc,
-                              CeltFrame *f, int index)
+static void celt_encode_frame(OpusEncContext *s, OpusEncStream *st,
+                              OpusRangeCoder *rc, CeltFrame *f, int index)
 {
     ff_opus_rc_enc_init(rc);
 
-    ff_opus_psy_celt_frame_init(&s->psyctx, f, index);
+    ff_opus_psy_celt_frame_init(&st->psyctx, f, index);
 
-    celt_frame_setup_input(s, f);
+    celt_frame_setup_input(s, st, f, index);
 
     if (f->silence) {
         if (f->framebits >= 16)
             ff_opus_rc_enc_log(rc, 1, 15); /* Silence (if using explicit singalling) */
-        for (int ch = 0; ch < s->channels; ch++)
-            memset(s->last_quantized_energy[ch], 0.0f, sizeof(float)*CELT_MAX_BANDS);
+        for (int ch = 0; ch < st->channels; ch++)
+            memset(st->last_quantized_energy[ch], 0.0f, sizeof(float)*CELT_MAX_BANDS);
         return;
     }
 
@@ -447,11 +489,11 @@ static void celt_encode_frame(OpusEncContext *s, OpusRangeCoder *rc,
     }
 
     /* Transform */
-    celt_frame_mdct(s, f);
+    celt_frame_mdct(s, st, f);
 
     /* Need to handle transient/non-transient switches at any point during analysis */
-    while (ff_opus_psy_celt_frame_process(&s->psyctx, f, index))
-        celt_frame_mdct(s, f);
+    while (ff_opus_psy_celt_frame_process(&st->psyctx, f, index))
+        celt_frame_mdct(s, st, f);
 
     ff_opus_rc_enc_init(rc);
 
@@ -467,7 +509,7 @@ static void celt_encode_frame(OpusEncContext *s, OpusRangeCoder *rc,
         ff_opus_rc_enc_log(rc, f->transient, 3);
 
     /* Main encoding */
-    celt_quant_coarse  (f, rc, s->last_quantized_energy);
+    celt_quant_coarse  (f, rc, st->last_quantized_energy);
     celt_enc_tf        (f, rc);
     ff_celt_bitalloc   (f, rc, 1);
     celt_quant_fine    (f, rc);
@@ -483,10 +525,21 @@ static void celt_encode_frame(OpusEncContext *s, OpusRangeCoder *rc,
     for (int ch = 0; ch < f->channels; ch++) {
         CeltBlock *block = &f->block[ch];
         for (int i = 0; i < CELT_MAX_BANDS; i++)
-            s->last_quantized_energy[ch][i] = block->energy[i] + block->error_energy[i];
+            st->last_quantized_energy[ch][i] = block->energy[i] + block->error_energy[i];
     }
 }
 
+static int encode_stream_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    OpusEncContext *s = avctx->priv_data;
+    OpusEncStream *st = &s->streams[jobnr];
+
+    for (int i = 0; i < s->packet.frames; i++)
+        celt_encode_frame(s, st, &st->rc[i], &st->frame[i], i);
+
+    return 0;
+}
+
 static inline int write_opuslacing(uint8_t *dst, int v)
 {
     dst[0] = FFMIN(v - FFALIGN(v - 255, 4), v);
@@ -496,24 +549,39 @@ static inline int write_opuslacing(uint8_t *dst, int v)
 
 static void opus_packet_assembler(OpusEncContext *s, AVPacket *avpkt)
 {
-    int offset, fsize_needed;
+    int offset = 0;
+
+    for (int n = 0; n < s->nb_streams; n++) {
+        OpusEncStream *st = &s->streams[n];
+        int size, fsize_needed;
 
-    /* Write toc */
-    opus_gen_toc(s, avpkt->data, &offset, &fsize_needed);
+        /* Write toc */
+        opus_gen_toc(s, st, avpkt->data + offset, &size, &fsize_needed);
+        offset += size;
 
-    /* Frame sizes if needed */
-    if (fsize_needed) {
-        for (int i = 0; i < s->packet.frames - 1; i++) {
+        /* Frame sizes if needed */
+        if (fsize_needed) {
+            for (int i = 0; i < s->packet.frames - 1; i++) {
+                offset += write_opuslacing(avpkt->data + offset,
+                                           st->frame[i].framebits >> 3);
+            }
+        }
+
+        /* All but the last stream use self-delimited framing, which also
+         * codes the size of the last frame, or the size of all frames if
+         * they all have the same size */
+        if (n < s->nb_streams - 1) {
+            const int last = fsize_needed ? s->packet.frames - 1 : 0;
             offset += write_opuslacing(avpkt->data + offset,
-                                       s->frame[i].framebits >> 3);
+                                       st->frame[last].framebits >> 3);
         }
-    }
 
-    /* Packets */
-    for (int i = 0; i < s->packet.frames; i++) {
-        ff_opus_rc_enc_end(&s->rc[i], avpkt->data + offset,
-                           s->frame[i].framebits >> 3);
-        offset += s->frame[i].framebits >> 3;
+        /* Packets */
+        for (int i = 0; i < s->packet.frames; i++) {
+            ff_opus_rc_enc_end(&st->rc[i], avpkt->data + offset,
+                               st->frame[i].framebits >> 3);
+            offset += st->frame[i].framebits >> 3;
+        }
     }
 
     avpkt->size = offset;
@@ -548,27 +616,36 @@ static int opus_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                              const AVFrame *frame, int *got_packet_ptr)
 {
     OpusEncContext *s = avctx->priv_data;
-    int ret, frame_size, alloc_size = 0;
+    int ret, frame_size, subframes, need_more = 0, alloc_size = 0;
 
     if (frame) { /* Add new frame to queue */
         if ((ret = ff_af_queue_add(&s->afq, frame)) < 0)
             return ret;
         ff_bufqueue_add(avctx, &s->bufqueue, av_frame_clone(frame));
     } else {
-        ff_opus_psy_signal_eof(&s->psyctx);
+        for (int n = 0; n < s->nb_streams; n++)
+            ff_opus_psy_signal_eof(&s->streams[n].psyctx);
         if (!s->afq.remaining_samples || !avctx->frame_num)
             return 0; /* We've been flushed and there's nothing left to encode */
     }
 
-    /* Run the psychoacoustic system */
-    if (ff_opus_psy_process(&s->psyctx, &s->packet))
+    /* Run the psychoacoustic system, the first stream decides on the
+     * frame size and the number of frames for all of them */
+    for (int n = 0; n < s->nb_streams; n++) {
+        OpusPacketInfo packet;
+        need_more |= ff_opus_psy_process(&s->streams[n].psyctx, n ? &packet : &s->packet);
+    }
+    if (need_more)
         return 0;
+    for (int n = 1; n < s->nb_streams; n++)
+        ff_opus_psy_set_packet(&s->streams[n].psyctx, &s->packet);
 
     frame_size = OPUS_BLOCK_SIZE(s->packet.framesize);
+    subframes  = frame_size/s->avctx->frame_size;
 
     if (!frame) {
         /* This can go negative, that's not a problem, we only pad if positive */
-        int pad_empty = s->packet.frames*(frame_size/s->avctx->frame_size) - s->bufqueue.available + 1;
+        int pad_empty = s->packet.frames*subframes - s->bufqueue.available + 1;
         /* Pad with empty 2.5 ms frames to whatever framesize was decided,
          * this should only happen at the very last flush frame. The frames
          * allocated here will be freed (because they have no other references)
@@ -581,13 +658,22 @@ static int opus_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         }
     }
 
-    for (int i = 0; i < s->packet.frames; i++) {
-        celt_encode_frame(s, &s->rc[i], &s->frame[i], i);
-        alloc_size += s->frame[i].framebits >> 3;
+    if (s->nb_streams > 1)
+        avctx->execute2(avctx, encode_stream_job, NULL, NULL, s->nb_streams);
+    else
+        encode_stream_job(avctx, NULL, 0, 0);
+
+    for (int i = 0; i < s->packet.frames*subframes; i++) {
+        AVFrame *cur = ff_bufqueue_get(&s->bufqueue);
+        av_frame_free(&cur);
     }
 
-    /* Worst case toc + the frame lengths if needed */
-    alloc_size += 2 + s->packet.frames*2;
+    for (int n = 0; n < s->nb_streams; n++) {
+        for (int i = 0; i < s->packet.frames; i++)
+            alloc_size += s->streams[n].frame[i].framebits >> 3;
+        /* Worst case toc + the frame lengths if needed */
+        alloc_size += 2 + (s->packet.frames + 1)*2;
+    }
 
     if ((ret = ff_alloc_packet(avctx, avpkt, alloc_size)) < 0)
         return ret;
@@ -596,7 +682,8 @@ static int opus_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     opus_packet_assembler(s, avpkt);
 
     /* Update the psychoacoustic system */
-    ff_opus_psy_postencode_update(&s->psyctx, s->frame);
+    for (int n = 0; n < s->nb_streams; n++)
+        ff_opus_psy_postencode_update(&s->streams[n].psyctx, s->streams[n].frame);
 
     /* Remove samples from queue and skip if needed */
     ff_af_queue_remove(&s->afq, s->packet.frames*frame_size, &avpkt->pts, &avpkt->duration);
@@ -616,23 +703,83 @@ static av_cold int opus_encode_end(AVCodecContext *avctx)
 {
     OpusEncContext *s = avctx->priv_data;
 
-    for (int i = 0; i < CELT_BLOCK_NB; i++)
-        av_tx_uninit(&s->tx[i]);
+    for (int n = 0; s->streams && n < s->nb_streams; n++) {
+        OpusEncStream *st = &s->streams[n];
+        for (int i = 0; i < CELT_BLOCK_NB; i++)
+            av_tx_uninit(&st->tx[i]);
+        ff_celt_pvq_uninit(&st->pvq);
+        av_freep(&st->frame);
+        av_freep(&st->rc);
+        ff_opus_psy_end(&st->psyctx);
+    }
+    av_freep(&s->streams);
 
-    ff_celt_pvq_uninit(&s->pvq);
     av_freep(&s->dsp);
-    av_freep(&s->frame);
-    av_freep(&s->rc);
     ff_af_queue_close(&s->afq);
-    ff_opus_psy_end(&s->psyctx);
     ff_bufqueue_discard_all(&s->bufqueue);
 
     return 0;
 }
 
+/* Set up the channel mapping, assigning the input channels to the streams */
+static av_cold int opus_init_mapping(OpusEncContext *s)
+{
+    AVCodecContext *avctx = s->avctx;
+    const AVChannelLayout *layout = &avctx->ch_layout;
+
+    if (s->channels <= 2) {
+        s->mapping_family     = 0;
+        s->nb_streams         = 1;
+        s->nb_coupled_streams = s->channels - 1;
+        for (int i = 0; i < s->channels; i++)
+            s->mapping[i] = i;
+    } else if (layout->order == AV_CHANNEL_ORDER_AMBISONIC) {
+        int order = av_channel_layout_ambisonic_order(layout);
+        int acn_channels = (order + 1)*(order + 1);
+        int nondiegetic  = s->channels - acn_channels;
+        if (order < 0 || (nondiegetic && layout->u.mask != AV_CH_LAYOUT_STEREO)) {
+            av_log(avctx, AV_LOG_ERROR, "Unsupported ambisonic channel layout\n");
+            return AVERROR(EINVAL);
+        }
+        /* Each ambisonic channel is coded as a mono stream, the non-diegetic
+         * channels as a coupled stream in front of them */
+        s->mapping_family     = 2;
+        s->nb_coupled_streams = !!nondiegetic;
+        s->nb_streams         = acn_channels + s->nb_coupled_streams;
+        for (int i = 0; i < acn_channels; i++)
+            s->mapping[i] = 2*s->nb_coupled_streams + i;
+        for (int i = 0; i < nondiegetic; i++)
+            s->mapping[acn_channels + i] = i;
+    } else {
+        s->mapping_family     = 1;
+        s->nb_coupled_streams = ff_opus_default_coupled_streams[s->channels - 1];
+        s->nb_streams         = s->channels - s->nb_coupled_streams;
+        memcpy(s->mapping, opus_vorbis_mapping[s->channels - 1], s->channels);
+    }
+
+    s->streams = av_calloc(s->nb_streams, sizeof(*s->streams));
+    if (!s->streams)
+        return AVERROR(ENOMEM);
+
+    for (int n = 0; n < s->nb_streams; n++)
+        s->streams[n].channels = 1 + (n < s->nb_coupled_streams);
+
+    for (int i = 0; i < s->channels; i++) {
+        const int idx = s->mapping_family == 1 ?
+                        s->mapping[ff_vorbis_channel_layout_offsets[s->channels - 1][i]] :
+                        s->mapping[i];
+        if (idx < 2*s->nb_coupled_streams)
+            s->streams[idx >> 1].ch_map[idx & 1] = i;
+        else
+            s->streams[idx - s->nb_coupled_streams].ch_map[0] = i;
+    }
+
+    return 0;
+}
+
 static av_cold int opus_encode_init(AVCodecContext *avctx)
 {
-    int ret, max_frames;
+    int ret, max_frames, nb_threads = 1;
     OpusEncContext *s = avctx->priv_data;
 
     s->avctx = avctx;
@@ -647,8 +794,11 @@ static av_cold int opus_encode_init(AVCodecContext *avctx)
     /* Initial padding will change if SILK is ever supported */
     avctx->initial_padding = 120;
 
+    if ((ret = opus_init_mapping(s)) < 0)
+        return ret;
+
     if (!avctx->bit_rate) {
-        int coupled = ff_opus_default_coupled_streams[s->channels - 1];
+        int coupled = s->nb_coupled_streams;
         avctx->bit_rate = coupled*(96000) + (s->channels - coupled*2)*(48000);
     } else if (avctx->bit_rate < 6000 || avctx->bit_rate > 255000 * s->channels) {
         int64_t clipped_rate = av_clip(avctx->bit_rate, 6000, 255000 * s->channels);
@@ -658,55 +808,67 @@ static av_cold int opus_encode_init(AVCodecContext *avctx)
     }
 
     /* Extradata */
-    avctx->extradata_size = 19;
+    avctx->extradata_size = 19 + (s->mapping_family ? 2 + s->channels : 0);
     avctx->extradata = av_malloc(avctx->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
     if (!avctx->extradata)
         return AVERROR(ENOMEM);
-    opus_write_extradata(avctx);
+    opus_write_extradata(s);
 
     ff_af_queue_init(avctx, &s->afq);
 
-    if ((ret = ff_celt_pvq_init(&s->pvq, 1)) < 0)
-        return ret;
-
     if (!(s->dsp = avpriv_float_dsp_alloc(avctx->flags & AV_CODEC_FLAG_BITEXACT)))
         return AVERROR(ENOMEM);
 
-    /* I have no idea why a base scaling factor of 68 works, could be the twiddles */
-    for (int i = 0; i < CELT_BLOCK_NB; i++) {
-        const float scale = 68 << (CELT_BLOCK_NB - 1 - i);
-        if ((ret = av_tx_init(&s->tx[i], &s->tx_fn[i], AV_TX_FLOAT_MDCT, 0, 15 << (i + 3), &scale, 0)))
-            return AVERROR(ENOMEM);
-    }
-
-    /* Zero out previous energy (matters for inter first frame) */
-    for (int ch = 0; ch < s->channels; ch++)
-        memset(s->last_quantized_energy[ch], 0.0f, sizeof(float)*CELT_MAX_BANDS);
-
     /* Allocate an empty frame to use as overlap for the first frame of audio */
     ff_bufqueue_add(avctx, &s->bufqueue, spawn_empty_frame(s));
     if (!ff_bufqueue_peek(&s->bufqueue, 0))
         return AVERROR(ENOMEM);
 
-    if ((ret = ff_opus_psy_init(&s->psyctx, s->avctx, &s->bufqueue, &s->options)))
-        return ret;
+    /* With a single stream, the slice threads are used by its stereo searches */
+    if (s->nb_streams == 1 && avctx->active_thread_type & FF_THREAD_SLICE)
+        nb_threads = FFMAX(avctx->thread_count, 1);
 
-    /* Frame structs and range coder buffers */
     max_frames = ceilf(FFMIN(s->options.max_delay_ms, 120.0f)/2.5f);
-    s->frame = av_malloc(max_frames*sizeof(CeltFrame));
-    if (!s->frame)
-        return AVERROR(ENOMEM);
-    s->rc = av_malloc(max_frames*sizeof(OpusRangeCoder));
-    if (!s->rc)
-        return AVERROR(ENOMEM);
 
-    for (int i = 0; i < max_frames; i++) {
-        s->frame[i].dsp = s->dsp;
-        s->frame[i].avctx = s->avctx;
-        s->frame[i].seed = 0;
-        s->frame[i].pvq = s->pvq;
-        s->frame[i].apply_phase_inv = s->options.apply_phase_inv;
-        s->frame[i].block[0].emph_coeff = s->frame[i].block[1].emph_coeff = 0.0f;
+    for (int n = 0; n < s->nb_streams; n++) {
+        OpusEncStream *st = &s->streams[n];
+        /* The bit rate is shared out evenly among the channels */
+        int64_t bit_rate = avctx->bit_rate*st->channels/s->channels;
+
+        if ((ret = ff_celt_pvq_init(&st->pvq, 1)) < 0)
+            return ret;
+
+        /* I have no idea why a base scaling factor of 68 works, could be the twiddles */
+        for (int i = 0; i < CELT_BLOCK_NB; i++) {
+            const float scale = 68 << (CELT_BLOCK_NB - 1 - i);
+            if ((ret = av_tx_init(&st->tx[i], &st->tx_fn[i], AV_TX_FLOAT_MDCT, 0, 15 << (i + 3), &scale, 0)))
+                return AVERROR(ENOMEM);
+        }
+
+        /* Zero out previous energy (matters for inter first frame) */
+        for (int ch = 0; ch < st->channels; ch++)
+            memset(st->last_quantized_energy[ch], 0.0f, sizeof(float)*CELT_MAX_BANDS);
+
+        if ((ret = ff_opus_psy_init(&st->psyctx, s->avctx, &s->bufqueue, &s->options,
+                                    st->ch_map, st->channels, bit_rate, nb_threads)))
+            return ret;
+
+        /* Frame structs and range coder buffers */
+        st->frame = av_malloc(max_frames*sizeof(CeltFrame));
+        if (!st->frame)
+            return AVERROR(ENOMEM);
+        st->rc = av_malloc(max_frames*sizeof(OpusRangeCoder));
+        if (!st->rc)
+            return AVERROR(ENOMEM);
+
+        for (int i = 0; i < max_frames; i++) {
+            st->frame[i].dsp = s->dsp;
+            st->frame[i].avctx = s->avctx;
+            st->frame[i].seed = 0;
+            st->frame[i].pvq = st->pvq;
+            st->frame[i].apply_phase_inv = s->options.apply_phase_inv;
+            st->frame[i].block[0].emph_coeff = st->frame[i].block[1].emph_coeff = 0.0f;
+        }
     }
 
     return 0;
@@ -726,6 +888,31 @@ static const AVClass opusenc_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#define OPUS_AMBISONIC_LAYOUT(n, nondiegetic)                \
+    { .order       = AV_CHANNEL_ORDER_AMBISONIC,             \
+      .nb_channels = ((n) + 1)*((n) + 1) + (nondiegetic),    \
+      .u.mask      = (nondiegetic) ? AV_CH_LAYOUT_STEREO : 0 }
+
+static const AVChannelLayout opusenc_ch_layouts[] = {
+    /* Vorbis channel order, mapping families 0 and 1 */
+    AV_CHANNEL_LAYOUT_MONO,
+    AV_CHANNEL_LAYOUT_STEREO,
+    AV_CHANNEL_LAYOUT_SURROUND,
+    AV_CHANNEL_LAYOUT_QUAD,
+    AV_CHANNEL_LAYOUT_5POINT0_BACK,
+    AV_CHANNEL_LAYOUT_5POINT1_BACK,
+    AV_CHANNEL_LAYOUT_6POINT1,
+    AV_CHANNEL_LAYOUT_7POINT1,
+    /* Ambisonics, mapping family 2 */
+    OPUS_AMBISONIC_LAYOUT(1, 0),
+    OPUS_AMBISONIC_LAYOUT(1, 2),
+    OPUS_AMBISONIC_LAYOUT(2, 0),
+    OPUS_AMBISONIC_LAYOUT(2, 2),
+    OPUS_AMBISONIC_LAYOUT(3, 0),
+    OPUS_AMBISONIC_LAYOUT(3, 2),
+    { 0 },
+};
+
 static const FFCodecDefault opusenc_defaults[] = {
     { "b", "0" },
     { "compression_level", "10" },
@@ -738,7 +925,8 @@ const FFCodec ff_opus_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_OPUS,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_EXPERIMENTAL,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_EXPERIMENTAL |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .defaults       = opusenc_defaults,
     .p.priv_class   = &opusenc_class,
     .priv_data_size = sizeof(OpusEncContext),
@@ -747,6 +935,6 @@ const FFCodec ff_opus_encoder = {
     .close          = opus_encode_end,
     .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
     CODEC_SAMPLERATES(48000),
-    CODEC_CH_LAYOUTS(AV_CHANNEL_LAYOUT_MONO, AV_CHANNEL_LAYOUT_STEREO),
+    CODEC_CH_LAYOUTS_ARRAY(opusenc_ch_layouts),
     CODEC_SAMPLEFMTS(AV_SAMPLE_FMT_FLTP),
 };
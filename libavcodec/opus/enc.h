@@ -31,6 +31,7 @@
 
 #define OPUS_MAX_LOOKAHEAD ((FF_BUFQUEUE_SIZE - 1)*2.5f)
 
+/* Channels per stream */
 #define OPUS_MAX_CHANNELS 2
 
 /* 120 ms / 2.5 ms = 48 frames (extremely improbable, but the encoder'll work) */
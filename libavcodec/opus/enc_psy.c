@@ -28,8 +28,8 @@
 #include "tab.h"
 #include "libavfilter/window_func.h"
 
-static float pvq_band_cost(CeltPVQ *pvq, CeltFrame *f, OpusRangeCoder *rc, int band,
-                           float *bits, float lambda)
+static float pvq_band_cost(CeltPVQ *pvq, CeltFrame *f, const CeltFrame *src,
+                           OpusRangeCoder *rc, int band, float *bits, float lambda)
 {
     int i, b = 0;
     uint32_t cm[2] = { (1 << f->blocks) - 1, (1 << f->blocks) - 1 };
@@ -37,9 +37,9 @@ static float pvq_band_cost(CeltPVQ *pvq, CeltFrame *f, OpusRangeCoder *rc, int b
     float buf[176 * 2], lowband_scratch[176], norm1[176], norm2[176];
     float dist, cost, err_x = 0.0f, err_y = 0.0f;
     float *X = buf;
-    float *X_orig = f->block[0].coeffs + (ff_celt_freq_bands[band] << f->size);
+    const float *X_orig = src->block[0].coeffs + (ff_celt_freq_bands[band] << f->size);
     float *Y = (f->channels == 2) ? &buf[176] : NULL;
-    float *Y_orig = f->block[1].coeffs + (ff_celt_freq_bands[band] << f->size);
+    const float *Y_orig = src->block[1].coeffs + (ff_celt_freq_bands[band] << f->size);
     OPUS_RC_CHECKPOINT_SPAWN(rc);
 
     memcpy(X, X_orig, band_size*sizeof(float));
@@ -86,17 +86,17 @@ static void step_collect_psy_metrics(OpusPsyContext *s, int index)
 
     st->index = index;
 
-    for (ch = 0; ch < s->avctx->ch_layout.nb_channels; ch++) {
+    for (ch = 0; ch < s->channels; ch++) {
         const int lap_size = (1 << s->bsize_analysis);
         for (i = 1; i <= FFMIN(lap_size, index); i++) {
             const int offset = i*120;
             AVFrame *cur = ff_bufqueue_peek(s->bufqueue, index - i);
-            memcpy(&s->scratch[offset], cur->extended_data[ch], cur->nb_samples*sizeof(float));
+            memcpy(&s->scratch[offset], cur->extended_data[s->ch_map[ch]], cur->nb_samples*sizeof(float));
         }
         for (i = 0; i < lap_size; i++) {
             const int offset = i*120 + lap_size;
             AVFrame *cur = ff_bufqueue_peek(s->bufqueue, index + i);
-            memcpy(&s->scratch[offset], cur->extended_data[ch], cur->nb_samples*sizeof(float));
+            memcpy(&s->scratch[offset], cur->extended_data[s->ch_map[ch]], cur->nb_samples*sizeof(float));
         }
 
         s->dsp->vector_fmul(s->scratch, s->scratch, s->window[s->bsize_analysis],
@@ -109,22 +109,24 @@ static void step_collect_psy_metrics(OpusPsyContext *s, int index)
             st->bands[ch][i] = &st->coeffs[ch][ff_celt_freq_bands[i] << s->bsize_analysis];
     }
 
-    for (ch = 0; ch < s->avctx->ch_layout.nb_channels; ch++) {
+    for (ch = 0; ch < s->channels; ch++) {
+        /* Squared coefficients, for the band energies and tonalities */
+        s->dsp->vector_fmul(s->sq, st->coeffs[ch], st->coeffs[ch],
+                            OPUS_BLOCK_SIZE(s->bsize_analysis));
+
         for (i = 0; i < CELT_MAX_BANDS; i++) {
             float avg_c_s, energy = 0.0f, dist_dev = 0.0f;
             const int range = ff_celt_freq_range[i] << s->bsize_analysis;
-            const float *coeffs = st->bands[ch][i];
+            const float *sq = s->sq + (ff_celt_freq_bands[i] << s->bsize_analysis);
             for (j = 0; j < range; j++)
-                energy += coeffs[j]*coeffs[j];
+                energy += sq[j];
 
             st->energy[ch][i] += sqrtf(energy);
             silence |= !!st->energy[ch][i];
             avg_c_s = energy / range;
 
-            for (j = 0; j < range; j++) {
-                const float c_s = coeffs[j]*coeffs[j];
-                dist_dev += (avg_c_s - c_s)*(avg_c_s - c_s);
-            }
+            for (j = 0; j < range; j++)
+                dist_dev += (avg_c_s - sq[j])*(avg_c_s - sq[j]);
 
             st->tone[ch][i] += sqrtf(dist_dev);
         }
@@ -132,7 +134,7 @@ static void step_collect_psy_metrics(OpusPsyContext *s, int index)
 
     st->silence = !silence;
 
-    if (s->avctx->ch_layout.nb_channels > 1) {
+    if (s->channels > 1) {
         for (i = 0; i < CELT_MAX_BANDS; i++) {
             float incompat = 0.0f;
             const float *coeffs1 = st->bands[0][i];
@@ -144,7 +146,7 @@ static void step_collect_psy_metrics(OpusPsyContext *s, int index)
         }
     }
 
-    for (ch = 0; ch < s->avctx->ch_layout.nb_channels; ch++) {
+    for (ch = 0; ch < s->channels; ch++) {
         for (i = 0; i < CELT_MAX_BANDS; i++) {
             OpusBandExcitation *ex = &s->ex[ch][i];
             float bp_e = bessel_filter(&s->bfilter_lo[ch][i], st->energy[ch][i]);
@@ -255,6 +257,15 @@ int ff_opus_psy_process(OpusPsyContext *s, OpusPacketInfo *p)
     return 0;
 }
 
+/* Override the packet decision, for streams which must match another one */
+void ff_opus_psy_set_packet(OpusPsyContext *s, const OpusPacketInfo *p)
+{
+    s->p.frames    = p->frames;
+    s->p.framesize = p->framesize;
+    s->p.mode      = p->mode;
+    s->p.bandwidth = p->bandwidth;
+}
+
 void ff_opus_psy_celt_frame_init(OpusPsyContext *s, CeltFrame *f, int index)
 {
     int i, neighbouring_points = 0, start_offset = 0;
@@ -263,7 +274,7 @@ void ff_opus_psy_celt_frame_init(OpusPsyContext *s, CeltFrame *f, int index)
 
     f->start_band = (s->p.mode == OPUS_MODE_HYBRID) ? 17 : 0;
     f->end_band   = ff_celt_band_end[s->p.bandwidth];
-    f->channels   = s->avctx->ch_layout.nb_channels;
+    f->channels   = s->channels;
     f->size       = s->p.framesize;
 
     for (i = 0; i < (1 << f->size); i++)
@@ -331,7 +342,7 @@ static void celt_gauge_psy_weight(OpusPsyContext *s, OpusPsyStep **start,
         float tonal_contrib = 0.0f;
         for (f = 0; f < (1 << s->p.framesize); f++) {
             weight = start[f]->stereo[i];
-            for (ch = 0; ch < s->avctx->ch_layout.nb_channels; ch++) {
+            for (ch = 0; ch < s->channels; ch++) {
                 weight += start[f]->change_amp[ch][i] + start[f]->tone[ch][i] + start[f]->energy[ch][i];
                 tonal_contrib += start[f]->tone[ch][i];
             }
@@ -355,7 +366,7 @@ static void celt_gauge_psy_weight(OpusPsyContext *s, OpusPsyStep **start,
     tonal /= 1333136.0f;
     f_out->spread = av_clip_uintp2(lrintf(tonal), 2);
 
-    rate = ((float)s->avctx->bit_rate) + frame_bits*frame_size*16;
+    rate = ((float)s->bit_rate) + frame_bits*frame_size*16;
     rate *= s->lambda;
     rate /= s->avctx->sample_rate/frame_size;
 
@@ -364,7 +375,8 @@ static void celt_gauge_psy_weight(OpusPsyContext *s, OpusPsyStep **start,
     f_out->framebits = FFALIGN(f_out->framebits, 8);
 }
 
-static int bands_dist(OpusPsyContext *s, CeltFrame *f, float *total_dist)
+static int bands_dist(OpusPsyContext *s, CeltFrame *f, const CeltFrame *src,
+                      float *total_dist)
 {
     int i, tdist = 0.0f;
     OpusRangeCoder dump;
@@ -374,7 +386,7 @@ static int bands_dist(OpusPsyContext *s, CeltFrame *f, float *total_dist)
 
     for (i = 0; i < CELT_MAX_BANDS; i++) {
         float bits = 0.0f;
-        float dist = pvq_band_cost(f->pvq, f, &dump, i, &bits, s->lambda);
+        float dist = pvq_band_cost(f->pvq, f, src, &dump, i, &bits, s->lambda);
         tdist += dist;
     }
 
@@ -383,38 +395,87 @@ static int bands_dist(OpusPsyContext *s, CeltFrame *f, float *total_dist)
     return 0;
 }
 
+/* The stereo parameters to try, each of which is evaluated independently */
+typedef struct OpusStereoSearch {
+    OpusPsyContext *s;
+    const CeltFrame *f;
+    int nb_candidates;
+    int intensity_stereo[CELT_MAX_BANDS + 1];
+    int dual_stereo[CELT_MAX_BANDS + 1];
+    float dist[CELT_MAX_BANDS + 1];
+} OpusStereoSearch;
+
+static int stereo_search_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    OpusStereoSearch *ss = arg;
+    OpusPsyContext *s = ss->s;
+    CeltFrame *f = &s->search_frame[threadnr];
+
+    /* Every candidate starts from the state of the frame before the search,
+     * only the band energies of the blocks are needed, the coefficients
+     * are read from the original frame. */
+    memcpy(f, ss->f, offsetof(CeltFrame, block));
+    for (int ch = 0; ch < ss->f->channels; ch++)
+        memcpy(f->block[ch].lin_energy, ss->f->block[ch].lin_energy,
+               sizeof(f->block[ch].lin_energy));
+    memcpy(&f->pvq, &ss->f->pvq, sizeof(*f) - offsetof(CeltFrame, pvq));
+
+    f->pvq              = s->search_pvq[threadnr];
+    f->intensity_stereo = ss->intensity_stereo[jobnr];
+    f->dual_stereo      = ss->dual_stereo[jobnr];
+
+    return bands_dist(s, f, ss->f, &ss->dist[jobnr]);
+}
+
+static void stereo_search(OpusPsyContext *s, OpusStereoSearch *ss)
+{
+    if (s->nb_search_ctx > 1) {
+        s->avctx->execute2(s->avctx, stereo_search_job, ss, NULL, ss->nb_candidates);
+    } else {
+        for (int i = 0; i < ss->nb_candidates; i++)
+            stereo_search_job(s->avctx, ss, i, 0);
+    }
+}
+
 static void celt_search_for_dual_stereo(OpusPsyContext *s, CeltFrame *f)
 {
-    float td1, td2;
+    OpusStereoSearch ss = { .s = s, .f = f, .nb_candidates = 2 };
     f->dual_stereo = 0;
 
-    if (s->avctx->ch_layout.nb_channels < 2)
+    if (s->channels < 2)
         return;
 
-    bands_dist(s, f, &td1);
-    f->dual_stereo = 1;
-    bands_dist(s, f, &td2);
+    for (int i = 0; i < 2; i++) {
+        ss.intensity_stereo[i] = f->intensity_stereo;
+        ss.dual_stereo[i]      = i;
+    }
+    stereo_search(s, &ss);
 
-    f->dual_stereo = td2 < td1;
-    s->dual_stereo_used += td2 < td1;
+    f->dual_stereo = ss.dist[1] < ss.dist[0];
+    s->dual_stereo_used += f->dual_stereo;
 }
 
 static void celt_search_for_intensity(OpusPsyContext *s, CeltFrame *f)
 {
     int i, best_band = CELT_MAX_BANDS - 1;
-    float dist, best_dist = FLT_MAX;
+    float best_dist = FLT_MAX;
     /* TODO: fix, make some heuristic up here using the lambda value */
-    float end_band = 0;
+    int end_band = 0;
+    OpusStereoSearch ss = { .s = s, .f = f };
 
-    if (s->avctx->ch_layout.nb_channels < 2)
+    if (s->channels < 2)
         return;
 
     for (i = f->end_band; i >= end_band; i--) {
-        f->intensity_stereo = i;
-        bands_dist(s, f, &dist);
-        if (best_dist > dist) {
-            best_dist = dist;
-            best_band = i;
+        ss.intensity_stereo[ss.nb_candidates] = i;
+        ss.dual_stereo[ss.nb_candidates++]    = f->dual_stereo;
+    }
+    stereo_search(s, &ss);
+
+    for (i = 0; i < ss.nb_candidates; i++) {
+        if (best_dist > ss.dist[i]) {
+            best_dist = ss.dist[i];
+            best_band = ss.intensity_stereo[i];
         }
     }
 
@@ -440,7 +501,7 @@ static int celt_search_for_tf(OpusPsyContext *s, OpusPsyStep **start, CeltFrame
             float iscore0 = 0.0f;
             float iscore1 = 0.0f;
             for (j = 0; j < (1 << f->size); j++) {
-                for (k = 0; k < s->avctx->ch_layout.nb_channels; k++) {
+                for (k = 0; k < s->channels; k++) {
                     iscore0 += start[j]->tone[k][i]*start[j]->change_amp[k][i]/mag[0];
                     iscore1 += start[j]->tone[k][i]*start[j]->change_amp[k][i]/mag[1];
                 }
@@ -498,7 +559,7 @@ void ff_opus_psy_postencode_update(OpusPsyContext *s, CeltFrame *f)
     for (i = steps_out; i < s->buffered_steps; i++)
         s->steps[i]->index -= steps_out;
 
-    ideal_fbits = s->avctx->bit_rate/(s->avctx->sample_rate/frame_size);
+    ideal_fbits = s->bit_rate/(s->avctx->sample_rate/frame_size);
 
     for (i = 0; i < s->p.frames; i++) {
         s->avg_is_band += f[i].intensity_stereo;
@@ -514,7 +575,9 @@ void ff_opus_psy_postencode_update(OpusPsyContext *s, CeltFrame *f)
 }
 
 av_cold int ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
-                             struct FFBufQueue *bufqueue, OpusEncOptions *options)
+                             struct FFBufQueue *bufqueue, OpusEncOptions *options,
+                             const int *ch_map, int channels, int64_t bit_rate,
+                             int nb_threads)
 {
     int i, ch, ret;
 
@@ -522,6 +585,10 @@ av_cold int ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
     s->options = options;
     s->avctx = avctx;
     s->bufqueue = bufqueue;
+    s->channels = channels;
+    s->bit_rate = bit_rate;
+    for (ch = 0; ch < channels; ch++)
+        s->ch_map[ch] = ch_map[ch];
     s->max_steps = ceilf(s->options->max_delay_ms/2.5f);
     s->bsize_analysis = CELT_BLOCK_960;
     s->avg_is_band = CELT_MAX_BANDS - 1;
@@ -539,7 +606,7 @@ av_cold int ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
         goto fail;
     }
 
-    for (ch = 0; ch < s->avctx->ch_layout.nb_channels; ch++) {
+    for (ch = 0; ch < s->channels; ch++) {
         for (i = 0; i < CELT_MAX_BANDS; i++) {
             bessel_init(&s->bfilter_hi[ch][i], 1.0f, 19.0f, 100.0f, 1);
             bessel_init(&s->bfilter_lo[ch][i], 1.0f, 20.0f, 100.0f, 0);
@@ -570,12 +637,32 @@ av_cold int ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
             goto fail;
     }
 
+    if (s->channels > 1) {
+        s->search_frame = av_calloc(nb_threads, sizeof(*s->search_frame));
+        s->search_pvq   = av_calloc(nb_threads, sizeof(*s->search_pvq));
+        if (!s->search_frame || !s->search_pvq) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        s->nb_search_ctx = nb_threads;
+        for (i = 0; i < s->nb_search_ctx; i++) {
+            if ((ret = ff_celt_pvq_init(&s->search_pvq[i], 1)) < 0)
+                goto fail;
+        }
+    }
+
     return 0;
 
 fail:
     av_freep(&s->inflection_points);
     av_freep(&s->dsp);
 
+    for (i = 0; i < s->nb_search_ctx; i++)
+        ff_celt_pvq_uninit(&s->search_pvq[i]);
+    av_freep(&s->search_pvq);
+    av_freep(&s->search_frame);
+    s->nb_search_ctx = 0;
+
     for (i = 0; i < CELT_BLOCK_NB; i++) {
         av_tx_uninit(&s->mdct[i]);
         av_freep(&s->window[i]);
@@ -599,6 +686,11 @@ av_cold int ff_opus_psy_end(OpusPsyContext *s)
     av_freep(&s->inflection_points);
     av_freep(&s->dsp);
 
+    for (i = 0; i < s->nb_search_ctx; i++)
+        ff_celt_pvq_uninit(&s->search_pvq[i]);
+    av_freep(&s->search_pvq);
+    av_freep(&s->search_frame);
+
     for (i = 0; i < CELT_BLOCK_NB; i++) {
         av_tx_uninit(&s->mdct[i]);
         av_freep(&s->window[i]);
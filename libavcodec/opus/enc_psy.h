@@ -27,6 +27,7 @@
 
 #include "enc.h"
 #include "celt.h"
+#include "pvq.h"
 #include "enc_utils.h"
 
 /* Each step is 2.5ms */
@@ -40,7 +41,7 @@ typedef struct OpusPsyStep {
     float total_change; /* Total change */
 
     float *bands[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
-    float coeffs[OPUS_MAX_CHANNELS][OPUS_BLOCK_SIZE(CELT_BLOCK_960)];
+    DECLARE_ALIGNED(32, float, coeffs)[OPUS_MAX_CHANNELS][OPUS_BLOCK_SIZE(CELT_BLOCK_960)];
 } OpusPsyStep;
 
 typedef struct OpusBandExcitation {
@@ -55,6 +56,15 @@ typedef struct OpusPsyContext {
     struct FFBufQueue *bufqueue;
     OpusEncOptions *options;
 
+    int channels;
+    int ch_map[OPUS_MAX_CHANNELS]; /* Input channel of each coded channel */
+    int64_t bit_rate;
+
+    /* Per-thread frames and PVQ contexts of the stereo parameter searches */
+    CeltFrame *search_frame;
+    CeltPVQ **search_pvq;
+    int nb_search_ctx;
+
     OpusBandExcitation ex[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
     FFBesselFilter bfilter_lo[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
     FFBesselFilter bfilter_hi[OPUS_MAX_CHANNELS][CELT_MAX_BANDS];
@@ -68,6 +78,7 @@ typedef struct OpusPsyContext {
     int bsize_analysis;
 
     DECLARE_ALIGNED(32, float, scratch)[2048];
+    DECLARE_ALIGNED(32, float, sq)[OPUS_BLOCK_SIZE(CELT_BLOCK_960)];
 
     /* Stats */
     float avg_is_band;
@@ -85,12 +96,21 @@ typedef struct OpusPsyContext {
 } OpusPsyContext;
 
 int  ff_opus_psy_process           (OpusPsyContext *s, OpusPacketInfo *p);
+void ff_opus_psy_set_packet        (OpusPsyContext *s, const OpusPacketInfo *p);
 void ff_opus_psy_celt_frame_init   (OpusPsyContext *s, CeltFrame *f, int index);
 int  ff_opus_psy_celt_frame_process(OpusPsyContext *s, CeltFrame *f, int index);
 void ff_opus_psy_postencode_update (OpusPsyContext *s, CeltFrame *f);
 
+/**
+ * @param ch_map     input channel of each of the channels coded by the stream
+ * @param bit_rate   bit rate of the stream
+ * @param nb_threads number of slice threads the stereo parameter searches
+ *                   may use, 1 if they must run in the calling thread
+ */
 int  ff_opus_psy_init(OpusPsyContext *s, AVCodecContext *avctx,
-                      struct FFBufQueue *bufqueue, OpusEncOptions *options);
+                      struct FFBufQueue *bufqueue, OpusEncOptions *options,
+                      const int *ch_map, int channels, int64_t bit_rate,
+                      int nb_threads);
 void ff_opus_psy_signal_eof(OpusPsyContext *s);
 int  ff_opus_psy_end(OpusPsyContext *s);
 
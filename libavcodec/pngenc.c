@@ -42,6 +42,13 @@
 
 #define IOBUF_SIZE 4096
 
+/* Amount of filtered image data compressed by one job when the image is
+ * deflated in parallel; independent of the thread count so that the output
+ * does not change with it. */
+#define BAND_SIZE (256 * 1024)
+/* size of the deflate window, the previous band primes the next one */
+#define WINDOW_SIZE 32768
+
 typedef struct APNGFctlChunk {
     uint32_t sequence_number;
     uint32_t width, height;
@@ -50,6 +57,20 @@ typedef struct APNGFctlChunk {
     uint8_t dispose_op, blend_op;
 } APNGFctlChunk;
 
+typedef struct PNGEncSlice {
+    FFZStream zstream;           ///< raw deflate stream, no zlib wrapper
+    uint8_t *crow_base;
+    unsigned int crow_base_size;
+} PNGEncSlice;
+
+typedef struct PNGEncBand {
+    uint8_t *buf;                ///< 2 bytes header room, data, 4 bytes trailer room
+    unsigned int buf_size;
+    int len;                     ///< size of the compressed data
+    uLong adler;                 ///< Adler-32 of the filtered data of the band
+    int ret;
+} PNGEncBand;
+
 typedef struct PNGEncContext {
     AVClass *class;
     LLVidEncDSPContext llvidencdsp;
@@ -62,6 +83,17 @@ typedef struct PNGEncContext {
 
     FFZStream zstream;
     uint8_t buf[IOBUF_SIZE];
+    int compression_level;
+
+    // parallel deflate, with slice threading
+    PNGEncSlice *slices;
+    int nb_slices;
+    PNGEncBand *bands;
+    int nb_bands_allocated;
+    int nb_bands;
+    int band_rows;
+    uint8_t *filtered;           ///< filter byte + filtered data of all rows
+    unsigned int filtered_size;
     int dpi;                     ///< Physical pixel density, in dots per inch, if set
     int dpm;                     ///< Physical pixel density, in dots per meter, if set
 
@@ -196,6 +228,27 @@ static void png_filter_row(PNGEncContext *c, uint8_t *dst, int filter_type,
     }
 }
 
+/* Sum of the magnitudes of the filtered bytes taken as signed values, used
+ * to rank the filters. Accumulated in blocks the compiler can vectorize;
+ * stops early once the cost reaches limit as the filter cannot win anymore. */
+static int png_filter_cost(const uint8_t *buf, int size, int limit)
+{
+    int cost = 0;
+
+    while (size > 0) {
+        int block = FFMIN(size, 256);
+        unsigned sum = 0;
+        for (int i = 0; i < block; i++)
+            sum += FFABS((int8_t)buf[i]);
+        cost += sum;
+        if (cost >= limit)
+            break;
+        buf  += block;
+        size -= block;
+    }
+    return cost;
+}
+
 static uint8_t *png_choose_filter(PNGEncContext *s, uint8_t *dst,
                                   const uint8_t *src, const uint8_t *top, int size, int bpp)
 {
@@ -204,15 +257,12 @@ static uint8_t *png_choose_filter(PNGEncContext *s, uint8_t *dst,
     if (!top && pred)
         pred = PNG_FILTER_VALUE_SUB;
     if (pred == PNG_FILTER_VALUE_MIXED) {
-        int i;
         int cost, bcost = INT_MAX;
         uint8_t *buf1 = dst, *buf2 = dst + size + 16;
         for (pred = 0; pred < 5; pred++) {
             png_filter_row(s, buf1 + 1, pred, src, top, size, bpp);
             buf1[0] = pred;
-            cost = 0;
-            for (i = 0; i <= size; i++)
-                cost += abs((int8_t) buf1[i]);
+            cost = png_filter_cost(buf1, size + 1, bcost);
             if (cost < bcost) {
                 bcost = cost;
                 FFSWAP(uint8_t *, buf1, buf2);
@@ -506,6 +556,156 @@ static int encode_headers(AVCodecContext *avctx, const AVFrame *pict)
     return 0;
 }
 
+static int filter_band(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s       = avctx->priv_data;
+    PNGEncSlice *sl        = &s->slices[threadnr];
+    const AVFrame *const p = arg;
+    const int row_size = (p->width * s->bits_per_pixel + 7) >> 3;
+    const int y0 = jobnr * s->band_rows;
+    const int y1 = FFMIN(y0 + s->band_rows, p->height);
+    uint8_t *dst = s->filtered + (size_t)y0 * (row_size + 1);
+
+    av_fast_malloc(&sl->crow_base, &sl->crow_base_size,
+                   (row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    if (!sl->crow_base) {
+        s->bands[jobnr].ret = AVERROR(ENOMEM);
+        return 0;
+    }
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *ptr = p->data[0] + y * p->linesize[0];
+        const uint8_t *top = y ? ptr - p->linesize[0] : NULL;
+        const uint8_t *crow = png_choose_filter(s, sl->crow_base + 15, ptr, top,
+                                                row_size, s->bits_per_pixel >> 3);
+        memcpy(dst, crow, row_size + 1);
+        dst += row_size + 1;
+    }
+    return 0;
+}
+
+static int deflate_band(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s        = avctx->priv_data;
+    z_stream *const zstream = &s->slices[threadnr].zstream.zstream;
+    PNGEncBand *band        = &s->bands[jobnr];
+    const AVFrame *const p  = arg;
+    const int row_size  = (p->width * s->bits_per_pixel + 7) >> 3;
+    const int last      = jobnr == s->nb_bands - 1;
+    const size_t start  = (size_t)jobnr * s->band_rows * (row_size + 1);
+    const size_t end    = last ? (size_t)p->height * (row_size + 1)
+                               : start + (size_t)s->band_rows * (row_size + 1);
+    int ret;
+
+    if (band->ret < 0)
+        return 0;
+
+    deflateReset(zstream);
+    /* the decoder has the end of the previous band in its window, so it can
+     * be referenced; this is what keeps the ratio close to a single stream */
+    if (start) {
+        size_t dict_size = FFMIN(start, WINDOW_SIZE);
+        deflateSetDictionary(zstream, s->filtered + start - dict_size, dict_size);
+    }
+
+    zstream->next_in   = s->filtered + start;
+    zstream->avail_in  = end - start;
+    zstream->next_out  = band->buf + 2;
+    zstream->avail_out = band->buf_size - 6;
+    /* a sync flush ends the band on a byte boundary without marking the
+     * last block, so the bands can be concatenated */
+    ret = deflate(zstream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (ret != (last ? Z_STREAM_END : Z_OK) || zstream->avail_in) {
+        band->ret = AVERROR_EXTERNAL;
+        return 0;
+    }
+    band->len   = zstream->next_out - (band->buf + 2);
+    band->adler = adler32(adler32(0, NULL, 0), s->filtered + start, end - start);
+    return 0;
+}
+
+/**
+ * Compress the image in independent bands on the slice threads and stitch
+ * the raw deflate outputs into a single zlib stream.
+ */
+static int encode_frame_parallel(AVCodecContext *avctx, const AVFrame *pict)
+{
+    PNGEncContext *s = avctx->priv_data;
+    const int row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
+    int level_flags, header;
+    uLong adler;
+
+    av_fast_malloc(&s->filtered, &s->filtered_size,
+                   (size_t)pict->height * (row_size + 1));
+    if (!s->filtered)
+        return AVERROR(ENOMEM);
+
+    if (s->nb_bands > s->nb_bands_allocated) {
+        PNGEncBand *bands = av_realloc_array(s->bands, s->nb_bands, sizeof(*bands));
+        if (!bands)
+            return AVERROR(ENOMEM);
+        memset(bands + s->nb_bands_allocated, 0,
+               (s->nb_bands - s->nb_bands_allocated) * sizeof(*bands));
+        s->bands              = bands;
+        s->nb_bands_allocated = s->nb_bands;
+    }
+    for (int i = 0; i < s->nb_bands; i++) {
+        PNGEncBand *band = &s->bands[i];
+        int rows = FFMIN(s->band_rows, pict->height - i * s->band_rows);
+        /* bound of the stream and of the empty block of the sync flush */
+        uLong bound = deflateBound(&s->slices[0].zstream.zstream,
+                                   (uLong)rows * (row_size + 1)) + 16;
+
+        if (bound > INT_MAX - 6)
+            return AVERROR(ENOMEM);
+        av_fast_malloc(&band->buf, &band->buf_size, bound + 6);
+        if (!band->buf)
+            return AVERROR(ENOMEM);
+        band->ret = 0;
+    }
+
+    avctx->execute2(avctx, filter_band,  (void *)pict, NULL, s->nb_bands);
+    avctx->execute2(avctx, deflate_band, (void *)pict, NULL, s->nb_bands);
+
+    for (int i = 0; i < s->nb_bands; i++)
+        if (s->bands[i].ret < 0)
+            return s->bands[i].ret;
+
+    /* zlib header, matching what deflate() would write for this level */
+    if (s->compression_level < 2)
+        level_flags = 0;
+    else if (s->compression_level < 6)
+        level_flags = 1;
+    else if (s->compression_level == 6)
+        level_flags = 2;
+    else
+        level_flags = 3;
+    header  = (0x78 << 8) | (level_flags << 6);
+    header += 31 - header % 31;
+    AV_WB16(s->bands[0].buf, header);
+
+    adler = s->bands[0].adler;
+    for (int i = 1; i < s->nb_bands; i++) {
+        int rows = FFMIN(s->band_rows, pict->height - i * s->band_rows);
+        adler = adler32_combine(adler, s->bands[i].adler,
+                                (z_off_t)rows * (row_size + 1));
+    }
+    AV_WB32(s->bands[s->nb_bands - 1].buf + 2 + s->bands[s->nb_bands - 1].len,
+            adler);
+
+    for (int i = 0; i < s->nb_bands; i++) {
+        PNGEncBand *band = &s->bands[i];
+        const uint8_t *data = band->buf + (i ? 2 : 0);
+        int len = band->len + (i ? 0 : 2) + (i == s->nb_bands - 1 ? 4 : 0);
+
+        if (s->bytestream_end - s->bytestream < len + 16)
+            return AVERROR_BUG;
+        png_write_image_data(avctx, data, len);
+    }
+
+    return 0;
+}
+
 static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
 {
     PNGEncContext *s       = avctx->priv_data;
@@ -520,6 +720,13 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
 
     row_size = (pict->width * s->bits_per_pixel + 7) >> 3;
 
+    if (s->nb_slices && !s->is_progressive) {
+        s->band_rows = FFMAX(BAND_SIZE / (row_size + 1), 1);
+        s->nb_bands  = (pict->height + s->band_rows - 1) / s->band_rows;
+        if (s->nb_bands > 1)
+            return encode_frame_parallel(avctx, pict);
+    }
+
     crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
     if (!crow_base) {
         ret = AVERROR(ENOMEM);
@@ -1103,7 +1310,7 @@ static int encode_apng(AVCodecContext *avctx, AVPacket *pkt,
 static av_cold int png_enc_init(AVCodecContext *avctx)
 {
     PNGEncContext *s = avctx->priv_data;
-    int compression_level;
+    int compression_level, ret;
 
     switch (avctx->pix_fmt) {
     case AV_PIX_FMT_RGBA:
@@ -1184,6 +1391,21 @@ static av_cold int png_enc_init(AVCodecContext *avctx)
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT
                       ? Z_DEFAULT_COMPRESSION
                       : av_clip(avctx->compression_level, 0, 9);
+    s->compression_level = compression_level == Z_DEFAULT_COMPRESSION ? 6 : compression_level;
+
+    if (avctx->active_thread_type == FF_THREAD_SLICE && avctx->thread_count > 1) {
+        s->slices = av_calloc(avctx->thread_count, sizeof(*s->slices));
+        if (!s->slices)
+            return AVERROR(ENOMEM);
+        s->nb_slices = avctx->thread_count;
+        for (int i = 0; i < s->nb_slices; i++) {
+            ret = ff_deflate_init2(&s->slices[i].zstream, compression_level,
+                                   -MAX_WBITS, avctx);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
     return ff_deflate_init(&s->zstream, compression_level, avctx);
 }
 
@@ -1192,6 +1414,17 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
     PNGEncContext *s = avctx->priv_data;
 
     ff_deflate_end(&s->zstream);
+    for (int i = 0; i < s->nb_slices; i++) {
+        ff_deflate_end(&s->slices[i].zstream);
+        av_freep(&s->slices[i].crow_base);
+    }
+    av_freep(&s->slices);
+    s->nb_slices = 0;
+    for (int i = 0; i < s->nb_bands_allocated; i++)
+        av_freep(&s->bands[i].buf);
+    av_freep(&s->bands);
+    s->nb_bands_allocated = 0;
+    av_freep(&s->filtered);
     av_frame_free(&s->last_frame);
     av_frame_free(&s->prev_frame);
     av_freep(&s->last_frame_packet);
@@ -1228,6 +1461,7 @@ const FFCodec ff_png_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_PNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1240,7 +1474,7 @@ const FFCodec ff_png_encoder = {
                   AV_PIX_FMT_GRAY16BE, AV_PIX_FMT_YA16BE,
                   AV_PIX_FMT_MONOBLACK),
     .p.priv_class   = &pngenc_class,
-    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_ICC_PROFILES,
 };
 
 const FFCodec ff_apng_encoder = {
@@ -1249,6 +1483,7 @@ const FFCodec ff_apng_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_APNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1260,5 +1495,5 @@ const FFCodec ff_apng_encoder = {
                   AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY8A,
                   AV_PIX_FMT_GRAY16BE, AV_PIX_FMT_YA16BE),
     .p.priv_class   = &pngenc_class,
-    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_ICC_PROFILES,
 };
@@ -37,8 +37,13 @@ typedef struct RangeCoder {
     int range;
     int outstanding_count;
     int outstanding_byte;
-    uint8_t zero_state[256];
-    uint8_t one_state[256];
+    union {
+        struct {
+            uint8_t zero_state[256];
+            uint8_t one_state[256];
+        };
+        uint8_t state_table[2][256]; ///< zero_state and one_state indexed by the coded bit
+    };
     uint8_t *bytestream_start;
     uint8_t *bytestream;
     uint8_t *bytestream_end;
@@ -91,14 +96,13 @@ static inline void put_rac(RangeCoder *c, uint8_t *const state, int bit)
     av_assert2(*state);
     av_assert2(range1 < c->range);
     av_assert2(range1 > 0);
-    if (!bit) {
-        c->range -= range1;
-        *state    = c->zero_state[*state];
-    } else {
-        c->low  += c->range - range1;
-        c->range = range1;
-        *state   = c->one_state[*state];
-    }
+    bit = !!bit;
+    /* The bit is known up front here, so unlike in get_rac() a branchless
+     * update does not lengthen the dependency chain, and it avoids the
+     * mispredictions on the nearly random mantissa bits. */
+    c->low  += (c->range - range1) & -bit;
+    c->range = bit ? range1 : c->range - range1;
+    *state   = c->state_table[bit][*state];
 
     if (c->range < 0x100)
         renorm_encoder(c);
@@ -255,18 +255,16 @@ static double modify_qscale(MPVMainEncContext *const m, const RateControlEntry *
 }
 
 /**
- * Modify the bitrate curve from pass1 for one frame.
+ * Evaluate the rate control equation for one frame.
  */
-static double get_qscale(MPVMainEncContext *const m, RateControlEntry *rce,
-                         double rate_factor, int frame_num)
+static double get_rc_eq_output(MPVMainEncContext *const m, RateControlEntry *rce)
 {
     MPVEncContext  *const s = &m->s;
     RateControlContext *rcc = &m->rc_context;
     AVCodecContext *const avctx = s->c.avctx;
     const int pict_type     = rce->new_pict_type;
     const double mb_num     = s->c.mb_num;
-    double q, bits;
-    int i;
+    double bits;
 
     double const_values[] = {
         M_PI,
@@ -293,10 +291,28 @@ static double get_qscale(MPVMainEncContext *const m, RateControlEntry *rce,
     };
 
     bits = av_expr_eval(rcc->rc_eq_eval, const_values, rce);
-    if (isnan(bits)) {
+    if (isnan(bits))
         av_log(avctx, AV_LOG_ERROR, "Error evaluating rc_eq \"%s\"\n", rcc->rc_eq);
+
+    return bits;
+}
+
+/**
+ * Modify the bitrate curve from pass1 for one frame.
+ */
+static double get_qscale(MPVMainEncContext *const m, RateControlEntry *rce,
+                         double rate_factor, int frame_num)
+{
+    MPVEncContext  *const s = &m->s;
+    RateControlContext *rcc = &m->rc_context;
+    AVCodecContext *const avctx = s->c.avctx;
+    const int pict_type     = rce->new_pict_type;
+    double q, bits;
+    int i;
+
+    bits = get_rc_eq_output(m, rce);
+    if (isnan(bits))
         return -1;
-    }
 
     rcc->pass1_rc_eq_output_sum += bits;
     bits *= rate_factor;
@@ -907,6 +923,206 @@ void ff_get_2pass_fcode(MPVMainEncContext *const m)
     s->c.b_code = rce->b_code;
 }
 
+/**
+ * Fill in a pass 1 entry for a picture of the given complexity, the bits
+ * are predicted at qscale 2.
+ */
+static void init_pass1_entry(MPVMainEncContext *const m, RateControlEntry *rce,
+                             int pict_type, int64_t mb_var_sum, int64_t mc_mb_var_sum)
+{
+    MPVEncContext *const s = &m->s;
+    RateControlContext *rcc = &m->rc_context;
+    const int64_t var = pict_type == AV_PICTURE_TYPE_I ? mb_var_sum : mc_mb_var_sum;
+    double bits;
+
+    rce->pict_type     =
+    rce->new_pict_type = pict_type;
+    rce->mc_mb_var_sum = mc_mb_var_sum;
+    rce->mb_var_sum    = mb_var_sum;
+    rce->qscale        = FF_QP2LAMBDA * 2;
+    rce->f_code        = s->c.f_code;
+    rce->b_code        = s->c.b_code;
+    rce->misc_bits     = 1;
+
+    bits = predict_size(&rcc->pred[pict_type], rce->qscale, sqrt(var));
+    if (pict_type == AV_PICTURE_TYPE_I) {
+        rce->i_count    = s->c.mb_num;
+        rce->i_tex_bits = bits;
+        rce->p_tex_bits = 0;
+        rce->mv_bits    = 0;
+    } else {
+        rce->i_count    = 0;    // FIXME we do know this approx
+        rce->i_tex_bits = 0;
+        rce->p_tex_bits = bits * 0.9;
+        rce->mv_bits    = bits * 0.1;
+    }
+}
+
+/**
+ * Ratio between the complexity measured while encoding and the one estimated
+ * by the lookahead for pictures of the given type.
+ */
+static double lookahead_ratio(const RateControlContext *rcc, int pict_type)
+{
+    static const uint8_t fallback[5] = {
+        [AV_PICTURE_TYPE_B] = AV_PICTURE_TYPE_P,
+        [AV_PICTURE_TYPE_P] = AV_PICTURE_TYPE_I,
+    };
+
+    while (pict_type && rcc->lookahead_est[pict_type] <= 0)
+        pict_type = fallback[pict_type];
+
+    return pict_type ? rcc->lookahead_cplx[pict_type] / rcc->lookahead_est[pict_type] : 1.0;
+}
+
+static void update_lookahead_ratio(MPVMainEncContext *const m, int pict_type)
+{
+    RateControlContext *rcc = &m->rc_context;
+    const MPVPicture *pic   = m->s.c.cur_pic.ptr;
+
+    /* the spatial complexity is only computed for I- and P-frames */
+    if (pict_type != AV_PICTURE_TYPE_B && pic->lookahead_var) {
+        rcc->lookahead_cplx[AV_PICTURE_TYPE_I] = rcc->lookahead_cplx[AV_PICTURE_TYPE_I] * 0.9 + m->mb_var_sum;
+        rcc->lookahead_est [AV_PICTURE_TYPE_I] = rcc->lookahead_est [AV_PICTURE_TYPE_I] * 0.9 + pic->lookahead_var;
+    }
+    if (pict_type != AV_PICTURE_TYPE_I && pic->lookahead_mc_var) {
+        rcc->lookahead_cplx[pict_type] = rcc->lookahead_cplx[pict_type] * 0.9 + m->mc_mb_var_sum;
+        rcc->lookahead_est [pict_type] = rcc->lookahead_est [pict_type] * 0.9 + pic->lookahead_mc_var;
+    }
+}
+
+static void init_lookahead_entry(MPVMainEncContext *const m, RateControlEntry *rce,
+                                 const MPVPicture *pic, int pict_type)
+{
+    const RateControlContext *rcc = &m->rc_context;
+    const int mc_type = pict_type == AV_PICTURE_TYPE_I ? AV_PICTURE_TYPE_P : pict_type;
+
+    init_pass1_entry(m, rce, pict_type,
+                     pic->lookahead_var    * lookahead_ratio(rcc, AV_PICTURE_TYPE_I),
+                     pic->lookahead_mc_var * lookahead_ratio(rcc, mc_type));
+}
+
+/**
+ * Fill in pass 1 entries for the pictures waiting behind the current one,
+ * the types of the pictures not reordered yet are guessed from the GOP
+ * structure.
+ * @return the number of entries
+ */
+static int get_lookahead_entries(MPVMainEncContext *const m, RateControlEntry *entries)
+{
+    int gop_pos = m->picture_in_gop_number + 1, chain = 0, n = 0;
+
+    for (int i = 1; i < FF_ARRAY_ELEMS(m->reordered_input_picture); i++) {
+        const MPVPicture *pic = m->reordered_input_picture[i];
+
+        if (!pic)
+            continue;
+        init_lookahead_entry(m, &entries[n++], pic, pic->f->pict_type);
+        gop_pos = pic->f->pict_type == AV_PICTURE_TYPE_I ? 1 : gop_pos + 1;
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(m->input_picture); i++) {
+        const MPVPicture *pic = m->input_picture[i];
+        int pict_type;
+
+        if (!pic)
+            continue;
+        if (m->intra_only || pic->f->pict_type == AV_PICTURE_TYPE_I ||
+            gop_pos >= m->gop_size) {
+            pict_type = AV_PICTURE_TYPE_I;
+            gop_pos   = 0;
+            chain     = 0;
+        } else if (++chain % (m->max_b_frames + 1)) {
+            pict_type = AV_PICTURE_TYPE_B;
+        } else
+            pict_type = AV_PICTURE_TYPE_P;
+        gop_pos++;
+
+        init_lookahead_entry(m, &entries[n++], pic, pict_type);
+    }
+
+    return n;
+}
+
+static double quant_factor(const AVCodecContext *avctx, int pict_type)
+{
+    if (pict_type == AV_PICTURE_TYPE_I)
+        return FFABS(avctx->i_quant_factor);
+    if (pict_type == AV_PICTURE_TYPE_B)
+        return FFABS(avctx->b_quant_factor);
+    return 1.0;
+}
+
+/**
+ * Simulate the VBV buffer over the current and the lookahead pictures
+ * coded at qscale q (for the type of the current picture).
+ */
+static void lookahead_vbv_fill(MPVMainEncContext *const m, const RateControlEntry *rce,
+                               const RateControlEntry *entries, int n, double q,
+                               double *min_fill, double *max_fill)
+{
+    const RateControlContext *rcc = &m->rc_context;
+    AVCodecContext *const avctx   = m->s.c.avctx;
+    const double buffer_size = avctx->rc_buffer_size;
+    const double fps         = get_fps(avctx);
+    const double min_rate    = avctx->rc_min_rate / fps;
+    const double max_rate    = avctx->rc_max_rate / fps;
+    const double p_q         = q / quant_factor(avctx, rce->new_pict_type);
+    double buffer_index      = rcc->buffer_index;
+
+    *min_fill = *max_fill = buffer_index;
+    for (int i = -1; i < n; i++) {
+        const RateControlEntry *e = i < 0 ? rce : &entries[i];
+
+        buffer_index -= qp2bits(e, p_q * quant_factor(avctx, e->new_pict_type)) +
+                        e->mv_bits + e->misc_bits;
+        *min_fill     = FFMIN(*min_fill, buffer_index);
+        buffer_index += av_clipd(buffer_size - buffer_index - 1, min_rate, max_rate);
+        *max_fill     = FFMAX(*max_fill, buffer_index);
+    }
+}
+
+/**
+ * Raise q while the predicted sizes of the lookahead pictures would drain
+ * the VBV buffer, and lower it while a constant bitrate stream would have to
+ * be stuffed.
+ */
+static double lookahead_vbv_qscale(MPVMainEncContext *const m, const RateControlEntry *rce,
+                                   const RateControlEntry *entries, int n, double q)
+{
+    AVCodecContext *const avctx = m->s.c.avctx;
+    const double buffer_size = avctx->rc_buffer_size;
+    double min_fill, max_fill;
+    int qmin, qmax;
+
+    if (!buffer_size || !avctx->rc_max_rate)
+        return q;
+
+    /* the long term rate control corrects anything beyond one buffer */
+    n = FFMIN(n, buffer_size * get_fps(avctx) / avctx->rc_max_rate);
+
+    get_qminmax(&qmin, &qmax, m, rce->new_pict_type);
+
+    lookahead_vbv_fill(m, rce, entries, n, q, &min_fill, &max_fill);
+    if (min_fill < 0) {
+        for (int i = 0; i < 32 && min_fill < 0 && q < qmax; i++) {
+            q = FFMIN(q * 1.05, qmax);
+            lookahead_vbv_fill(m, rce, entries, n, q, &min_fill, &max_fill);
+        }
+    } else if (avctx->rc_min_rate) {
+        for (int i = 0; i < 32 && max_fill > buffer_size && q > qmin; i++) {
+            const double new_q = FFMAX(q / 1.05, qmin);
+
+            lookahead_vbv_fill(m, rce, entries, n, new_q, &min_fill, &max_fill);
+            if (min_fill < 0)
+                break;
+            q = new_q;
+        }
+    }
+
+    return q;
+}
+
 // FIXME rd or at least approx for dquant
 
 float ff_rate_estimate_qscale(MPVMainEncContext *const m, int dry_run)
@@ -923,7 +1139,9 @@ float ff_rate_estimate_qscale(MPVMainEncContext *const m, int dry_run)
     int picture_number = s->c.picture_number;
     int64_t wanted_bits;
     RateControlEntry local_rce, *rce;
-    double bits;
+    RateControlEntry lookahead[FF_ARRAY_ELEMS(m->reordered_input_picture) +
+                               FF_ARRAY_ELEMS(m->input_picture)];
+    int nb_lookahead = 0;
     double rate_factor;
     int64_t var;
     const int pict_type = s->c.pict_type;
@@ -992,34 +1210,34 @@ float ff_rate_estimate_qscale(MPVMainEncContext *const m, int dry_run)
         ff_dlog(s->c.avctx, "%f %f %f last:%d var:%"PRId64" type:%d//\n", q, rce->new_qscale,
                 br_compensation, m->frame_bits, var, pict_type);
     } else {
-        rce->pict_type     =
-        rce->new_pict_type = pict_type;
-        rce->mc_mb_var_sum = m->mc_mb_var_sum;
-        rce->mb_var_sum    = m->mb_var_sum;
-        rce->qscale        = FF_QP2LAMBDA * 2;
-        rce->f_code        = s->c.f_code;
-        rce->b_code        = s->c.b_code;
-        rce->misc_bits     = 1;
-
-        bits = predict_size(&rcc->pred[pict_type], rce->qscale, sqrt(var));
-        if (pict_type == AV_PICTURE_TYPE_I) {
-            rce->i_count    = s->c.mb_num;
-            rce->i_tex_bits = bits;
-            rce->p_tex_bits = 0;
-            rce->mv_bits    = 0;
-        } else {
-            rce->i_count    = 0;    // FIXME we do know this approx
-            rce->i_tex_bits = 0;
-            rce->p_tex_bits = bits * 0.9;
-            rce->mv_bits    = bits * 0.1;
-        }
+        init_pass1_entry(m, rce, pict_type, m->mb_var_sum, m->mc_mb_var_sum);
         rcc->i_cplx_sum[pict_type]  += rce->i_tex_bits * rce->qscale;
         rcc->p_cplx_sum[pict_type]  += rce->p_tex_bits * rce->qscale;
         rcc->mv_bits_sum[pict_type] += rce->mv_bits;
         rcc->frame_count[pict_type]++;
 
-        rate_factor = rcc->pass1_wanted_bits /
-                      rcc->pass1_rc_eq_output_sum * br_compensation;
+        if (m->rc_lookahead) {
+            if (!dry_run)
+                update_lookahead_ratio(m, pict_type);
+            nb_lookahead = get_lookahead_entries(m, lookahead);
+        }
+
+        if (nb_lookahead) {
+            /* spread the bits over the past and the lookahead pictures
+             * instead of the past ones only */
+            double eq_sum = 0;
+
+            for (int i = 0; i < nb_lookahead; i++) {
+                double eq = get_rc_eq_output(m, &lookahead[i]);
+                if (isnan(eq))
+                    return -1;
+                eq_sum += eq;
+            }
+            rate_factor = (rcc->pass1_wanted_bits + nb_lookahead * m->bit_rate / fps) /
+                          (rcc->pass1_rc_eq_output_sum + eq_sum) * br_compensation;
+        } else
+            rate_factor = rcc->pass1_wanted_bits /
+                          rcc->pass1_rc_eq_output_sum * br_compensation;
 
         q = get_qscale(m, rce, rate_factor, picture_number);
         if (q < 0)
@@ -1041,6 +1259,8 @@ float ff_rate_estimate_qscale(MPVMainEncContext *const m, int dry_run)
         av_assert0(q > 0.0);
 
         q = modify_qscale(m, rce, q, picture_number);
+        if (nb_lookahead)
+            q = lookahead_vbv_qscale(m, rce, lookahead, nb_lookahead, q);
 
         rcc->pass1_wanted_bits += m->bit_rate / fps;
 
@@ -91,6 +91,9 @@ typedef struct RateControlContext{
     struct AVExpr *rc_eq_eval;
 
     float *cplx_tab, *bits_tab;
+
+    double lookahead_cplx[5];     ///< decaying sum of the measured complexity per picture type
+    double lookahead_est[5];      ///< decaying sum of the lookahead estimate of the same pictures
 }RateControlContext;
 
 typedef struct MPVMainEncContext MPVMainEncContext;
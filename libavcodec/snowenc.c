@@ -41,8 +41,6 @@
 #include "mpegvideo.h"
 #include "h263enc.h"
 
-#define FF_ME_ITER 3
-
 typedef struct SnowEncContext {
     SnowContext com;
     QpelDSPContext qdsp;
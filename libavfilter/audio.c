@@ -43,12 +43,11 @@ AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
     return ff_get_audio_buffer(link->dst->outputs[0], nb_samples);
 }
 
-AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
+/* In pipelined graphs, called with the pool lock held. */
+static AVFrame *frame_pool_get(FilterLinkInternal *li, int channels,
+                               int nb_samples, int align)
 {
-    AVFrame *frame = NULL;
-    FilterLinkInternal *const li = ff_link_internal(link);
-    int channels = link->ch_layout.nb_channels;
-    int align = av_cpu_max_align();
+    AVFilterLink *const link = &li->l.pub;
 
     if (!li->frame_pool) {
         li->frame_pool = ff_frame_pool_audio_init(av_buffer_allocz, channels,
@@ -78,7 +77,19 @@ AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
         }
     }
 
-    frame = ff_frame_pool_get(li->frame_pool);
+    return ff_frame_pool_get(li->frame_pool);
+}
+
+AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
+{
+    AVFrame *frame = NULL;
+    FilterLinkInternal *const li = ff_link_internal(link);
+    int channels = link->ch_layout.nb_channels;
+    int align = av_cpu_max_align();
+
+    ff_graph_pool_lock(link->dst->graph);
+    frame = frame_pool_get(li, channels, nb_samples, align);
+    ff_graph_pool_unlock(link->dst->graph);
     if (!frame)
         return NULL;
 
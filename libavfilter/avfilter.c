@@ -78,14 +78,19 @@ static void tlog_ref(void *ctx, AVFrame *ref, int end)
 #endif
 }
 
+static void command_free(AVFilterCommand *c)
+{
+    av_freep(&c->arg);
+    av_freep(&c->command);
+    av_free(c);
+}
+
 static void command_queue_pop(AVFilterContext *filter)
 {
     FFFilterContext *ctxi = fffilterctx(filter);
     AVFilterCommand *c    = ctxi->command_queue;
-    av_freep(&c->arg);
-    av_freep(&c->command);
     ctxi->command_queue = c->next;
-    av_free(c);
+    command_free(c);
 }
 
 /**
@@ -226,10 +231,28 @@ static void update_link_current_pts(FilterLinkInternal *li, int64_t pts)
         ff_avfilter_graph_update_heap(li->l.graph, li);
 }
 
+/*
+ * In pipelined graphs, the functions below which do not take the graph lock
+ * themselves must be called with it held.
+ */
+
+static void filter_set_ready(AVFilterContext *filter, unsigned priority)
+{
+    FFFilterContext *ctxi   = fffilterctx(filter);
+    FFFilterGraph   *graphi = fffiltergraph(filter->graph);
+
+    if (priority > ctxi->ready) {
+        ctxi->ready = priority;
+        if (graphi && graphi->pipelined)
+            ff_cond_broadcast(&graphi->cond);
+    }
+}
+
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
-    FFFilterContext *ctxi = fffilterctx(filter);
-    ctxi->ready = FFMAX(ctxi->ready, priority);
+    ff_graph_lock(filter->graph);
+    filter_set_ready(filter, priority);
+    ff_graph_unlock(filter->graph);
 }
 
 /**
@@ -247,7 +270,7 @@ static void filter_unblock(AVFilterContext *filter)
 }
 
 
-void ff_avfilter_link_set_in_status(AVFilterLink *link, int status, int64_t pts)
+static void link_set_in_status(AVFilterLink *link, int status, int64_t pts)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
 
@@ -259,7 +282,14 @@ void ff_avfilter_link_set_in_status(AVFilterLink *link, int status, int64_t pts)
     li->frame_wanted_out = 0;
     li->frame_blocked_in = 0;
     filter_unblock(link->dst);
-    ff_filter_set_ready(link->dst, 200);
+    filter_set_ready(link->dst, 200);
+}
+
+void ff_avfilter_link_set_in_status(AVFilterLink *link, int status, int64_t pts)
+{
+    ff_graph_lock(link->dst->graph);
+    link_set_in_status(link, status, pts);
+    ff_graph_unlock(link->dst->graph);
 }
 
 /**
@@ -276,7 +306,23 @@ static void link_set_out_status(AVFilterLink *link, int status, int64_t pts)
     if (pts != AV_NOPTS_VALUE)
         update_link_current_pts(li, pts);
     filter_unblock(link->dst);
-    ff_filter_set_ready(link->src, 200);
+    filter_set_ready(link->src, 200);
+}
+
+static void inlink_set_status(AVFilterLink *link, int status)
+{
+    FilterLinkInternal * const li = ff_link_internal(link);
+    if (li->status_out)
+        return;
+    li->frame_wanted_out = 0;
+    li->frame_blocked_in = 0;
+    link_set_out_status(link, status, AV_NOPTS_VALUE);
+    while (ff_framequeue_queued_frames(&li->fifo)) {
+           AVFrame *frame = ff_framequeue_take(&li->fifo);
+           av_frame_free(&frame);
+    }
+    if (!li->status_in)
+        li->status_in = status;
 }
 
 int avfilter_insert_filter(AVFilterLink *link, AVFilterContext *filt,
@@ -477,13 +523,10 @@ void ff_tlog_link(void *ctx, AVFilterLink *link, int end)
 }
 #endif
 
-int ff_request_frame(AVFilterLink *link)
+static int request_frame_locked(AVFilterLink *link)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
 
-    FF_TPRINTF_START(NULL, request_frame); ff_tlog_link(NULL, link, 1);
-
-    av_assert1(!fffilter(link->dst->filter)->activate);
     if (li->status_out)
         return li->status_out;
     if (li->status_in) {
@@ -500,10 +543,23 @@ int ff_request_frame(AVFilterLink *link)
         }
     }
     li->frame_wanted_out = 1;
-    ff_filter_set_ready(link->src, 100);
+    filter_set_ready(link->src, 100);
     return 0;
 }
 
+int ff_request_frame(AVFilterLink *link)
+{
+    int ret;
+
+    FF_TPRINTF_START(NULL, request_frame); ff_tlog_link(NULL, link, 1);
+
+    av_assert1(!fffilter(link->dst->filter)->activate);
+    ff_graph_lock(link->dst->graph);
+    ret = request_frame_locked(link);
+    ff_graph_unlock(link->dst->graph);
+    return ret;
+}
+
 static int64_t guess_status_pts(AVFilterContext *ctx, int status, AVRational link_time_base)
 {
     unsigned i;
@@ -533,14 +589,18 @@ static int request_frame_to_filter(AVFilterLink *link)
 
     FF_TPRINTF_START(NULL, request_frame_to_filter); ff_tlog_link(NULL, link, 1);
     /* Assume the filter is blocked, let the method clear it if not */
+    ff_graph_lock(link->dst->graph);
     li->frame_blocked_in = 1;
+    ff_graph_unlock(link->dst->graph);
     if (link->srcpad->request_frame)
         ret = link->srcpad->request_frame(link);
     else if (link->src->inputs[0])
         ret = ff_request_frame(link->src->inputs[0]);
     if (ret < 0) {
+        ff_graph_lock(link->dst->graph);
         if (ret != AVERROR(EAGAIN) && ret != li->status_in)
-            ff_avfilter_link_set_in_status(link, ret, guess_status_pts(link->src, ret, link->time_base));
+            link_set_in_status(link, ret, guess_status_pts(link->src, ret, link->time_base));
+        ff_graph_unlock(link->dst->graph);
         if (ret == AVERROR_EOF)
             ret = 0;
     }
@@ -1042,7 +1102,9 @@ static int filter_frame_framed(AVFilterLink *link, AVFrame *frame)
         (dstctx->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC))
         filter_frame = default_filter_frame;
     ret = filter_frame(link, frame);
+    ff_graph_lock(dstctx->graph);
     l->frame_count_out++;
+    ff_graph_unlock(dstctx->graph);
     return ret;
 
 fail:
@@ -1087,16 +1149,19 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
                                        link->time_base);
     }
 
+    ff_graph_lock(link->dst->graph);
     li->frame_blocked_in = li->frame_wanted_out = 0;
     li->l.frame_count_in++;
     li->l.sample_count_in += frame->nb_samples;
     filter_unblock(link->dst);
     ret = ff_framequeue_add(&li->fifo, frame);
+    if (ret >= 0)
+        filter_set_ready(link->dst, 300);
+    ff_graph_unlock(link->dst->graph);
     if (ret < 0) {
         av_frame_free(&frame);
         return ret;
     }
-    ff_filter_set_ready(link->dst, 300);
     return 0;
 
 error:
@@ -1121,7 +1186,7 @@ static int take_samples(FilterLinkInternal *li, unsigned min, unsigned max,
     int ret;
 
     /* Note: this function relies on no format changes and must only be
-       called with enough samples. */
+       called with enough samples, with the graph lock held. */
     av_assert1(samples_ready(li, l->min_samples));
     frame0 = frame = ff_framequeue_peek(&li->fifo, 0);
     if (!li->fifo.samples_skipped && frame->nb_samples >= min && frame->nb_samples <= max) {
@@ -1190,18 +1255,22 @@ static int filter_frame_to_filter(AVFilterLink *link)
     }
     /* The filter will soon have received a new frame, that may allow it to
        produce one or more: unblock its outputs. */
+    ff_graph_lock(dst->graph);
     filter_unblock(dst);
     /* AVFilterPad.filter_frame() expect frame_count_out to have the value
        before the frame; filter_frame_framed() will re-increment it. */
     li->l.frame_count_out--;
+    ff_graph_unlock(dst->graph);
     ret = filter_frame_framed(link, frame);
+    ff_graph_lock(dst->graph);
     if (ret < 0 && ret != li->status_out) {
         link_set_out_status(link, ret, AV_NOPTS_VALUE);
     } else {
         /* Run once again, to see if several frames were available, or if
            the input status has also changed, or any other reason. */
-        ff_filter_set_ready(dst, 300);
+        filter_set_ready(dst, 300);
     }
+    ff_graph_unlock(dst->graph);
     return ret;
 }
 
@@ -1211,32 +1280,37 @@ static int forward_status_change(AVFilterContext *filter, FilterLinkInternal *li
     unsigned out = 0, progress = 0;
     int ret;
 
-    av_assert0(!li_in->status_out);
     if (!filter->nb_outputs) {
         /* not necessary with the current API and sinks */
         return 0;
     }
+    ff_graph_lock(filter->graph);
+    av_assert0(!li_in->status_out);
     while (!li_in->status_out) {
         FilterLinkInternal *li_out = ff_link_internal(filter->outputs[out]);
 
         if (!li_out->status_in) {
             progress++;
+            ff_graph_unlock(filter->graph);
             ret = request_frame_to_filter(filter->outputs[out]);
             if (ret < 0)
                 return ret;
+            ff_graph_lock(filter->graph);
         }
         if (++out == filter->nb_outputs) {
             if (!progress) {
                 /* Every output already closed: input no longer interesting
                    (example: overlay in shortest mode, other input closed). */
                 link_set_out_status(in, li_in->status_in, li_in->status_in_pts);
+                ff_graph_unlock(filter->graph);
                 return 0;
             }
             progress = 0;
             out = 0;
         }
     }
-    ff_filter_set_ready(filter, 200);
+    filter_set_ready(filter, 200);
+    ff_graph_unlock(filter->graph);
     return 0;
 }
 
@@ -1244,13 +1318,17 @@ static int filter_activate_default(AVFilterContext *filter)
 {
     unsigned i;
 
+    /* The action is chosen with the graph lock held, and performed without
+       it since it calls into the filter. */
+    ff_graph_lock(filter->graph);
     for (i = 0; i < filter->nb_outputs; i++) {
         FilterLinkInternal *li = ff_link_internal(filter->outputs[i]);
         int ret = li->status_in;
 
         if (ret) {
             for (int j = 0; j < filter->nb_inputs; j++)
-                ff_inlink_set_status(filter->inputs[j], ret);
+                inlink_set_status(filter->inputs[j], ret);
+            ff_graph_unlock(filter->graph);
             return 0;
         }
     }
@@ -1258,6 +1336,7 @@ static int filter_activate_default(AVFilterContext *filter)
     for (i = 0; i < filter->nb_inputs; i++) {
         FilterLinkInternal *li = ff_link_internal(filter->inputs[i]);
         if (samples_ready(li, li->l.min_samples)) {
+            ff_graph_unlock(filter->graph);
             return filter_frame_to_filter(filter->inputs[i]);
         }
     }
@@ -1265,6 +1344,7 @@ static int filter_activate_default(AVFilterContext *filter)
         FilterLinkInternal * const li = ff_link_internal(filter->inputs[i]);
         if (li->status_in && !li->status_out) {
             av_assert1(!ff_framequeue_queued_frames(&li->fifo));
+            ff_graph_unlock(filter->graph);
             return forward_status_change(filter, li);
         }
     }
@@ -1272,9 +1352,11 @@ static int filter_activate_default(AVFilterContext *filter)
         FilterLinkInternal * const li = ff_link_internal(filter->outputs[i]);
         if (li->frame_wanted_out &&
             !li->frame_blocked_in) {
+            ff_graph_unlock(filter->graph);
             return request_frame_to_filter(filter->outputs[i]);
         }
     }
+    ff_graph_unlock(filter->graph);
     return FFERROR_NOT_READY;
 }
 
@@ -1419,7 +1501,9 @@ int ff_filter_activate(AVFilterContext *filter)
     /* Generic timeline support is not yet implemented but should be easy */
     av_assert1(!(fi->p.flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  fi->activate));
+    ff_graph_lock(filter->graph);
     ctxi->ready = 0;
+    ff_graph_unlock(filter->graph);
     ret = fi->activate ? fi->activate(filter) : filter_activate_default(filter);
     if (ret == FFERROR_NOT_READY)
         ret = 0;
@@ -1429,54 +1513,101 @@ int ff_filter_activate(AVFilterContext *filter)
 int ff_inlink_acknowledge_status(AVFilterLink *link, int *rstatus, int64_t *rpts)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
+    int ret = 0;
+
+    ff_graph_lock(link->dst->graph);
     *rpts = li->l.current_pts;
-    if (ff_framequeue_queued_frames(&li->fifo))
-        return *rstatus = 0;
-    if (li->status_out)
-        return *rstatus = li->status_out;
-    if (!li->status_in)
-        return *rstatus = 0;
-    *rstatus = li->status_out = li->status_in;
-    update_link_current_pts(li, li->status_in_pts);
-    *rpts = li->l.current_pts;
-    return 1;
+    if (ff_framequeue_queued_frames(&li->fifo)) {
+        *rstatus = 0;
+    } else if (li->status_out) {
+        ret = *rstatus = li->status_out;
+    } else if (!li->status_in) {
+        *rstatus = 0;
+    } else {
+        *rstatus = li->status_out = li->status_in;
+        update_link_current_pts(li, li->status_in_pts);
+        *rpts = li->l.current_pts;
+        ret = 1;
+    }
+    ff_graph_unlock(link->dst->graph);
+    return ret;
 }
 
 size_t ff_inlink_queued_frames(AVFilterLink *link)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
-    return ff_framequeue_queued_frames(&li->fifo);
+    size_t ret;
+
+    ff_graph_lock(link->dst->graph);
+    ret = ff_framequeue_queued_frames(&li->fifo);
+    ff_graph_unlock(link->dst->graph);
+    return ret;
 }
 
 int ff_inlink_check_available_frame(AVFilterLink *link)
 {
-    FilterLinkInternal * const li = ff_link_internal(link);
-    return ff_framequeue_queued_frames(&li->fifo) > 0;
+    return ff_inlink_queued_frames(link) > 0;
 }
 
 int ff_inlink_queued_samples(AVFilterLink *link)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
-    return ff_framequeue_queued_samples(&li->fifo);
+    int ret;
+
+    ff_graph_lock(link->dst->graph);
+    ret = ff_framequeue_queued_samples(&li->fifo);
+    ff_graph_unlock(link->dst->graph);
+    return ret;
 }
 
-int ff_inlink_check_available_samples(AVFilterLink *link, unsigned min)
+static int check_available_samples(FilterLinkInternal *li, unsigned min)
 {
-    FilterLinkInternal * const li = ff_link_internal(link);
     uint64_t samples = ff_framequeue_queued_samples(&li->fifo);
     av_assert1(min);
     return samples >= min || (li->status_in && samples);
 }
 
+int ff_inlink_check_available_samples(AVFilterLink *link, unsigned min)
+{
+    FilterLinkInternal * const li = ff_link_internal(link);
+    int ret;
+
+    ff_graph_lock(link->dst->graph);
+    ret = check_available_samples(li, min);
+    ff_graph_unlock(link->dst->graph);
+    return ret;
+}
+
+/**
+ * In pipelined graphs, ask the source of a link for the next frame as soon as
+ * one is consumed, so that both filters can work at the same time, unless
+ * enough frames are already queued.
+ */
+static void link_prefetch(FilterLinkInternal *li)
+{
+    AVFilterLink *const link = &li->l.pub;
+    FFFilterGraph *graphi = fffiltergraph(link->dst->graph);
+
+    if (!graphi || !graphi->pipelined ||
+        li->status_in || li->status_out || li->frame_wanted_out ||
+        ff_framequeue_queued_frames(&li->fifo) >= graphi->pipeline_depth)
+        return;
+    li->frame_wanted_out = 1;
+    filter_set_ready(link->src, 100);
+}
+
 static void consume_update(FilterLinkInternal *li, const AVFrame *frame)
 {
     AVFilterLink *const link = &li->l.pub;
-    update_link_current_pts(li, frame->pts);
     ff_inlink_process_commands(link, frame);
     if (link == link->dst->inputs[0])
         link->dst->is_disabled = !evaluate_timeline_at_frame(link, frame);
+    /* only the thread running the destination writes the output counts,
+       but the graph reads them from the thread of the caller */
+    ff_graph_lock(link->dst->graph);
     li->l.frame_count_out++;
     li->l.sample_count_out += frame->nb_samples;
+    ff_graph_unlock(link->dst->graph);
 }
 
 int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe)
@@ -1485,15 +1616,22 @@ int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe)
     AVFrame *frame;
 
     *rframe = NULL;
-    if (!ff_inlink_check_available_frame(link))
+    ff_graph_lock(link->dst->graph);
+    if (!ff_framequeue_queued_frames(&li->fifo)) {
+        ff_graph_unlock(link->dst->graph);
         return 0;
+    }
 
     if (li->fifo.samples_skipped) {
         frame = ff_framequeue_peek(&li->fifo, 0);
+        ff_graph_unlock(link->dst->graph);
         return ff_inlink_consume_samples(link, frame->nb_samples, frame->nb_samples, rframe);
     }
 
     frame = ff_framequeue_take(&li->fifo);
+    update_link_current_pts(li, frame->pts);
+    link_prefetch(li);
+    ff_graph_unlock(link->dst->graph);
     consume_update(li, frame);
     *rframe = frame;
     return 1;
@@ -1508,11 +1646,19 @@ int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
 
     av_assert1(min);
     *rframe = NULL;
-    if (!ff_inlink_check_available_samples(link, min))
+    ff_graph_lock(link->dst->graph);
+    if (!check_available_samples(li, min)) {
+        ff_graph_unlock(link->dst->graph);
         return 0;
+    }
     if (li->status_in)
         min = FFMIN(min, ff_framequeue_queued_samples(&li->fifo));
     ret = take_samples(li, min, max, &frame);
+    if (ret >= 0) {
+        update_link_current_pts(li, frame->pts);
+        link_prefetch(li);
+    }
+    ff_graph_unlock(link->dst->graph);
     if (ret < 0)
         return ret;
     consume_update(li, frame);
@@ -1523,7 +1669,12 @@ int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
 AVFrame *ff_inlink_peek_frame(AVFilterLink *link, size_t idx)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
-    return ff_framequeue_peek(&li->fifo, idx);
+    AVFrame *frame;
+
+    ff_graph_lock(link->dst->graph);
+    frame = ff_framequeue_peek(&li->fifo, idx);
+    ff_graph_unlock(link->dst->graph);
+    return frame;
 }
 
 int ff_inlink_make_frame_writable(AVFilterLink *link, AVFrame **rframe)
@@ -1569,15 +1720,25 @@ int ff_inlink_make_frame_writable(AVFilterLink *link, AVFrame **rframe)
 int ff_inlink_process_commands(AVFilterLink *link, const AVFrame *frame)
 {
     FFFilterContext *ctxi = fffilterctx(link->dst);
-    AVFilterCommand *cmd  = ctxi->command_queue;
+    AVFilterCommand *cmd;
+
+    while (1) {
+        /* Commands may be queued concurrently, process them unlocked. */
+        ff_graph_lock(link->dst->graph);
+        cmd = ctxi->command_queue;
+        if (cmd && cmd->time <= frame->pts * av_q2d(link->time_base))
+            ctxi->command_queue = cmd->next;
+        else
+            cmd = NULL;
+        ff_graph_unlock(link->dst->graph);
+        if (!cmd)
+            break;
 
-    while(cmd && cmd->time <= frame->pts * av_q2d(link->time_base)){
         av_log(link->dst, AV_LOG_DEBUG,
                "Processing command time:%f command:%s arg:%s\n",
                cmd->time, cmd->command, cmd->arg);
         avfilter_process_command(link->dst, cmd->command, cmd->arg, 0, 0, cmd->flags);
-        command_queue_pop(link->dst);
-        cmd = ctxi->command_queue;
+        command_free(cmd);
     }
     return 0;
 }
@@ -1585,40 +1746,44 @@ int ff_inlink_process_commands(AVFilterLink *link, const AVFrame *frame)
 void ff_inlink_request_frame(AVFilterLink *link)
 {
     av_unused FilterLinkInternal *li = ff_link_internal(link);
+
+    ff_graph_lock(link->dst->graph);
     av_assert1(!li->status_in);
     av_assert1(!li->status_out);
     li->frame_wanted_out = 1;
-    ff_filter_set_ready(link->src, 100);
+    filter_set_ready(link->src, 100);
+    ff_graph_unlock(link->dst->graph);
 }
 
 void ff_inlink_set_status(AVFilterLink *link, int status)
 {
-    FilterLinkInternal * const li = ff_link_internal(link);
-    if (li->status_out)
-        return;
-    li->frame_wanted_out = 0;
-    li->frame_blocked_in = 0;
-    link_set_out_status(link, status, AV_NOPTS_VALUE);
-    while (ff_framequeue_queued_frames(&li->fifo)) {
-           AVFrame *frame = ff_framequeue_take(&li->fifo);
-           av_frame_free(&frame);
-    }
-    if (!li->status_in)
-        li->status_in = status;
+    ff_graph_lock(link->dst->graph);
+    inlink_set_status(link, status);
+    ff_graph_unlock(link->dst->graph);
 }
 
 int ff_outlink_get_status(AVFilterLink *link)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
-    return li->status_in;
+    int ret;
+
+    ff_graph_lock(link->src->graph);
+    ret = li->status_in;
+    ff_graph_unlock(link->src->graph);
+    return ret;
 }
 
 int ff_inoutlink_check_flow(AVFilterLink *inlink, AVFilterLink *outlink)
 {
     FilterLinkInternal * const li_in = ff_link_internal(inlink);
-    return ff_outlink_frame_wanted(outlink) ||
-           ff_inlink_check_available_frame(inlink) ||
-           li_in->status_out;
+    int ret;
+
+    ff_graph_lock(inlink->dst->graph);
+    ret = ff_link_internal(outlink)->frame_wanted_out ||
+          ff_framequeue_queued_frames(&li_in->fifo) ||
+          li_in->status_out;
+    ff_graph_unlock(inlink->dst->graph);
+    return ret;
 }
 
 
@@ -1652,7 +1817,12 @@ int ff_filter_init_hw_frames(AVFilterContext *avctx, AVFilterLink *link,
 int ff_outlink_frame_wanted(AVFilterLink *link)
 {
     FilterLinkInternal * const li = ff_link_internal(link);
-    return li->frame_wanted_out;
+    int ret;
+
+    ff_graph_lock(link->src->graph);
+    ret = li->frame_wanted_out;
+    ff_graph_unlock(link->src->graph);
+    return ret;
 }
 
 int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -253,6 +253,18 @@ unsigned avfilter_filter_pad_count(const AVFilter *filter, int is_output);
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Activate different filters of a graph concurrently, so that consecutive
+ * stages of a filter chain work on different frames at the same time.
+ *
+ * Only meaningful for AVFilterGraph.thread_type, and only if it is set before
+ * avfilter_graph_config(). The frames queued on each link are bounded by the
+ * "pipeline_depth" option of the graph. The buffer sources and sinks are only
+ * run from the thread calling into them; all the calls into a pipelined graph
+ * must still come from a single thread at a time.
+ */
+#define AVFILTER_THREAD_PIPELINE (1 << 1)
+
 /** An instance of a filter */
 typedef struct AVFilterContext {
     const AVClass *av_class;        ///< needed for av_log() and filters common options
@@ -1137,6 +1149,10 @@ void avfilter_graph_segment_free(AVFilterGraphSegment **seg);
  *
  * @returns >=0 on success otherwise an error code.
  *              AVERROR(ENOSYS) on unsupported commands
+ *
+ * @note In a graph using AVFILTER_THREAD_PIPELINE, a command sent to a filter
+ *       which is running in another thread is queued instead, and processed
+ *       before its next input frame; res is left empty in that case.
  */
 int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const char *cmd, const char *arg, char *res, int res_len, int flags);
 
@@ -27,6 +27,8 @@
 
 #include <stdint.h>
 
+#include "libavutil/thread.h"
+
 #include "avfilter.h"
 #include "filters.h"
 #include "framequeue.h"
@@ -110,6 +112,12 @@ typedef struct FFFilterContext {
      */
     unsigned ready;
 
+    /**
+     * Set while a thread activates the filter or sends it a command,
+     * in pipelined graphs.
+     */
+    int running;
+
     /// parsed expression
     struct AVExpr *enable;
     /// variable values for the enable expression
@@ -145,6 +153,26 @@ typedef struct FFFilterGraph {
     void *thread;
     avfilter_execute_func *thread_execute;
     FFFrameQueueGlobal frame_queues;
+
+    /**
+     * Pipelined execution, see AVFILTER_THREAD_PIPELINE.
+     *
+     * While set, the state of the links, the ready and running fields of the
+     * filters and the command queues are protected by lock. Frame pool
+     * management is protected by pool_lock, which can be taken while holding
+     * lock but not the other way around. Neither is held while calling into
+     * filter code.
+     */
+    int pipelined;
+    AVMutex lock;
+    AVCond cond;
+    AVMutex pool_lock;
+    /// maximum number of frames queued on a link before its source is paused
+    int pipeline_depth;
+    int nb_running;
+    /// first error returned by an activation in a worker thread
+    int pipeline_err;
+    void *pipeline;
 } FFFilterGraph;
 
 static inline FFFilterGraph *fffiltergraph(AVFilterGraph *graph)
@@ -152,6 +180,34 @@ static inline FFFilterGraph *fffiltergraph(AVFilterGraph *graph)
     return (FFFilterGraph*)graph;
 }
 
+static inline void ff_graph_lock(AVFilterGraph *graph)
+{
+    FFFilterGraph *graphi = fffiltergraph(graph);
+    if (graphi && graphi->pipelined)
+        ff_mutex_lock(&graphi->lock);
+}
+
+static inline void ff_graph_unlock(AVFilterGraph *graph)
+{
+    FFFilterGraph *graphi = fffiltergraph(graph);
+    if (graphi && graphi->pipelined)
+        ff_mutex_unlock(&graphi->lock);
+}
+
+static inline void ff_graph_pool_lock(AVFilterGraph *graph)
+{
+    FFFilterGraph *graphi = fffiltergraph(graph);
+    if (graphi && graphi->pipelined)
+        ff_mutex_lock(&graphi->pool_lock);
+}
+
+static inline void ff_graph_pool_unlock(AVFilterGraph *graph)
+{
+    FFFilterGraph *graphi = fffiltergraph(graph);
+    if (graphi && graphi->pipelined)
+        ff_mutex_unlock(&graphi->pool_lock);
+}
+
 /**
  * Update the position of a link in the age heap.
  */
@@ -192,6 +248,16 @@ int ff_graph_thread_init(FFFilterGraph *graph);
 
 void ff_graph_thread_free(FFFilterGraph *graph);
 
+/**
+ * Start the worker threads of a pipelined graph.
+ */
+int ff_graph_pipeline_init(FFFilterGraph *graph);
+
+/**
+ * Stop the worker threads of a pipelined graph.
+ */
+void ff_graph_pipeline_free(FFFilterGraph *graph);
+
 /**
  * Negotiate the media format, dimensions, etc of all inputs to a filter.
  *
@@ -215,6 +281,17 @@ void ff_tlog_link(void *ctx, AVFilterLink *link, int end);
  */
 int ff_filter_graph_run_once(AVFilterGraph *graph);
 
+/**
+ * Activate the most urgent ready filter which is not already running.
+ * Must be called with the graph lock held, which is released during the
+ * activation.
+ *
+ * @param worker if set, skip the filters flagged FF_FILTER_FLAG_APP_THREAD
+ * @return AVERROR(EAGAIN) if there is no filter to activate, the result of
+ *         the activation otherwise, with AVERROR(EAGAIN) mapped to 0
+ */
+int ff_filter_graph_activate_next(FFFilterGraph *graph, int worker);
+
 /**
  * Process the commands queued in the link up to the time of the frame.
  * Commands will trigger the process_command() callback.
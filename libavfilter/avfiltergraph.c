@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <math.h>
 #include <string.h>
 
 #include "libavutil/avassert.h"
@@ -49,9 +50,12 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, .unit = "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "pipeline", "run different filters concurrently", 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_PIPELINE }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, F|V|A, .unit = "threads"},
         {"auto", "autodetect a suitable number of threads to use", 0, AV_OPT_TYPE_CONST, {.i64 = 0 }, .flags = F|V|A, .unit = "threads"},
+    { "pipeline_depth", "Maximum number of frames queued on a link in pipelined graphs",
+        offsetof(FFFilterGraph, pipeline_depth), AV_OPT_TYPE_INT, { .i64 = 2 }, 1, INT_MAX, F|V|A },
     {"scale_sws_opts"       , "default scale filter options"        , OFFSET(scale_sws_opts)        ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|V },
     {"aresample_swr_opts"   , "default aresample filter options"    , OFFSET(aresample_swr_opts)    ,
@@ -78,6 +82,15 @@ int ff_graph_thread_init(FFFilterGraph *graph)
     graph->p.nb_threads  = 1;
     return 0;
 }
+
+int ff_graph_pipeline_init(FFFilterGraph *graph)
+{
+    return 0;
+}
+
+void ff_graph_pipeline_free(FFFilterGraph *graph)
+{
+}
 #endif
 
 AVFilterGraph *avfilter_graph_alloc(void)
@@ -122,6 +135,8 @@ void avfilter_graph_free(AVFilterGraph **graphp)
     if (!graph)
         return;
 
+    ff_graph_pipeline_free(graphi);
+
     while (graph->nb_filters)
         avfilter_free(graph->filters[0]);
 
@@ -1307,9 +1322,70 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
     if ((ret = graph_config_pointers(graphctx, log_ctx)))
         return ret;
 
+    if (graphctx->thread_type & AVFILTER_THREAD_PIPELINE &&
+        !fffiltergraph(graphctx)->pipelined) {
+        ret = ff_graph_pipeline_init(fffiltergraph(graphctx));
+        if (ret < 0) {
+            av_log(graphctx, AV_LOG_ERROR, "Error initializing pipelined execution: %s.\n",
+                   av_err2str(ret));
+            return ret;
+        }
+    }
+
     return 0;
 }
 
+static int command_queue_insert(FFFilterContext *ctxi, const char *command,
+                                const char *arg, int flags, double ts)
+{
+    AVFilterCommand **queue = &ctxi->command_queue, *next;
+
+    while (*queue && (*queue)->time <= ts)
+        queue = &(*queue)->next;
+    next = *queue;
+    *queue = av_mallocz(sizeof(AVFilterCommand));
+    if (!*queue)
+        return AVERROR(ENOMEM);
+
+    (*queue)->command = av_strdup(command);
+    (*queue)->arg     = av_strdup(arg);
+    (*queue)->time    = ts;
+    (*queue)->flags   = flags;
+    (*queue)->next    = next;
+    return 0;
+}
+
+static int graph_process_command(AVFilterGraph *graph, AVFilterContext *filter,
+                                 const char *cmd, const char *arg,
+                                 char *res, int res_len, int flags)
+{
+    FFFilterGraph   *graphi = fffiltergraph(graph);
+    FFFilterContext *ctxi   = fffilterctx(filter);
+    int ret;
+
+    if (!graphi->pipelined)
+        return avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+
+    /* Waiting for the filter could deadlock if the command is sent from
+       inside the graph, queue it for its next frame instead. */
+    ff_mutex_lock(&graphi->lock);
+    if (ctxi->running) {
+        ret = command_queue_insert(ctxi, cmd, arg, flags, -INFINITY);
+        ff_mutex_unlock(&graphi->lock);
+        return ret;
+    }
+    ctxi->running = 1;
+    ff_mutex_unlock(&graphi->lock);
+
+    ret = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+
+    ff_mutex_lock(&graphi->lock);
+    ctxi->running = 0;
+    ff_cond_broadcast(&graphi->cond);
+    ff_mutex_unlock(&graphi->lock);
+    return ret;
+}
+
 int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const char *cmd, const char *arg, char *res, int res_len, int flags)
 {
     int i, r = AVERROR(ENOSYS);
@@ -1329,7 +1405,7 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
     for (i = 0; i < graph->nb_filters; i++) {
         AVFilterContext *filter = graph->filters[i];
         if (!strcmp(target, "all") || (filter->name && !strcmp(target, filter->name)) || !strcmp(target, filter->filter->name)) {
-            r = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
+            r = graph_process_command(graph, filter, cmd, arg, res, res_len, flags);
             if (r != AVERROR(ENOSYS)) {
                 if ((flags & AVFILTER_CMD_FLAG_ONE) || r < 0)
                     return r;
@@ -1340,6 +1416,44 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
     return r;
 }
 
+int ff_filter_graph_send_command(AVFilterContext *ctx, double ts,
+                                 const char *target, const char *cmd,
+                                 const char *arg, char *res, int res_len,
+                                 int flags)
+{
+    AVFilterGraph *graph = ctx->graph;
+    int r = AVERROR(ENOSYS);
+
+    if (!fffiltergraph(graph)->pipelined)
+        return avfilter_graph_send_command(graph, target, cmd, arg, res, res_len, flags);
+
+    if (res_len && res)
+        res[0] = 0;
+    if (isnan(ts))
+        ts = -INFINITY;
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        if (strcmp(target, "all") && (!filter->name || strcmp(target, filter->name)) &&
+            strcmp(target, filter->filter->name))
+            continue;
+        if (filter->nb_inputs) {
+            ff_mutex_lock(&fffiltergraph(graph)->lock);
+            r = command_queue_insert(fffilterctx(filter), cmd, arg, flags, ts);
+            ff_mutex_unlock(&fffiltergraph(graph)->lock);
+        } else {
+            r = graph_process_command(graph, filter, cmd, arg, res, res_len, flags);
+        }
+        if (r != AVERROR(ENOSYS)) {
+            if ((flags & AVFILTER_CMD_FLAG_ONE) || r < 0)
+                return r;
+        }
+    }
+
+    return r;
+}
+
 int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const char *command, const char *arg, int flags, double ts)
 {
     int i;
@@ -1351,19 +1465,13 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
         AVFilterContext *filter = graph->filters[i];
         FFFilterContext *ctxi   = fffilterctx(filter);
         if(filter && (!strcmp(target, "all") || !strcmp(target, filter->name) || !strcmp(target, filter->filter->name))){
-            AVFilterCommand **queue = &ctxi->command_queue, *next;
-            while (*queue && (*queue)->time <= ts)
-                queue = &(*queue)->next;
-            next = *queue;
-            *queue = av_mallocz(sizeof(AVFilterCommand));
-            if (!*queue)
-                return AVERROR(ENOMEM);
+            int ret;
 
-            (*queue)->command = av_strdup(command);
-            (*queue)->arg     = av_strdup(arg);
-            (*queue)->time    = ts;
-            (*queue)->flags   = flags;
-            (*queue)->next    = next;
+            ff_graph_lock(graph);
+            ret = command_queue_insert(ctxi, command, arg, flags, ts);
+            ff_graph_unlock(graph);
+            if (ret < 0)
+                return ret;
             if(flags & AVFILTER_CMD_FLAG_ONE)
                 return 0;
         }
@@ -1423,17 +1531,34 @@ void ff_avfilter_graph_update_heap(AVFilterGraph *graph, FilterLinkInternal *li)
     heap_bubble_down(graphi, li, li->age_index);
 }
 
+/* the sink may be running in a worker thread of a pipelined graph */
+static int64_t sink_frame_count(AVFilterGraph *graph, FilterLinkInternal *li)
+{
+    int64_t frame_count;
+
+    ff_graph_lock(graph);
+    frame_count = li->l.frame_count_out;
+    ff_graph_unlock(graph);
+    return frame_count;
+}
+
 int avfilter_graph_request_oldest(AVFilterGraph *graph)
 {
     FFFilterGraph *graphi = fffiltergraph(graph);
     FilterLinkInternal *oldesti = graphi->sink_links[0];
     AVFilterLink *oldest = &oldesti->l.pub;
     int64_t frame_count;
-    int r;
+    int r, request;
 
-    while (graphi->sink_links_count) {
+    while (1) {
+        ff_graph_lock(graph);
+        if (!graphi->sink_links_count) {
+            ff_graph_unlock(graph);
+            break;
+        }
         oldesti = graphi->sink_links[0];
         oldest  = &oldesti->l.pub;
+        ff_graph_unlock(graph);
         if (fffilter(oldest->dst->filter)->activate) {
             r = av_buffersink_get_frame_flags(oldest->dst, NULL,
                                               AV_BUFFERSINK_FLAG_PEEK);
@@ -1448,21 +1573,25 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
                oldest->dst->name,
                oldest->dstpad->name);
         /* EOF: remove the link from the heap */
+        ff_graph_lock(graph);
         if (oldesti->age_index < --graphi->sink_links_count)
             heap_bubble_down(graphi, graphi->sink_links[graphi->sink_links_count],
                              oldesti->age_index);
         oldesti->age_index = -1;
+        ff_graph_unlock(graph);
     }
     if (!graphi->sink_links_count)
         return AVERROR_EOF;
     av_assert1(!fffilter(oldest->dst->filter)->activate);
     av_assert1(oldesti->age_index >= 0);
-    frame_count = oldesti->l.frame_count_out;
-    while (frame_count == oldesti->l.frame_count_out) {
+    frame_count = sink_frame_count(graph, oldesti);
+    while (frame_count == sink_frame_count(graph, oldesti)) {
         r = ff_filter_graph_run_once(graph);
-        if (r == AVERROR(EAGAIN) &&
-            !oldesti->frame_wanted_out && !oldesti->frame_blocked_in &&
-            !oldesti->status_in)
+        ff_graph_lock(graph);
+        request = !oldesti->frame_wanted_out && !oldesti->frame_blocked_in &&
+                  !oldesti->status_in;
+        ff_graph_unlock(graph);
+        if (r == AVERROR(EAGAIN) && request)
             (void)ff_request_frame(oldest);
         else if (r < 0)
             return r;
@@ -1470,12 +1599,94 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+int ff_filter_graph_activate_next(FFFilterGraph *graphi, int worker)
+{
+    AVFilterGraph *graph = &graphi->p;
+    FFFilterContext *ctxi = NULL;
+    int ret;
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        FFFilterContext *ctxi_other = fffilterctx(graph->filters[i]);
+
+        if (!ctxi_other->ready || ctxi_other->running)
+            continue;
+        if (worker &&
+            fffilter(ctxi_other->p.filter)->flags_internal & FF_FILTER_FLAG_APP_THREAD)
+            continue;
+        if (!ctxi || ctxi_other->ready > ctxi->ready)
+            ctxi = ctxi_other;
+    }
+    if (!ctxi)
+        return AVERROR(EAGAIN);
+
+    ctxi->running = 1;
+    graphi->nb_running++;
+    ff_mutex_unlock(&graphi->lock);
+
+    ret = ff_filter_activate(&ctxi->p);
+
+    ff_mutex_lock(&graphi->lock);
+    ctxi->running = 0;
+    graphi->nb_running--;
+    ff_cond_broadcast(&graphi->cond);
+    return ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
+/**
+ * Check if a source fed by the application has been asked for a frame.
+ * Must be called with the graph lock held.
+ */
+static int graph_wants_input(AVFilterGraph *graph)
+{
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *f = graph->filters[i];
+
+        if (f->nb_inputs ||
+            !(fffilter(f->filter)->flags_internal & FF_FILTER_FLAG_APP_THREAD))
+            continue;
+        for (unsigned j = 0; j < f->nb_outputs; j++) {
+            FilterLinkInternal *li = ff_link_internal(f->outputs[j]);
+            if (li->frame_wanted_out && !li->status_in)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Activate one filter, waiting for the worker threads if none is ready.
+ * Return AVERROR(EAGAIN) when the graph is idle or needs more input.
+ */
+static int graph_run_once_pipelined(FFFilterGraph *graphi)
+{
+    int ret;
+
+    ff_mutex_lock(&graphi->lock);
+    while (1) {
+        if (graphi->pipeline_err) {
+            ret = graphi->pipeline_err;
+            graphi->pipeline_err = 0;
+            break;
+        }
+        ret = ff_filter_graph_activate_next(graphi, 0);
+        if (ret != AVERROR(EAGAIN) ||
+            !graphi->nb_running || graph_wants_input(&graphi->p))
+            break;
+        ff_cond_wait(&graphi->cond, &graphi->lock);
+    }
+    ff_mutex_unlock(&graphi->lock);
+    return ret;
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
     FFFilterContext *ctxi;
     unsigned i;
 
     av_assert0(graph->nb_filters);
+    if (fffiltergraph(graph)->pipelined)
+        return graph_run_once_pipelined(fffiltergraph(graph));
+
     ctxi = fffilterctx(graph->filters[0]);
     for (i = 1; i < graph->nb_filters; i++) {
         FFFilterContext *ctxi_other = fffilterctx(graph->filters[i]);
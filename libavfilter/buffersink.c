@@ -37,7 +37,6 @@
 #include "buffersink.h"
 #include "filters.h"
 #include "formats.h"
-#include "framequeue.h"
 #include "video.h"
 
 typedef struct BufferSinkContext {
@@ -109,7 +108,6 @@ static int get_frame_internal(AVFilterContext *ctx, AVFrame *frame, int flags, i
 {
     BufferSinkContext *buf = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
-    FilterLinkInternal *li = ff_link_internal(inlink);
     int status, ret;
     AVFrame *cur_frame;
     int64_t pts;
@@ -129,7 +127,7 @@ static int get_frame_internal(AVFilterContext *ctx, AVFrame *frame, int flags, i
             return status;
         } else if ((flags & AV_BUFFERSINK_FLAG_NO_REQUEST)) {
             return AVERROR(EAGAIN);
-        } else if (li->frame_wanted_out) {
+        } else if (ff_outlink_frame_wanted(inlink)) {
             ret = ff_filter_graph_run_once(ctx->graph);
             if (ret < 0)
                 return ret;
@@ -277,10 +275,9 @@ static void uninit(AVFilterContext *ctx)
 static int activate(AVFilterContext *ctx)
 {
     BufferSinkContext *buf = ctx->priv;
-    FilterLinkInternal * const li = ff_link_internal(ctx->inputs[0]);
 
     if (buf->warning_limit &&
-        ff_framequeue_queued_frames(&li->fifo) >= buf->warning_limit) {
+        ff_inlink_queued_frames(ctx->inputs[0]) >= buf->warning_limit) {
         av_log(ctx, AV_LOG_WARNING,
                "%d buffers queued in %s, something may be wrong.\n",
                buf->warning_limit,
@@ -542,6 +539,7 @@ const FFFilter ff_vsink_buffer = {
     .p.priv_class  = &buffersink_class,
     .p.outputs     = NULL,
     .priv_size     = sizeof(BufferSinkContext),
+    .flags_internal = FF_FILTER_FLAG_APP_THREAD,
     .init          = init_video,
     .uninit        = uninit,
     .activate      = activate,
@@ -563,6 +561,7 @@ const FFFilter ff_asink_abuffer = {
     .p.priv_class  = &abuffersink_class,
     .p.outputs     = NULL,
     .priv_size     = sizeof(BufferSinkContext),
+    .flags_internal = FF_FILTER_FLAG_APP_THREAD,
     .init          = init_audio,
     .uninit        = uninit,
     .activate      = activate,
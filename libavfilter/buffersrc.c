@@ -568,6 +568,7 @@ const FFFilter ff_vsrc_buffer = {
     .p.description = NULL_IF_CONFIG_SMALL("Buffer video frames, and make them accessible to the filterchain."),
     .p.priv_class  = &buffer_class,
     .priv_size = sizeof(BufferSourceContext),
+    .flags_internal = FF_FILTER_FLAG_APP_THREAD,
     .activate  = activate,
     .init      = init_video,
     .uninit    = uninit,
@@ -589,6 +590,7 @@ const FFFilter ff_asrc_abuffer = {
     .p.description = NULL_IF_CONFIG_SMALL("Buffer audio frames, and make them accessible to the filterchain."),
     .p.priv_class  = &abuffer_class,
     .priv_size     = sizeof(BufferSourceContext),
+    .flags_internal = FF_FILTER_FLAG_APP_THREAD,
     .activate  = activate,
     .init      = init_audio,
     .uninit    = uninit,
@@ -555,10 +555,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *ref)
                     av_log(ctx, AV_LOG_VERBOSE,
                            "Processing command #%d target:%s command:%s arg:%s\n",
                            cmd->index, cmd->target, cmd->command, cmd_arg);
-                    ret = avfilter_graph_send_command(inl->graph,
-                                                      cmd->target, cmd->command, cmd_arg,
-                                                      buf, sizeof(buf),
-                                                      AVFILTER_CMD_FLAG_ONE);
+                    ret = ff_filter_graph_send_command(ctx, TS2T(ref->pts, inlink->time_base),
+                                                       cmd->target, cmd->command, cmd_arg,
+                                                       buf, sizeof(buf),
+                                                       AVFILTER_CMD_FLAG_ONE);
                     av_log(ctx, AV_LOG_VERBOSE,
                            "Command reply for command #%d: ret:%s res:%s\n",
                            cmd->index, av_err2str(ret), buf);
@@ -205,6 +205,13 @@ static inline FilterLink* ff_filter_link(AVFilterLink *link)
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The application accesses the filter private context through a dedicated
+ * API. In pipelined graphs, the filter is only activated from the thread
+ * calling into the graph.
+ */
+#define FF_FILTER_FLAG_APP_THREAD    (1 << 1)
+
 /**
  * Find the index of a link.
  *
@@ -720,6 +727,20 @@ int ff_inoutlink_check_flow(AVFilterLink *inlink, AVFilterLink *outlink);
 int ff_filter_init_hw_frames(AVFilterContext *avctx, AVFilterLink *link,
                              int default_pool_size);
 
+/**
+ * Send a command to the filters of the graph, on behalf of a filter which is
+ * processing a frame at time ts (in seconds, NAN if unknown).
+ *
+ * Same as avfilter_graph_send_command(), except that in pipelined graphs the
+ * command is queued on the targets which have inputs, so that they process it
+ * in sync with the frame instead of whatever frame they are at; res is left
+ * empty for those.
+ */
+int ff_filter_graph_send_command(AVFilterContext *ctx, double ts,
+                                 const char *target, const char *cmd,
+                                 const char *arg, char *res, int res_len,
+                                 int flags);
+
 /**
  * Generic processing of user supplied commands that are set
  * in the same way as the filter options.
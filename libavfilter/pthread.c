@@ -23,10 +23,14 @@
 
 #include <stddef.h>
 
+#include "libavutil/cpu.h"
 #include "libavutil/error.h"
+#include "libavutil/log.h"
 #include "libavutil/macros.h"
+#include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
 
 #include "avfilter.h"
 #include "avfilter_internal.h"
@@ -36,6 +40,9 @@ typedef struct ThreadContext {
     AVSliceThread *thread;
     avfilter_action_func *func;
 
+    /* serializes the executions requested by different pipeline workers */
+    AVMutex execute_lock;
+
     /* per-execute parameters */
     AVFilterContext *ctx;
     void *arg;
@@ -53,6 +60,7 @@ static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb
 static void slice_thread_uninit(ThreadContext *c)
 {
     avpriv_slicethread_free(&c->thread);
+    ff_mutex_destroy(&c->execute_lock);
 }
 
 static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -62,20 +70,28 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
 
     if (nb_jobs <= 0)
         return 0;
+    ff_mutex_lock(&c->execute_lock);
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    ff_mutex_unlock(&c->execute_lock);
     return 0;
 }
 
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
+    int ret = ff_mutex_init(&c->execute_lock, NULL);
+    if (ret)
+        return AVERROR(ret);
+
     nb_threads = avpriv_slicethread_create(&c->thread, c, worker_func, NULL, nb_threads);
-    if (nb_threads <= 1)
+    if (nb_threads <= 1) {
         avpriv_slicethread_free(&c->thread);
+        ff_mutex_destroy(&c->execute_lock);
+    }
     return FFMAX(nb_threads, 1);
 }
 
@@ -113,3 +129,109 @@ void ff_graph_thread_free(FFFilterGraph *graph)
         slice_thread_uninit(graph->thread);
     av_freep(&graph->thread);
 }
+
+typedef struct PipelineContext {
+    pthread_t *threads;
+    int     nb_threads;
+    int     die;
+} PipelineContext;
+
+static void *attribute_align_arg pipeline_worker(void *arg)
+{
+    FFFilterGraph  *graphi = arg;
+    PipelineContext *p     = graphi->pipeline;
+
+    ff_mutex_lock(&graphi->lock);
+    while (!p->die) {
+        int ret = ff_filter_graph_activate_next(graphi, 1);
+        if (ret == AVERROR(EAGAIN))
+            ff_cond_wait(&graphi->cond, &graphi->lock);
+        else if (ret < 0 && !graphi->pipeline_err)
+            graphi->pipeline_err = ret;
+    }
+    ff_mutex_unlock(&graphi->lock);
+
+    return NULL;
+}
+
+static void pipeline_uninit(FFFilterGraph *graphi)
+{
+    PipelineContext *p = graphi->pipeline;
+
+    ff_mutex_lock(&graphi->lock);
+    p->die = 1;
+    ff_cond_broadcast(&graphi->cond);
+    ff_mutex_unlock(&graphi->lock);
+
+    for (int i = 0; i < p->nb_threads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    graphi->pipelined = 0;
+    ff_cond_destroy(&graphi->cond);
+    ff_mutex_destroy(&graphi->pool_lock);
+    ff_mutex_destroy(&graphi->lock);
+
+    av_freep(&p->threads);
+    av_freep(&graphi->pipeline);
+}
+
+int ff_graph_pipeline_init(FFFilterGraph *graphi)
+{
+    AVFilterGraph *graph = &graphi->p;
+    PipelineContext *p;
+    int nb_threads = graph->nb_threads ? graph->nb_threads : av_cpu_count();
+    int ret;
+
+    /* the calling thread counts as one */
+    if (nb_threads <= 1 || graph->nb_filters <= 1)
+        return 0;
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    p->threads = av_calloc(nb_threads - 1, sizeof(*p->threads));
+    if (!p->threads) {
+        av_free(p);
+        return AVERROR(ENOMEM);
+    }
+
+    if ((ret = ff_mutex_init(&graphi->lock, NULL))) {
+        av_freep(&p->threads);
+        av_free(p);
+        return AVERROR(ret);
+    }
+    if ((ret = ff_mutex_init(&graphi->pool_lock, NULL))) {
+        ff_mutex_destroy(&graphi->lock);
+        av_freep(&p->threads);
+        av_free(p);
+        return AVERROR(ret);
+    }
+    if ((ret = ff_cond_init(&graphi->cond, NULL))) {
+        ff_mutex_destroy(&graphi->pool_lock);
+        ff_mutex_destroy(&graphi->lock);
+        av_freep(&p->threads);
+        av_free(p);
+        return AVERROR(ret);
+    }
+
+    graphi->pipeline  = p;
+    graphi->pipelined = 1;
+
+    for (; p->nb_threads < nb_threads - 1; p->nb_threads++) {
+        ret = pthread_create(&p->threads[p->nb_threads], NULL, pipeline_worker, graphi);
+        if (ret) {
+            pipeline_uninit(graphi);
+            return AVERROR(ret);
+        }
+    }
+
+    av_log(graph, AV_LOG_VERBOSE, "Pipelined execution with %d threads\n", nb_threads);
+
+    return 0;
+}
+
+void ff_graph_pipeline_free(FFFilterGraph *graphi)
+{
+    if (graphi->pipeline)
+        pipeline_uninit(graphi);
+}
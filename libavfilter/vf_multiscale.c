@@ -0,0 +1,421 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * scale the input video to several output sizes in a single pass
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#include "avfilter.h"
+#include "filters.h"
+#include "formats.h"
+#include "scale_eval.h"
+#include "video.h"
+
+typedef struct MultiScaleContext {
+    const AVClass *class;
+    SwsContext *sws;
+
+    char *sizes_str;
+    char *flags_str;
+
+    int nb_sizes;
+    int (*sizes)[2];  ///< requested output sizes, may be -n as in scale
+
+    AVFrame **out;    ///< output frames of the current input frame
+} MultiScaleContext;
+
+static av_cold int preinit(AVFilterContext *ctx)
+{
+    MultiScaleContext *s = ctx->priv;
+
+    s->sws = sws_alloc_context();
+    if (!s->sws)
+        return AVERROR(ENOMEM);
+
+    // set threads=0, so we can later check whether the user modified it
+    s->sws->threads = 0;
+
+    return 0;
+}
+
+static int parse_size(AVFilterContext *ctx, const char *str, int *w, int *h)
+{
+    char tail;
+
+    if (av_parse_video_size(w, h, str) >= 0)
+        return 0;
+
+    /* allow -n for either dimension to keep the aspect ratio */
+    if (sscanf(str, "%dx%d%c", w, h, &tail) == 2 && *w >= -256 && *h >= -256 &&
+        *w && *h && (*w > 0 || *h > 0))
+        return 0;
+
+    av_log(ctx, AV_LOG_ERROR, "Invalid size '%s'\n", str);
+    return AVERROR(EINVAL);
+}
+
+static int config_output(AVFilterLink *outlink);
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    MultiScaleContext *s = ctx->priv;
+    const char *p = s->sizes_str;
+    int ret;
+
+    while (p && *p) {
+        char *size = av_get_token(&p, "|");
+        int w, h;
+
+        if (!size)
+            return AVERROR(ENOMEM);
+        ret = parse_size(ctx, size, &w, &h);
+        av_free(size);
+        if (ret < 0)
+            return ret;
+
+        ret = av_reallocp_array(&s->sizes, s->nb_sizes + 1, sizeof(*s->sizes));
+        if (ret < 0)
+            return ret;
+        s->sizes[s->nb_sizes][0] = w;
+        s->sizes[s->nb_sizes][1] = h;
+        s->nb_sizes++;
+
+        if (*p)
+            p++;
+    }
+
+    if (!s->nb_sizes) {
+        av_log(ctx, AV_LOG_ERROR, "No output sizes specified\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->out = av_calloc(s->nb_sizes, sizeof(*s->out));
+    if (!s->out)
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < s->nb_sizes; i++) {
+        AVFilterPad pad = { 0 };
+
+        pad.type         = AVMEDIA_TYPE_VIDEO;
+        pad.config_props = config_output;
+        pad.name         = av_asprintf("output%d", i);
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_append_outpad_free_name(ctx, &pad)) < 0)
+            return ret;
+    }
+
+    if (s->flags_str && *s->flags_str) {
+        ret = av_opt_set(s->sws, "sws_flags", s->flags_str, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    // use generic thread-count if the user did not set it explicitly
+    if (!s->sws->threads)
+        s->sws->threads = ff_filter_get_nb_threads(ctx);
+
+    return 0;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    MultiScaleContext *s = ctx->priv;
+
+    if (s->out) {
+        for (int i = 0; i < s->nb_sizes; i++)
+            av_frame_free(&s->out[i]);
+    }
+    av_freep(&s->out);
+    av_freep(&s->sizes);
+    sws_free_context(&s->sws);
+}
+
+static int query_formats(const AVFilterContext *ctx,
+                         AVFilterFormatsConfig **cfg_in,
+                         AVFilterFormatsConfig **cfg_out)
+{
+    AVFilterFormats *formats;
+    const AVPixFmtDescriptor *desc;
+    enum AVPixelFormat pix_fmt;
+    int ret;
+
+    desc    = NULL;
+    formats = NULL;
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        pix_fmt = av_pix_fmt_desc_get_id(desc);
+        if (sws_test_format(pix_fmt, 0)) {
+            if ((ret = ff_add_format(&formats, pix_fmt)) < 0)
+                return ret;
+        }
+    }
+    if ((ret = ff_formats_ref(formats, &cfg_in[0]->formats)) < 0)
+        return ret;
+
+    /* each output negotiates its own pixel format */
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        desc    = NULL;
+        formats = NULL;
+        while ((desc = av_pix_fmt_desc_next(desc))) {
+            pix_fmt = av_pix_fmt_desc_get_id(desc);
+            if (sws_test_format(pix_fmt, 1)) {
+                if ((ret = ff_add_format(&formats, pix_fmt)) < 0)
+                    return ret;
+            }
+        }
+        if ((ret = ff_formats_ref(formats, &cfg_out[i]->formats)) < 0)
+            return ret;
+    }
+
+    /* but the color space and range are passed through unchanged */
+    formats = ff_all_color_spaces();
+    for (int i = 0; i < formats->nb_formats; i++) {
+        if (!sws_test_colorspace(formats->formats[i], 0) ||
+            !sws_test_colorspace(formats->formats[i], 1)) {
+            for (int j = i--; j + 1 < formats->nb_formats; j++)
+                formats->formats[j] = formats->formats[j + 1];
+            formats->nb_formats--;
+        }
+    }
+    if ((ret = ff_formats_ref(formats, &cfg_in[0]->color_spaces)) < 0)
+        return ret;
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        if ((ret = ff_formats_ref(formats, &cfg_out[i]->color_spaces)) < 0)
+            return ret;
+    }
+
+    formats = ff_all_color_ranges();
+    if ((ret = ff_formats_ref(formats, &cfg_in[0]->color_ranges)) < 0)
+        return ret;
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        if ((ret = ff_formats_ref(formats, &cfg_out[i]->color_ranges)) < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    MultiScaleContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    const int idx = FF_OUTLINK_IDX(outlink);
+    int w = s->sizes[idx][0];
+    int h = s->sizes[idx][1];
+    int ret;
+
+    ret = ff_scale_adjust_dimensions(inlink, &w, &h, 0, 1, 1.0);
+    if (ret < 0)
+        return ret;
+
+    outlink->w = w;
+    outlink->h = h;
+
+    if (inlink->sample_aspect_ratio.num)
+        outlink->sample_aspect_ratio = av_mul_q((AVRational){ outlink->h * inlink->w,
+                                                              outlink->w * inlink->h },
+                                                inlink->sample_aspect_ratio);
+    else
+        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    if (inlink->w != outlink->w || inlink->h != outlink->h) {
+        av_frame_side_data_remove_by_props(&outlink->side_data, &outlink->nb_side_data,
+                                           AV_SIDE_DATA_PROP_SIZE_DEPENDENT);
+    }
+
+    av_log(ctx, AV_LOG_VERBOSE, "output%d: w:%d h:%d fmt:%s -> w:%d h:%d fmt:%s\n",
+           idx, inlink->w, inlink->h, av_get_pix_fmt_name(inlink->format),
+           outlink->w, outlink->h, av_get_pix_fmt_name(outlink->format));
+
+    return 0;
+}
+
+static int scale_frame(AVFilterContext *ctx, AVFrame *in)
+{
+    MultiScaleContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int nb_out = 0, ret = 0;
+
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        AVFilterLink *outlink = ctx->outputs[i];
+        AVFrame *out;
+
+        if (ff_outlink_get_status(outlink))
+            continue;
+
+        out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        s->out[nb_out++] = out;
+
+        ret = av_frame_copy_props(out, in);
+        if (ret < 0)
+            goto fail;
+        out->width       = outlink->w;
+        out->height      = outlink->h;
+        out->color_range = outlink->color_range;
+        out->colorspace  = outlink->colorspace;
+
+        if (out->width != in->width || out->height != in->height) {
+            av_frame_side_data_remove_by_props(&out->side_data, &out->nb_side_data,
+                                               AV_SIDE_DATA_PROP_SIZE_DEPENDENT);
+        }
+
+        av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
+                  (int64_t)in->sample_aspect_ratio.num * outlink->h * inlink->w,
+                  (int64_t)in->sample_aspect_ratio.den * outlink->w * inlink->h,
+                  INT_MAX);
+    }
+
+    ret = sws_scale_frames(s->sws, s->out, nb_out, in);
+    if (ret < 0)
+        goto fail;
+
+    for (int i = 0, j = 0; i < ctx->nb_outputs; i++) {
+        if (ff_outlink_get_status(ctx->outputs[i]))
+            continue;
+
+        ret = ff_filter_frame(ctx->outputs[i], s->out[j]);
+        s->out[j++] = NULL;
+        if (ret < 0)
+            goto fail;
+    }
+
+fail:
+    for (int i = 0; i < nb_out; i++)
+        av_frame_free(&s->out[i]);
+    return ret;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    AVFilterLink *inlink = ctx->inputs[0];
+    AVFrame *in;
+    int status, ret, nb_eofs = 0;
+    int64_t pts;
+
+    for (int i = 0; i < ctx->nb_outputs; i++)
+        nb_eofs += ff_outlink_get_status(ctx->outputs[i]) == AVERROR_EOF;
+
+    if (nb_eofs == ctx->nb_outputs) {
+        ff_inlink_set_status(inlink, AVERROR_EOF);
+        return 0;
+    }
+
+    ret = ff_inlink_consume_frame(inlink, &in);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        ret = scale_frame(ctx, in);
+        av_frame_free(&in);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (ff_inlink_acknowledge_status(inlink, &status, &pts)) {
+        for (int i = 0; i < ctx->nb_outputs; i++) {
+            if (ff_outlink_get_status(ctx->outputs[i]))
+                continue;
+            ff_outlink_set_status(ctx->outputs[i], status, pts);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < ctx->nb_outputs; i++) {
+        if (ff_outlink_get_status(ctx->outputs[i]))
+            continue;
+
+        if (ff_outlink_frame_wanted(ctx->outputs[i])) {
+            ff_inlink_request_frame(inlink);
+            return 0;
+        }
+    }
+
+    return FFERROR_NOT_READY;
+}
+
+static const AVClass *child_class_iterate(void **iter)
+{
+    const AVClass *c = *iter ? NULL : sws_get_class();
+    *iter = (void*)(uintptr_t)c;
+    return c;
+}
+
+static void *child_next(void *obj, void *prev)
+{
+    MultiScaleContext *s = obj;
+    if (!prev)
+        return s->sws;
+    return NULL;
+}
+
+#define OFFSET(x) offsetof(MultiScaleContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption multiscale_options[] = {
+    { "sizes",   "'|'-separated list of output sizes", OFFSET(sizes_str), AV_OPT_TYPE_STRING, { .str = NULL }, .flags = FLAGS },
+    { "flags",   "Flags to pass to libswscale",        OFFSET(flags_str), AV_OPT_TYPE_STRING, { .str = "" },   .flags = FLAGS },
+    { NULL }
+};
+
+static const AVClass multiscale_class = {
+    .class_name          = "multiscale",
+    .item_name           = av_default_item_name,
+    .option              = multiscale_options,
+    .version             = LIBAVUTIL_VERSION_INT,
+    .category            = AV_CLASS_CATEGORY_FILTER,
+    .child_class_iterate = child_class_iterate,
+    .child_next          = child_next,
+};
+
+static const AVFilterPad multiscale_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+    },
+};
+
+const FFFilter ff_vf_multiscale = {
+    .p.name          = "multiscale",
+    .p.description   = NULL_IF_CONFIG_SMALL("Scale the input video to several output sizes at once."),
+    .p.priv_class    = &multiscale_class,
+    .p.flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .preinit         = preinit,
+    .init            = init,
+    .uninit          = uninit,
+    .priv_size       = sizeof(MultiScaleContext),
+    .activate        = activate,
+    FILTER_INPUTS(multiscale_inputs),
+    FILTER_QUERY_FUNC2(query_formats),
+};
@@ -1436,6 +1436,14 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SORT_DTS    0x10000 ///< try to interleave outputted packets by dts (using this flag can slow demuxing down)
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+/**
+ * Let avformat_find_stream_info() take the video size and pixel format from
+ * the parser, and do not decode frames for streams whose parameters are
+ * already known. The decoder delay and the channel layout are then not
+ * verified by decoding, and parameters only the decoder exports, such as the
+ * profile or the color properties, may remain unset.
+ */
+#define AVFMT_FLAG_PARSER_INFO 0x400000
 
     /**
      * Maximum number of bytes read from input in order to determine stream
@@ -1889,6 +1897,31 @@ typedef struct AVFormatContext {
      * @see skip_estimate_duration_from_pts
      */
     int64_t duration_probesize;
+
+    /**
+     * Callback invoked by avformat_find_stream_info() once for every stream,
+     * as soon as its codec parameters are known. This may happen long before
+     * avformat_find_stream_info() returns, e.g. when other streams still need
+     * more data.
+     *
+     * st->codecpar is up to date when the callback is called. Timing
+     * information such as the frame rates and the duration is only final once
+     * avformat_find_stream_info() has returned.
+     *
+     * The callback is always called from the thread that called
+     * avformat_find_stream_info().
+     *
+     * - demuxing: Set by user.
+     */
+    void (*stream_info_cb)(struct AVFormatContext *s, AVStream *st);
+
+    /**
+     * Number of threads avformat_find_stream_info() may use to decode the
+     * probe frames of different streams in parallel. 0 selects automatically.
+     * Ignored with AVFMT_FLAG_NOBUFFER.
+     * - demuxing: Set by user.
+     */
+    int stream_info_threads;
 } AVFormatContext;
 
 /**
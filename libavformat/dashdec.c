@@ -30,6 +30,7 @@
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "segment_prefetch.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -118,6 +119,9 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    SegmentPrefetch *prefetch;
+    int input_prefetched;
 };
 
 typedef struct DASHContext {
@@ -160,6 +164,8 @@ typedef struct DASHContext {
     int is_init_section_common_audio;
     int is_init_section_common_subtitle;
 
+    int prefetch_segments;
+    int64_t prefetch_max_size;
 } DASHContext;
 
 static int ishttp(char *url)
@@ -350,6 +356,7 @@ static void free_timelines_list(struct representation *pls)
 
 static void free_representation(struct representation *pls)
 {
+    ff_segment_prefetch_free(&pls->prefetch);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -1582,6 +1589,27 @@ finish:
     return ret;
 }
 
+static char *get_template_url(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    char *tmpfilename;
+    char *url;
+
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename)
+        return NULL;
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        url = av_strdup(pls->url_template);
+        if (!url)
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+    }
+    av_free(tmpfilename);
+    return url;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
@@ -1635,30 +1663,16 @@ static struct fragment *get_current_fragment(struct representation *pls)
         }
     }
     if (seg) {
-        char *tmpfilename;
         if (!pls->url_template) {
             av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
             av_free(seg);
             return NULL;
         }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
+        seg->url = get_template_url(pls, pls->cur_seq_no);
+        if (!seg->url) {
             av_free(seg);
             return NULL;
         }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
         seg->size = -1;
     }
 
@@ -1674,7 +1688,10 @@ static int read_from_url(struct representation *pls, struct fragment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->input_prefetched)
+        ret = ff_segment_prefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1713,6 +1730,108 @@ cleanup:
     return ret;
 }
 
+/* Called from the prefetch worker threads, see open_input(). */
+static int prefetch_open(void *opaque, AVIOContext **pb, const char *url,
+                         int64_t url_offset, int64_t size, AVDictionary **opts)
+{
+    AVFormatContext *s = opaque;
+    AVDictionary *opts2 = NULL;
+    const AVDictionaryEntry *e;
+    char *cookies = NULL;
+    int ret;
+
+    /* open_url() does not use the io_open callback, so neither may the
+     * workers use io_close2 */
+    avio_closep(pb);
+    if (size >= 0) {
+        av_dict_set_int(&opts2, "offset", url_offset, 0);
+        av_dict_set_int(&opts2, "end_offset", url_offset + size, 0);
+    }
+    if ((e = av_dict_get(*opts, "cookies", NULL, 0)))
+        cookies = av_strdup(e->value);
+    ret = open_url(s, pb, url, opts, opts2, NULL);
+    /* only pass the cookies back to the demuxer if the server set some */
+    e = av_dict_get(*opts, "cookies", NULL, 0);
+    if (e && cookies && !strcmp(e->value, cookies))
+        av_dict_set(opts, "cookies", NULL, 0);
+    av_free(cookies);
+    av_dict_free(&opts2);
+    return ret;
+}
+
+static void prefetch_close(void *opaque, AVIOContext **pb)
+{
+    avio_closep(pb);
+}
+
+static int open_prefetched_input(DASHContext *c, struct representation *pls,
+                                 struct fragment *seg)
+{
+    char *url = av_mallocz(c->max_url_size);
+    int ret;
+
+    if (!url)
+        return 0;
+    ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+    ret = ff_segment_prefetch_open(pls->prefetch, pls->cur_seq_no, url,
+                                   seg->url_offset, seg->size);
+    av_free(url);
+    if (ret > 0) {
+        /* cookies set by the server when the segment was prefetched */
+        const AVDictionaryEntry *e = av_dict_get(ff_segment_prefetch_opts(pls->prefetch),
+                                                 "cookies", NULL, 0);
+        if (e)
+            av_dict_set(&c->avio_opts, "cookies", e->value, 0);
+        pls->input_prefetched = 1;
+        pls->cur_seg_offset = 0;
+        pls->cur_seg_size = seg->size;
+    }
+    return ret;
+}
+
+static void prefetch_fragments(DASHContext *c, struct representation *pls)
+{
+    char *url = av_mallocz(c->max_url_size);
+
+    if (!url)
+        return;
+
+    for (int i = 1; i <= c->prefetch_segments; i++) {
+        int64_t seq_no = pls->cur_seq_no + i;
+        int64_t url_offset = 0, size = -1;
+        char *tmpl_url = NULL;
+        int ret;
+
+        /* same fragments as get_current_fragment() returns for VOD */
+        if (seq_no < pls->n_fragments) {
+            struct fragment *seg = pls->fragments[seq_no];
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+            url_offset = seg->url_offset;
+            size       = seg->size;
+        } else if (seq_no <= pls->last_seq_no && pls->url_template) {
+            tmpl_url = get_template_url(pls, seq_no);
+            if (!tmpl_url)
+                break;
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, tmpl_url);
+            av_free(tmpl_url);
+        } else {
+            break;
+        }
+
+        ret = ff_segment_prefetch_add(pls->prefetch, seq_no, url, url_offset,
+                                      size, c->avio_opts);
+        if (ret < 0)
+            break;
+    }
+    av_free(url);
+}
+
+static void reset_prefetch(struct representation *pls)
+{
+    ff_segment_prefetch_flush(pls->prefetch);
+    pls->input_prefetched = 0;
+}
+
 static int update_init_section(struct representation *pls)
 {
     static const int max_init_section_size = 1024 * 1024;
@@ -1763,6 +1882,8 @@ static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
     if (v->n_fragments && !v->init_sec_data_len) {
+        if (v->input_prefetched)
+            return ff_segment_prefetch_seek(v->prefetch, offset, whence);
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1776,7 +1897,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->input_prefetched) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1789,16 +1910,32 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
-        if (ret < 0) {
-            if (ff_check_interrupt(c->interrupt_callback)) {
-                ret = AVERROR_EXIT;
-                goto end;
+        if (c->prefetch_segments > 0 && !c->is_live && !v->prefetch) {
+            ret = ff_segment_prefetch_alloc(&v->prefetch, v->parent, c->prefetch_segments,
+                                            c->prefetch_max_size,
+                                            prefetch_open, prefetch_close, v->parent);
+            if (ret < 0) {
+                av_log(v->parent, AV_LOG_WARNING, "Cannot prefetch segments: %s\n",
+                       av_err2str(ret));
+                c->prefetch_segments = 0;
+            }
+        }
+
+        if (!v->prefetch || open_prefetched_input(c, v, v->cur_seg) <= 0) {
+            ret = open_input(c, v, v->cur_seg);
+            if (ret < 0) {
+                if (ff_check_interrupt(c->interrupt_callback)) {
+                    ret = AVERROR_EXIT;
+                    goto end;
+                }
+                av_log(v->parent, AV_LOG_WARNING, "Failed to open fragment of playlist\n");
+                v->cur_seq_no++;
+                goto restart;
             }
-            av_log(v->parent, AV_LOG_WARNING, "Failed to open fragment of playlist\n");
-            v->cur_seq_no++;
-            goto restart;
         }
+
+        if (v->prefetch)
+            prefetch_fragments(c, v);
     }
 
     if (v->init_sec_buf_read_offset < v->init_sec_data_len) {
@@ -2148,6 +2285,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            reset_prefetch(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2210,6 +2348,10 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            if (cur->input_prefetched) {
+                ff_segment_prefetch_close(cur->prefetch);
+                cur->input_prefetched = 0;
+            }
             ret = reopen_demux_for_component(s, cur);
         }
     }
@@ -2248,6 +2390,7 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    reset_prefetch(pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2346,6 +2489,10 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    {"prefetch_segments", "Number of segments to download in advance, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum size of the data downloaded in advance per representation",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -54,6 +54,7 @@
 #include "isom.h"
 #include "mux.h"
 #include "os_support.h"
+#include "upload_queue.h"
 #include "url.h"
 #include "vpcc.h"
 #include "dash.h"
@@ -84,6 +85,7 @@ typedef struct Segment {
     double prog_date_time;
     int64_t duration;
     int n;
+    int64_t upload_id;
 } Segment;
 
 typedef struct AdaptationSet {
@@ -132,6 +134,7 @@ typedef struct OutputStream {
 
     char codec_str[100];
     int written_len;
+    int64_t upload_id;  /* last segment upload, with async_uploads */
     char filename[1024];
     char full_path[1024];
     char temp_path[1024];
@@ -204,6 +207,9 @@ typedef struct DASHContext {
     AVRational min_playback_rate;
     AVRational max_playback_rate;
     int64_t update_period;
+    int async_uploads;
+    int upload_max_retry;
+    UploadQueue *upload;
 } DASHContext;
 
 static const struct codec_string {
@@ -218,7 +224,7 @@ static const struct codec_string {
     { AV_CODEC_ID_NONE }
 };
 
-static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
+static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, const char *filename,
                            AVDictionary **options) {
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
@@ -237,23 +243,25 @@ static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     return err;
 }
 
-static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
+static int dashenc_io_close(AVFormatContext *s, AVIOContext **pb, const char *filename) {
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
+    int ret = 0;
 
     if (!*pb)
-        return;
+        return 0;
 
     if (!http_base_proto || !c->http_persistent) {
-        ff_format_io_close(s, pb);
+        ret = ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
         URLContext *http_url_context = ffio_geturlcontext(*pb);
         av_assert0(http_url_context);
         avio_flush(*pb);
-        ffurl_shutdown(http_url_context, AVIO_FLAG_WRITE);
+        ret = ffurl_shutdown(http_url_context, AVIO_FLAG_WRITE);
 #endif
     }
+    return ret;
 }
 
 static const char *get_format_str(SegmentType segment_type)
@@ -482,6 +490,99 @@ static void set_http_options(AVDictionary **options, DASHContext *c)
         av_dict_set_int(options, "timeout", c->timeout, 0);
 }
 
+/* Called from the upload worker threads. */
+static int upload_open(void *opaque, AVIOContext **pb, const char *url,
+                       AVDictionary **options)
+{
+    return dashenc_io_open(opaque, pb, url, options);
+}
+
+static int upload_close(void *opaque, AVIOContext **pb, const char *url)
+{
+    if (!url)
+        return ff_format_io_close(opaque, pb);
+    return dashenc_io_close(opaque, pb, url);
+}
+
+static int64_t queue_upload(AVFormatContext *s, const char *filename,
+                            const char *final_filename, uint8_t **buf, int size,
+                            int flags)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *opts = NULL;
+    int64_t id;
+
+    set_http_options(&opts, c);
+    id = ff_upload_queue_add(c->upload, filename, final_filename, opts,
+                             buf, size, flags);
+    av_dict_free(&opts);
+    return id;
+}
+
+/* Queue the media segment buffered in os->ctx->pb, see flush_dynbuf(). */
+static int queue_segment(AVFormatContext *s, OutputStream *os,
+                         const char *final_filename, int *range_length)
+{
+    uint8_t *buffer;
+    int64_t id;
+    int ret;
+
+    av_write_frame(os->ctx, NULL);
+    avio_flush(os->ctx->pb);
+
+    *range_length = avio_close_dyn_buf(os->ctx->pb, &buffer);
+    os->ctx->pb = NULL;
+    if (buffer) {
+        id = queue_upload(s, os->temp_path, final_filename, &buffer, *range_length, 0);
+        av_free(buffer);
+        if (id > 0)
+            os->upload_id = id;
+    } else {
+        id = AVERROR(ENOMEM);
+    }
+
+    // re-open buffer
+    ret = avio_open_dyn_buf(&os->ctx->pb);
+    return id < 0 ? id : ret;
+}
+
+/* With async_uploads, manifests are written to memory and uploaded once
+ * the segments queued before them are. */
+static int dashenc_manifest_open(AVFormatContext *s, AVIOContext **pb,
+                                 const char *filename, AVDictionary **options)
+{
+    DASHContext *c = s->priv_data;
+
+    if (c->upload) {
+        ffio_free_dyn_buf(pb);
+        return avio_open_dyn_buf(pb);
+    }
+    return dashenc_io_open(s, pb, filename, options);
+}
+
+static int dashenc_manifest_close(AVFormatContext *s, AVIOContext **pb,
+                                  const char *filename, const char *final_filename)
+{
+    DASHContext *c = s->priv_data;
+    uint8_t *buf;
+    int64_t id;
+    int size;
+
+    if (!c->upload) {
+        dashenc_io_close(s, pb, filename);
+        return final_filename ? ff_rename(filename, final_filename, s) : 0;
+    }
+
+    size = avio_close_dyn_buf(*pb, &buf);
+    *pb = NULL;
+    if (!buf)
+        return AVERROR(ENOMEM);
+    id = queue_upload(s, filename, final_filename, &buf, size,
+                      FF_UPLOAD_QUEUE_BARRIER);
+    av_free(buf);
+    return id < 0 ? id : 0;
+}
+
 static void get_hls_playlist_name(char *playlist_name, int string_size,
                                   const char *base_url, int id) {
     if (base_url)
@@ -527,7 +628,7 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     snprintf(temp_filename_hls, sizeof(temp_filename_hls), use_rename ? "%s.tmp" : "%s", filename_hls);
 
     set_http_options(&http_opts, c);
-    ret = dashenc_io_open(s, &c->m3u8_out, temp_filename_hls, &http_opts);
+    ret = dashenc_manifest_open(s, &c->m3u8_out, temp_filename_hls, &http_opts);
     av_dict_free(&http_opts);
     if (ret < 0) {
         handle_io_open_error(s, ret, temp_filename_hls);
@@ -573,10 +674,8 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     if (final)
         ff_hls_write_end_list(c->m3u8_out);
 
-    dashenc_io_close(s, &c->m3u8_out, temp_filename_hls);
-
-    if (use_rename)
-        ff_rename(temp_filename_hls, filename_hls, os->ctx);
+    dashenc_manifest_close(s, &c->m3u8_out, temp_filename_hls,
+                           use_rename ? filename_hls : NULL);
 }
 
 static int flush_init_segment(AVFormatContext *s, OutputStream *os)
@@ -602,6 +701,13 @@ static void dash_free(AVFormatContext *s)
     DASHContext *c = s->priv_data;
     int i, j;
 
+    if (c->upload) {
+        ff_upload_queue_free(&c->upload);
+        /* manifests are only written to memory */
+        ffio_free_dyn_buf(&c->mpd_out);
+        ffio_free_dyn_buf(&c->m3u8_out);
+    }
+
     if (c->as) {
         for (i = 0; i < c->nb_as; i++) {
             av_dict_free(&c->as[i].metadata);
@@ -1145,7 +1251,7 @@ static int write_manifest(AVFormatContext *s, int final)
 
     snprintf(temp_filename, sizeof(temp_filename), use_rename ? "%s.tmp" : "%s", s->url);
     set_http_options(&opts, c);
-    ret = dashenc_io_open(s, &c->mpd_out, temp_filename, &opts);
+    ret = dashenc_manifest_open(s, &c->mpd_out, temp_filename, &opts);
     av_dict_free(&opts);
     if (ret < 0) {
         return handle_io_open_error(s, ret, temp_filename);
@@ -1237,12 +1343,10 @@ static int write_manifest(AVFormatContext *s, int final)
 
     avio_printf(out, "</MPD>\n");
     avio_flush(out);
-    dashenc_io_close(s, &c->mpd_out, temp_filename);
-
-    if (use_rename) {
-        if ((ret = ff_rename(temp_filename, s->url, s)) < 0)
-            return ret;
-    }
+    ret = dashenc_manifest_close(s, &c->mpd_out, temp_filename,
+                                 use_rename ? s->url : NULL);
+    if (ret < 0)
+        return ret;
 
     if (c->hls_playlist) {
         char filename_hls[1024];
@@ -1260,7 +1364,7 @@ static int write_manifest(AVFormatContext *s, int final)
         snprintf(temp_filename, sizeof(temp_filename), use_rename ? "%s.tmp" : "%s", filename_hls);
 
         set_http_options(&opts, c);
-        ret = dashenc_io_open(s, &c->m3u8_out, temp_filename, &opts);
+        ret = dashenc_manifest_open(s, &c->m3u8_out, temp_filename, &opts);
         av_dict_free(&opts);
         if (ret < 0) {
             return handle_io_open_error(s, ret, temp_filename);
@@ -1354,10 +1458,10 @@ static int write_manifest(AVFormatContext *s, int final)
             }
         }
 
-        dashenc_io_close(s, &c->m3u8_out, temp_filename);
-        if (use_rename)
-            if ((ret = ff_rename(temp_filename, filename_hls, s)) < 0)
-                return ret;
+        ret = dashenc_manifest_close(s, &c->m3u8_out, temp_filename,
+                                     use_rename ? filename_hls : NULL);
+        if (ret < 0)
+            return ret;
         c->master_playlist_created = 1;
     }
 
@@ -1415,6 +1519,24 @@ static int dash_init(AVFormatContext *s)
         c->target_latency = 0;
     }
 
+    if (c->async_uploads > 0 && !ff_format_io_is_default(s)) {
+        av_log(s, AV_LOG_WARNING, "Asynchronous uploads are not supported "
+               "with custom I/O callbacks, writing synchronously\n");
+    } else if (c->async_uploads > 0) {
+        ret = ff_upload_queue_alloc(&c->upload, s, c->async_uploads,
+                                    c->upload_max_retry,
+                                    upload_open, upload_close, s);
+        if (ret == AVERROR(ENOSYS)) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous uploads need threads, "
+                   "writing synchronously\n");
+        } else if (ret < 0) {
+            return ret;
+        }
+        if (c->upload && (c->single_file || c->streaming))
+            av_log(s, AV_LOG_INFO, "Media segments are written synchronously "
+                   "in single file and streaming modes\n");
+    }
+
     if (c->global_sidx && !c->single_file) {
         av_log(s, AV_LOG_WARNING, "Global SIDX option will be ignored as single_file is not enabled\n");
         c->global_sidx = 0;
@@ -1775,6 +1897,7 @@ static int add_segment(OutputStream *os, const char *file,
     seg->start_pos = start_pos;
     seg->range_length = range_length;
     seg->index_length = index_length;
+    seg->upload_id = os->upload_id;
     os->segments[os->nb_segments++] = seg;
     os->segment_index++;
     //correcting the segment index if it has fallen behind the expected value
@@ -1894,7 +2017,10 @@ static int dashenc_delete_segment_file(AVFormatContext *s, const char* file)
 
 static inline void dashenc_delete_media_segments(AVFormatContext *s, OutputStream *os, int remove_count)
 {
+    DASHContext *c = s->priv_data;
+
     for (int i = 0; i < remove_count; ++i) {
+        ff_upload_queue_wait(c->upload, os->segments[i]->upload_id);
         dashenc_delete_segment_file(s, os->segments[i]->file);
 
         // Delete the segment regardless of whether the file was successfully deleted
@@ -1956,13 +2082,18 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
         if (c->single_file)
             snprintf(os->full_path, sizeof(os->full_path), "%s%s", c->dirname, os->initfile);
 
-        ret = flush_dynbuf(c, os, &range_length);
+        if (c->upload && !c->single_file && !c->streaming)
+            ret = queue_segment(s, os, use_rename ? os->full_path : NULL, &range_length);
+        else
+            ret = flush_dynbuf(c, os, &range_length);
         if (ret < 0)
             break;
         os->packets_written = 0;
 
         if (c->single_file) {
             find_index_range(s, os->full_path, os->pos, &index_length);
+        } else if (c->upload && !c->streaming) {
+            /* renamed once uploaded */
         } else {
             dashenc_io_close(s, &os->out, os->temp_path);
 
@@ -2023,6 +2154,9 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
             }
         }
     }
+    /* report the uploads that failed in the meantime */
+    if (ret >= 0 && !c->ignore_io_errors)
+        ret = ff_upload_queue_error(c->upload);
     if (ret >= 0) {
         if (c->has_video && !final) {
             c->nr_of_streams_flushed++;
@@ -2255,11 +2389,17 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
                  os->filename);
         snprintf(os->temp_path, sizeof(os->temp_path),
                  use_rename ? "%s.tmp" : "%s", os->full_path);
-        set_http_options(&opts, c);
-        ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
-        av_dict_free(&opts);
-        if (ret < 0) {
-            return handle_io_open_error(s, ret, os->temp_path);
+        if (c->upload && !c->streaming) {
+            /* the segment is queued for upload once complete, drop the
+             * connection kept open by the init segment */
+            ff_format_io_close(s, &os->out);
+        } else {
+            set_http_options(&opts, c);
+            ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
+            av_dict_free(&opts);
+            if (ret < 0) {
+                return handle_io_open_error(s, ret, os->temp_path);
+            }
         }
 
         // in streaming mode, the segments are available for playing
@@ -2294,7 +2434,7 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 static int dash_write_trailer(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
-    int i;
+    int i, ret;
 
     if (s->nb_streams > 0) {
         OutputStream *os = &c->streams[0];
@@ -2309,6 +2449,7 @@ static int dash_write_trailer(AVFormatContext *s)
                                          AV_TIME_BASE_Q);
     }
     dash_flush(s, 1, -1);
+    ret = ff_upload_queue_flush(c->upload);
 
     if (c->remove_at_exit) {
         for (i = 0; i < s->nb_streams; ++i) {
@@ -2330,7 +2471,7 @@ static int dash_write_trailer(AVFormatContext *s)
         }
     }
 
-    return 0;
+    return c->ignore_io_errors ? 0 : ret;
 }
 
 static int dash_check_bitstream(AVFormatContext *s, AVStream *st,
@@ -2358,6 +2499,7 @@ static int dash_check_bitstream(AVFormatContext *s, AVStream *st,
 #define E AV_OPT_FLAG_ENCODING_PARAM
 static const AVOption options[] = {
     { "adaptation_sets", "Adaptation sets. Syntax: id=0,streams=0,1,2 id=1,streams=3,4 and so on", OFFSET(adaptation_sets), AV_OPT_TYPE_STRING, { 0 }, 0, 0, AV_OPT_FLAG_ENCODING_PARAM },
+    { "async_uploads", "Number of segment and manifest uploads that can be pending, 0 = write synchronously", OFFSET(async_uploads), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, E },
     { "dash_segment_type", "set dash segment files type", OFFSET(segment_type_option), AV_OPT_TYPE_INT, {.i64 = SEGMENT_TYPE_AUTO }, 0, SEGMENT_TYPE_NB - 1, E, .unit = "segment_type"},
         { "auto", "select segment file format based on codec", 0, AV_OPT_TYPE_CONST, {.i64 = SEGMENT_TYPE_AUTO }, 0, UINT_MAX,   E, .unit = "segment_type"},
         { "mp4", "make segment file in ISOBMFF format", 0, AV_OPT_TYPE_CONST, {.i64 = SEGMENT_TYPE_MP4 }, 0, UINT_MAX,   E, .unit = "segment_type"},
@@ -2397,6 +2539,7 @@ static const AVOption options[] = {
     { "target_latency", "Set desired target latency for Low-latency dash", OFFSET(target_latency), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT_MAX, E },
     { "timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "upload_max_retry", "Number of times a failed asynchronous upload is retried", OFFSET(upload_max_retry), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, INT_MAX, E },
     { "use_template", "Use SegmentTemplate instead of SegmentList", OFFSET(use_template), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { "use_timeline", "Use SegmentTimeline in SegmentTemplate", OFFSET(use_timeline), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { "utc_timing_url", "URL of the page that will return the UTC timestamp in ISO format", OFFSET(utc_timing_url), AV_OPT_TYPE_STRING, { 0 }, 0, 0, E },
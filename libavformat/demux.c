@@ -32,6 +32,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/time.h"
 #include "libavutil/timestamp.h"
 
@@ -1154,6 +1155,30 @@ static void compute_pkt_fields(AVFormatContext *s, AVStream *st,
         pkt->flags |= AV_PKT_FLAG_KEY;
 }
 
+/**
+ * Take the video parameters exported by the parser, so that
+ * avformat_find_stream_info() does not have to decode frames to find them.
+ */
+static void update_avctx_from_parser(FFStream *sti)
+{
+    const AVCodecParserContext *const pc = sti->parser;
+    AVCodecContext *const avctx = sti->avctx;
+
+    if (avctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        return;
+
+    if (!avctx->width && pc->width > 0 && pc->height > 0) {
+        avctx->width  = pc->width;
+        avctx->height = pc->height;
+    }
+    if (!avctx->coded_width && pc->coded_width > 0 && pc->coded_height > 0) {
+        avctx->coded_width  = pc->coded_width;
+        avctx->coded_height = pc->coded_height;
+    }
+    if (avctx->pix_fmt == AV_PIX_FMT_NONE && pc->format >= 0)
+        avctx->pix_fmt = pc->format;
+}
+
 /**
  * Parse a packet, add all split parts to parse_queue.
  *
@@ -1206,6 +1231,9 @@ static int parse_packet(AVFormatContext *s, AVPacket *pkt,
         if (!out_pkt->size)
             continue;
 
+        if ((s->flags & AVFMT_FLAG_PARSER_INFO) && sti->info)
+            update_avctx_from_parser(sti);
+
         if (pkt->buf && out_pkt->data == pkt->data) {
             /* reference pkt->buf only when out_pkt->data is guaranteed to point
              * to data in it and not in the parser's internal buffer. */
@@ -2089,6 +2117,11 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st,
     enum AVDiscard skip_frame;
     int pkt_to_send = pkt->size > 0;
 
+    if ((s->flags & AVFMT_FLAG_PARSER_INFO) && has_codec_parameters(st, NULL)) {
+        av_frame_free(&frame);
+        return 0;
+    }
+
     if (!frame)
         return AVERROR(ENOMEM);
 
@@ -2504,6 +2537,105 @@ static int extract_extradata(FFFormatContext *si, AVStream *st, const AVPacket *
     return 0;
 }
 
+/**
+ * Call AVFormatContext.stream_info_cb for the stream if its codec parameters
+ * have become known since the last call.
+ */
+static int report_stream_info(AVFormatContext *ic, AVStream *st)
+{
+    FFStream *const sti = ffstream(st);
+    int ret;
+
+    if (!ic->stream_info_cb || sti->info->params_reported ||
+        !sti->avctx_inited || !has_codec_parameters(st, NULL))
+        return 0;
+
+    ret = avcodec_parameters_from_context(st->codecpar, sti->avctx);
+    if (ret < 0)
+        return ret;
+
+    sti->info->params_reported = 1;
+    ic->stream_info_cb(ic, st);
+    return 0;
+}
+
+/**
+ * Probe frames queued for decoding by avformat_find_stream_info() when it
+ * decodes different streams in parallel. At most one packet per stream is
+ * pending, so every packet is a separate job.
+ */
+typedef struct StreamInfoDecode {
+    AVSliceThread *thread;
+    AVFormatContext *ic;
+    AVDictionary **options;
+    int orig_nb_streams;
+    const AVPacket **pkts;
+    unsigned nb_pkts;
+    unsigned pkts_allocated;
+} StreamInfoDecode;
+
+static void stream_info_decode_worker(void *priv, int jobnr, int threadnr,
+                                      int nb_jobs, int nb_threads)
+{
+    StreamInfoDecode *const sd = priv;
+    const AVPacket *const pkt = sd->pkts[jobnr];
+    AVStream *const st  = sd->ic->streams[pkt->stream_index];
+    FFStream *const sti = ffstream(st);
+
+    /* codec_info_nb_frames was already incremented for this packet */
+    sti->codec_info_nb_frames--;
+    try_decode_frame(sd->ic, st, pkt,
+                     (sd->options && pkt->stream_index < sd->orig_nb_streams)
+                     ? &sd->options[pkt->stream_index] : NULL);
+    sti->codec_info_nb_frames++;
+}
+
+static int stream_info_decode_flush(StreamInfoDecode *sd)
+{
+    unsigned nb_pkts = sd->nb_pkts;
+
+    if (!nb_pkts)
+        return 0;
+
+    avpriv_slicethread_execute(sd->thread, nb_pkts, 0);
+    sd->nb_pkts = 0;
+
+    for (unsigned i = 0; i < nb_pkts; i++) {
+        int ret = report_stream_info(sd->ic, sd->ic->streams[sd->pkts[i]->stream_index]);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * Queue a buffered packet for decoding, decoding the pending packets first
+ * if one of them belongs to the same stream.
+ */
+static int stream_info_decode_add(StreamInfoDecode *sd, const AVPacket *pkt)
+{
+    for (unsigned i = 0; i < sd->nb_pkts; i++) {
+        if (sd->pkts[i]->stream_index == pkt->stream_index) {
+            int ret = stream_info_decode_flush(sd);
+            if (ret < 0)
+                return ret;
+            break;
+        }
+    }
+
+    if (sd->nb_pkts >= sd->pkts_allocated) {
+        const AVPacket **pkts = av_realloc_array(sd->pkts, sd->nb_pkts + 1,
+                                                 2 * sizeof(*pkts));
+        if (!pkts)
+            return AVERROR(ENOMEM);
+        sd->pkts           = pkts;
+        sd->pkts_allocated = 2 * (sd->nb_pkts + 1);
+    }
+    sd->pkts[sd->nb_pkts++] = pkt;
+
+    return 0;
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     FFFormatContext *const si = ffformatcontext(ic);
@@ -2513,6 +2645,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t old_offset  = avio_tell(ic->pb);
     // new streams might appear, no options for those
     int orig_nb_streams = ic->nb_streams;
+    StreamInfoDecode sd = { .ic = ic, .options = options,
+                            .orig_nb_streams = orig_nb_streams };
     int flush_codecs;
     int64_t max_analyze_duration = ic->max_analyze_duration;
     int64_t max_stream_analyze_duration;
@@ -2587,7 +2721,10 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
         // Try to just open decoders, in case this is enough to get parameters.
         // Also ensure that subtitle_header is properly set.
-        if (!has_codec_parameters(st, NULL) && sti->request_probe <= 0 ||
+        // Video decoders are opened lazily if the parser may be enough.
+        if (!has_codec_parameters(st, NULL) && sti->request_probe <= 0 &&
+            !((ic->flags & AVFMT_FLAG_PARSER_INFO) && sti->parser &&
+              st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) ||
             st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE) {
             if (codec && !avctx->codec)
                 if (avcodec_open2(avctx, codec, options ? &options[i] : &thread_opt) < 0)
@@ -2596,6 +2733,19 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         }
         if (!options)
             av_dict_free(&thread_opt);
+
+        ret = report_stream_info(ic, st);
+        if (ret < 0)
+            goto find_stream_info_err;
+    }
+
+    /* The packets must stay around until they are decoded. */
+    if (ic->stream_info_threads != 1 && !(ic->flags & AVFMT_FLAG_NOBUFFER)) {
+        ret = avpriv_slicethread_create(&sd.thread, &sd, stream_info_decode_worker,
+                                        NULL, ic->stream_info_threads);
+        if (ret <= 1)
+            avpriv_slicethread_free(&sd.thread);
+        ret = 0;
     }
 
     read_size = 0;
@@ -2826,14 +2976,31 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
          * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+        if (sd.thread) {
+            ret = stream_info_decode_add(&sd, pkt);
+            if (ret < 0)
+                goto find_stream_info_err;
+        } else
+            try_decode_frame(ic, st, pkt,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(pkt1);
 
         sti->codec_info_nb_frames++;
         count++;
+
+        if (!sd.thread) {
+            ret = report_stream_info(ic, st);
+            if (ret < 0)
+                goto find_stream_info_err;
+        }
+    }
+
+    err = stream_info_decode_flush(&sd);
+    if (err < 0) {
+        ret = err;
+        goto find_stream_info_err;
     }
 
     if (eof_reached) {
@@ -2881,6 +3048,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                         "decoding for stream %d failed\n", st->index);
                 }
             }
+
+            err = report_stream_info(ic, st);
+            if (err < 0) {
+                ret = err;
+                goto find_stream_info_err;
+            }
         }
     }
 
@@ -3051,12 +3224,20 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                         av_free(props);
                 }
             }
+
+            if (ic->stream_info_cb && !sti->info->params_reported &&
+                has_codec_parameters(st, NULL)) {
+                sti->info->params_reported = 1;
+                ic->stream_info_cb(ic, st);
+            }
         }
 
         sti->avctx_inited = 0;
     }
 
 find_stream_info_err:
+    avpriv_slicethread_free(&sd.thread);
+    av_freep(&sd.pkts);
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
         FFStream *const sti = ffstream(st);
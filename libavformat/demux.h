@@ -167,6 +167,11 @@ typedef struct FFStreamInfo {
     int     fps_first_dts_idx;
     int64_t fps_last_dts;
     int     fps_last_dts_idx;
+
+    /**
+     * Set once AVFormatContext.stream_info_cb has been called for the stream.
+     */
+    int params_reported;
 } FFStreamInfo;
 
 /**
@@ -236,6 +241,16 @@ int ff_add_index_entry(AVIndexEntry **index_entries,
                        unsigned int *index_entries_allocated_size,
                        int64_t pos, int64_t timestamp, int size, int distance, int flags);
 
+/**
+ * Add several entries to the index of a stream. The result is the same as
+ * calling av_add_index_entry() for each of them in order, but entries that
+ * do not go to the end of the index are merged in a single pass instead of
+ * being inserted one at a time.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_add_index_entries(AVStream *st, const AVIndexEntry *entries, int nb_entries);
+
 void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance);
 
 /**
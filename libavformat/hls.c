@@ -47,6 +47,7 @@
 #include "url.h"
 
 #include "hls_sample_encryption.h"
+#include "segment_prefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -107,6 +108,8 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    SegmentPrefetch *prefetch;
+    int input_prefetched;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -229,6 +232,8 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int64_t prefetch_max_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -267,6 +272,7 @@ static void free_playlist_list(HLSContext *c)
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        ff_segment_prefetch_free(&pls->prefetch);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -1121,7 +1127,10 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->input_prefetched)
+        ret = ff_segment_prefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1412,6 +1421,89 @@ cleanup:
     return ret;
 }
 
+/* Called from the prefetch worker threads, see open_input(). */
+static int prefetch_open(void *opaque, AVIOContext **pb, const char *url,
+                         int64_t url_offset, int64_t size, AVDictionary **opts)
+{
+    AVFormatContext *s = opaque;
+    HLSContext *c = s->priv_data;
+    AVDictionary *opts2 = NULL;
+    const AVDictionaryEntry *e;
+    char *cookies = NULL;
+    int is_http = 0;
+    int ret;
+
+    /* only reuse the previous connection for a keepalive request */
+    if (*pb && !(c->http_persistent && av_strstart(url, "http", NULL)))
+        ff_format_io_close(s, pb);
+
+    if (c->http_persistent)
+        av_dict_set(&opts2, "multiple_requests", "1", 0);
+    if (size >= 0) {
+        av_dict_set_int(&opts2, "offset", url_offset, 0);
+        av_dict_set_int(&opts2, "end_offset", url_offset + size, 0);
+    }
+
+    if ((e = av_dict_get(*opts, "cookies", NULL, 0)))
+        cookies = av_strdup(e->value);
+    ret = open_url(s, pb, url, opts, opts2, &is_http);
+    /* only pass the cookies back to the demuxer if the server set some,
+     * see merge_prefetch_cookies() */
+    e = av_dict_get(*opts, "cookies", NULL, 0);
+    if (e && cookies && !strcmp(e->value, cookies))
+        av_dict_set(opts, "cookies", NULL, 0);
+    av_free(cookies);
+    if (ret == 0 && !is_http && url_offset) {
+        int64_t seekret = avio_seek(*pb, url_offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            ff_format_io_close(s, pb);
+        }
+    }
+
+    av_dict_free(&opts2);
+    return ret;
+}
+
+static void prefetch_close(void *opaque, AVIOContext **pb)
+{
+    ff_format_io_close(opaque, pb);
+}
+
+static void prefetch_segments(HLSContext *c, struct playlist *pls)
+{
+    for (int i = 1; i <= c->prefetch_segments; i++) {
+        int64_t n = pls->cur_seq_no - pls->start_seq_no + i;
+        struct segment *seg;
+
+        if (n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        /* encrypted segments need the key state of the playlist */
+        if (seg->key_type != KEY_NONE)
+            break;
+        if (ff_segment_prefetch_add(pls->prefetch, pls->cur_seq_no + i, seg->url,
+                                    seg->url_offset, seg->size, c->avio_opts) < 0)
+            break;
+    }
+}
+
+/* Cookies set by the server when a segment was prefetched are used for
+ * the next requests, as when the segment is opened directly. */
+static void merge_prefetch_cookies(HLSContext *c, struct playlist *pls)
+{
+    const AVDictionaryEntry *e = av_dict_get(ff_segment_prefetch_opts(pls->prefetch),
+                                             "cookies", NULL, 0);
+    if (e)
+        av_dict_set(&c->avio_opts, "cookies", e->value, 0);
+}
+
+static void reset_prefetch(struct playlist *pls)
+{
+    ff_segment_prefetch_flush(pls->prefetch);
+    pls->input_prefetched = 0;
+}
+
 static int update_init_section(struct playlist *pls, struct segment *seg)
 {
     static const int max_init_section_size = 1024*1024;
@@ -1536,7 +1628,8 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->input_prefetched) ||
+        (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1607,7 +1700,31 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments > 0 && !ff_format_io_is_default(v->parent)) {
+            /* the segments are opened from the worker threads */
+            av_log(v->parent, AV_LOG_WARNING, "Cannot prefetch segments "
+                   "with custom I/O callbacks\n");
+            c->prefetch_segments = 0;
+        }
+        if (c->prefetch_segments > 0 && !v->prefetch) {
+            ret = ff_segment_prefetch_alloc(&v->prefetch, v->parent, c->prefetch_segments,
+                                            c->prefetch_max_size,
+                                            prefetch_open, prefetch_close, v->parent);
+            if (ret < 0) {
+                av_log(v->parent, AV_LOG_WARNING, "Cannot prefetch segments: %s\n",
+                       av_err2str(ret));
+                c->prefetch_segments = 0;
+            }
+        }
+
+        if (v->prefetch &&
+            ff_segment_prefetch_open(v->prefetch, v->cur_seq_no, seg->url,
+                                     seg->url_offset, seg->size) > 0) {
+            v->input_prefetched = 1;
+            v->cur_seg_offset = 0;
+            merge_prefetch_cookies(c, v);
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1634,9 +1751,12 @@ reload:
         }
         segment_retries = 0;
         just_opened = 1;
+
+        if (v->prefetch)
+            prefetch_segments(c, v);
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1646,7 +1766,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !v->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1679,7 +1799,12 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->input_prefetched) {
+        ff_segment_prefetch_close(v->prefetch);
+        v->input_prefetched = 0;
+        /* a connection kept open for keepalive requests is idle */
+        v->input_read_done = 1;
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -2131,6 +2256,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input);
             pls->input = NULL;
             pls->input_read_done = 0;
+            reset_prefetch(pls);
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
@@ -2294,6 +2420,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
         } else if (first && !cur_needed && pls->needed) {
             ff_format_io_close(pls->parent, &pls->input);
             pls->input_read_done = 0;
+            reset_prefetch(pls);
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
             pls->needed = 0;
@@ -2550,6 +2677,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         AVIOContext *const pb = &pls->pb.pub;
         ff_format_io_close(pls->parent, &pls->input);
         pls->input_read_done = 0;
+        reset_prefetch(pls);
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
         av_packet_unref(pls->pkt);
@@ -2646,6 +2774,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments to download in advance, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum size of the data downloaded in advance per playlist",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
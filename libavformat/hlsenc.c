@@ -53,6 +53,7 @@
 #include "nal.h"
 #include "mux.h"
 #include "os_support.h"
+#include "upload_queue.h"
 #include "url.h"
 
 typedef enum {
@@ -84,6 +85,7 @@ typedef struct HLSSegment {
     int64_t keyframe_pos;
     int64_t keyframe_size;
     unsigned var_stream_idx;
+    int64_t upload_id;
 
     char key_uri[LINE_BUFFER_SIZE + 1];
     char iv_string[KEYSIZE*2 + 1];
@@ -145,6 +147,7 @@ typedef struct VariantStream {
     double duration;      // last segment duration computed so far, in seconds
     int64_t start_pos;    // last segment starting position
     int64_t size;         // last segment size
+    int64_t upload_id;    // last segment upload, with async_uploads
     int nb_entries;
     int discontinuity_set;
     int discontinuity;
@@ -263,6 +266,9 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+    int async_uploads;
+    int upload_max_retry;
+    UploadQueue *upload;
 } HLSContext;
 
 static int strftime_expand(const char *fmt, char **dest)
@@ -309,7 +315,7 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, const char *file
     return err;
 }
 
-static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
+static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, const char *filename)
 {
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
@@ -348,6 +354,101 @@ static void set_http_options(AVFormatContext *s, AVDictionary **options, HLSCont
         av_dict_set(options, "headers", c->headers, 0);
 }
 
+/* Called from the upload worker threads. */
+static int upload_open(void *opaque, AVIOContext **pb, const char *url,
+                       AVDictionary **options)
+{
+    AVFormatContext *s = opaque;
+    char *filename;
+    int ret;
+
+    /* encrypted segments are queued with their key */
+    if (av_dict_get(*options, "encryption_key", NULL, 0))
+        filename = av_asprintf("crypto:%s", url);
+    else
+        filename = av_strdup(url);
+    if (!filename)
+        return AVERROR(ENOMEM);
+    ret = hlsenc_io_open(s, pb, filename, options);
+    av_free(filename);
+    return ret;
+}
+
+static int upload_close(void *opaque, AVIOContext **pb, const char *url)
+{
+    AVFormatContext *s = opaque;
+    HLSContext *hls = s->priv_data;
+
+    if (url && hls->http_persistent && ff_is_http_proto(url) &&
+        !hls->key_info_file && !hls->encrypt)
+        return hlsenc_io_close(s, pb, url);
+    return ff_format_io_close(s, pb);
+}
+
+/* Queue the content of the dynamic buffer *pb for upload and free it. */
+static int hlsenc_queue_upload(AVFormatContext *s, AVIOContext **pb,
+                               const char *filename, const char *final_filename,
+                               AVDictionary *options, int flags, int64_t *upload_id)
+{
+    HLSContext *hls = s->priv_data;
+    uint8_t *buf;
+    int size;
+    int64_t id;
+
+    if (!*pb)
+        return 0;
+    size = avio_close_dyn_buf(*pb, &buf);
+    *pb = NULL;
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    id = ff_upload_queue_add(hls->upload, filename, final_filename, options,
+                             &buf, size, flags);
+    av_free(buf);
+    if (id < 0)
+        return id;
+    if (upload_id)
+        *upload_id = id;
+    return 0;
+}
+
+/* With async_uploads, playlists are written to memory and uploaded once
+ * the segments queued before them are. */
+static int hlsenc_playlist_open(AVFormatContext *s, AVIOContext **pb,
+                                const char *filename, AVDictionary **options)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->upload) {
+        /* a connection kept open by a previous synchronous write */
+        ff_format_io_close(s, pb);
+        return avio_open_dyn_buf(pb);
+    }
+    return hlsenc_io_open(s, pb, filename, options);
+}
+
+static int hlsenc_playlist_close(AVFormatContext *s, AVIOContext **pb,
+                                 const char *filename, const char *final_filename)
+{
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    if (hls->upload) {
+        AVDictionary *options = NULL;
+
+        set_http_options(s, &options, hls);
+        ret = hlsenc_queue_upload(s, pb, filename, final_filename, options,
+                                  FF_UPLOAD_QUEUE_BARRIER, NULL);
+        av_dict_free(&options);
+        return ret;
+    }
+
+    ret = hlsenc_io_close(s, pb, filename);
+    if (ret >= 0 && final_filename)
+        ff_rename(filename, final_filename, s);
+    return ret;
+}
+
 static void write_codec_attr(AVStream *st, VariantStream *vs)
 {
     int codec_strlen = strlen(vs->codec_attr);
@@ -609,6 +710,46 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
     avio_write(vs->out, vs->temp_buffer, *range_length);
 }
 
+static int hls_queue_segment(AVFormatContext *s, VariantStream *vs, int use_temp_file)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    AVDictionary *options = NULL;
+    char *final_filename = NULL;
+    int range_length, ret;
+
+    if (hls->key_info_file || hls->encrypt) {
+        av_dict_set(&options, "encryption_key", vs->key_string, 0);
+        av_dict_set(&options, "encryption_iv", vs->iv_string, 0);
+    }
+    if (use_temp_file) {
+        final_filename = av_strndup(oc->url, strlen(oc->url) - 4);
+        if (!final_filename) {
+            av_dict_free(&options);
+            return AVERROR(ENOMEM);
+        }
+    }
+    set_http_options(s, &options, hls);
+
+    ff_format_io_close(s, &vs->out);
+    ret = avio_open_dyn_buf(&vs->out);
+    if (ret >= 0) {
+        if (hls->segment_type == SEGMENT_TYPE_FMP4)
+            write_styp(vs->out);
+        ret = flush_dynbuf(vs, &range_length);
+        av_freep(&vs->temp_buffer);
+    }
+    if (ret >= 0) {
+        vs->size = range_length;
+        ret = hlsenc_queue_upload(s, &vs->out, oc->url, final_filename,
+                                  options, 0, &vs->upload_id);
+    }
+    ffio_free_dyn_buf(&vs->out);
+    av_dict_free(&options);
+    av_free(final_filename);
+    return ret;
+}
+
 static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
                            char *path, const char *proto)
 {
@@ -710,6 +851,7 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         }
 
         proto = avio_find_protocol_name(s->url);
+        ff_upload_queue_wait(hls->upload, segment->upload_id);
         if (ret = hls_delete_file(hls, s, path.str, proto))
             goto fail;
 
@@ -1088,6 +1230,7 @@ static int sls_flag_check_duration_size(HLSContext *hls, VariantStream *vs)
 static void sls_flag_file_rename(HLSContext *hls, VariantStream *vs, char *old_filename) {
     if ((hls->flags & (HLS_SECOND_LEVEL_SEGMENT_SIZE | HLS_SECOND_LEVEL_SEGMENT_DURATION)) &&
         strlen(vs->current_segment_final_filename_fmt)) {
+        ff_upload_queue_wait(hls->upload, vs->upload_id);
         ff_rename(old_filename, vs->avf->url, hls);
     }
 }
@@ -1188,6 +1331,7 @@ static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
     en->size     = size;
     en->keyframe_pos      = vs->video_keyframe_pos;
     en->keyframe_size     = vs->video_keyframe_size;
+    en->upload_id         = vs->upload_id;
     en->next     = NULL;
     en->discont  = 0;
     en->discont_program_date_time = 0;
@@ -1479,7 +1623,7 @@ static int create_master_playlist(AVFormatContext *s,
 
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", hls->master_m3u8_url);
-    ret = hlsenc_io_open(s, &hls->m3u8_out, temp_filename, &options);
+    ret = hlsenc_playlist_open(s, &hls->m3u8_out, temp_filename, &options);
     av_dict_free(&options);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open master play list file '%s'\n",
@@ -1615,9 +1759,8 @@ static int create_master_playlist(AVFormatContext *s,
 fail:
     if (ret >=0)
         hls->master_m3u8_created = 1;
-    hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
-    if (use_temp_file)
-        ff_rename(temp_filename, hls->master_m3u8_url, s);
+    hlsenc_playlist_close(s, &hls->m3u8_out, temp_filename,
+                          use_temp_file ? hls->master_m3u8_url : NULL);
 
     return ret;
 }
@@ -1669,7 +1812,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", vs->m3u8_name);
-    ret = hlsenc_io_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options);
+    ret = hlsenc_playlist_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options);
     av_dict_free(&options);
     if (ret < 0) {
         goto fail;
@@ -1726,7 +1869,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     if (vs->vtt_m3u8_name) {
         set_http_options(vs->vtt_avf, &options, hls);
         snprintf(temp_vtt_filename, sizeof(temp_vtt_filename), use_temp_file ? "%s.tmp" : "%s", vs->vtt_m3u8_name);
-        ret = hlsenc_io_open(s, &hls->sub_m3u8_out, temp_vtt_filename, &options);
+        ret = hlsenc_playlist_open(s, &hls->sub_m3u8_out, temp_vtt_filename, &options);
         av_dict_free(&options);
         if (ret < 0) {
             goto fail;
@@ -1749,16 +1892,14 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
 fail:
     av_dict_free(&options);
-    ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
+    ret = hlsenc_playlist_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename,
+                                use_temp_file ? vs->m3u8_name : NULL);
     if (ret < 0) {
         return ret;
     }
-    hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
-    if (use_temp_file) {
-        ff_rename(temp_filename, vs->m3u8_name, s);
-        if (vs->vtt_m3u8_name)
-            ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
-    }
+    if (hls->sub_m3u8_out)
+        hlsenc_playlist_close(s, &hls->sub_m3u8_out, temp_vtt_filename,
+                              use_temp_file ? vs->vtt_m3u8_name : NULL);
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs, last) < 0)
             av_log(s, AV_LOG_WARNING, "Master playlist creation failed\n");
@@ -2641,7 +2782,15 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
                                       && (hls->flags & HLS_TEMP_FILE);
             }
 
-            if ((hls->max_seg_size > 0 && (vs->size + vs->start_pos >= hls->max_seg_size)) || !byterange_mode) {
+            if (hls->upload && !byterange_mode) {
+                ret = hls_queue_segment(s, vs, use_temp_file);
+                if (ret < 0)
+                    return ret;
+                /* report the uploads that failed in the meantime */
+                ret = ff_upload_queue_error(hls->upload);
+                if (hls->ignore_io_errors)
+                    ret = 0;
+            } else if ((hls->max_seg_size > 0 && (vs->size + vs->start_pos >= hls->max_seg_size)) || !byterange_mode) {
                 AVDictionary *options = NULL;
                 char *filename = NULL;
                 if (hls->key_info_file || hls->encrypt) {
@@ -2696,8 +2845,13 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
                 av_freep(&filename);
             }
 
-            if (use_temp_file)
-                hls_rename_temp_file(s, oc);
+            if (use_temp_file) {
+                /* queued segments are renamed once uploaded */
+                if (hls->upload && !byterange_mode)
+                    oc->url[strlen(oc->url) - 4] = '\0';
+                else
+                    hls_rename_temp_file(s, oc);
+            }
         }
 
         if (ret < 0)
@@ -2790,6 +2944,8 @@ static void hls_deinit(AVFormatContext *s)
     int i = 0;
     VariantStream *vs = NULL;
 
+    ff_upload_queue_free(&hls->upload);
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2839,6 +2995,11 @@ static int hls_write_trailer(struct AVFormatContext *s)
         vtt_oc = vs->vtt_avf;
         old_filename = av_strdup(oc->url);
         use_temp_file = 0;
+        byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+        if (oc->url[0]) {
+            proto = avio_find_protocol_name(oc->url);
+            use_temp_file = proto && !strcmp(proto, "file") && (hls->flags & HLS_TEMP_FILE);
+        }
 
         if (!old_filename) {
             return AVERROR(ENOMEM);
@@ -2869,13 +3030,16 @@ static int hls_write_trailer(struct AVFormatContext *s)
                 avio_open_dyn_buf(&oc->pb);
                 vs->packets_written = 0;
                 vs->start_pos = range_length;
-                byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
                 if (!byterange_mode) {
                     ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
                 }
             }
         }
+        if (hls->upload && !byterange_mode) {
+            ret = hls_queue_segment(s, vs, use_temp_file);
+            goto failed;
+        }
         if (!(hls->flags & HLS_SINGLE_FILE)) {
             set_http_options(s, &options, hls);
             ret = hlsenc_io_open(s, &vs->out, filename, &options);
@@ -2916,14 +3080,14 @@ failed:
         av_dict_free(&options);
         av_freep(&filename);
         av_write_trailer(oc);
-        if (oc->url[0]) {
-            proto = avio_find_protocol_name(oc->url);
-            use_temp_file = proto && !strcmp(proto, "file") && (hls->flags & HLS_TEMP_FILE);
-        }
 
         // rename that segment from .tmp to the real one
         if (use_temp_file && !(hls->flags & HLS_SINGLE_FILE)) {
-            hls_rename_temp_file(s, oc);
+            /* queued segments are renamed once uploaded */
+            if (hls->upload && !byterange_mode)
+                oc->url[strlen(oc->url) - 4] = '\0';
+            else
+                hls_rename_temp_file(s, oc);
             av_freep(&old_filename);
             old_filename = av_strdup(oc->url);
 
@@ -2954,6 +3118,9 @@ failed:
         av_free(old_filename);
     }
 
+    ret = ff_upload_queue_flush(hls->upload);
+    if (ret < 0 && !hls->ignore_io_errors)
+        return ret;
     return 0;
 }
 
@@ -2993,6 +3160,21 @@ static int hls_init(AVFormatContext *s)
         av_log(hls, AV_LOG_WARNING, "No HTTP method set, hls muxer defaulting to method PUT.\n");
     }
 
+    if (hls->async_uploads > 0 && !ff_format_io_is_default(s)) {
+        av_log(s, AV_LOG_WARNING, "Asynchronous uploads are not supported "
+               "with custom I/O callbacks, writing synchronously\n");
+    } else if (hls->async_uploads > 0) {
+        ret = ff_upload_queue_alloc(&hls->upload, s, hls->async_uploads,
+                                    hls->upload_max_retry,
+                                    upload_open, upload_close, s);
+        if (ret == AVERROR(ENOSYS)) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous uploads need threads, "
+                   "writing synchronously\n");
+        } else if (ret < 0) {
+            return ret;
+        }
+    }
+
     ret = validate_name(hls->nb_varstreams, s->url);
     if (ret < 0)
         return ret;
@@ -3270,6 +3452,8 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"async_uploads", "Number of segment and playlist uploads that can be pending, 0 = write synchronously", OFFSET(async_uploads), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, E },
+    {"upload_max_retry", "Number of times a failed asynchronous upload is retried", OFFSET(upload_max_retry), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, INT_MAX, E },
     { NULL },
 };
 
@@ -594,6 +594,14 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether AVFormatContext.io_open and io_close2 are the ones set by
+ * avformat_alloc_context(). Only then may they be called from a thread
+ * other than the one of the caller, since the default callbacks do not
+ * touch anything but the whitelists and the interrupt callback.
+ */
+int ff_format_io_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
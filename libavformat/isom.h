@@ -204,6 +204,9 @@ typedef struct MOVStreamContext {
     unsigned int stsz_sample_size; ///< always contains sample size from stsz atom
     unsigned int sample_count;
     unsigned int *sample_sizes;
+    const uint8_t *stsz_data; ///< packed stsz/stz2 entries, in the file mapping or stsz_buf
+    uint8_t *stsz_buf;
+    int stsz_field_size;
     int keyframe_absent;
     unsigned int keyframe_count;
     int *keyframes;
@@ -284,6 +287,22 @@ typedef struct MOVStreamContext {
 
     struct IAMFDemuxContext *iamf;
     int iamf_stream_offset;
+
+    /**
+     * 1 if the samples are looked up in the sample tables instead of the
+     * AVIndex, -1 if the AVIndex has been built from them afterwards.
+     */
+    int lazy_index;
+    unsigned int lazy_nb_samples;
+    /* first sample (and dts) of every MOV_LAZY_RUN_STEP-th table entry */
+    int64_t *lazy_stts_sample;
+    int64_t *lazy_stts_dts;
+    int64_t *lazy_ctts_sample;
+    int64_t *lazy_stsc_sample;
+    unsigned int lazy_pos_sample; ///< sample at lazy_pos, for sequential reads
+    int64_t lazy_pos;
+    int lazy_entry_sample;    ///< sample in lazy_entry, -1 if none
+    AVIndexEntry lazy_entry;
 } MOVStreamContext;
 
 typedef struct HEIFItem {
@@ -379,6 +398,9 @@ typedef struct MOVContext {
     int thmb_item_id;
     int64_t idat_offset;
     int interleaved_read;
+    int lazy_index;
+    uint8_t *map;           ///< read-only mapping of the input file, for lazy_index
+    size_t map_size;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
@@ -1988,10 +1988,13 @@ static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
 
 static void matroska_add_index_entries(MatroskaDemuxContext *matroska)
 {
+    MatroskaTrack *tracks = matroska->tracks.elem;
     EbmlList *index_list;
     MatroskaIndex *index;
+    AVIndexEntry *entries, *track_entries;
+    MatroskaTrack **owners;
     uint64_t index_scale = 1;
-    int i, j;
+    int i, j, nb_entries = 0, ret = 0;
 
     if (matroska->ctx->flags & AVFMT_FLAG_IGNIDX)
         return;
@@ -2004,19 +2007,60 @@ static void matroska_add_index_entries(MatroskaDemuxContext *matroska)
         av_log(matroska->ctx, AV_LOG_WARNING, "Dropping apparently-broken index.\n");
         return;
     }
+    for (i = 0; i < index_list->nb_elem; i++) {
+        if (index[i].pos.nb_elem > INT_MAX / sizeof(*entries) - nb_entries)
+            return;
+        nb_entries += index[i].pos.nb_elem;
+    }
+
+    /* Cues may be parsed after packets have already added entries to the
+     * index, so collect them per stream and merge them in one go. */
+    entries       = av_malloc_array(nb_entries, sizeof(*entries));
+    track_entries = av_malloc_array(nb_entries, sizeof(*track_entries));
+    owners        = av_malloc_array(nb_entries, sizeof(*owners));
+    if (!entries || !track_entries || !owners) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    nb_entries = 0;
     for (i = 0; i < index_list->nb_elem; i++) {
         EbmlList *pos_list    = &index[i].pos;
         MatroskaIndexPos *pos = pos_list->elem;
         for (j = 0; j < pos_list->nb_elem; j++) {
             MatroskaTrack *track = matroska_find_track_by_num(matroska,
                                                               pos[j].track);
-            if (track && track->stream)
-                av_add_index_entry(track->stream,
-                                   pos[j].pos + matroska->segment_start,
-                                   index[i].time / index_scale, 0, 0,
-                                   AVINDEX_KEYFRAME);
+            if (track && track->stream) {
+                entries[nb_entries] = (AVIndexEntry) {
+                    .pos       = pos[j].pos + matroska->segment_start,
+                    .timestamp = index[i].time / index_scale,
+                    .flags     = AVINDEX_KEYFRAME,
+                };
+                owners[nb_entries++] = track;
+            }
         }
     }
+
+    for (i = 0; i < matroska->tracks.nb_elem; i++) {
+        int nb_track_entries = 0;
+
+        if (!tracks[i].stream)
+            continue;
+        for (j = 0; j < nb_entries; j++)
+            if (owners[j] == &tracks[i])
+                track_entries[nb_track_entries++] = entries[j];
+        ret = ff_add_index_entries(tracks[i].stream, track_entries, nb_track_entries);
+        if (ret < 0)
+            break;
+    }
+
+end:
+    if (ret < 0)
+        av_log(matroska->ctx, AV_LOG_WARNING, "Could not add the cues to the index: %s\n",
+               av_err2str(ret));
+    av_free(entries);
+    av_free(track_entries);
+    av_free(owners);
 }
 
 static void matroska_parse_cues(MatroskaDemuxContext *matroska) {
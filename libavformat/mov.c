@@ -40,6 +40,7 @@
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
 #include "libavutil/display.h"
+#include "libavutil/file.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/aes.h"
@@ -3379,6 +3380,70 @@ static int mov_read_stss(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+static unsigned int mov_get_stsz_entry(const MOVStreamContext *sc, unsigned int sample)
+{
+    const uint8_t *p = sc->stsz_data;
+
+    switch (sc->stsz_field_size) {
+    case 32: return AV_RB32(p + 4 * sample);
+    case 16: return AV_RB16(p + 2 * sample);
+    case  8: return p[sample];
+    default: return p[sample >> 1] >> (sample & 1 ? 0 : 4) & 0xF;
+    }
+}
+
+static unsigned int mov_get_sample_size(const MOVStreamContext *sc, unsigned int sample)
+{
+    if (sc->stsz_sample_size > 0)
+        return sc->stsz_sample_size;
+    return sc->sample_sizes ? sc->sample_sizes[sample] : mov_get_stsz_entry(sc, sample);
+}
+
+/**
+ * Keep the stsz entries in their packed form for lazy_index, pointing into
+ * the file mapping if there is one.
+ */
+static int mov_read_stsz_packed(MOVContext *c, AVIOContext *pb, MOVStreamContext *sc,
+                                unsigned int entries, int field_size)
+{
+    unsigned int num_bytes = (entries * field_size + 4) >> 3;
+    int64_t pos = avio_tell(pb);
+    int ret;
+
+    sc->sample_count    = 0;
+    sc->stsz_field_size = field_size;
+
+    if (c->map && pb == c->fc->pb && pos >= 0 && pos + num_bytes <= c->map_size) {
+        ret = avio_skip(pb, num_bytes);
+        if (ret < 0)
+            return ret;
+        sc->stsz_data = c->map + pos;
+    } else {
+        sc->stsz_buf = av_malloc(num_bytes);
+        if (!sc->stsz_buf)
+            return AVERROR(ENOMEM);
+        ret = ffio_read_size(pb, sc->stsz_buf, num_bytes);
+        if (ret < 0) {
+            av_freep(&sc->stsz_buf);
+            av_log(c->fc, AV_LOG_WARNING, "STSZ atom truncated\n");
+            return 0;
+        }
+        sc->stsz_data = sc->stsz_buf;
+    }
+
+    for (unsigned int i = 0; i < entries; i++) {
+        unsigned int size = mov_get_stsz_entry(sc, i);
+        if (size > INT64_MAX - sc->data_size) {
+            av_log(c->fc, AV_LOG_ERROR, "Sample size overflow in STSZ\n");
+            return AVERROR_INVALIDDATA;
+        }
+        sc->data_size += size;
+    }
+    sc->sample_count = entries;
+
+    return 0;
+}
+
 static int mov_read_stsz(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     AVStream *st;
@@ -3429,8 +3494,12 @@ static int mov_read_stsz(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         return 0;
     if (entries >= (INT_MAX - 4 - 8 * AV_INPUT_BUFFER_PADDING_SIZE) / field_size)
         return AVERROR_INVALIDDATA;
-    if (sc->sample_sizes)
+    if (sc->sample_sizes || sc->stsz_data)
         av_log(c->fc, AV_LOG_WARNING, "Duplicated STSZ atom\n");
+    av_freep(&sc->stsz_buf);
+    sc->stsz_data = NULL;
+    if (c->lazy_index)
+        return mov_read_stsz_packed(c, pb, sc, entries, field_size);
     av_free(sc->sample_sizes);
     sc->sample_count = 0;
     sc->sample_sizes = av_malloc_array(entries, sizeof(*sc->sample_sizes));
@@ -4613,6 +4682,374 @@ static int mov_merge_tts_data(MOVContext *mov, AVStream *st, int flags)
     return 0;
 }
 
+#define MOV_LAZY_RUN_STEP 64
+
+static void mov_lazy_free(MOVStreamContext *sc)
+{
+    av_freep(&sc->lazy_stts_sample);
+    av_freep(&sc->lazy_stts_dts);
+    av_freep(&sc->lazy_ctts_sample);
+    av_freep(&sc->lazy_stsc_sample);
+}
+
+/* Check if all samples have the same duration, optionally ignoring the last one. */
+static int mov_lazy_stts_constant(const MOVStreamContext *sc, int ignore_last)
+{
+    unsigned int count = sc->stts_count;
+
+    if (ignore_last && count > 1 && sc->stts_data[count - 1].count == 1)
+        count--;
+    for (unsigned int i = 1; i < count; i++)
+        if (sc->stts_data[i].duration != sc->stts_data[0].duration)
+            return 0;
+
+    return 1;
+}
+
+/* Number of samples of the stsc entry at the given index, within chunk_count. */
+static int64_t mov_lazy_stsc_samples(const MOVStreamContext *sc, unsigned int index)
+{
+    int64_t first = FFMIN(sc->stsc_data[index].first - 1LL, sc->chunk_count);
+    int64_t end   = sc->chunk_count;
+
+    if (mov_stsc_index_valid(index, sc->stsc_count))
+        end = FFMIN(sc->stsc_data[index + 1].first - 1LL, end);
+
+    return FFMAX(end - first, 0) * FFMAX(sc->stsc_data[index].count, 0);
+}
+
+/*
+ * Find the last checkpoint at or before the given sample. Checkpoint k holds
+ * the first sample of table entry k * MOV_LAZY_RUN_STEP.
+ */
+static unsigned int mov_lazy_find_checkpoint(const int64_t *checkpoints,
+                                             unsigned int nb_entries, int64_t sample)
+{
+    unsigned int lo = 0, hi = (nb_entries - 1) / MOV_LAZY_RUN_STEP;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi + 1) >> 1;
+        if (checkpoints[mid] <= sample)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+static int64_t mov_lazy_get_dts(const MOVStreamContext *sc, int64_t sample,
+                                unsigned int *duration)
+{
+    unsigned int k = mov_lazy_find_checkpoint(sc->lazy_stts_sample, sc->stts_count, sample);
+    int64_t first  = sc->lazy_stts_sample[k];
+    int64_t dts    = sc->lazy_stts_dts[k];
+
+    for (unsigned int i = k * MOV_LAZY_RUN_STEP; i < sc->stts_count; i++) {
+        const MOVStts *e = &sc->stts_data[i];
+        if (sample - first < e->count) {
+            *duration = e->duration;
+            return dts + (sample - first) * e->duration;
+        }
+        first += e->count;
+        dts   += (int64_t)e->count * e->duration;
+    }
+
+    /* samples not covered by stts keep the last duration, as in the AVIndex */
+    *duration = 0;
+    return dts + (sample - first) * sc->stts_data[sc->stts_count - 1].duration;
+}
+
+static int mov_lazy_get_ctts(const MOVStreamContext *sc, int64_t sample)
+{
+    unsigned int k;
+    int64_t first;
+
+    if (!sc->ctts_count)
+        return 0;
+
+    k     = mov_lazy_find_checkpoint(sc->lazy_ctts_sample, sc->ctts_count, sample);
+    first = sc->lazy_ctts_sample[k];
+    for (unsigned int i = k * MOV_LAZY_RUN_STEP; i < sc->ctts_count; i++) {
+        if (sample - first < sc->ctts_data[i].count)
+            return sc->ctts_data[i].offset;
+        first += sc->ctts_data[i].count;
+    }
+
+    return 0;
+}
+
+/* Find the chunk of a sample and the first sample of that chunk. */
+static int mov_lazy_get_chunk(const MOVStreamContext *sc, int64_t sample,
+                              unsigned int *chunk, int64_t *chunk_sample)
+{
+    unsigned int k = mov_lazy_find_checkpoint(sc->lazy_stsc_sample, sc->stsc_count, sample);
+    int64_t first  = sc->lazy_stsc_sample[k];
+
+    for (unsigned int i = k * MOV_LAZY_RUN_STEP; i < sc->stsc_count; i++) {
+        int64_t nb_samples = mov_lazy_stsc_samples(sc, i);
+        if (sample - first < nb_samples) {
+            int64_t off = sample - first;
+            *chunk        = sc->stsc_data[i].first - 1 + off / sc->stsc_data[i].count;
+            *chunk_sample = sample - off % sc->stsc_data[i].count;
+            return 0;
+        }
+        first += nb_samples;
+    }
+
+    return AVERROR_INVALIDDATA;
+}
+
+/* Index of the last entry <= val in a sorted sample number table, -1 if none. */
+static int mov_lazy_search_table(const unsigned int *tab, unsigned int count,
+                                 unsigned int val)
+{
+    int lo = -1, hi = count;
+
+    while (hi - lo > 1) {
+        int mid = (lo + hi) >> 1;
+        if (tab[mid] <= val)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Find the closest keyframe at or before (backward) or at or after the given
+ * sample, following the same rules as mov_build_index().
+ *
+ * @return the keyframe sample, -1 or lazy_nb_samples if there is none
+ */
+static int64_t mov_lazy_find_keyframe(const AVStream *st, int64_t sample, int backward)
+{
+    const MOVStreamContext *sc = st->priv_data;
+    int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+    int64_t key = backward ? -1 : (int64_t)sc->lazy_nb_samples;
+    const unsigned int *tabs[2];
+    unsigned int counts[2];
+    int nb_tabs = 0;
+
+    if (!sc->keyframe_absent && !sc->keyframe_count)
+        return sample;
+    if (sc->keyframe_absent && !sc->stps_count) {
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            return sample;
+        return backward || !sample ? 0 : key;
+    }
+
+    if (!sc->keyframe_absent) {
+        tabs[nb_tabs]     = (const unsigned int *)sc->keyframes;
+        counts[nb_tabs++] = sc->keyframe_count;
+    }
+    if (sc->stps_count) {
+        tabs[nb_tabs]     = sc->stps_data;
+        counts[nb_tabs++] = sc->stps_count;
+    }
+
+    for (int t = 0; t < nb_tabs; t++) {
+        unsigned int val = sample + key_off;
+        int i = mov_lazy_search_table(tabs[t], counts[t], val);
+
+        if (backward) {
+            if (i >= 0)
+                key = FFMAX(key, (int64_t)tabs[t][i] - key_off);
+        } else {
+            if (i < 0 || tabs[t][i] != val)
+                i++;
+            if (i < counts[t])
+                key = FFMIN(key, (int64_t)tabs[t][i] - key_off);
+        }
+    }
+
+    return key;
+}
+
+/**
+ * Get the index entry of a sample of a stream using lazy_index.
+ * The returned entry is only valid until the next call for the same stream.
+ */
+static AVIndexEntry *mov_lazy_get_entry(AVStream *st, int64_t sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    AVIndexEntry *e = &sc->lazy_entry;
+    unsigned int chunk, size, duration;
+    int64_t chunk_sample, pos, key;
+
+    if (sample < 0 || sample >= sc->lazy_nb_samples)
+        return NULL;
+    if (sc->lazy_entry_sample == sample)
+        return e;
+    if (mov_lazy_get_chunk(sc, sample, &chunk, &chunk_sample) < 0)
+        return NULL;
+
+    size = mov_get_sample_size(sc, sample);
+    if (size > 0x3FFFFFFF)
+        return NULL;
+
+    pos = sc->chunk_offsets[chunk];
+    if (sc->stsz_sample_size > 0) {
+        int64_t off = (sample - chunk_sample) * sc->stsz_sample_size;
+        if (pos > INT64_MAX - off)
+            return NULL;
+        pos += off;
+    } else {
+        int64_t i = chunk_sample;
+
+        /* continue from the previous sample when reading sequentially */
+        if (sc->lazy_pos_sample >= chunk_sample && sc->lazy_pos_sample <= sample) {
+            i   = sc->lazy_pos_sample;
+            pos = sc->lazy_pos;
+        }
+        for (; i < sample; i++) {
+            unsigned int sample_size = mov_get_sample_size(sc, i);
+            if (pos > INT64_MAX - sample_size)
+                return NULL;
+            pos += sample_size;
+        }
+        sc->lazy_pos_sample = sample;
+        sc->lazy_pos        = pos;
+    }
+    if (pos > INT64_MAX - size)
+        return NULL;
+
+    key = mov_lazy_find_keyframe(st, sample, 1);
+
+    e->pos          = pos;
+    e->timestamp    = mov_lazy_get_dts(sc, sample, &duration);
+    e->size         = size;
+    e->min_distance = sample - FFMAX(key, 0);
+    e->flags        = key == sample ? AVINDEX_KEYFRAME : 0;
+    sc->lazy_entry_sample = sample;
+
+    return e;
+}
+
+/* Check that mov_build_index() would not skip samples of other sample descriptions. */
+static int mov_lazy_all_samples_indexed(const MOVStreamContext *sc)
+{
+    if (sc->pseudo_stream_id == -1)
+        return 1;
+    for (unsigned int i = 0; i < sc->stsc_count; i++)
+        if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+            return 0;
+    return 1;
+}
+
+static int mov_lazy_index_possible(const MOVContext *mov, const AVStream *st,
+                                   int multiple_edits)
+{
+    const MOVStreamContext *sc = st->priv_data;
+
+    return mov->lazy_index && !sc->lazy_index && !multiple_edits &&
+           (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ||
+            st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) &&
+           sc->sample_count && sc->sample_count <= INT_MAX &&
+           (sc->stsz_sample_size > 0 || sc->stsz_data) && !sc->sample_sizes &&
+           sc->stts_count && sc->chunk_count && sc->stsc_count &&
+           sc->stsc_data[0].first == 1 && !sc->rap_group_count &&
+           !sc->sync_group_count && !sc->iamf &&
+           !cffstream(st)->nb_index_entries && !sc->tts_count &&
+           mov_lazy_all_samples_indexed(sc);
+}
+
+/**
+ * Set up sample lookups in the sample tables instead of building the AVIndex.
+ * Only every MOV_LAZY_RUN_STEP-th entry of stts, ctts and stsc gets a
+ * checkpoint, so memory use no longer grows with the number of samples.
+ */
+static int mov_lazy_init(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int nb_stts = (sc->stts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP;
+    unsigned int nb_ctts = (sc->ctts_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP;
+    unsigned int nb_stsc = (sc->stsc_count + MOV_LAZY_RUN_STEP - 1) / MOV_LAZY_RUN_STEP;
+    unsigned int stsc_index = 0, duration;
+    int64_t sample, dts;
+    uint64_t stream_size;
+
+    sc->lazy_stts_sample = av_malloc_array(nb_stts, sizeof(*sc->lazy_stts_sample));
+    sc->lazy_stts_dts    = av_malloc_array(nb_stts, sizeof(*sc->lazy_stts_dts));
+    sc->lazy_stsc_sample = av_malloc_array(nb_stsc, sizeof(*sc->lazy_stsc_sample));
+    if (nb_ctts)
+        sc->lazy_ctts_sample = av_malloc_array(nb_ctts, sizeof(*sc->lazy_ctts_sample));
+    if (!sc->lazy_stts_sample || !sc->lazy_stts_dts || !sc->lazy_stsc_sample ||
+        (nb_ctts && !sc->lazy_ctts_sample)) {
+        mov_lazy_free(sc);
+        return AVERROR(ENOMEM);
+    }
+
+    sample = 0;
+    dts    = start_dts;
+    for (unsigned int i = 0; i < sc->stts_count; i++) {
+        if (!(i % MOV_LAZY_RUN_STEP)) {
+            sc->lazy_stts_sample[i / MOV_LAZY_RUN_STEP] = sample;
+            sc->lazy_stts_dts[i / MOV_LAZY_RUN_STEP]    = dts;
+        }
+        sample += sc->stts_data[i].count;
+        dts    += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+    }
+
+    sample = 0;
+    for (unsigned int i = 0; i < sc->ctts_count; i++) {
+        if (!(i % MOV_LAZY_RUN_STEP))
+            sc->lazy_ctts_sample[i / MOV_LAZY_RUN_STEP] = sample;
+        sample += sc->ctts_data[i].count;
+    }
+
+    sample = 0;
+    for (unsigned int i = 0; i < sc->stsc_count; i++) {
+        if (!(i % MOV_LAZY_RUN_STEP))
+            sc->lazy_stsc_sample[i / MOV_LAZY_RUN_STEP] = sample;
+        sample += mov_lazy_stsc_samples(sc, i);
+    }
+    if (sample > sc->sample_count)
+        av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+    sc->lazy_nb_samples = FFMIN(sample, sc->sample_count);
+
+    if (sc->stsz_sample_size > 0) {
+        for (unsigned int i = 0; i < sc->chunk_count; i++) {
+            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
+            int64_t current_offset = sc->chunk_offsets[i];
+            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+                i + 1 == sc->stsc_data[stsc_index + 1].first)
+                stsc_index++;
+
+            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+        }
+    }
+
+    sc->lazy_index        = 1;
+    sc->lazy_entry_sample = -1;
+    sc->lazy_pos_sample   = UINT_MAX;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        for (sample = 0; sample < FFMIN(sc->lazy_nb_samples, 99); sample++)
+            ff_rfps_add_frame(mov->fc, st, mov_lazy_get_dts(sc, sample, &duration));
+
+    stream_size = sc->stsz_sample_size > 0 ?
+                  (uint64_t)sc->stsz_sample_size * sc->lazy_nb_samples : sc->data_size;
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+        sc->lazy_nb_samples > 0)
+        st->start_time = mov_lazy_get_dts(sc, 0, &duration) + sc->dts_shift +
+                         mov_lazy_get_ctts(sc, 0);
+
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -4625,15 +5062,16 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     unsigned int stps_index = 0;
     unsigned int i, j;
     uint64_t stream_size = 0;
+    int multiple_edits = 0;
+    int64_t start_time = 0; // start time of the media
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
         return;
 
     if (sc->elst_count) {
-        int i, edit_start_index = 0, multiple_edits = 0;
+        int i, edit_start_index = 0;
         int64_t empty_duration = 0; // empty duration of the first edit list entry
-        int64_t start_time = 0; // start time of the media
 
         for (i = 0; i < sc->elst_count; i++) {
             const MOVElst *e = &sc->elst_data[i];
@@ -4692,6 +5130,14 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         current_dts -= sc->dts_shift;
 
+        /* lazy streams use the timestamps of -advanced_editlist 0 */
+        if (mov_lazy_index_possible(mov, st, multiple_edits) &&
+            mov_lazy_init(mov, st, -sc->time_offset - sc->dts_shift) >= 0) {
+            if (st->codecpar->codec_id == AV_CODEC_ID_AAC && start_time > 0)
+                sc->start_pad = start_time;
+            return;
+        }
+
         if (!sc->sample_count || sti->nb_index_entries || sc->tts_count)
             return;
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
@@ -4756,7 +5202,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                      keyframe = 1;
                 if (keyframe)
                     distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
+                sample_size = mov_get_sample_size(sc, current_sample);
                 if (current_offset > INT64_MAX - sample_size) {
                     av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
                            current_offset,
@@ -4922,6 +5368,53 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     mov_estimate_video_delay(mov, st);
 }
 
+/**
+ * Build the AVIndex of a stream using lazy_index, for the code which needs
+ * all index entries.
+ */
+static void mov_lazy_expand(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int advanced_editlist = mov->advanced_editlist;
+
+    if (sc->lazy_index <= 0)
+        return;
+
+    sc->lazy_index = -1;
+    mov_lazy_free(sc);
+
+    /* keep the timestamps of the samples already returned */
+    mov->advanced_editlist = 0;
+    mov_build_index(mov, st);
+    mov->advanced_editlist = advanced_editlist;
+
+    /* the merged time to sample table has one entry per sample */
+    sc->tts_index  = sc->current_sample;
+    sc->tts_sample = 0;
+}
+
+static AVIndexEntry *mov_get_index_entry(AVStream *st, int64_t sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+
+    if (sc->lazy_index > 0)
+        return mov_lazy_get_entry(st, sample);
+    if (sample < 0 || sample >= sti->nb_index_entries)
+        return NULL;
+    return &sti->index_entries[sample];
+}
+
+static int64_t mov_get_sample_timestamp(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int duration;
+
+    if (sc->lazy_index > 0)
+        return mov_lazy_get_dts(sc, sample, &duration);
+    return ffstream(st)->index_entries[sample].timestamp;
+}
+
 static int test_same_origin(const char *src, const char *ref) {
     char src_proto[64];
     char ref_proto[64];
@@ -5197,14 +5690,17 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         }
 
 #if FF_API_R_FRAME_RATE
+        if (sc->lazy_index > 0)
+            stts_constant = mov_lazy_stts_constant(sc, 1);
         for (unsigned int i = 1; sc->stts_count && i + 1 < sc->tts_count; i++) {
             if (sc->tts_data[i].duration == sc->tts_data[0].duration)
                 continue;
             stts_constant = 0;
         }
         if (stts_constant)
-            av_reduce(&st->r_frame_rate.num, &st->r_frame_rate.den,
-                      sc->time_scale, sc->tts_data[0].duration, INT_MAX);
+            av_reduce(&st->r_frame_rate.num, &st->r_frame_rate.den, sc->time_scale,
+                      sc->lazy_index > 0 ? sc->stts_data[0].duration : sc->tts_data[0].duration,
+                      INT_MAX);
 #endif
     }
 
@@ -5234,7 +5730,7 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     // If the duration of the mp3 packets is not constant, then they could need a parser
     if (st->codecpar->codec_id == AV_CODEC_ID_MP3
         && sc->time_scale == st->codecpar->sample_rate) {
-        int stts_constant = 1;
+        int stts_constant = sc->lazy_index > 0 ? mov_lazy_stts_constant(sc, 0) : 1;
         for (int i = 1; sc->stts_count && i < sc->tts_count; i++) {
             if (sc->tts_data[i].duration == sc->tts_data[0].duration)
                 continue;
@@ -5243,12 +5739,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         if (!stts_constant)
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
+    /* Do not need those anymore, unless the samples are looked up lazily. */
+    if (sc->lazy_index <= 0) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->elst_data);
+        av_freep(&sc->stsz_buf);
+        sc->stsz_data = NULL;
+    }
     av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stps_data);
-    av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
     av_freep(&sc->sgpd_sync);
@@ -5753,6 +6253,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    mov_lazy_expand(c, st);
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -9563,6 +10065,7 @@ static void mov_read_chapters(AVFormatContext *s)
         sti = ffstream(st);
 
         sc = st->priv_data;
+        mov_lazy_expand(mov, st);
         cur_pos = avio_tell(sc->pb);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
@@ -9773,6 +10276,8 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
     av_freep(&sc->open_key_samples);
     av_freep(&sc->display_matrix);
     av_freep(&sc->index_ranges);
+    av_freep(&sc->stsz_buf);
+    mov_lazy_free(sc);
 
     if (sc->extradata)
         for (int i = 0; i < sc->stsd_count; i++)
@@ -9848,6 +10353,11 @@ static int mov_read_close(AVFormatContext *s)
     }
     av_freep(&mov->heif_grid);
 
+    if (mov->map)
+        av_file_unmap(mov->map, mov->map_size);
+    mov->map      = NULL;
+    mov->map_size = 0;
+
     return 0;
 }
 
@@ -10467,6 +10977,22 @@ static int mov_read_header(AVFormatContext *s)
     mov->thmb_item_id = -1;
     mov->primary_item_id = -1;
     mov->cur_item_id = -1;
+
+#if HAVE_MMAP
+    /* map local files so that the sample size tables need not be copied */
+    if (mov->lazy_index && !(s->flags & AVFMT_FLAG_CUSTOM_IO)) {
+        const char *proto = avio_find_protocol_name(s->url);
+        const char *path  = s->url;
+
+        if (proto && !strcmp(proto, "file")) {
+            av_strstart(path, "file:", &path);
+            if (av_file_map(path, &mov->map, &mov->map_size,
+                            AV_LOG_VERBOSE - AV_LOG_ERROR, s) < 0)
+                mov->map = NULL;
+        }
+    }
+#endif
+
     /* .mov and .mp4 aren't streamable anyway (only progressive download if moov is before mdat) */
     if (pb->seekable & AVIO_SEEKABLE_NORMAL)
         atom.size = avio_size(pb);
@@ -10692,10 +11218,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int no_interleave = !mov->interleaved_read || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL);
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample;
+        if (msc->pb && (current_sample = mov_get_index_entry(avst, msc->current_sample))) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -10859,12 +11384,25 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
     if (sample->flags & AVINDEX_DISCARD_FRAME) {
         pkt->flags |= AV_PKT_FLAG_DISCARD;
     }
-    if (sc->stts_count && sc->tts_index < sc->tts_count)
+    if (sc->lazy_index > 0) {
+        unsigned int duration;
+        mov_lazy_get_dts(sc, sc->current_sample - 1, &duration);
+        pkt->duration = duration;
+    } else if (sc->stts_count && sc->tts_index < sc->tts_count)
         pkt->duration = sc->tts_data[sc->tts_index].duration;
-    if (sc->ctts_count && sc->tts_index < sc->tts_count) {
+    if (sc->lazy_index > 0 && sc->ctts_count) {
+        pkt->pts = av_sat_add64(pkt->dts, av_sat_add64(sc->dts_shift,
+                                                       mov_lazy_get_ctts(sc, sc->current_sample - 1)));
+    } else if (sc->ctts_count && sc->tts_index < sc->tts_count) {
         pkt->pts = av_sat_add64(pkt->dts, av_sat_add64(sc->dts_shift, sc->tts_data[sc->tts_index].offset));
     } else {
-        if (pkt->duration == 0) {
+        if (pkt->duration == 0 && sc->lazy_index > 0) {
+            unsigned int duration;
+            int64_t next_dts = sc->current_sample < sc->lazy_nb_samples ?
+                mov_lazy_get_dts(sc, sc->current_sample, &duration) : st->duration;
+            if (next_dts >= pkt->dts)
+                pkt->duration = next_dts - pkt->dts;
+        } else if (pkt->duration == 0) {
             int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
                 ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
             if (next_dts >= pkt->dts)
@@ -11138,10 +11676,41 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     return 1;
 }
 
+/* Same as av_index_search_timestamp(), also for streams using lazy_index. */
+static int mov_index_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int nb_samples = sc->lazy_nb_samples;
+    int a = -1, b = nb_samples, m;
+    unsigned int duration;
+
+    if (sc->lazy_index <= 0)
+        return av_index_search_timestamp(st, wanted_timestamp, flags);
+
+    while (b - a > 1) {
+        int64_t timestamp;
+
+        m         = (a + b) >> 1;
+        timestamp = mov_lazy_get_dts(sc, m, &duration);
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY) && m >= 0 && m < nb_samples)
+        m = mov_lazy_find_keyframe(st, m, flags & AVSEEK_FLAG_BACKWARD);
+
+    if (m == nb_samples)
+        return -1;
+    return m;
+}
+
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
+    const AVIndexEntry *first;
     int sample, time_sample, ret, next_ts, requested_sample;
     unsigned int i;
 
@@ -11154,9 +11723,9 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && (first = mov_get_index_entry(st, 0)) && timestamp < first->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -11165,7 +11734,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
             break;
 
         next_ts = timestamp - FFMAX(sc->min_sample_duration, 1);
-        requested_sample = av_index_search_timestamp(st, next_ts, flags);
+        requested_sample = mov_index_search_timestamp(st, next_ts, flags);
 
         // If we've reached a different sample trying to find a good pts to
         // seek to, give up searching because we'll end up seeking back to
@@ -11213,14 +11782,14 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
-    int64_t off;
+    int64_t first_ts, ts, off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
         return 0;
 
+    first_ts = mov_get_sample_timestamp(st, 0);
+    ts       = mov_get_sample_timestamp(st, sample);
+
     /* compute skip samples according to stream start_pad, seek ts and first ts */
     off = av_rescale_q(ts - first_ts, st->time_base,
                        (AVRational){1, st->codecpar->sample_rate});
@@ -11246,7 +11815,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_get_sample_timestamp(st, sample);
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -11296,6 +11865,10 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_editlist", "Ignore the edit list atom.", OFFSET(ignore_editlist), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Look up samples in the sample tables instead of building the full index",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"advanced_editlist",
         "Modify the AVIndex according to the editlists. Use this option to decode in the order specified by the edits.",
         OFFSET(advanced_editlist), AV_OPT_TYPE_BOOL, {.i64 = 1},
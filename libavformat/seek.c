@@ -129,6 +129,111 @@ int av_add_index_entry(AVStream *st, int64_t pos, int64_t timestamp,
                               timestamp, size, distance, flags);
 }
 
+static int index_entry_ptr_cmp(const void *a, const void *b)
+{
+    const AVIndexEntry *e1 = *(const AVIndexEntry *const *)a;
+    const AVIndexEntry *e2 = *(const AVIndexEntry *const *)b;
+
+    if (e1->timestamp != e2->timestamp)
+        return FFDIFFSIGN(e1->timestamp, e2->timestamp);
+    /* keep entries with equal timestamps in the order they were given */
+    return FFDIFFSIGN(e1, e2);
+}
+
+int ff_add_index_entries(AVStream *st, const AVIndexEntry *entries, int nb_entries)
+{
+    FFStream *const sti = ffstream(st);
+    const AVIndexEntry *old = sti->index_entries;
+    const AVIndexEntry **sorted = NULL;
+    AVIndexEntry *batch = NULL, *out = NULL;
+    int nb_old = sti->nb_index_entries, nb_batch = 0, nb_out = 0;
+    int i, j, ret = 0;
+
+    if (!nb_entries)
+        return 0;
+
+    /* Discarded frames change the insertion point ff_add_index_entry()
+     * picks, so fall back to inserting one entry at a time for those. */
+    if ((unsigned)nb_old + nb_entries >= UINT_MAX / sizeof(AVIndexEntry))
+        goto sequential;
+    for (i = 0; i < nb_old; i++)
+        if (old[i].flags & AVINDEX_DISCARD_FRAME)
+            goto sequential;
+    for (i = 0; i < nb_entries; i++)
+        if (entries[i].flags & AVINDEX_DISCARD_FRAME)
+            goto sequential;
+
+    batch  = av_malloc_array(nb_entries, sizeof(*batch));
+    sorted = av_malloc_array(nb_entries, sizeof(*sorted));
+    out    = av_malloc_array(nb_old + nb_entries, sizeof(*out));
+    if (!batch || !sorted || !out) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (i = 0; i < nb_entries; i++) {
+        AVIndexEntry e = entries[i];
+
+        /* same validation as ff_add_index_entry(); the size field cannot
+         * hold values above its 0x3FFFFFFF limit, only the sign is left */
+        e.timestamp = ff_wrap_timestamp(st, e.timestamp);
+        if (e.timestamp == AV_NOPTS_VALUE || e.size < 0)
+            continue;
+        if (is_relative(e.timestamp))
+            e.timestamp -= RELATIVE_TS_BASE;
+        batch[nb_batch]  = e;
+        sorted[nb_batch] = &batch[nb_batch];
+        nb_batch++;
+    }
+    qsort(sorted, nb_batch, sizeof(*sorted), index_entry_ptr_cmp);
+
+    for (i = j = 0; i < nb_old || j < nb_batch;) {
+        AVIndexEntry cur;
+        int64_t timestamp;
+
+        if (j == nb_batch || (i < nb_old && old[i].timestamp < sorted[j]->timestamp)) {
+            out[nb_out++] = old[i++];
+            continue;
+        }
+
+        /* Entries with the same timestamp replace each other in order,
+         * starting from the one already in the index. */
+        timestamp = sorted[j]->timestamp;
+        if (i < nb_old && old[i].timestamp == timestamp)
+            cur = old[i++];
+        else
+            cur = *sorted[j++];
+        for (; j < nb_batch && sorted[j]->timestamp == timestamp; j++) {
+            int distance = sorted[j]->min_distance;
+            if (cur.pos == sorted[j]->pos && distance < cur.min_distance)
+                // do not reduce the distance
+                distance = cur.min_distance;
+            cur              = *sorted[j];
+            cur.min_distance = distance;
+        }
+        out[nb_out++] = cur;
+    }
+
+    av_free(sti->index_entries);
+    sti->index_entries                = out;
+    sti->nb_index_entries             = nb_out;
+    sti->index_entries_allocated_size = (nb_old + nb_entries) * sizeof(*out);
+    out = NULL;
+
+end:
+    av_free(batch);
+    av_free(sorted);
+    av_free(out);
+    return ret;
+
+sequential:
+    for (i = 0; i < nb_entries; i++)
+        av_add_index_entry(st, entries[i].pos, entries[i].timestamp,
+                           entries[i].size, entries[i].min_distance,
+                           entries[i].flags);
+    return 0;
+}
+
 int ff_index_search_timestamp(const AVIndexEntry *entries, int nb_entries,
                               int64_t wanted_timestamp, int flags)
 {
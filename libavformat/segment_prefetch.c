@@ -0,0 +1,522 @@
+/*
+ * Background download of upcoming media segments
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "segment_prefetch.h"
+
+#if HAVE_THREADS
+
+#define PREFETCH_CHUNK_SIZE (64 * 1024)
+
+enum PrefetchState {
+    PREFETCH_FREE,
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+};
+
+typedef struct PrefetchJob {
+    enum PrefetchState state;
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    AVDictionary *opts;
+
+    uint8_t *buf;
+    size_t buf_size;
+    size_t data_len;
+    size_t read_pos;
+    /* result of the download once it is done */
+    int ret;
+    /* the job was dropped while running, the worker frees it */
+    int abort;
+    /* the job is being read, so it is not limited by max_size */
+    int current;
+} PrefetchJob;
+
+typedef struct PrefetchWorker {
+    SegmentPrefetch *sp;
+    pthread_t thread;
+    AVIOContext *pb;
+} PrefetchWorker;
+
+struct SegmentPrefetch {
+    void *logctx;
+    SegmentPrefetchOpen open;
+    SegmentPrefetchClose close;
+    void *opaque;
+
+    int64_t max_size;
+    int64_t cached_size;
+
+    PrefetchJob *jobs;
+    int nb_jobs;
+    PrefetchJob *cur;
+
+    PrefetchWorker *workers;
+    int nb_workers;
+    int nb_running;
+
+    int abort;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void free_job(SegmentPrefetch *sp, PrefetchJob *job)
+{
+    sp->cached_size -= job->data_len;
+    av_freep(&job->url);
+    av_freep(&job->buf);
+    av_dict_free(&job->opts);
+    memset(job, 0, sizeof(*job));
+}
+
+static void drop_job(SegmentPrefetch *sp, PrefetchJob *job)
+{
+    if (job->state == PREFETCH_RUNNING) {
+        job->abort   = 1;
+        job->current = 0;
+        pthread_cond_broadcast(&sp->cond);
+    } else {
+        free_job(sp, job);
+    }
+}
+
+/* Called with the mutex locked, returns with it locked. */
+static int download(PrefetchWorker *w, PrefetchJob *job)
+{
+    SegmentPrefetch *sp = w->sp;
+    int ret;
+
+    pthread_mutex_unlock(&sp->mutex);
+    ret = sp->open(sp->opaque, &w->pb, job->url, job->url_offset, job->size,
+                   &job->opts);
+    pthread_mutex_lock(&sp->mutex);
+    if (ret < 0)
+        return ret;
+
+    while (1) {
+        size_t size = PREFETCH_CHUNK_SIZE;
+
+        while (!job->abort && !sp->abort && !job->current &&
+               sp->cached_size >= sp->max_size)
+            pthread_cond_wait(&sp->cond, &sp->mutex);
+        if (job->abort || sp->abort)
+            return AVERROR_EXIT;
+
+        if (job->size >= 0) {
+            size = FFMIN(size, job->size - job->data_len);
+            if (!size)
+                return AVERROR_EOF;
+        }
+        if (job->buf_size - job->data_len < size) {
+            size_t new_size = FFMAX(job->buf_size * 2, job->data_len + size);
+            uint8_t *buf    = av_realloc(job->buf, new_size);
+            if (!buf)
+                return AVERROR(ENOMEM);
+            job->buf      = buf;
+            job->buf_size = new_size;
+        }
+
+        /* The reader only accesses data below data_len and the buffer is
+         * only reallocated with the mutex held, so this part can be filled
+         * without it. */
+        pthread_mutex_unlock(&sp->mutex);
+        ret = avio_read(w->pb, job->buf + job->data_len, size);
+        pthread_mutex_lock(&sp->mutex);
+        if (ret <= 0)
+            return ret ? ret : AVERROR_EOF;
+
+        job->data_len   += ret;
+        sp->cached_size += ret;
+        pthread_cond_broadcast(&sp->cond);
+    }
+}
+
+static void *prefetch_worker(void *arg)
+{
+    PrefetchWorker *w   = arg;
+    SegmentPrefetch *sp = w->sp;
+
+    pthread_mutex_lock(&sp->mutex);
+    while (!sp->abort) {
+        PrefetchJob *job = NULL;
+        int ret;
+
+        for (int i = 0; i < sp->nb_jobs; i++)
+            if (sp->jobs[i].state == PREFETCH_QUEUED &&
+                (!job || sp->jobs[i].seq_no < job->seq_no))
+                job = &sp->jobs[i];
+        if (!job) {
+            pthread_cond_wait(&sp->cond, &sp->mutex);
+            continue;
+        }
+
+        job->state = PREFETCH_RUNNING;
+        sp->nb_running++;
+        ret = download(w, job);
+        if (ret != AVERROR_EOF && w->pb) {
+            /* the connection is in an unknown state, do not reuse it */
+            pthread_mutex_unlock(&sp->mutex);
+            sp->close(sp->opaque, &w->pb);
+            pthread_mutex_lock(&sp->mutex);
+        }
+        if (ret < 0 && ret != AVERROR_EOF && ret != AVERROR_EXIT)
+            av_log(sp->logctx, AV_LOG_WARNING,
+                   "Failed to prefetch segment %"PRId64" '%s': %s\n",
+                   job->seq_no, job->url, av_err2str(ret));
+
+        sp->nb_running--;
+        if (job->abort) {
+            free_job(sp, job);
+        } else {
+            job->state = PREFETCH_DONE;
+            job->ret   = ret == AVERROR_EOF ? 0 : ret;
+        }
+        pthread_cond_broadcast(&sp->cond);
+    }
+    pthread_mutex_unlock(&sp->mutex);
+
+    if (w->pb)
+        sp->close(sp->opaque, &w->pb);
+    return NULL;
+}
+
+int ff_segment_prefetch_alloc(SegmentPrefetch **psp, void *logctx,
+                              int depth, int64_t max_size,
+                              SegmentPrefetchOpen open, SegmentPrefetchClose close,
+                              void *opaque)
+{
+    SegmentPrefetch *sp;
+    int ret;
+
+    *psp = NULL;
+    if (depth <= 0)
+        return AVERROR(EINVAL);
+
+    sp = av_mallocz(sizeof(*sp));
+    if (!sp)
+        return AVERROR(ENOMEM);
+    sp->logctx   = logctx;
+    sp->open     = open;
+    sp->close    = close;
+    sp->opaque   = opaque;
+    sp->max_size = max_size;
+
+    /* one more slot than workers for the segment being read */
+    sp->nb_jobs = depth + 1;
+    sp->jobs    = av_calloc(sp->nb_jobs, sizeof(*sp->jobs));
+    sp->workers = av_calloc(depth, sizeof(*sp->workers));
+    if (!sp->jobs || !sp->workers) {
+        av_freep(&sp->jobs);
+        av_freep(&sp->workers);
+        av_free(sp);
+        return AVERROR(ENOMEM);
+    }
+
+    if ((ret = pthread_mutex_init(&sp->mutex, NULL))) {
+        av_freep(&sp->jobs);
+        av_freep(&sp->workers);
+        av_free(sp);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&sp->cond, NULL))) {
+        pthread_mutex_destroy(&sp->mutex);
+        av_freep(&sp->jobs);
+        av_freep(&sp->workers);
+        av_free(sp);
+        return AVERROR(ret);
+    }
+
+    for (int i = 0; i < depth; i++) {
+        PrefetchWorker *w = &sp->workers[i];
+
+        w->sp = sp;
+        if ((ret = pthread_create(&w->thread, NULL, prefetch_worker, w))) {
+            ff_segment_prefetch_free(&sp);
+            return AVERROR(ret);
+        }
+        sp->nb_workers++;
+    }
+
+    *psp = sp;
+    return 0;
+}
+
+void ff_segment_prefetch_free(SegmentPrefetch **psp)
+{
+    SegmentPrefetch *sp = *psp;
+
+    if (!sp)
+        return;
+
+    pthread_mutex_lock(&sp->mutex);
+    sp->abort = 1;
+    pthread_cond_broadcast(&sp->cond);
+    pthread_mutex_unlock(&sp->mutex);
+
+    for (int i = 0; i < sp->nb_workers; i++)
+        pthread_join(sp->workers[i].thread, NULL);
+
+    for (int i = 0; i < sp->nb_jobs; i++)
+        free_job(sp, &sp->jobs[i]);
+    pthread_cond_destroy(&sp->cond);
+    pthread_mutex_destroy(&sp->mutex);
+    av_freep(&sp->jobs);
+    av_freep(&sp->workers);
+    av_freep(psp);
+}
+
+int ff_segment_prefetch_add(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                            int64_t url_offset, int64_t size,
+                            const AVDictionary *opts)
+{
+    PrefetchJob *job = NULL;
+
+    pthread_mutex_lock(&sp->mutex);
+    for (int i = 0; i < sp->nb_jobs; i++) {
+        if (sp->jobs[i].state != PREFETCH_FREE && !sp->jobs[i].abort &&
+            sp->jobs[i].seq_no == seq_no) {
+            pthread_mutex_unlock(&sp->mutex);
+            return 0;
+        }
+        if (!job && sp->jobs[i].state == PREFETCH_FREE)
+            job = &sp->jobs[i];
+    }
+    if (!job) {
+        pthread_mutex_unlock(&sp->mutex);
+        return AVERROR(EAGAIN);
+    }
+
+    job->url = av_strdup(url);
+    if (!job->url || av_dict_copy(&job->opts, opts, 0) < 0) {
+        free_job(sp, job);
+        pthread_mutex_unlock(&sp->mutex);
+        return AVERROR(ENOMEM);
+    }
+    job->seq_no     = seq_no;
+    job->url_offset = url_offset;
+    job->size       = size;
+    job->state      = PREFETCH_QUEUED;
+    pthread_cond_broadcast(&sp->cond);
+    pthread_mutex_unlock(&sp->mutex);
+
+    return 0;
+}
+
+int ff_segment_prefetch_open(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                             int64_t url_offset, int64_t size)
+{
+    PrefetchJob *job = NULL;
+
+    pthread_mutex_lock(&sp->mutex);
+    if (sp->cur) {
+        drop_job(sp, sp->cur);
+        sp->cur = NULL;
+    }
+    for (int i = 0; i < sp->nb_jobs; i++) {
+        PrefetchJob *j = &sp->jobs[i];
+
+        if (j->state == PREFETCH_FREE || j->abort || j->seq_no > seq_no)
+            continue;
+        /* the playlist may have changed since the segment was added */
+        if (j->seq_no == seq_no && !strcmp(j->url, url) &&
+            j->url_offset == url_offset && j->size == size)
+            job = j;
+        else
+            drop_job(sp, j);
+    }
+
+    /* Workers take the earliest queued segment, so a queued segment is
+     * about to be started if a worker is idle. Otherwise all of them are
+     * busy with later segments and it is read directly instead. */
+    if (job && job->state == PREFETCH_QUEUED) {
+        if (sp->nb_running < sp->nb_workers) {
+            while (job->state == PREFETCH_QUEUED)
+                pthread_cond_wait(&sp->cond, &sp->mutex);
+        } else {
+            drop_job(sp, job);
+            job = NULL;
+        }
+    }
+
+    if (job) {
+        job->current = 1;
+        pthread_cond_broadcast(&sp->cond);
+        while (job->state == PREFETCH_RUNNING && !job->data_len)
+            pthread_cond_wait(&sp->cond, &sp->mutex);
+        if (!job->data_len) {
+            drop_job(sp, job);
+            job = NULL;
+        }
+    }
+    sp->cur = job;
+    pthread_mutex_unlock(&sp->mutex);
+
+    return !!job;
+}
+
+const AVDictionary *ff_segment_prefetch_opts(SegmentPrefetch *sp)
+{
+    /* the worker does not touch them once data has been received, which
+     * ff_segment_prefetch_open() waited for with the mutex */
+    return sp->cur ? sp->cur->opts : NULL;
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *sp, uint8_t *buf, int buf_size)
+{
+    PrefetchJob *job = sp->cur;
+    int ret;
+
+    if (!job)
+        return AVERROR_EOF;
+
+    pthread_mutex_lock(&sp->mutex);
+    while (job->read_pos >= job->data_len && job->state == PREFETCH_RUNNING)
+        pthread_cond_wait(&sp->cond, &sp->mutex);
+    if (job->read_pos < job->data_len) {
+        ret = FFMIN(buf_size, job->data_len - job->read_pos);
+        memcpy(buf, job->buf + job->read_pos, ret);
+        job->read_pos += ret;
+    } else {
+        ret = job->ret < 0 ? job->ret : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&sp->mutex);
+
+    return ret;
+}
+
+int64_t ff_segment_prefetch_seek(SegmentPrefetch *sp, int64_t offset, int whence)
+{
+    PrefetchJob *job = sp->cur;
+    int64_t ret;
+
+    if (!job)
+        return AVERROR(EINVAL);
+    if (whence != SEEK_SET && whence != AVSEEK_SIZE)
+        return AVERROR(ENOSYS);
+
+    pthread_mutex_lock(&sp->mutex);
+    if (whence == AVSEEK_SIZE) {
+        if (job->size >= 0)
+            ret = job->size;
+        else if (job->state == PREFETCH_DONE && !job->ret)
+            ret = job->data_len;
+        else
+            ret = AVERROR(ENOSYS);
+    } else {
+        while (offset > job->data_len && job->state == PREFETCH_RUNNING)
+            pthread_cond_wait(&sp->cond, &sp->mutex);
+        if (offset < 0 || offset > job->data_len) {
+            ret = AVERROR(EINVAL);
+        } else {
+            job->read_pos = offset;
+            ret = offset;
+        }
+    }
+    pthread_mutex_unlock(&sp->mutex);
+
+    return ret;
+}
+
+void ff_segment_prefetch_close(SegmentPrefetch *sp)
+{
+    pthread_mutex_lock(&sp->mutex);
+    if (sp->cur)
+        drop_job(sp, sp->cur);
+    sp->cur = NULL;
+    pthread_mutex_unlock(&sp->mutex);
+}
+
+void ff_segment_prefetch_flush(SegmentPrefetch *sp)
+{
+    if (!sp)
+        return;
+
+    pthread_mutex_lock(&sp->mutex);
+    for (int i = 0; i < sp->nb_jobs; i++)
+        if (sp->jobs[i].state != PREFETCH_FREE)
+            drop_job(sp, &sp->jobs[i]);
+    sp->cur = NULL;
+    pthread_mutex_unlock(&sp->mutex);
+}
+
+#else
+
+int ff_segment_prefetch_alloc(SegmentPrefetch **psp, void *logctx,
+                              int depth, int64_t max_size,
+                              SegmentPrefetchOpen open, SegmentPrefetchClose close,
+                              void *opaque)
+{
+    *psp = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ff_segment_prefetch_free(SegmentPrefetch **psp)
+{
+}
+
+int ff_segment_prefetch_add(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                            int64_t url_offset, int64_t size,
+                            const AVDictionary *opts)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_segment_prefetch_open(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                             int64_t url_offset, int64_t size)
+{
+    return 0;
+}
+
+const AVDictionary *ff_segment_prefetch_opts(SegmentPrefetch *sp)
+{
+    return NULL;
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *sp, uint8_t *buf, int buf_size)
+{
+    return AVERROR_EOF;
+}
+
+int64_t ff_segment_prefetch_seek(SegmentPrefetch *sp, int64_t offset, int whence)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_segment_prefetch_close(SegmentPrefetch *sp)
+{
+}
+
+void ff_segment_prefetch_flush(SegmentPrefetch *sp)
+{
+}
+
+#endif /* HAVE_THREADS */
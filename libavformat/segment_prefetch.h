@@ -0,0 +1,133 @@
+/*
+ * Background download of upcoming media segments
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGMENT_PREFETCH_H
+#define AVFORMAT_SEGMENT_PREFETCH_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avio.h"
+
+/**
+ * Segment prefetcher used by the segmented streaming demuxers.
+ *
+ * Upcoming segments of a playlist are downloaded into memory by a pool of
+ * worker threads, while the demuxer reads the current one. Segments are
+ * identified by their sequence number and read back one at a time, so the
+ * data is returned in exactly the same order as when reading the segments
+ * directly.
+ */
+typedef struct SegmentPrefetch SegmentPrefetch;
+
+/**
+ * Open a segment. Called from a worker thread.
+ *
+ * @param pb   connection to open; it may still hold the connection used
+ *             for the previous segment downloaded by the same thread, which
+ *             the callback may reuse or must close
+ * @param size size of the segment, -1 if it extends to the end of the resource
+ * @param opts options captured when the segment was added
+ */
+typedef int (*SegmentPrefetchOpen)(void *opaque, AVIOContext **pb, const char *url,
+                                   int64_t url_offset, int64_t size,
+                                   AVDictionary **opts);
+
+/**
+ * Close a connection opened by SegmentPrefetchOpen. Called from a worker
+ * thread.
+ */
+typedef void (*SegmentPrefetchClose)(void *opaque, AVIOContext **pb);
+
+/**
+ * Allocate a prefetcher and start its worker threads.
+ *
+ * @param depth    number of segments downloaded ahead of the one being read
+ * @param max_size maximum number of bytes kept in memory for segments that
+ *                 are not being read yet
+ * @return 0 on success, AVERROR(ENOSYS) if threads are not available,
+ *         another negative AVERROR code on failure
+ */
+int ff_segment_prefetch_alloc(SegmentPrefetch **psp, void *logctx,
+                              int depth, int64_t max_size,
+                              SegmentPrefetchOpen open, SegmentPrefetchClose close,
+                              void *opaque);
+
+/**
+ * Stop the worker threads and free everything. *psp may be NULL.
+ */
+void ff_segment_prefetch_free(SegmentPrefetch **psp);
+
+/**
+ * Schedule the download of a segment. Does nothing if a segment with the
+ * same sequence number is already scheduled.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if depth segments are already
+ *         scheduled, another negative AVERROR code on failure
+ */
+int ff_segment_prefetch_add(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                            int64_t url_offset, int64_t size,
+                            const AVDictionary *opts);
+
+/**
+ * Start reading a segment from the prefetcher. Segments scheduled before
+ * seq_no are dropped. If the segment is not being downloaded, or if its
+ * download failed before any data was received, it is dropped too and the
+ * caller should open it directly.
+ *
+ * @return 1 if the segment is read from the prefetcher, 0 otherwise
+ */
+int ff_segment_prefetch_open(SegmentPrefetch *sp, int64_t seq_no, const char *url,
+                             int64_t url_offset, int64_t size);
+
+/**
+ * Get the options of the segment opened with ff_segment_prefetch_open(), as
+ * left by SegmentPrefetchOpen, e.g. with the cookies set by the server. They
+ * are valid until the segment is closed.
+ */
+const AVDictionary *ff_segment_prefetch_opts(SegmentPrefetch *sp);
+
+/**
+ * Read data of the segment opened with ff_segment_prefetch_open(), waiting
+ * for it to be downloaded if needed.
+ *
+ * @return number of bytes read, AVERROR_EOF at the end of the segment, or
+ *         the error that interrupted the download
+ */
+int ff_segment_prefetch_read(SegmentPrefetch *sp, uint8_t *buf, int buf_size);
+
+/**
+ * Seek in the segment opened with ff_segment_prefetch_open(). Offsets are
+ * relative to the start of the segment, only SEEK_SET and AVSEEK_SIZE are
+ * supported.
+ */
+int64_t ff_segment_prefetch_seek(SegmentPrefetch *sp, int64_t offset, int whence);
+
+/**
+ * Stop reading the segment opened with ff_segment_prefetch_open().
+ */
+void ff_segment_prefetch_close(SegmentPrefetch *sp);
+
+/**
+ * Drop all scheduled segments, e.g. after a seek. sp may be NULL.
+ */
+void ff_segment_prefetch_flush(SegmentPrefetch *sp);
+
+#endif /* AVFORMAT_SEGMENT_PREFETCH_H */
@@ -0,0 +1,122 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Checks that ff_add_index_entries() builds the same index as adding the
+ * entries one by one with av_add_index_entry().
+ */
+
+#include <stdio.h>
+
+#include "libavformat/avformat.h"
+#include "libavformat/demux.h"
+#include "libavformat/avformat_internal.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+
+#define MAX_ENTRIES 1000
+
+static AVIndexEntry random_entry(AVLFG *lfg, int range)
+{
+    AVIndexEntry e = { 0 };
+    unsigned r = av_lfg_get(lfg);
+
+    e.timestamp    = av_lfg_get(lfg) % range;
+    /* few distinct positions so that equal positions get folded */
+    e.pos          = av_lfg_get(lfg) % 4;
+    e.size         = av_lfg_get(lfg) % 1000;
+    e.min_distance = av_lfg_get(lfg) % 100;
+    e.flags        = r & 1 ? AVINDEX_KEYFRAME : 0;
+    if (!(r % 97))
+        e.timestamp = AV_NOPTS_VALUE;
+    else if (!(r % 89))
+        e.timestamp += RELATIVE_TS_BASE;
+    /* invalid sizes must be rejected */
+    if (!(r % 83))
+        e.size = -1;
+    return e;
+}
+
+static int compare_index(AVStream *a, AVStream *b)
+{
+    int nb_entries = avformat_index_get_entries_count(a);
+
+    if (nb_entries != avformat_index_get_entries_count(b))
+        return 1;
+    for (int i = 0; i < nb_entries; i++) {
+        const AVIndexEntry *e1 = avformat_index_get_entry(a, i);
+        const AVIndexEntry *e2 = avformat_index_get_entry(b, i);
+
+        if (e1->pos != e2->pos || e1->timestamp != e2->timestamp ||
+            e1->size != e2->size || e1->flags != e2->flags ||
+            e1->min_distance != e2->min_distance)
+            return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    AVIndexEntry *entries = av_malloc_array(MAX_ENTRIES, sizeof(*entries));
+    AVLFG lfg;
+    int ret = 0;
+
+    if (!entries)
+        return 1;
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    for (int test = 0; test < 200 && !ret; test++) {
+        AVFormatContext *s = avformat_alloc_context();
+        AVStream *ref, *st;
+        int range      = 1 + av_lfg_get(&lfg) % 2000;
+        int nb_initial = av_lfg_get(&lfg) % MAX_ENTRIES;
+        int nb_batch   = av_lfg_get(&lfg) % MAX_ENTRIES;
+
+        if (!s || !(ref = avformat_new_stream(s, NULL)) ||
+            !(st = avformat_new_stream(s, NULL))) {
+            avformat_free_context(s);
+            ret = 1;
+            break;
+        }
+
+        /* build the same starting index in both streams */
+        for (int i = 0; i < nb_initial; i++) {
+            AVIndexEntry e = random_entry(&lfg, range);
+            av_add_index_entry(ref, e.pos, e.timestamp, e.size, e.min_distance, e.flags);
+            av_add_index_entry(st,  e.pos, e.timestamp, e.size, e.min_distance, e.flags);
+        }
+
+        for (int i = 0; i < nb_batch; i++)
+            entries[i] = random_entry(&lfg, range);
+        for (int i = 0; i < nb_batch; i++)
+            av_add_index_entry(ref, entries[i].pos, entries[i].timestamp,
+                               entries[i].size, entries[i].min_distance,
+                               entries[i].flags);
+        if (ff_add_index_entries(st, entries, nb_batch) < 0 ||
+            compare_index(ref, st)) {
+            printf("Mismatch in test %d (%d + %d entries)\n",
+                   test, nb_initial, nb_batch);
+            ret = 1;
+        }
+
+        avformat_free_context(s);
+    }
+
+    av_free(entries);
+    return ret;
+}
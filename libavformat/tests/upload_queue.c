@@ -0,0 +1,124 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Drives the upload queue with segments that take longer to upload than
+ * they take to produce, the way a live stream on a slow output does. Every
+ * version of the playlist must be published, each after all the segments
+ * it references.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avio.h"
+#include "libavformat/upload_queue.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define NB_SEGMENTS 8
+
+static AVMutex log_lock = AV_MUTEX_INITIALIZER;
+static int segments_done;
+static int errors;
+
+static int test_open(void *opaque, AVIOContext **pb, const char *url,
+                     AVDictionary **opts)
+{
+    if (*pb) {
+        uint8_t *buf;
+        avio_close_dyn_buf(*pb, &buf);
+        av_free(buf);
+        *pb = NULL;
+    }
+    return avio_open_dyn_buf(pb);
+}
+
+static int test_close(void *opaque, AVIOContext **pb, const char *url)
+{
+    uint8_t *buf;
+    int size = avio_close_dyn_buf(*pb, &buf);
+    int version;
+
+    *pb = NULL;
+    if (!url) {
+        av_free(buf);
+        return 0;
+    }
+
+    if (!strncmp(url, "segment", 7)) {
+        /* slower than the muxer, which adds one segment per iteration */
+        av_usleep(20000);
+        ff_mutex_lock(&log_lock);
+        segments_done++;
+        ff_mutex_unlock(&log_lock);
+    } else if (size > 0 && sscanf(buf, "version %d", &version) == 1) {
+        ff_mutex_lock(&log_lock);
+        /* the playlist version N references the segments 1 to N */
+        if (segments_done < version) {
+            printf("playlist version %d published with %d segments done\n",
+                   version, segments_done);
+            errors++;
+        }
+        ff_mutex_unlock(&log_lock);
+        printf("playlist version %d\n", version);
+    }
+    av_free(buf);
+    return 0;
+}
+
+int main(void)
+{
+    UploadQueue *q;
+    int ret;
+
+    ret = ff_upload_queue_alloc(&q, NULL, 4, 0, test_open, test_close, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to allocate the upload queue\n");
+        return 1;
+    }
+
+    for (int i = 1; i <= NB_SEGMENTS; i++) {
+        char url[32], content[32];
+        uint8_t *data;
+
+        snprintf(url, sizeof(url), "segment%d.ts", i);
+        if (!(data = av_strdup(url)) ||
+            ff_upload_queue_add(q, url, NULL, NULL, &data, strlen(url), 0) < 0)
+            goto fail;
+
+        snprintf(content, sizeof(content), "version %d", i);
+        if (!(data = av_strdup(content)) ||
+            ff_upload_queue_add(q, "playlist.m3u8", NULL, NULL, &data,
+                                strlen(content), FF_UPLOAD_QUEUE_BARRIER) < 0)
+            goto fail;
+        av_usleep(5000);
+    }
+
+    ret = ff_upload_queue_flush(q);
+    ff_upload_queue_free(&q);
+    if (ret < 0 || errors)
+        return 1;
+    return 0;
+
+fail:
+    fprintf(stderr, "Failed to queue an upload\n");
+    ff_upload_queue_free(&q);
+    return 1;
+}
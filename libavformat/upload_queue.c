@@ -0,0 +1,400 @@
+/*
+ * Background upload of media segments and playlists
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "internal.h"
+#include "upload_queue.h"
+
+#if HAVE_THREADS
+
+enum UploadState {
+    UPLOAD_FREE,
+    UPLOAD_QUEUED,
+    UPLOAD_RUNNING,
+};
+
+typedef struct UploadJob {
+    enum UploadState state;
+    int64_t id;
+    int flags;
+    char *url;
+    char *final_url;
+    AVDictionary *opts;
+    uint8_t *data;
+    int size;
+} UploadJob;
+
+typedef struct UploadWorker {
+    UploadQueue *q;
+    pthread_t thread;
+    AVIOContext *pb;
+} UploadWorker;
+
+struct UploadQueue {
+    void *logctx;
+    UploadQueueOpen open;
+    UploadQueueClose close;
+    void *opaque;
+    int max_retry;
+
+    UploadJob *jobs;
+    int nb_jobs;
+    int64_t last_id;
+    int error;
+
+    UploadWorker *workers;
+    int nb_workers;
+
+    int abort;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void free_job(UploadJob *job)
+{
+    av_freep(&job->url);
+    av_freep(&job->final_url);
+    av_freep(&job->data);
+    av_dict_free(&job->opts);
+    memset(job, 0, sizeof(*job));
+}
+
+/* Called with the mutex locked. */
+static UploadJob *next_job(UploadQueue *q)
+{
+    UploadJob *job = NULL;
+    int64_t first_id = INT64_MAX;
+
+    for (int i = 0; i < q->nb_jobs; i++)
+        if (q->jobs[i].state != UPLOAD_FREE)
+            first_id = FFMIN(first_id, q->jobs[i].id);
+
+    for (int i = 0; i < q->nb_jobs; i++) {
+        UploadJob *j = &q->jobs[i];
+
+        if (j->state != UPLOAD_QUEUED ||
+            (j->flags & FF_UPLOAD_QUEUE_BARRIER && j->id != first_id))
+            continue;
+        if (!job || j->id < job->id)
+            job = j;
+    }
+    return job;
+}
+
+static int upload(UploadWorker *w, const UploadJob *job)
+{
+    UploadQueue *q = w->q;
+    int ret;
+
+    for (int attempt = 0;; attempt++) {
+        AVDictionary *opts = NULL;
+
+        ret = av_dict_copy(&opts, job->opts, 0);
+        if (ret >= 0)
+            ret = q->open(q->opaque, &w->pb, job->url, &opts);
+        av_dict_free(&opts);
+        if (ret >= 0) {
+            int ret2;
+
+            avio_write(w->pb, job->data, job->size);
+            avio_flush(w->pb);
+            ret  = w->pb->error;
+            ret2 = q->close(q->opaque, &w->pb, job->url);
+            if (ret >= 0)
+                ret = ret2;
+        }
+        if (ret >= 0)
+            break;
+
+        /* the connection is in an unknown state, do not reuse it */
+        if (w->pb)
+            q->close(q->opaque, &w->pb, NULL);
+        if (ret == AVERROR(ENOMEM) || attempt >= q->max_retry) {
+            av_log(q->logctx, AV_LOG_ERROR, "Failed to upload '%s': %s\n",
+                   job->url, av_err2str(ret));
+            return ret;
+        }
+        av_log(q->logctx, AV_LOG_WARNING, "Failed to upload '%s': %s, retrying\n",
+               job->url, av_err2str(ret));
+    }
+
+    if (job->final_url)
+        ret = ff_rename(job->url, job->final_url, q->logctx);
+    return ret;
+}
+
+static void *upload_worker(void *arg)
+{
+    UploadWorker *w = arg;
+    UploadQueue *q  = w->q;
+
+    pthread_mutex_lock(&q->mutex);
+    while (!q->abort) {
+        UploadJob *job = next_job(q);
+        int ret;
+
+        if (!job) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+            continue;
+        }
+
+        /* the job is not modified by the other threads while running */
+        job->state = UPLOAD_RUNNING;
+        pthread_mutex_unlock(&q->mutex);
+        ret = upload(w, job);
+        pthread_mutex_lock(&q->mutex);
+
+        if (ret < 0 && !q->error)
+            q->error = ret;
+        free_job(job);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    if (w->pb)
+        q->close(q->opaque, &w->pb, NULL);
+    return NULL;
+}
+
+int ff_upload_queue_alloc(UploadQueue **pq, void *logctx,
+                          int max_uploads, int max_retry,
+                          UploadQueueOpen open, UploadQueueClose close,
+                          void *opaque)
+{
+    UploadQueue *q;
+    int ret;
+
+    *pq = NULL;
+    if (max_uploads <= 0)
+        return AVERROR(EINVAL);
+
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->logctx    = logctx;
+    q->open      = open;
+    q->close     = close;
+    q->opaque    = opaque;
+    q->max_retry = max_retry;
+
+    q->nb_jobs = max_uploads;
+    q->jobs    = av_calloc(max_uploads, sizeof(*q->jobs));
+    q->workers = av_calloc(max_uploads, sizeof(*q->workers));
+    if (!q->jobs || !q->workers) {
+        av_freep(&q->jobs);
+        av_freep(&q->workers);
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+
+    if ((ret = pthread_mutex_init(&q->mutex, NULL))) {
+        av_freep(&q->jobs);
+        av_freep(&q->workers);
+        av_free(q);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&q->cond, NULL))) {
+        pthread_mutex_destroy(&q->mutex);
+        av_freep(&q->jobs);
+        av_freep(&q->workers);
+        av_free(q);
+        return AVERROR(ret);
+    }
+
+    for (int i = 0; i < max_uploads; i++) {
+        UploadWorker *w = &q->workers[i];
+
+        w->q = q;
+        if ((ret = pthread_create(&w->thread, NULL, upload_worker, w))) {
+            ff_upload_queue_free(&q);
+            return AVERROR(ret);
+        }
+        q->nb_workers++;
+    }
+    av_log(logctx, AV_LOG_VERBOSE, "Uploading in the background with %d threads\n",
+           q->nb_workers);
+
+    *pq = q;
+    return 0;
+}
+
+void ff_upload_queue_free(UploadQueue **pq)
+{
+    UploadQueue *q = *pq;
+
+    if (!q)
+        return;
+
+    pthread_mutex_lock(&q->mutex);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    for (int i = 0; i < q->nb_workers; i++)
+        pthread_join(q->workers[i].thread, NULL);
+
+    for (int i = 0; i < q->nb_jobs; i++)
+        free_job(&q->jobs[i]);
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+    av_freep(&q->jobs);
+    av_freep(&q->workers);
+    av_freep(pq);
+}
+
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, const char *final_url,
+                            const AVDictionary *opts, uint8_t **data, int size,
+                            int flags)
+{
+    UploadJob *job;
+    int64_t id;
+
+    pthread_mutex_lock(&q->mutex);
+    while (1) {
+        job = NULL;
+        for (int i = 0; i < q->nb_jobs && !job; i++)
+            if (q->jobs[i].state == UPLOAD_FREE)
+                job = &q->jobs[i];
+        if (job)
+            break;
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+
+    job->url = av_strdup(url);
+    if (final_url)
+        job->final_url = av_strdup(final_url);
+    if (!job->url || (final_url && !job->final_url) ||
+        av_dict_copy(&job->opts, opts, 0) < 0) {
+        free_job(job);
+        pthread_mutex_unlock(&q->mutex);
+        return AVERROR(ENOMEM);
+    }
+    job->data  = *data;
+    job->size  = size;
+    job->flags = flags;
+    job->id    = id = ++q->last_id;
+    job->state = UPLOAD_QUEUED;
+    *data = NULL;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return id;
+}
+
+void ff_upload_queue_wait(UploadQueue *q, int64_t id)
+{
+    int pending = 1;
+
+    if (!q || id <= 0)
+        return;
+
+    pthread_mutex_lock(&q->mutex);
+    while (pending) {
+        pending = 0;
+        for (int i = 0; i < q->nb_jobs; i++)
+            if (q->jobs[i].state != UPLOAD_FREE && q->jobs[i].id == id)
+                pending = 1;
+        if (pending)
+            pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+int ff_upload_queue_flush(UploadQueue *q)
+{
+    int pending = 1;
+
+    if (!q)
+        return 0;
+
+    pthread_mutex_lock(&q->mutex);
+    while (pending) {
+        pending = 0;
+        for (int i = 0; i < q->nb_jobs; i++)
+            if (q->jobs[i].state != UPLOAD_FREE)
+                pending = 1;
+        if (pending)
+            pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return ff_upload_queue_error(q);
+}
+
+int ff_upload_queue_error(UploadQueue *q)
+{
+    int ret;
+
+    if (!q)
+        return 0;
+
+    pthread_mutex_lock(&q->mutex);
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->mutex);
+
+    return ret;
+}
+
+#else
+
+int ff_upload_queue_alloc(UploadQueue **pq, void *logctx,
+                          int max_uploads, int max_retry,
+                          UploadQueueOpen open, UploadQueueClose close,
+                          void *opaque)
+{
+    *pq = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_queue_free(UploadQueue **pq)
+{
+}
+
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, const char *final_url,
+                            const AVDictionary *opts, uint8_t **data, int size,
+                            int flags)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_queue_wait(UploadQueue *q, int64_t id)
+{
+}
+
+int ff_upload_queue_flush(UploadQueue *q)
+{
+    return 0;
+}
+
+int ff_upload_queue_error(UploadQueue *q)
+{
+    return 0;
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,120 @@
+/*
+ * Background upload of media segments and playlists
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_UPLOAD_QUEUE_H
+#define AVFORMAT_UPLOAD_QUEUE_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avio.h"
+
+/**
+ * Upload queue used by the segmenting muxers.
+ *
+ * Files are built in memory by the muxer and written out by a pool of
+ * worker threads, so that a slow output does not block the muxer until
+ * the queue is full.
+ */
+typedef struct UploadQueue UploadQueue;
+
+/**
+ * Open a file for writing. Called from a worker thread.
+ *
+ * @param pb   connection to open; it may still hold the connection used
+ *             for the previous upload of the same thread, which the
+ *             callback may reuse or must close
+ * @param opts options given when the upload was added
+ */
+typedef int (*UploadQueueOpen)(void *opaque, AVIOContext **pb, const char *url,
+                               AVDictionary **opts);
+
+/**
+ * Finish writing a file opened by UploadQueueOpen. The connection may be
+ * kept in *pb for the next upload, unless url is NULL, in which case it
+ * must be closed. Called from a worker thread.
+ */
+typedef int (*UploadQueueClose)(void *opaque, AVIOContext **pb, const char *url);
+
+/**
+ * The upload is started only once all the uploads added before it are
+ * completed. This is meant for playlists, which must not reference
+ * segments that are not available yet. Barrier uploads are never merged,
+ * each version of a playlist is published in order; when the uploads are
+ * slower than real time, ff_upload_queue_add() blocks instead.
+ */
+#define FF_UPLOAD_QUEUE_BARRIER (1 << 0)
+
+/**
+ * Allocate an upload queue and start its worker threads.
+ *
+ * @param max_uploads maximum number of uploads queued or in progress,
+ *                    ff_upload_queue_add() blocks when it is reached
+ * @param max_retry   number of times a failed upload is retried
+ * @return 0 on success, AVERROR(ENOSYS) if threads are not available,
+ *         another negative AVERROR code on failure
+ */
+int ff_upload_queue_alloc(UploadQueue **pq, void *logctx,
+                          int max_uploads, int max_retry,
+                          UploadQueueOpen open, UploadQueueClose close,
+                          void *opaque);
+
+/**
+ * Stop the worker threads and free everything. Uploads that have not
+ * started yet are dropped, call ff_upload_queue_flush() first to complete
+ * them. *pq may be NULL.
+ */
+void ff_upload_queue_free(UploadQueue **pq);
+
+/**
+ * Queue the upload of a file.
+ *
+ * @param final_url if not NULL, the file is renamed from url to final_url
+ *                  once written
+ * @param data      file content; on success the queue takes ownership of
+ *                  it and sets *data to NULL
+ * @param flags     a combination of FF_UPLOAD_QUEUE_* flags
+ * @return a positive identifier of the upload for ff_upload_queue_wait(),
+ *         or a negative AVERROR code on failure
+ */
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, const char *final_url,
+                            const AVDictionary *opts, uint8_t **data, int size,
+                            int flags);
+
+/**
+ * Wait until an upload is completed, e.g. before deleting the file.
+ * Does nothing if q is NULL or id is not positive.
+ */
+void ff_upload_queue_wait(UploadQueue *q, int64_t id);
+
+/**
+ * Wait until all the queued uploads are completed.
+ *
+ * @return same as ff_upload_queue_error()
+ */
+int ff_upload_queue_flush(UploadQueue *q);
+
+/**
+ * @return the error of the first upload that failed since the last call,
+ *         0 if none did or if q is NULL
+ */
+int ff_upload_queue_error(UploadQueue *q);
+
+#endif /* AVFORMAT_UPLOAD_QUEUE_H */
@@ -24,6 +24,7 @@
 
 #include "mem.h"
 #include "thread.h"
+#include "workpool_internal.h"
 
 #include "executor.h"
 
@@ -46,12 +47,17 @@
 typedef struct ThreadInfo {
     AVExecutor *e;
     ExecutorThread thread;
+
+    // used instead of the thread on a shared pool
+    FFWorkPoolTask pool_task;
+    int active;
 } ThreadInfo;
 
 struct AVExecutor {
     AVTaskCallbacks cb;
     int thread_count;
     bool recursive;
+    AVWorkPool *pool;
 
     ThreadInfo *threads;
     uint8_t *local_contexts;
@@ -116,9 +122,60 @@ static void *executor_worker_task(void *data)
 }
 #endif
 
+// runs the ready tasks on a pool worker, then gives the worker back
+static void executor_pool_task(void *data)
+{
+    ThreadInfo *ti = data;
+    AVExecutor *e  = ti->e;
+    void *lc       = e->local_contexts + (ti - e->threads) * e->cb.local_context_size;
+
+    ff_mutex_lock(&e->lock);
+    while (!e->die && run_one_task(e, lc))
+        /* nothing */;
+    ti->active = 0;
+    if (e->die)
+        ff_cond_broadcast(&e->cond);
+    ff_mutex_unlock(&e->lock);
+}
+
+static void executor_pool_wake(AVExecutor *e)
+{
+    for (int i = 0; i < e->thread_count; i++) {
+        ThreadInfo *ti = e->threads + i;
+        if (!ti->active) {
+            ti->active = 1;
+            ff_workpool_submit(e->pool, &ti->pool_task);
+            return;
+        }
+    }
+}
+
+static void executor_pool_stop(AVExecutor *e)
+{
+    int active;
+
+    ff_mutex_lock(&e->lock);
+    e->die = 1;
+    do {
+        active = 0;
+        for (int i = 0; i < e->thread_count; i++) {
+            ThreadInfo *ti = e->threads + i;
+            if (ti->active && ff_workpool_cancel(e->pool, &ti->pool_task))
+                ti->active = 0;
+            active |= ti->active;
+        }
+        if (active)
+            ff_cond_wait(&e->cond, &e->lock);
+    } while (active);
+    ff_mutex_unlock(&e->lock);
+}
+
 static void executor_free(AVExecutor *e, const int has_lock, const int has_cond)
 {
-    if (e->thread_count) {
+    if (e->pool) {
+        if (has_lock && has_cond)
+            executor_pool_stop(e);
+    } else if (e->thread_count) {
         //signal die
         ff_mutex_lock(&e->lock);
         e->die = 1;
@@ -168,6 +225,18 @@ AVExecutor* av_executor_alloc(const AVTaskCallbacks *cb, int thread_count)
     if (!has_lock || !has_cond)
         goto free_executor;
 
+    e->pool = HAVE_THREADS ? av_workpool_get_default() : NULL;
+    if (e->pool) {
+        for (int i = 0; i < thread_count; i++) {
+            ThreadInfo *ti = e->threads + i;
+            ti->e                = e;
+            ti->pool_task.run    = executor_pool_task;
+            ti->pool_task.opaque = ti;
+        }
+        e->thread_count = thread_count;
+        return e;
+    }
+
     for (/* nothing */; e->thread_count < thread_count; e->thread_count++) {
         ThreadInfo *ti = e->threads + e->thread_count;
         ti->e = e;
@@ -205,7 +274,10 @@ void av_executor_execute(AVExecutor *e, AVTask *t)
         add_task(prev, t);
     }
     if (e->thread_count) {
-        ff_cond_signal(&e->cond);
+        if (e->pool)
+            executor_pool_wake(e);
+        else
+            ff_cond_signal(&e->cond);
         ff_mutex_unlock(&e->lock);
     }
 
@@ -23,6 +23,7 @@
 #include "mem.h"
 #include "thread.h"
 #include "avassert.h"
+#include "workpool_internal.h"
 
 #define MAX_AUTO_THREADS 16
 
@@ -38,6 +39,9 @@ typedef struct WorkerContext {
 
 struct AVSliceThread {
     WorkerContext   *workers;
+    AVWorkPool      *pool;
+    FFWorkPoolTask  *pool_tasks;
+    int             nb_pool_tasks;
     int             nb_threads;
     int             nb_active_threads;
     int             nb_jobs;
@@ -68,6 +72,62 @@ static int run_jobs(AVSliceThread *ctx)
     return current_job == nb_jobs + nb_active_threads - 1;
 }
 
+/*
+ * On a shared pool the helper tasks may start late or never, so jobs are
+ * claimed from a single counter and the thread numbers are handed out as
+ * the helpers arrive. The calling thread always takes part.
+ */
+static void run_pool_jobs(AVSliceThread *ctx)
+{
+    unsigned nb_jobs  = ctx->nb_jobs;
+    unsigned nb_active_threads = ctx->nb_active_threads;
+    unsigned threadnr = atomic_fetch_add_explicit(&ctx->first_job, 1, memory_order_acq_rel);
+    unsigned jobnr;
+
+    if (threadnr >= nb_active_threads)
+        return;
+
+    while ((jobnr = atomic_fetch_add_explicit(&ctx->current_job, 1, memory_order_acq_rel)) < nb_jobs)
+        ctx->worker_func(ctx->priv, jobnr, threadnr, nb_jobs, nb_active_threads);
+}
+
+static void pool_worker(void *v)
+{
+    AVSliceThread *ctx = v;
+
+    run_pool_jobs(ctx);
+
+    pthread_mutex_lock(&ctx->done_mutex);
+    if (!--ctx->nb_pool_tasks)
+        pthread_cond_signal(&ctx->done_cond);
+    pthread_mutex_unlock(&ctx->done_mutex);
+}
+
+static void pool_execute(AVSliceThread *ctx)
+{
+    const int nb_tasks = ctx->nb_active_threads - 1;
+    int cancelled = 0;
+
+    atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
+    atomic_store_explicit(&ctx->current_job, 0, memory_order_relaxed);
+    ctx->nb_pool_tasks = nb_tasks;
+
+    for (int i = 0; i < nb_tasks; i++)
+        ff_workpool_submit(ctx->pool, &ctx->pool_tasks[i]);
+
+    run_pool_jobs(ctx);
+
+    // all jobs are claimed, the helpers still queued have nothing left to do
+    for (int i = 0; i < nb_tasks; i++)
+        cancelled += ff_workpool_cancel(ctx->pool, &ctx->pool_tasks[i]);
+
+    pthread_mutex_lock(&ctx->done_mutex);
+    ctx->nb_pool_tasks -= cancelled;
+    while (ctx->nb_pool_tasks)
+        pthread_cond_wait(&ctx->done_cond, &ctx->done_mutex);
+    pthread_mutex_unlock(&ctx->done_mutex);
+}
+
 static void *attribute_align_arg thread_worker(void *v)
 {
     WorkerContext *w = v;
@@ -122,7 +182,20 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     if (!ctx)
         return AVERROR(ENOMEM);
 
-    if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
+    // a main function may wait on the jobs, keep dedicated threads for it
+    if (!main_func && nb_workers)
+        ctx->pool = av_workpool_get_default();
+
+    if (ctx->pool) {
+        if (!(ctx->pool_tasks = av_calloc(nb_workers, sizeof(*ctx->pool_tasks)))) {
+            av_freep(pctx);
+            return AVERROR(ENOMEM);
+        }
+        for (i = 0; i < nb_workers; i++) {
+            ctx->pool_tasks[i].run    = pool_worker;
+            ctx->pool_tasks[i].opaque = ctx;
+        }
+    } else if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
         av_freep(pctx);
         return AVERROR(ENOMEM);
     }
@@ -139,6 +212,7 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     atomic_init(&ctx->current_job, 0);
     ret = pthread_mutex_init(&ctx->done_mutex, NULL);
     if (ret) {
+        av_freep(&ctx->pool_tasks);
         av_freep(&ctx->workers);
         av_freep(pctx);
         return AVERROR(ret);
@@ -151,6 +225,9 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     }
     ctx->done        = 0;
 
+    if (ctx->pool)
+        return nb_threads;
+
     for (i = 0; i < nb_workers; i++) {
         WorkerContext *w = &ctx->workers[i];
         int ret;
@@ -195,6 +272,10 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     av_assert0(nb_jobs > 0);
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
+    if (ctx->pool) {
+        pool_execute(ctx);
+        return;
+    }
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
     atomic_store_explicit(&ctx->current_job, ctx->nb_active_threads, memory_order_relaxed);
     nb_workers             = ctx->nb_active_threads;
@@ -231,8 +312,8 @@ av_cold void avpriv_slicethread_free(AVSliceThread **pctx)
     if (!ctx)
         return;
 
-    nb_workers = ctx->nb_threads;
-    if (!ctx->main_func)
+    nb_workers = ctx->pool ? 0 : ctx->nb_threads;
+    if (!ctx->main_func && nb_workers)
         nb_workers--;
 
     ctx->finished = 1;
@@ -253,6 +334,7 @@ av_cold void avpriv_slicethread_free(AVSliceThread **pctx)
 
     pthread_cond_destroy(&ctx->done_cond);
     pthread_mutex_destroy(&ctx->done_mutex);
+    av_freep(&ctx->pool_tasks);
     av_freep(&ctx->workers);
     av_freep(pctx);
 }
@@ -0,0 +1,190 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "libavutil/executor.h"
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+#include "libavutil/workpool.h"
+
+#define NB_CONTEXTS 4
+#define NB_JOBS     37
+#define NB_THREADS  5
+#define NB_RUNS     200
+#define NB_TASKS    1000
+
+typedef struct SliceTest {
+    pthread_t      thread;
+    AVSliceThread *slicethread;
+    atomic_int     runs[NB_JOBS];
+    atomic_int     bad_threadnr;
+    int            ret;
+} SliceTest;
+
+static void slice_worker(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    SliceTest *t = priv;
+
+    if (threadnr < 0 || threadnr >= nb_threads || nb_threads > NB_THREADS)
+        atomic_store(&t->bad_threadnr, 1);
+    atomic_fetch_add(&t->runs[jobnr], 1);
+}
+
+// several contexts sharing the pool from their own threads
+static void *slice_thread(void *arg)
+{
+    SliceTest *t = arg;
+
+    for (int run = 0; run < NB_RUNS; run++) {
+        const int nb_jobs = 1 + run % NB_JOBS;
+
+        for (int i = 0; i < NB_JOBS; i++)
+            atomic_store(&t->runs[i], 0);
+
+        avpriv_slicethread_execute(t->slicethread, nb_jobs, 0);
+
+        for (int i = 0; i < NB_JOBS; i++) {
+            if (atomic_load(&t->runs[i]) != (i < nb_jobs)) {
+                t->ret = 1;
+                return NULL;
+            }
+        }
+    }
+    t->ret = atomic_load(&t->bad_threadnr);
+    return NULL;
+}
+
+static int test_slicethread(void)
+{
+    SliceTest tests[NB_CONTEXTS] = { 0 };
+    int nb_started = 0, ret = 0;
+
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        SliceTest *t = &tests[i];
+        int nb_threads = avpriv_slicethread_create(&t->slicethread, t, slice_worker,
+                                                   NULL, NB_THREADS);
+        if (nb_threads != NB_THREADS) {
+            fprintf(stderr, "slicethread_create failed: %d\n", nb_threads);
+            ret = 1;
+            goto end;
+        }
+    }
+
+    for (; nb_started < NB_CONTEXTS; nb_started++)
+        if (pthread_create(&tests[nb_started].thread, NULL, slice_thread, &tests[nb_started]))
+            break;
+
+    for (int i = 0; i < nb_started; i++) {
+        pthread_join(tests[i].thread, NULL);
+        if (tests[i].ret) {
+            fprintf(stderr, "slicethread %d: wrong jobs run\n", i);
+            ret = 1;
+        }
+    }
+    if (nb_started < NB_CONTEXTS)
+        ret = 1;
+
+end:
+    for (int i = 0; i < NB_CONTEXTS; i++)
+        avpriv_slicethread_free(&tests[i].slicethread);
+
+    return ret;
+}
+
+typedef struct ExecutorTest {
+    AVTask     tasks[NB_TASKS];
+    AVMutex    lock;
+    AVCond     cond;
+    int        done;
+} ExecutorTest;
+
+static int task_priority_higher(const AVTask *a, const AVTask *b)
+{
+    return a < b;
+}
+
+static int task_ready(const AVTask *t, void *user_data)
+{
+    return 1;
+}
+
+static int task_run(AVTask *t, void *local_context, void *user_data)
+{
+    ExecutorTest *et = user_data;
+
+    ff_mutex_lock(&et->lock);
+    if (++et->done == NB_TASKS)
+        ff_cond_signal(&et->cond);
+    ff_mutex_unlock(&et->lock);
+    return 0;
+}
+
+static int test_executor(void)
+{
+    static ExecutorTest et;
+    AVTaskCallbacks cb = {
+        .user_data          = &et,
+        .local_context_size = 16,
+        .priority_higher    = task_priority_higher,
+        .ready              = task_ready,
+        .run                = task_run,
+    };
+    AVExecutor *e;
+
+    ff_mutex_init(&et.lock, NULL);
+    ff_cond_init(&et.cond, NULL);
+
+    e = av_executor_alloc(&cb, NB_THREADS);
+    if (!e)
+        return 1;
+
+    for (int i = 0; i < NB_TASKS; i++)
+        av_executor_execute(e, &et.tasks[i]);
+
+    ff_mutex_lock(&et.lock);
+    while (et.done < NB_TASKS)
+        ff_cond_wait(&et.cond, &et.lock);
+    ff_mutex_unlock(&et.lock);
+
+    av_executor_free(&e);
+    ff_cond_destroy(&et.cond);
+    ff_mutex_destroy(&et.lock);
+    return 0;
+}
+
+int main(void)
+{
+    AVWorkPool *pool = av_workpool_alloc(3);
+    int ret;
+
+    if (!pool) {
+        fprintf(stderr, "workpool_alloc failed\n");
+        return 1;
+    }
+    av_workpool_set_default(pool);
+
+    ret = test_slicethread();
+    if (!ret)
+        ret = test_executor();
+
+    av_workpool_set_default(NULL);
+    av_workpool_free(&pool);
+    return ret;
+}
@@ -0,0 +1,314 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+
+#include "config.h"
+
+#include "avassert.h"
+#include "cpu.h"
+#include "internal.h"
+#include "mem.h"
+#include "thread.h"
+#include "workpool.h"
+#include "workpool_internal.h"
+
+static AVMutex default_lock = AV_MUTEX_INITIALIZER;
+static AVWorkPool *default_pool;
+
+#if HAVE_THREADS
+
+/*
+ * Every worker owns a queue. Submitted tasks are spread over the queues
+ * round robin, a worker takes the oldest task of its own queue and, when
+ * that is empty, steals the newest task of the other queues.
+ */
+typedef struct WorkQueue {
+    AVMutex         lock;
+    FFWorkPoolTask *head;
+    FFWorkPoolTask *tail;
+} WorkQueue;
+
+typedef struct PoolWorker {
+    AVWorkPool *pool;
+    pthread_t   thread;
+    WorkQueue   queue;
+} PoolWorker;
+
+struct AVWorkPool {
+    PoolWorker     *workers;
+    int             nb_workers;
+
+    atomic_uint     next_queue;
+    atomic_int      nb_queued;
+
+    AVMutex         lock;
+    AVCond          cond;
+    int             nb_sleeping;
+    int             die;
+};
+
+static void queue_unlink(WorkQueue *q, FFWorkPoolTask *t)
+{
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        q->head = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    else
+        q->tail = t->prev;
+    t->prev = t->next = NULL;
+    t->queued = 0;
+}
+
+static FFWorkPoolTask *get_task(AVWorkPool *pool, int self)
+{
+    for (int i = 0; i < pool->nb_workers; i++) {
+        WorkQueue *q = &pool->workers[(self + i) % pool->nb_workers].queue;
+        FFWorkPoolTask *t;
+
+        ff_mutex_lock(&q->lock);
+        t = i ? q->tail : q->head;
+        if (t)
+            queue_unlink(q, t);
+        ff_mutex_unlock(&q->lock);
+
+        if (t) {
+            atomic_fetch_sub_explicit(&pool->nb_queued, 1, memory_order_relaxed);
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void *attribute_align_arg worker_thread(void *arg)
+{
+    PoolWorker *w     = arg;
+    AVWorkPool *pool  = w->pool;
+    const int self    = w - pool->workers;
+
+    while (1) {
+        FFWorkPoolTask *t = NULL;
+
+        if (atomic_load_explicit(&pool->nb_queued, memory_order_relaxed) > 0)
+            t = get_task(pool, self);
+        if (t) {
+            t->run(t->opaque);
+            continue;
+        }
+
+        ff_mutex_lock(&pool->lock);
+        while (!pool->die && atomic_load(&pool->nb_queued) <= 0) {
+            pool->nb_sleeping++;
+            ff_cond_wait(&pool->cond, &pool->lock);
+            pool->nb_sleeping--;
+        }
+        if (pool->die) {
+            ff_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        ff_mutex_unlock(&pool->lock);
+    }
+}
+
+void ff_workpool_submit(AVWorkPool *pool, FFWorkPoolTask *t)
+{
+    const unsigned idx = atomic_fetch_add_explicit(&pool->next_queue, 1, memory_order_relaxed);
+    WorkQueue *q;
+
+    av_assert1(!t->queued);
+    t->queue = idx % pool->nb_workers;
+    q        = &pool->workers[t->queue].queue;
+
+    ff_mutex_lock(&q->lock);
+    t->prev   = q->tail;
+    t->next   = NULL;
+    t->queued = 1;
+    if (q->tail)
+        q->tail->next = t;
+    else
+        q->head = t;
+    q->tail = t;
+    ff_mutex_unlock(&q->lock);
+
+    atomic_fetch_add(&pool->nb_queued, 1);
+
+    ff_mutex_lock(&pool->lock);
+    if (pool->nb_sleeping)
+        ff_cond_signal(&pool->cond);
+    ff_mutex_unlock(&pool->lock);
+}
+
+int ff_workpool_cancel(AVWorkPool *pool, FFWorkPoolTask *t)
+{
+    WorkQueue *q = &pool->workers[t->queue].queue;
+    int cancelled;
+
+    ff_mutex_lock(&q->lock);
+    cancelled = t->queued;
+    if (cancelled)
+        queue_unlink(q, t);
+    ff_mutex_unlock(&q->lock);
+
+    if (cancelled)
+        atomic_fetch_sub_explicit(&pool->nb_queued, 1, memory_order_relaxed);
+    return cancelled;
+}
+
+static void workpool_free(AVWorkPool *pool, int nb_threads, int has_cond)
+{
+    if (has_cond) {
+        ff_mutex_lock(&pool->lock);
+        pool->die = 1;
+        ff_cond_broadcast(&pool->cond);
+        ff_mutex_unlock(&pool->lock);
+
+        for (int i = 0; i < nb_threads; i++)
+            pthread_join(pool->workers[i].thread, NULL);
+
+        ff_cond_destroy(&pool->cond);
+        ff_mutex_destroy(&pool->lock);
+    }
+
+    for (int i = 0; i < pool->nb_workers; i++)
+        ff_mutex_destroy(&pool->workers[i].queue.lock);
+
+    av_free(pool->workers);
+    av_free(pool);
+}
+
+AVWorkPool *av_workpool_alloc(int nb_threads)
+{
+    AVWorkPool *pool;
+    int i;
+
+    if (nb_threads < 0)
+        return NULL;
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->workers = av_calloc(nb_threads, sizeof(*pool->workers));
+    if (!pool->workers) {
+        av_free(pool);
+        return NULL;
+    }
+
+    for (; pool->nb_workers < nb_threads; pool->nb_workers++) {
+        if (ff_mutex_init(&pool->workers[pool->nb_workers].queue.lock, NULL)) {
+            workpool_free(pool, 0, 0);
+            return NULL;
+        }
+    }
+
+    atomic_init(&pool->next_queue, 0);
+    atomic_init(&pool->nb_queued, 0);
+
+    if (ff_mutex_init(&pool->lock, NULL)) {
+        workpool_free(pool, 0, 0);
+        return NULL;
+    }
+    if (ff_cond_init(&pool->cond, NULL)) {
+        ff_mutex_destroy(&pool->lock);
+        workpool_free(pool, 0, 0);
+        return NULL;
+    }
+
+    for (i = 0; i < nb_threads; i++) {
+        PoolWorker *w = &pool->workers[i];
+        w->pool = pool;
+        if (pthread_create(&w->thread, NULL, worker_thread, w)) {
+            workpool_free(pool, i, 1);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void av_workpool_free(AVWorkPool **ppool)
+{
+    AVWorkPool *pool = *ppool;
+
+    if (!pool)
+        return;
+
+    av_assert0(av_workpool_get_default() != pool);
+    workpool_free(pool, pool->nb_workers, 1);
+    *ppool = NULL;
+}
+
+int av_workpool_get_nb_threads(const AVWorkPool *pool)
+{
+    return pool->nb_workers;
+}
+
+#else /* HAVE_THREADS */
+
+struct AVWorkPool {
+    int nb_workers;
+};
+
+void ff_workpool_submit(AVWorkPool *pool, FFWorkPoolTask *t)
+{
+    av_assert0(0);
+}
+
+int ff_workpool_cancel(AVWorkPool *pool, FFWorkPoolTask *t)
+{
+    av_assert0(0);
+    return 0;
+}
+
+AVWorkPool *av_workpool_alloc(int nb_threads)
+{
+    return NULL;
+}
+
+void av_workpool_free(AVWorkPool **ppool)
+{
+    av_assert0(!ppool || !*ppool);
+}
+
+int av_workpool_get_nb_threads(const AVWorkPool *pool)
+{
+    return 0;
+}
+
+#endif /* HAVE_THREADS */
+
+void av_workpool_set_default(AVWorkPool *pool)
+{
+    ff_mutex_lock(&default_lock);
+    default_pool = pool;
+    ff_mutex_unlock(&default_lock);
+}
+
+AVWorkPool *av_workpool_get_default(void)
+{
+    AVWorkPool *pool;
+
+    ff_mutex_lock(&default_lock);
+    pool = default_pool;
+    ff_mutex_unlock(&default_lock);
+    return pool;
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_workpool
+ * Shared worker thread pool
+ */
+
+#ifndef AVUTIL_WORKPOOL_H
+#define AVUTIL_WORKPOOL_H
+
+/**
+ * @defgroup lavu_workpool Shared worker thread pool
+ * @ingroup lavu_utility
+ *
+ * A process-wide pool of worker threads, shared by the slice threading of
+ * libavcodec, libavfilter and libswscale and by AVExecutor.
+ *
+ * By default every codec, filter graph and scaler spawns its own threads.
+ * Once a pool is attached with av_workpool_set_default(), contexts created
+ * afterwards run their jobs on the pool instead: the total number of threads
+ * is bounded by the pool size, and idle workers steal queued work from any
+ * component. Frame threading and slice threading with a main function keep
+ * their dedicated threads, since their jobs may block on each other.
+ *
+ * @{
+ */
+
+typedef struct AVWorkPool AVWorkPool;
+
+/**
+ * Allocate a pool and start its worker threads.
+ *
+ * @param nb_threads number of worker threads, 0 for the number of CPUs
+ * @return the pool, or NULL on failure or if threads are not supported
+ */
+AVWorkPool *av_workpool_alloc(int nb_threads);
+
+/**
+ * Stop the worker threads and free the pool.
+ *
+ * The pool must not be the default pool anymore, and all the contexts
+ * which were created while it was attached must have been freed.
+ *
+ * @param pool pointer to the pool, set to NULL on return
+ */
+void av_workpool_free(AVWorkPool **pool);
+
+/**
+ * @return the number of worker threads of the pool
+ */
+int av_workpool_get_nb_threads(const AVWorkPool *pool);
+
+/**
+ * Attach a pool as the process-wide default, or detach the current one
+ * if pool is NULL. Only contexts created afterwards are affected.
+ */
+void av_workpool_set_default(AVWorkPool *pool);
+
+/**
+ * @return the process-wide default pool, or NULL if none is attached
+ */
+AVWorkPool *av_workpool_get_default(void);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_WORKPOOL_H */
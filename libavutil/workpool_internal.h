@@ -0,0 +1,52 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_WORKPOOL_INTERNAL_H
+#define AVUTIL_WORKPOOL_INTERNAL_H
+
+#include "workpool.h"
+
+/**
+ * A unit of work queued on a pool. The task is owned by the submitter,
+ * which must keep it alive until it has run or has been cancelled.
+ */
+typedef struct FFWorkPoolTask {
+    void (*run)(void *opaque);
+    void  *opaque;
+
+    // private to the pool
+    struct FFWorkPoolTask *prev, *next;
+    int queue;
+    int queued;
+} FFWorkPoolTask;
+
+/**
+ * Queue a task, it will be run once by one of the pool workers.
+ * A task must not be submitted again before it has run or has been cancelled.
+ */
+void ff_workpool_submit(AVWorkPool *pool, FFWorkPoolTask *task);
+
+/**
+ * Remove a task from its queue if no worker has taken it yet.
+ *
+ * @return 1 if the task was removed and will not run, 0 if it already
+ *         started or finished running
+ */
+int ff_workpool_cancel(AVWorkPool *pool, FFWorkPoolTask *task);
+
+#endif /* AVUTIL_WORKPOOL_INTERNAL_H */
@@ -37,7 +37,8 @@
 
 static int pass_alloc_output(SwsPass *pass)
 {
-    if (!pass || pass->output.fmt != AV_PIX_FMT_NONE)
+    /* passes writing into a graph output are read back from there */
+    if (!pass || pass->output.fmt != AV_PIX_FMT_NONE || pass->output_idx >= 0)
         return 0;
     pass->output.fmt = pass->format;
     return av_image_alloc(pass->output.data, pass->output.linesize, pass->width,
@@ -62,6 +63,7 @@ static SwsPass *pass_add(SwsGraph *graph, void *priv, enum AVPixelFormat fmt,
     pass->height = h;
     pass->input  = input;
     pass->output.fmt = AV_PIX_FMT_NONE;
+    pass->output_idx = -1;
 
     ret = pass_alloc_output(input);
     if (ret < 0) {
@@ -119,16 +121,10 @@ static void run_copy(const SwsImg *out_base, const SwsImg *in_base,
 
     for (int i = 0; i < FF_ARRAY_ELEMS(in.data) && in.data[i]; i++) {
         const int lines = h >> vshift(in.fmt, i);
-        if (in.linesize[i] == out.linesize[i]) {
-            memcpy(out.data[i], in.data[i], lines * out.linesize[i]);
-        } else {
-            const int linesize = FFMIN(out.linesize[i], in.linesize[i]);
-            for (int j = 0; j < lines; j++) {
-                memcpy(out.data[i], in.data[i], linesize);
-                in.data[i]  += in.linesize[i];
-                out.data[i] += out.linesize[i];
-            }
-        }
+        /* Don't copy whole strides, which span two lines for fields */
+        const int bytes = av_image_get_linesize(in.fmt, pass->width, i);
+        av_image_copy_plane(out.data[i], out.linesize[i],
+                            in.data[i], in.linesize[i], bytes, lines);
     }
 }
 
@@ -565,46 +561,102 @@ static int adapt_colors(SwsGraph *graph, SwsFormat src, SwsFormat dst,
  * Main filter graph construction code *
  ***************************************/
 
+/* Tests if `dst` can be produced by only downscaling `src` */
+static int can_cascade(const SwsFormat *src, const SwsFormat *dst)
+{
+    return dst->width <= src->width && dst->height <= src->height &&
+           ff_props_equal(src, dst);
+}
+
 static int init_passes(SwsGraph *graph)
 {
-    SwsFormat src = graph->src;
-    SwsFormat dst = graph->dst;
-    SwsPass *pass = NULL; /* read from main input image */
-    int ret;
+    SwsPass *prev = NULL;    /* pass writing the previous output */
+    SwsPass **color_pass;    /* result of color mapping for each output */
+    int ret = 0;
 
-    ret = adapt_colors(graph, src, dst, pass, &pass);
-    if (ret < 0)
-        return ret;
-    src.format = pass ? pass->format : src.format;
-    src.color  = dst.color;
+    color_pass = av_calloc(graph->num_outputs, sizeof(*color_pass));
+    if (!color_pass)
+        return AVERROR(ENOMEM);
 
-    if (!ff_fmt_equal(&src, &dst)) {
-        ret = add_legacy_sws_pass(graph, src, dst, pass, &pass);
-        if (ret < 0)
-            return ret;
-    }
+    for (int i = 0; i < graph->num_outputs; i++) {
+        const int first_pass = graph->num_passes;
+        const SwsFormat dst = graph->outputs[i];
+        SwsFormat src = graph->src;
+        SwsPass *pass = NULL; /* read from main input image */
+        int shared = -1;
+
+        if (prev && graph->ctx->cascade && can_cascade(&graph->outputs[i - 1], &dst)) {
+            /* Read from the previous, already converted output instead */
+            src  = graph->outputs[i - 1];
+            pass = prev;
+            color_pass[i] = NULL;
+        } else {
+            /* Color mapping only depends on the output format and colors */
+            for (int j = 0; j < i && shared < 0; j++) {
+                if (color_pass[j] && graph->outputs[j].format == dst.format &&
+                    ff_color_equal(&graph->outputs[j].color, &dst.color))
+                    shared = j;
+            }
 
-    if (!pass) {
-        /* No passes were added, so no operations were necessary */
-        graph->noop = 1;
+            if (shared >= 0) {
+                pass = color_pass[shared];
+            } else {
+                ret = adapt_colors(graph, src, dst, pass, &pass);
+                if (ret < 0)
+                    goto end;
+            }
+            color_pass[i] = pass;
+            src.format = pass ? pass->format : src.format;
+            src.color  = dst.color;
+        }
 
-        /* Add threaded memcpy pass */
-        pass = pass_add(graph, NULL, dst.format, dst.width, dst.height, pass, 1, run_copy);
-        if (!pass)
-            return AVERROR(ENOMEM);
+        if (!ff_fmt_equal(&src, &dst)) {
+            ret = add_legacy_sws_pass(graph, src, dst, pass, &pass);
+            if (ret < 0)
+                goto end;
+        }
+
+        if (graph->num_passes == first_pass) {
+            /* No passes were added, so no operations were necessary */
+            graph->noop = graph->num_outputs == 1;
+
+            /* Add threaded memcpy pass */
+            pass = pass_add(graph, NULL, dst.format, dst.width, dst.height, pass, 1, run_copy);
+            if (!pass) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+        }
+
+        pass->output_idx = i;
+        prev = pass;
     }
 
-    return 0;
+end:
+    av_free(color_pass);
+    return ret;
+}
+
+static const SwsImg *pass_image(const SwsGraph *graph, const SwsPass *pass)
+{
+    if (!pass)
+        return &graph->exec.input;
+    else if (pass->output_idx >= 0)
+        return &graph->exec.output[pass->output_idx];
+    else
+        return &pass->output;
 }
 
 static void sws_graph_worker(void *priv, int jobnr, int threadnr, int nb_jobs,
                              int nb_threads)
 {
     SwsGraph *graph = priv;
-    const SwsPass *pass = graph->exec.pass;
-    const SwsImg *input  = pass->input ? &pass->input->output : &graph->exec.input;
-    const SwsImg *output = pass->output.fmt != AV_PIX_FMT_NONE ? &pass->output : &graph->exec.output;
-    const int slice_y = jobnr * pass->slice_h;
+    /* Interleave the passes of a group, so that each slice of the shared
+     * input is consumed by all of them while it is still in cache */
+    const SwsPass *pass = graph->exec.passes[jobnr % graph->exec.num_passes];
+    const SwsImg *input  = pass_image(graph, pass->input);
+    const SwsImg *output = pass_image(graph, pass);
+    const int slice_y = jobnr / graph->exec.num_passes * pass->slice_h;
     const int slice_h = FFMIN(pass->slice_h, pass->height - slice_y);
 
     pass->run(output, input, slice_y, slice_h, pass);
@@ -612,6 +664,13 @@ static void sws_graph_worker(void *priv, int jobnr, int threadnr, int nb_jobs,
 
 int ff_sws_graph_create(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *src,
                         int field, SwsGraph **out_graph)
+{
+    return ff_sws_graph_create_multi(ctx, dst, 1, src, field, out_graph);
+}
+
+int ff_sws_graph_create_multi(SwsContext *ctx, const SwsFormat *dst, int num_dst,
+                              const SwsFormat *src, int field,
+                              SwsGraph **out_graph)
 {
     int ret;
     SwsGraph *graph = av_mallocz(sizeof(*graph));
@@ -624,8 +683,17 @@ int ff_sws_graph_create(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *
     graph->field = field;
     graph->opts_copy = *ctx;
 
-    graph->exec.input.fmt  = src->format;
-    graph->exec.output.fmt = dst->format;
+    graph->outputs     = av_memdup(dst, num_dst * sizeof(*dst));
+    graph->exec.output = av_calloc(num_dst, sizeof(*graph->exec.output));
+    if (!graph->outputs || !graph->exec.output) {
+        ret = AVERROR(ENOMEM);
+        goto error;
+    }
+    graph->num_outputs = num_dst;
+
+    graph->exec.input.fmt = src->format;
+    for (int i = 0; i < num_dst; i++)
+        graph->exec.output[i].fmt = dst[i].format;
 
     ret = avpriv_slicethread_create(&graph->slicethread, (void *) graph,
                                     sws_graph_worker, NULL, ctx->threads);
@@ -665,6 +733,8 @@ void ff_sws_graph_free(SwsGraph **pgraph)
         av_free(pass);
     }
     av_free(graph->passes);
+    av_free(graph->outputs);
+    av_free(graph->exec.output);
 
     av_free(graph);
     *pgraph = NULL;
@@ -683,24 +753,35 @@ static int opts_equal(const SwsContext *c1, const SwsContext *c2)
            c1->dst_h_chr_pos == c2->dst_h_chr_pos &&
            c1->dst_v_chr_pos == c2->dst_v_chr_pos &&
            c1->intent        == c2->intent        &&
+           c1->cascade       == c2->cascade       &&
            !memcmp(c1->scaler_params, c2->scaler_params, sizeof(c1->scaler_params));
 
 }
 
 int ff_sws_graph_reinit(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *src,
                         int field, SwsGraph **out_graph)
+{
+    return ff_sws_graph_reinit_multi(ctx, dst, 1, src, field, out_graph);
+}
+
+int ff_sws_graph_reinit_multi(SwsContext *ctx, const SwsFormat *dst, int num_dst,
+                              const SwsFormat *src, int field, SwsGraph **out_graph)
 {
     SwsGraph *graph = *out_graph;
-    if (graph && ff_fmt_equal(&graph->src, src) &&
-                 ff_fmt_equal(&graph->dst, dst) &&
-                 opts_equal(ctx, &graph->opts_copy))
-    {
+    int equal = graph && graph->num_outputs == num_dst &&
+                ff_fmt_equal(&graph->src, src) &&
+                opts_equal(ctx, &graph->opts_copy);
+
+    for (int i = 0; equal && i < num_dst; i++)
+        equal = ff_fmt_equal(&graph->outputs[i], &dst[i]);
+
+    if (equal) {
         ff_sws_graph_update_metadata(graph, &src->color);
         return 0;
     }
 
     ff_sws_graph_free(out_graph);
-    return ff_sws_graph_create(ctx, dst, src, field, out_graph);
+    return ff_sws_graph_create_multi(ctx, dst, num_dst, src, field, out_graph);
 }
 
 void ff_sws_graph_update_metadata(SwsGraph *graph, const SwsColor *color)
@@ -716,18 +797,44 @@ void ff_sws_graph_run(SwsGraph *graph, uint8_t *const out_data[4],
                       const uint8_t *const in_data[4],
                       const int in_linesize[4])
 {
-    SwsImg *out = &graph->exec.output;
+    SwsImg out;
+    av_assert1(graph->num_outputs == 1);
+    memcpy(out.data,     out_data,     sizeof(out.data));
+    memcpy(out.linesize, out_linesize, sizeof(out.linesize));
+    ff_sws_graph_run_multi(graph, &out, in_data, in_linesize);
+}
+
+void ff_sws_graph_run_multi(SwsGraph *graph, const SwsImg *out_imgs,
+                            const uint8_t *const in_data[4],
+                            const int in_linesize[4])
+{
+    SwsImg *out = graph->exec.output;
     SwsImg *in  = &graph->exec.input;
-    memcpy(out->data,     out_data,     sizeof(out->data));
-    memcpy(out->linesize, out_linesize, sizeof(out->linesize));
+    for (int i = 0; i < graph->num_outputs; i++) {
+        memcpy(out[i].data,     out_imgs[i].data,     sizeof(out[i].data));
+        memcpy(out[i].linesize, out_imgs[i].linesize, sizeof(out[i].linesize));
+    }
     memcpy(in->data,      in_data,      sizeof(in->data));
     memcpy(in->linesize,  in_linesize,  sizeof(in->linesize));
 
-    for (int i = 0; i < graph->num_passes; i++) {
-        const SwsPass *pass = graph->passes[i];
-        graph->exec.pass = pass;
-        if (pass->setup)
-            pass->setup(out, in, pass);
-        avpriv_slicethread_execute(graph->slicethread, pass->num_slices, 0);
+    for (int i = 0, num; i < graph->num_passes; i += num) {
+        SwsPass *const *passes = &graph->passes[i];
+
+        /* Group consecutive passes reading the same input */
+        for (num = 1; i + num < graph->num_passes; num++) {
+            const SwsPass *pass = passes[num];
+            if (pass->input != passes[0]->input ||
+                pass->num_slices != passes[0]->num_slices)
+                break;
+        }
+
+        graph->exec.passes     = passes;
+        graph->exec.num_passes = num;
+        for (int j = 0; j < num; j++) {
+            if (passes[j]->setup)
+                passes[j]->setup(out, in, passes[j]);
+        }
+        avpriv_slicethread_execute(graph->slicethread,
+                                   num * passes[0]->num_slices, 0);
     }
 }
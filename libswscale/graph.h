@@ -74,10 +74,16 @@ struct SwsPass {
      */
     SwsImg output;
 
+    /**
+     * Index of the graph output this pass writes into, or -1 if it writes
+     * into its own output buffer instead.
+     */
+    int output_idx;
+
     /**
      * Called once from the main thread before running the filter. Optional.
-     * `out` and `in` always point to the main image input/output, regardless
-     * of `input` and `output` fields.
+     * `out` and `in` always point to the main image input and the first
+     * image output, regardless of `input` and `output` fields.
      */
     void (*setup)(const SwsImg *out, const SwsImg *in, const SwsPass *pass);
 
@@ -109,16 +115,28 @@ typedef struct SwsGraph {
     SwsContext opts_copy;
 
     /**
-     * Currently active format and processing parameters.
+     * Currently active format and processing parameters. `dst` is the
+     * first of `outputs`.
      */
     SwsFormat src, dst;
     int field;
 
+    /**
+     * All output formats produced from the same input, in order.
+     */
+    SwsFormat *outputs;
+    int num_outputs;
+
     /** Temporary execution state inside ff_sws_graph_run */
     struct {
-        const SwsPass *pass; /* current filter pass */
+        /**
+         * Current group of consecutive passes sharing the same input, which
+         * are executed together slice by slice.
+         */
+        SwsPass *const *passes;
+        int num_passes;
         SwsImg input;
-        SwsImg output;
+        SwsImg *output; /* one per graph output */
     } exec;
 } SwsGraph;
 
@@ -128,6 +146,16 @@ typedef struct SwsGraph {
 int ff_sws_graph_create(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *src,
                         int field, SwsGraph **out_graph);
 
+/**
+ * Allocate and initialize a filter graph producing `num_dst` outputs from the
+ * same input. Color conversions common to several outputs are only performed
+ * once. If `SwsContext.cascade` is set, each output is scaled from the
+ * previous one instead of from the input wherever that is possible.
+ */
+int ff_sws_graph_create_multi(SwsContext *ctx, const SwsFormat *dst, int num_dst,
+                              const SwsFormat *src, int field,
+                              SwsGraph **out_graph);
+
 /**
  * Uninitialize any state associate with this filter graph and free it.
  */
@@ -147,6 +175,12 @@ void ff_sws_graph_update_metadata(SwsGraph *graph, const SwsColor *color);
 int ff_sws_graph_reinit(SwsContext *ctx, const SwsFormat *dst, const SwsFormat *src,
                         int field, SwsGraph **graph);
 
+/**
+ * Like ff_sws_graph_reinit(), for graphs created by ff_sws_graph_create_multi().
+ */
+int ff_sws_graph_reinit_multi(SwsContext *ctx, const SwsFormat *dst, int num_dst,
+                              const SwsFormat *src, int field, SwsGraph **graph);
+
 /**
  * Dispatch the filter graph on a single field. Internally threaded.
  */
@@ -155,4 +189,12 @@ void ff_sws_graph_run(SwsGraph *graph, uint8_t *const out_data[4],
                       const uint8_t *const in_data[4],
                       const int in_linesize[4]);
 
+/**
+ * Dispatch the filter graph on a single field, writing into one image per
+ * graph output. Only the `data` and `linesize` fields of `out` are used.
+ */
+void ff_sws_graph_run_multi(SwsGraph *graph, const SwsImg *out,
+                            const uint8_t *const in_data[4],
+                            const int in_linesize[4]);
+
 #endif /* SWSCALE_GRAPH_H */
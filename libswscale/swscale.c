@@ -1352,67 +1352,6 @@ static int frame_ref(AVFrame *dst, const AVFrame *src)
     return 0;
 }
 
-int sws_scale_frame(SwsContext *sws, AVFrame *dst, const AVFrame *src)
-{
-    int ret;
-    SwsInternal *c = sws_internal(sws);
-    if (!src || !dst)
-        return AVERROR(EINVAL);
-
-    if (c->frame_src) {
-        /* Context has been initialized with explicit values, fall back to
-         * legacy API */
-        ret = sws_frame_start(sws, dst, src);
-        if (ret < 0)
-            return ret;
-
-        ret = sws_send_slice(sws, 0, src->height);
-        if (ret >= 0)
-            ret = sws_receive_slice(sws, 0, dst->height);
-
-        sws_frame_end(sws);
-
-        return ret;
-    }
-
-    ret = sws_frame_setup(sws, dst, src);
-    if (ret < 0)
-        return ret;
-
-    if (!src->data[0])
-        return 0;
-
-    if (c->graph[FIELD_TOP]->noop &&
-        (!c->graph[FIELD_BOTTOM] || c->graph[FIELD_BOTTOM]->noop) &&
-        src->buf[0] && !dst->buf[0] && !dst->data[0])
-    {
-        /* Lightweight refcopy */
-        ret = frame_ref(dst, src);
-        if (ret < 0)
-            return ret;
-    } else {
-        if (!dst->data[0]) {
-            ret = av_frame_get_buffer(dst, 0);
-            if (ret < 0)
-                return ret;
-        }
-
-        for (int field = 0; field < 2; field++) {
-            SwsGraph *graph = c->graph[field];
-            uint8_t *dst_data[4], *src_data[4];
-            int dst_linesize[4], src_linesize[4];
-            get_frame_pointers(dst, dst_data, dst_linesize, field);
-            get_frame_pointers(src, src_data, src_linesize, field);
-            ff_sws_graph_run(graph, dst_data, dst_linesize,
-                          (const uint8_t **) src_data, src_linesize);
-            if (!graph->dst.interlaced)
-                break;
-        }
-    }
-
-    return 0;
-}
-
 static int validate_params(SwsContext *ctx)
 {
 #define VALIDATE(field, min, max) \
@@ -1428,37 +1367,55 @@ static int validate_params(SwsContext *ctx)
     return 0;
 }
 
-int sws_frame_setup(SwsContext *ctx, const AVFrame *dst, const AVFrame *src)
+static int frames_setup(SwsContext *ctx, AVFrame *const *dst, int nb_dst,
+                        const AVFrame *src)
 {
     SwsInternal *s = sws_internal(ctx);
+    SwsFormat dst_single, *dst_fmt = &dst_single;
     const char *err_msg;
-    int ret;
+    int ret = 0;
 
-    if (!src || !dst)
+    if (!src || !dst || nb_dst < 1)
         return AVERROR(EINVAL);
+    for (int i = 0; i < nb_dst; i++) {
+        if (!dst[i])
+            return AVERROR(EINVAL);
+    }
     if ((ret = validate_params(ctx)) < 0)
         return ret;
 
+    if (nb_dst > 1) {
+        dst_fmt = av_malloc_array(nb_dst, sizeof(*dst_fmt));
+        if (!dst_fmt)
+            return AVERROR(ENOMEM);
+    }
+
     for (int field = 0; field < 2; field++) {
         SwsFormat src_fmt = ff_fmt_from_frame(src, field);
-        SwsFormat dst_fmt = ff_fmt_from_frame(dst, field);
-        int src_ok, dst_ok;
+        const int src_ok = ff_test_fmt(&src_fmt, 0);
+        int idx = 0;
 
-        if ((src->flags ^ dst->flags) & AV_FRAME_FLAG_INTERLACED) {
-            err_msg = "Cannot convert interlaced to progressive frames or vice versa.\n";
-            ret = AVERROR(EINVAL);
-            goto fail;
-        }
+        for (idx = 0; idx < nb_dst; idx++) {
+            int dst_ok;
+            dst_fmt[idx] = ff_fmt_from_frame(dst[idx], field);
 
-        src_ok = ff_test_fmt(&src_fmt, 0);
-        dst_ok = ff_test_fmt(&dst_fmt, 1);
-        if ((!src_ok || !dst_ok) && !ff_props_equal(&src_fmt, &dst_fmt)) {
-            err_msg = src_ok ? "Unsupported output" : "Unsupported input";
-            ret = AVERROR(ENOTSUP);
-            goto fail;
+            if ((src->flags ^ dst[idx]->flags) & AV_FRAME_FLAG_INTERLACED) {
+                err_msg = "Cannot convert interlaced to progressive frames or vice versa.\n";
+                ret = AVERROR(EINVAL);
+                goto fail;
+            }
+
+            dst_ok = ff_test_fmt(&dst_fmt[idx], 1);
+            if ((!src_ok || !dst_ok) && !ff_props_equal(&src_fmt, &dst_fmt[idx])) {
+                err_msg = src_ok ? "Unsupported output" : "Unsupported input";
+                ret = AVERROR(ENOTSUP);
+                goto fail;
+            }
         }
 
-        ret = ff_sws_graph_reinit(ctx, &dst_fmt, &src_fmt, field, &s->graph[field]);
+        idx = 0;
+        ret = ff_sws_graph_reinit_multi(ctx, dst_fmt, nb_dst, &src_fmt, field,
+                                        &s->graph[field]);
         if (ret < 0) {
             err_msg = "Failed initializing scaling graph";
             goto fail;
@@ -1483,18 +1440,125 @@ int sws_frame_setup(SwsContext *ctx, const AVFrame *dst, const AVFrame *src)
                err_msg, av_err2str(ret),
                av_get_pix_fmt_name(src_fmt.format), av_color_space_name(src_fmt.csp),
                av_color_primaries_name(src_fmt.color.prim), av_color_transfer_name(src_fmt.color.trc),
-               av_get_pix_fmt_name(dst_fmt.format), av_color_space_name(dst_fmt.csp),
-               av_color_primaries_name(dst_fmt.color.prim), av_color_transfer_name(dst_fmt.color.trc));
+               av_get_pix_fmt_name(dst_fmt[idx].format), av_color_space_name(dst_fmt[idx].csp),
+               av_color_primaries_name(dst_fmt[idx].color.prim), av_color_transfer_name(dst_fmt[idx].color.trc));
 
         for (int i = 0; i < FF_ARRAY_ELEMS(s->graph); i++)
             ff_sws_graph_free(&s->graph[i]);
 
+        break;
+    }
+
+    if (dst_fmt != &dst_single)
+        av_free(dst_fmt);
+    return ret;
+}
+
+static int scale_frames(SwsContext *sws, AVFrame *const *dst, int nb_dst,
+                        const AVFrame *src)
+{
+    SwsInternal *c = sws_internal(sws);
+    SwsImg out_single, *out = &out_single;
+    int ret;
+
+    ret = frames_setup(sws, dst, nb_dst, src);
+    if (ret < 0)
         return ret;
+
+    if (!src->data[0])
+        return 0;
+
+    if (c->graph[FIELD_TOP]->noop &&
+        (!c->graph[FIELD_BOTTOM] || c->graph[FIELD_BOTTOM]->noop) &&
+        src->buf[0] && !dst[0]->buf[0] && !dst[0]->data[0])
+    {
+        /* Lightweight refcopy */
+        av_assert1(nb_dst == 1);
+        return frame_ref(dst[0], src);
     }
 
+    for (int i = 0; i < nb_dst; i++) {
+        if (!dst[i]->data[0]) {
+            ret = av_frame_get_buffer(dst[i], 0);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    if (nb_dst > 1) {
+        out = av_malloc_array(nb_dst, sizeof(*out));
+        if (!out)
+            return AVERROR(ENOMEM);
+    }
+
+    for (int field = 0; field < 2; field++) {
+        SwsGraph *graph = c->graph[field];
+        uint8_t *src_data[4];
+        int src_linesize[4];
+        for (int i = 0; i < nb_dst; i++)
+            get_frame_pointers(dst[i], out[i].data, out[i].linesize, field);
+        get_frame_pointers(src, src_data, src_linesize, field);
+        ff_sws_graph_run_multi(graph, out, (const uint8_t **) src_data,
+                               src_linesize);
+        if (!graph->dst.interlaced)
+            break;
+    }
+
+    if (out != &out_single)
+        av_free(out);
     return 0;
 }
 
+int sws_scale_frame(SwsContext *sws, AVFrame *dst, const AVFrame *src)
+{
+    int ret;
+    SwsInternal *c = sws_internal(sws);
+    if (!src || !dst)
+        return AVERROR(EINVAL);
+
+    if (c->frame_src) {
+        /* Context has been initialized with explicit values, fall back to
+         * legacy API */
+        ret = sws_frame_start(sws, dst, src);
+        if (ret < 0)
+            return ret;
+
+        ret = sws_send_slice(sws, 0, src->height);
+        if (ret >= 0)
+            ret = sws_receive_slice(sws, 0, dst->height);
+
+        sws_frame_end(sws);
+
+        return ret;
+    }
+
+    return scale_frames(sws, &dst, 1, src);
+}
+
+int sws_scale_frames(SwsContext *sws, AVFrame *const *dst, int nb_dst,
+                     const AVFrame *src)
+{
+    SwsInternal *c = sws_internal(sws);
+    if (!src || !dst || nb_dst < 1)
+        return AVERROR(EINVAL);
+
+    if (nb_dst == 1)
+        return sws_scale_frame(sws, dst[0], src);
+
+    if (c->frame_src) {
+        av_log(sws, AV_LOG_ERROR, "Multiple outputs are not supported on "
+               "explicitly initialized contexts.\n");
+        return AVERROR(EINVAL);
+    }
+
+    return scale_frames(sws, dst, nb_dst, src);
+}
+
+int sws_frame_setup(SwsContext *ctx, const AVFrame *dst, const AVFrame *src)
+{
+    return frames_setup(ctx, (AVFrame *const *) &dst, 1, src);
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
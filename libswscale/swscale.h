@@ -239,6 +239,14 @@ typedef struct SwsContext {
      */
     int intent;
 
+    /**
+     * When producing several outputs with sws_scale_frames(), scale each
+     * output from the previous one instead of from the source frame, if
+     * it only differs from it by being smaller. Faster for resolution
+     * ladders sorted by decreasing size, at the cost of some quality.
+     */
+    int cascade;
+
     /* Remember to add new fields to graph.c:opts_equal() */
 } SwsContext;
 
@@ -355,6 +363,27 @@ int sws_is_noop(const AVFrame *dst, const AVFrame *src);
  */
 int sws_scale_frame(SwsContext *c, AVFrame *dst, const AVFrame *src);
 
+/**
+ * Scale source data from `src` into several destination frames at once,
+ * which may differ in size and format. This is equivalent to, but more
+ * efficient than, calling sws_scale_frame() for each of them: conversions
+ * common to several outputs are only performed once, and the source is
+ * read once per slice for all outputs scaled directly from it. See also
+ * `SwsContext.cascade`.
+ *
+ * Only supported in dynamic mode, i.e. on contexts that have not been
+ * explicitly initialized with sws_init_context().
+ *
+ * @param ctx    The scaling context.
+ * @param dst    Array of `nb_dst` destination frames, as in sws_scale_frame().
+ *               Frames without data buffers are allocated by the scaler.
+ * @param nb_dst Number of destination frames.
+ * @param src    The source frame.
+ * @return >= 0 on success, a negative AVERROR code on failure.
+ */
+int sws_scale_frames(SwsContext *ctx, AVFrame *const *dst, int nb_dst,
+                     const AVFrame *src);
+
 /*************************
  * Legacy (stateful) API *
  *************************/
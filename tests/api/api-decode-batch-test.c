@@ -0,0 +1,211 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Batched decoding test.
+ * Decodes a stream of small PCM packets once with avcodec_send_packet() /
+ * avcodec_receive_frame() and then with avcodec_decode_packets() using
+ * various packet and frame batch sizes, and compares the output.
+ */
+
+#include <string.h>
+
+#include "libavcodec/avcodec.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+
+#define NB_PACKETS  500
+#define MAX_FRAMES  8
+
+static AVPacket *pkts[NB_PACKETS + 1];
+
+static int create_packets(void)
+{
+    unsigned seed = 1;
+
+    for (int i = 0; i < NB_PACKETS; i++) {
+        /* 1 to 64 stereo s16 samples per packet */
+        int size = 4 * (1 + i % 64);
+
+        pkts[i] = av_packet_alloc();
+        if (!pkts[i] || av_new_packet(pkts[i], size) < 0)
+            return AVERROR(ENOMEM);
+        for (int j = 0; j < size; j++) {
+            seed = seed * 1664525 + 1013904223;
+            pkts[i]->data[j] = seed >> 24;
+        }
+        pkts[i]->pts = i;
+    }
+    /* terminating flush packet */
+    pkts[NB_PACKETS] = NULL;
+
+    return 0;
+}
+
+static AVCodecContext *open_decoder(void)
+{
+    const AVCodec *dec = avcodec_find_decoder(AV_CODEC_ID_PCM_S16LE);
+    AVChannelLayout stereo = AV_CHANNEL_LAYOUT_STEREO;
+    AVCodecContext *ctx;
+
+    if (!dec)
+        return NULL;
+    ctx = avcodec_alloc_context3(dec);
+    if (!ctx)
+        return NULL;
+    ctx->sample_rate = 48000;
+    av_channel_layout_copy(&ctx->ch_layout, &stereo);
+    if (avcodec_open2(ctx, dec, NULL) < 0)
+        avcodec_free_context(&ctx);
+
+    return ctx;
+}
+
+static int append_frame(uint8_t **out, size_t *out_size, const AVFrame *frame)
+{
+    size_t size = frame->nb_samples * 4;
+    uint8_t *tmp = av_realloc(*out, *out_size + size + sizeof(frame->pts));
+
+    if (!tmp)
+        return AVERROR(ENOMEM);
+    *out = tmp;
+    memcpy(*out + *out_size, &frame->pts, sizeof(frame->pts));
+    memcpy(*out + *out_size + sizeof(frame->pts), frame->data[0], size);
+    *out_size += size + sizeof(frame->pts);
+
+    return 0;
+}
+
+static int decode_reference(uint8_t **out, size_t *out_size)
+{
+    AVCodecContext *ctx = open_decoder();
+    AVFrame *frame = av_frame_alloc();
+    int ret = 0;
+
+    if (!ctx || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i <= NB_PACKETS; i++) {
+        ret = avcodec_send_packet(ctx, pkts[i]);
+        if (ret < 0)
+            goto end;
+        while ((ret = avcodec_receive_frame(ctx, frame)) >= 0) {
+            ret = append_frame(out, out_size, frame);
+            if (ret < 0)
+                goto end;
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    return ret;
+}
+
+static int decode_batched(int pkt_batch, int frame_batch,
+                          uint8_t **out, size_t *out_size)
+{
+    AVCodecContext *ctx = open_decoder();
+    AVFrame *frames[MAX_FRAMES] = { NULL };
+    int pos = 0, ret = 0;
+
+    if (!ctx) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (int i = 0; i < frame_batch; i++) {
+        frames[i] = av_frame_alloc();
+        if (!frames[i]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    while (1) {
+        int nb_pkts   = FFMIN(pkt_batch, NB_PACKETS + 1 - pos);
+        int nb_frames = frame_batch;
+
+        ret = avcodec_decode_packets(ctx, (const AVPacket *const *)pkts + pos,
+                                     &nb_pkts, frames, &nb_frames);
+        for (int i = 0; i < nb_frames; i++) {
+            int err = append_frame(out, out_size, frames[i]);
+            if (err < 0) {
+                ret = err;
+                goto end;
+            }
+        }
+        pos += nb_pkts;
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        }
+        if (ret < 0)
+            goto end;
+        if (!nb_pkts && !nb_frames) {
+            fprintf(stderr, "No progress at packet %d\n", pos);
+            ret = AVERROR_BUG;
+            goto end;
+        }
+    }
+
+end:
+    for (int i = 0; i < frame_batch; i++)
+        av_frame_free(&frames[i]);
+    avcodec_free_context(&ctx);
+    return ret;
+}
+
+int main(void)
+{
+    static const int pkt_batches[]   = { 1, 3, 16, NB_PACKETS + 1 };
+    static const int frame_batches[] = { 1, 2, MAX_FRAMES };
+    uint8_t *ref = NULL, *out = NULL;
+    size_t ref_size = 0, out_size = 0;
+    int ret;
+
+    if (create_packets() < 0 || decode_reference(&ref, &ref_size) < 0) {
+        fprintf(stderr, "Reference decoding failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(pkt_batches); i++) {
+        for (int j = 0; j < FF_ARRAY_ELEMS(frame_batches); j++) {
+            out_size = 0;
+            ret = decode_batched(pkt_batches[i], frame_batches[j], &out, &out_size);
+            if (ret < 0 || out_size != ref_size || memcmp(ref, out, ref_size)) {
+                fprintf(stderr, "Mismatch with %d packets and %d frames per call\n",
+                        pkt_batches[i], frame_batches[j]);
+                return 1;
+            }
+        }
+    }
+
+    av_freep(&ref);
+    av_freep(&out);
+    for (int i = 0; i < NB_PACKETS; i++)
+        av_packet_free(&pkts[i]);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Stream info test.
+ * Runs avformat_find_stream_info() serially and with parallel probe
+ * decoding, checks that the stream parameters match and that
+ * AVFormatContext.stream_info_cb reports every stream exactly once with
+ * complete parameters.
+ */
+
+#include <string.h>
+
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/log.h"
+
+#define MAX_STREAMS 16
+
+typedef struct StreamInfo {
+    enum AVCodecID codec_id;
+    int format;
+    int width, height;
+    int sample_rate, channels;
+} StreamInfo;
+
+static StreamInfo ref[MAX_STREAMS];
+static int nb_reported[MAX_STREAMS];
+static int incomplete;
+
+static void get_info(StreamInfo *info, const AVCodecParameters *par)
+{
+    info->codec_id    = par->codec_id;
+    info->format      = par->format;
+    info->width       = par->width;
+    info->height      = par->height;
+    info->sample_rate = par->sample_rate;
+    info->channels    = par->ch_layout.nb_channels;
+}
+
+static void stream_info_cb(AVFormatContext *s, AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+
+    if (st->index < MAX_STREAMS)
+        nb_reported[st->index]++;
+
+    if (par->format < 0 ||
+        (par->codec_type == AVMEDIA_TYPE_VIDEO && !par->width) ||
+        (par->codec_type == AVMEDIA_TYPE_AUDIO && !par->sample_rate))
+        incomplete = 1;
+}
+
+static int find_stream_info(const char *filename, int threads, int use_cb,
+                            StreamInfo *info, int *nb_streams)
+{
+    AVFormatContext *fmt_ctx = avformat_alloc_context();
+    int ret;
+
+    if (!fmt_ctx)
+        return AVERROR(ENOMEM);
+    fmt_ctx->stream_info_threads = threads;
+    if (use_cb)
+        fmt_ctx->stream_info_cb = stream_info_cb;
+
+    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't open file\n");
+        return ret;
+    }
+
+    ret = avformat_find_stream_info(fmt_ctx, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't get stream info\n");
+        goto end;
+    }
+
+    if (fmt_ctx->nb_streams > MAX_STREAMS) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    *nb_streams = fmt_ctx->nb_streams;
+    for (int i = 0; i < fmt_ctx->nb_streams; i++)
+        get_info(&info[i], fmt_ctx->streams[i]->codecpar);
+
+end:
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    StreamInfo info[MAX_STREAMS];
+    int nb_ref = 0, nb_streams = 0;
+
+    if (argc < 2) {
+        av_log(NULL, AV_LOG_ERROR, "Incorrect input\n");
+        return 1;
+    }
+
+    if (find_stream_info(argv[1], 1, 0, ref, &nb_ref) < 0 || !nb_ref)
+        return 1;
+
+    for (int threads = 1; threads <= 3; threads++) {
+        memset(nb_reported, 0, sizeof(nb_reported));
+        incomplete = 0;
+
+        if (find_stream_info(argv[1], threads, 1, info, &nb_streams) < 0)
+            return 1;
+
+        if (nb_streams != nb_ref || memcmp(info, ref, nb_ref * sizeof(*info))) {
+            av_log(NULL, AV_LOG_ERROR, "Mismatch with %d threads\n", threads);
+            return 1;
+        }
+        for (int i = 0; i < nb_streams; i++) {
+            if (nb_reported[i] != 1) {
+                av_log(NULL, AV_LOG_ERROR, "Stream %d reported %d times with %d threads\n",
+                       i, nb_reported[i], threads);
+                return 1;
+            }
+        }
+        if (incomplete) {
+            av_log(NULL, AV_LOG_ERROR, "Incomplete parameters reported with %d threads\n",
+                   threads);
+            return 1;
+        }
+    }
+
+    return 0;
+}
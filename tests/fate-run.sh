@@ -323,6 +323,51 @@ enc_external(){
     run ffprobe${PROGSUF}${EXECSUF} -bitexact $probe_opt $encfile || return
 }
 
+# encodes once with a single thread and once with slice threads; the packets
+# must be identical, only their number is printed since the encoders of the
+# float codecs do not produce the same output on every platform
+enc_threads(){
+    src_fmt=$1
+    srcfile=$2
+    enc_opt=$3
+    enc_threads=$4
+
+    encfile1="${outdir}/${test}.out-1"
+    encfile2="${outdir}/${test}.out-2"
+    cleanfiles="$cleanfiles $encfile1 $encfile2"
+
+    ffmpeg -auto_conversion_filters -f $src_fmt $DEC_OPTS -i $srcfile $enc_opt $FLAGS \
+        -threads 1 -f framecrc -y $(target_path $encfile1) || return
+    ffmpeg -auto_conversion_filters -f $src_fmt $DEC_OPTS -i $srcfile $enc_opt $FLAGS \
+        -threads $enc_threads -thread_type slice -f framecrc -y $(target_path $encfile2) || return
+    diff -u $encfile1 $encfile2 || return
+    echo $(grep -vc '^#' $encfile1) packets
+}
+
+# muxes the same source with and without async_uploads; the files written
+# must be the same, with none of the temporary ones left
+async_uploads(){
+    fmt=$1
+    playlist=$2
+    src=$3
+    mux_opt=$4
+
+    syncdir="${outdir}/${test}-sync"
+    asyncdir="${outdir}/${test}-async"
+    rm -rf $syncdir $asyncdir
+    mkdir -p $syncdir $asyncdir
+
+    ffmpeg -auto_conversion_filters -f lavfi -i $src $FLAGS $mux_opt \
+        -f $fmt -y $(target_path $syncdir/$playlist) || return
+    ffmpeg -auto_conversion_filters -f lavfi -i $src $FLAGS $mux_opt -async_uploads 2 \
+        -v verbose -f $fmt -y $(target_path $asyncdir/$playlist) 2> $asyncdir.log || return
+    grep -q "Uploading in the background" $asyncdir.log || return
+    diff -r $syncdir $asyncdir || return
+    ls $asyncdir
+    cat $asyncdir/$playlist
+    rm -rf $syncdir $asyncdir $asyncdir.log
+}
+
 # FIXME: There is a certain duplication between the avconv-related helper
 # functions above and below that should be refactored.
 ffmpeg2="$target_exec ${target_path}/ffmpeg${PROGSUF}${EXECSUF}"
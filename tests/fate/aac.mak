@@ -255,7 +255,15 @@ FATE_AAC_ENCODE-$(call ENCMUX, AAC, ADTS, ARESAMPLE_FILTER) += $(FATE_AAC_ENCODE
 
 FATE_AAC_BSF-$(call ALLYES, AAC_DEMUXER AAC_ADTSTOASC_BSF MATROSKA_MUXER) += fate-aac-autobsf-adtstoasc
 
+# the frame-parallel mode searches the quantizers of several frames at once
+# with slice threads, which must not change the output
+FATE_AAC_ENC_THREADS-$(call ALLYES, LAVFI_INDEV AEVALSRC_FILTER ARESAMPLE_FILTER AAC_ENCODER FRAMECRC_MUXER) += fate-aac-enc-frame-parallel
+fate-aac-enc-frame-parallel: CMD = enc_threads lavfi \
+  "aevalsrc=sin(440*2*PI*t)*gt(mod(t\,0.3)\,0.1)|sin(554*2*PI*t)|sin(660*2*PI*t)|0.1*sin(55*2*PI*t)|t*sin(880*2*PI*t)|sin(1000*2*PI*t):c=5.1:s=48000:d=2" \
+  "-c:a aac -aac_frame_parallel 4" 4
+
+FATE_FFMPEG += $(FATE_AAC_ENC_THREADS-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_AAC_ALL) $(FATE_AAC_ENCODE-yes) $(FATE_AAC_BSF-yes)
 
-fate-aac: $(FATE_AAC_ALL) $(FATE_AAC_ENCODE) $(FATE_AAC_BSF-yes)
+fate-aac: $(FATE_AAC_ALL) $(FATE_AAC_ENCODE) $(FATE_AAC_BSF-yes) $(FATE_AAC_ENC_THREADS-yes)
 fate-aac-latm: $(FATE_AAC_LATM-yes)
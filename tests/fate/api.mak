@@ -3,6 +3,11 @@ fate-api-flac: $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMD = run $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMP = null
 
+FATE_API_LIBAVCODEC-$(CONFIG_PCM_S16LE_DECODER) += fate-api-decode-batch
+fate-api-decode-batch: $(APITESTSDIR)/api-decode-batch-test$(EXESUF)
+fate-api-decode-batch: CMD = run $(APITESTSDIR)/api-decode-batch-test$(EXESUF)
+fate-api-decode-batch: CMP = null
+
 FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, FLV, FLV) += fate-api-band
 fate-api-band: $(APITESTSDIR)/api-band-test$(EXESUF)
 fate-api-band: CMD = run $(APITESTSDIR)/api-band-test$(EXESUF) $(TARGET_SAMPLES)/mpeg4/resize_down-up.h263
@@ -22,6 +27,12 @@ fate-lavf-flv: KEEP_FILES ?= 1
 fate-api-seek: CMD = run $(APITESTSDIR)/api-seek-test$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.flv 0 720
 fate-api-seek: CMP = null
 
+FATE_API_LIBAVFORMAT-yes += $(if $(findstring fate-lavf-ts,$(FATE_LAVF_CONTAINER)),fate-api-stream-info)
+fate-api-stream-info: $(APITESTSDIR)/api-stream-info-test$(EXESUF) fate-lavf-ts
+fate-lavf-ts: KEEP_FILES ?= 1
+fate-api-stream-info: CMD = run $(APITESTSDIR)/api-stream-info-test$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.ts
+fate-api-stream-info: CMP = null
+
 FATE_API-$(HAVE_THREADS) += fate-api-threadmessage
 fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
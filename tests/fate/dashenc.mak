@@ -0,0 +1,9 @@
+# background uploads must write the same segments and manifests as the
+# synchronous ones
+FATE_DASHENC-$(call ALLYES, DASH_MUXER MP4_MUXER AEVALSRC_FILTER ARESAMPLE_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-dash-async-uploads
+fate-dash-async-uploads: CMD = async_uploads dash out.mpd \
+  "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" \
+  "-codec:a mp2fixed -seg_duration 3"
+
+FATE_FFMPEG += $(FATE_DASHENC-yes)
+fate-dashenc: $(FATE_DASHENC-yes)
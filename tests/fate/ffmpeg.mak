@@ -23,6 +23,53 @@ fate-force_key_frames: CMD = enc_dec \
   avi "-c mpeg4 -g 240 -qscale 10 -force_key_frames 0.5,0:00:01.5" \
   framecrc "" "-skip_frame nokey"
 
+# hierarchical motion estimation of the mpegvideo encoders, with B-frames and
+# 4MV so the coarse search levels are used for all vector types
+FATE_FFMPEG-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER) += fate-mpeg4-motion-est-hier
+fate-mpeg4-motion-est-hier: tests/data/vsynth1.yuv
+fate-mpeg4-motion-est-hier: CMD = enc_dec \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv      \
+  avi "-c mpeg4 -qscale 7 -bf 2 -flags +mv4 -motion_est hier -frames:v 10" \
+  framecrc ""
+
+# rate control lookahead of the mpegvideo encoders, one pass with a variable
+# and a constant bitrate; the picture is inverted from frame 13 on, so the
+# lookahead must code it as an I-frame, visible in the probed frame types
+FATE_MPEG4_RC_LOOKAHEAD-$(call ENCDEC2, MPEG4, RAWVIDEO, AVI, RAWVIDEO_DEMUXER FRAMECRC_MUXER NEGATE_FILTER) += fate-mpeg4-rc-lookahead fate-mpeg4-rc-lookahead-cbr
+$(FATE_MPEG4_RC_LOOKAHEAD-yes): tests/data/vsynth1.yuv
+fate-mpeg4-rc-lookahead:     RCOPTS = -b:v 400k
+fate-mpeg4-rc-lookahead-cbr: RCOPTS = -b:v 1000k -minrate 1000k -maxrate 1000k -bufsize 1000k
+$(FATE_MPEG4_RC_LOOKAHEAD-yes): CMD = enc_dec \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv           \
+  avi "-vf negate=enable=gte(n\\,13) -c mpeg4 $(RCOPTS) -bf 2 -rc_lookahead 20 \
+       -frames:v 30" framecrc "" "" "-show_entries frame=pict_type,pkt_size -of compact"
+FATE_FFMPEG_FFPROBE += $(FATE_MPEG4_RC_LOOKAHEAD-yes)
+
+# parallel deflate of the png encoder with slice threads, the pictures are
+# split in several bands and the output must be the same for any number of
+# threads above one, so both refs have the same checksums
+FATE_PNG_SLICE_THREADS = fate-png-slice-threads-2 fate-png-slice-threads-5
+FATE_FFMPEG-$(call ENCDEC2, PNG, RAWVIDEO, NUT, RAWVIDEO_DEMUXER FRAMECRC_MUXER SCALE_FILTER) += $(FATE_PNG_SLICE_THREADS)
+$(FATE_PNG_SLICE_THREADS): tests/data/vsynth1.yuv
+fate-png-slice-threads-2: THREADS = 2
+fate-png-slice-threads-5: THREADS = 5
+fate-png-slice-threads-%: CMD = enc_dec \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv         \
+  nut "-c png -pix_fmt rgb24 -s 704x576 -pred mixed -threads $(THREADS)  \
+       -thread_type slice -frames:v 5 -sws_flags +accurate_rnd+bitexact" \
+  framecrc "-pix_fmt rgb24"
+
+# HTJ2K block coder of the jpeg2000 encoder, lossless with dwt53 and rate
+# distortion optimized with dwt97int
+FATE_FFMPEG-$(call ENCDEC2, JPEG2000, RAWVIDEO, NUT, RAWVIDEO_DEMUXER RAWVIDEO_MUXER) += fate-jpeg2000-ht-dwt53 fate-jpeg2000-ht-dwt97int
+fate-jpeg2000-ht-dwt53 fate-jpeg2000-ht-dwt97int: tests/data/vsynth1.yuv
+fate-jpeg2000-ht-%: CMD = enc_dec \
+  "rawvideo -s 352x288 -color_range mpeg -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+  nut "-c jpeg2000 -ht 1 $(ENCOPTS)" rawvideo "-pix_fmt yuv420p -color_range mpeg"
+fate-jpeg2000-ht-%: CMP_UNIT = 1
+fate-jpeg2000-ht-dwt53:    ENCOPTS = -pred dwt53
+fate-jpeg2000-ht-dwt97int: ENCOPTS = -pred dwt97int -q:v 5
+
 # test -force_key_frames source with and without framerate conversion
 # * we don't care about the actual video content, so replace it with
 #   a 2x2 black square to speed up encoding
@@ -249,6 +296,20 @@ fate-ffmpeg-filter-in-eof: CMD = framecrc
     -filter_complex "[0][1]concat" -c:v rawvideo
 FATE_FFMPEG-$(call FRAMECRC, RAWVIDEO, RAWVIDEO, CONCAT_FILTER) += fate-ffmpeg-filter-in-eof
 
+# A complex filtergraph output feeding another filtergraph must pass on its
+# EOF timestamp, or filters with a tail after EOF in the downstream graph,
+# here aecho, lose their last frames.
+fate-ffmpeg-filter-chain-eof: CMD = framecrc -auto_conversion_filters -f lavfi -i "sine=d=1:r=8000" \
+    -filter_complex "[0:a]anull[a]" -filter_complex "[a]aecho=0.8:0.9:500:0.3" -c:a pcm_s16le
+FATE_FFMPEG-$(call FILTERFRAMECRC, SINE ANULL AECHO, LAVFI_INDEV) += fate-ffmpeg-filter-chain-eof
+
+# simple filtergraphs starting with the same filters on the same input
+fate-ffmpeg-filter-share-prefix: tests/data/vsynth1.yuv
+fate-ffmpeg-filter-share-prefix: CMD = framecrc -filter_share_prefix              \
+    -f rawvideo -s 352x288 -pix_fmt yuv420p -t 0.4 -i $(TARGET_PATH)/tests/data/vsynth1.yuv \
+    -map 0:v -map 0:v -filter:v:0 "hflip,negate,vflip" -filter:v:1 "hflip,negate" -c:v rawvideo
+FATE_FFMPEG-$(call FRAMECRC, RAWVIDEO, RAWVIDEO, HFLIP_FILTER NEGATE_FILTER SPLIT_FILTER VFLIP_FILTER) += fate-ffmpeg-filter-share-prefix
+
 # Test termination on streamcopy with -t as an output option.
 fate-ffmpeg-streamcopy-t: tests/data/vsynth1.yuv
 fate-ffmpeg-streamcopy-t: CMP = null
@@ -387,6 +387,14 @@ fate-filter-unsharp: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf unsharp=11:11:-1.5
 FATE_FILTER_VSYNTH-$(call FILTERFRAMECRC, TESTSRC2 SCALE UNSHARP) += fate-filter-unsharp-yuv420p10
 fate-filter-unsharp-yuv420p10: CMD = framecrc -lavfi testsrc2=r=2:d=10,scale,format=yuv420p10,unsharp=11:11:-1.5:11:11:-1.5,scale -pix_fmt yuv420p10le -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
+# same graph run with pipelined filters, must give the same output
+FATE_FILTER_VSYNTH-$(call FILTERFRAMECRC, TESTSRC2 SCALE UNSHARP) += fate-filter-pipeline
+fate-filter-pipeline: CMD = framecrc -filter_pipeline -filter_complex_threads 4 -lavfi testsrc2=r=2:d=10,scale,format=yuv420p10,unsharp=11:11:-1.5:11:11:-1.5,scale -pix_fmt yuv420p10le -flags +bitexact -sws_flags +accurate_rnd+bitexact
+fate-filter-pipeline: REF = $(SRC_PATH)/tests/ref/fate/filter-unsharp-yuv420p10
+
+FATE_FILTER_VSYNTH-$(call FILTERFRAMECRC, TESTSRC2 MULTISCALE) += fate-filter-multiscale
+fate-filter-multiscale: CMD = framecrc -lavfi "testsrc2=r=5:d=1,multiscale=sizes=240x180|160x-2|qcif|80x60:cascade=1:flags=+accurate_rnd+bitexact:threads=2" -flags +bitexact
+
 FATE_FILTER_SAMPLES-$(call FILTERDEMDEC, PERMS HQDN3D, SMJPEG, MJPEG) += fate-filter-hqdn3d-sample
 fate-filter-hqdn3d-sample: tests/data/filtergraphs/hqdn3d
 fate-filter-hqdn3d-sample: CMD = framecrc -idct simple -i $(TARGET_SAMPLES)/smjpeg/scenwin.mjpg -/filter_complex $(TARGET_PATH)/tests/data/filtergraphs/hqdn3d -an
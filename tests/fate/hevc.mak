@@ -221,6 +221,15 @@ FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) +=         \
 
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) += $(HEVC_TESTS_MULTIVIEW)
 
+# multi-slice pictures decoded with slice threads, where the in-loop filters of
+# each slice run in parallel with its decoding; the output must not change
+HEVC_SAMPLES_SLICE_THREADS = SLICES_A_Rovi_3 DBLK_B_SONY_3 DBLK_C_SONY_3
+FATE_HEVC_SLICE_THREADS = $(addprefix fate-hevc-slice-threads-, $(HEVC_SAMPLES_SLICE_THREADS))
+$(FATE_HEVC_SLICE_THREADS): CMD = threads=4 thread_type=slice framecrc -flags output_corrupt \
+    -i $(TARGET_SAMPLES)/hevc-conformance/$(subst fate-hevc-slice-threads-,,$(@)).bit -pix_fmt yuv420p
+$(FATE_HEVC_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/$(subst fate-hevc-slice-threads-,hevc-conformance-,$(@))
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += $(FATE_HEVC_SLICE_THREADS)
+
 fate-hevc-paramchange-yuv420p-yuv420p10: CMD = framecrc -i $(TARGET_SAMPLES)/hevc/paramchange_yuv420p_yuv420p10.hevc -fps_mode passthrough -sws_flags area+accurate_rnd+bitexact
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER LARGE_TESTS) += fate-hevc-paramchange-yuv420p-yuv420p10
 
@@ -41,6 +41,18 @@ fate-hls-live-endlist: CMD = md5 -i $(SRC) -af hdcd=process_stereo=false -t 20 -
 fate-hls-live-endlist: CMP = oneline
 fate-hls-live-endlist: REF = e189ce781d9c87882f58e3929455167b
 
+# background uploads must write the same segments and playlist as the
+# synchronous ones, and rename all the temporary files; with a sliding
+# window, the segments must also be deleted the same way
+FATE_HLSENC_ASYNC-$(call ALLYES, HLS_MUXER MPEGTS_MUXER AEVALSRC_FILTER ARESAMPLE_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-async-uploads fate-hls-async-uploads-window
+fate-hls-async-uploads: CMD = async_uploads hls out.m3u8 \
+  "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" \
+  "-codec:a mp2fixed -hls_time 3 -hls_list_size 0 -hls_flags temp_file"
+fate-hls-async-uploads-window: CMD = async_uploads hls out.m3u8 \
+  "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" \
+  "-codec:a mp2fixed -hls_time 3 -hls_list_size 2 -hls_flags temp_file+delete_segments"
+FATE_FFMPEG += $(FATE_HLSENC_ASYNC-yes)
+
 tests/data/hls_segment_size.m3u8: TAG = GEN
 tests/data/hls_segment_size.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -31,6 +31,16 @@ fate-seek_utils: libavformat/tests/seek_utils$(EXESUF)
 fate-seek_utils: CMD = run libavformat/tests/seek_utils$(EXESUF)
 fate-seek_utils: CMP = null
 
+FATE_LIBAVFORMAT += fate-index_entries
+fate-index_entries: libavformat/tests/index_entries$(EXESUF)
+fate-index_entries: CMD = run libavformat/tests/index_entries$(EXESUF)
+fate-index_entries: CMP = null
+
+UPLOAD-QUEUE-TEST-$(CONFIG_HLS_MUXER) += fate-upload_queue
+FATE_LIBAVFORMAT-$(HAVE_THREADS) += $(UPLOAD-QUEUE-TEST-yes)
+fate-upload_queue: libavformat/tests/upload_queue$(EXESUF)
+fate-upload_queue: CMD = run libavformat/tests/upload_queue$(EXESUF)
+
 FATE_LIBAVFORMAT += $(FATE_LIBAVFORMAT-yes)
 FATE-$(CONFIG_AVFORMAT) += $(FATE_LIBAVFORMAT)
 fate-libavformat: $(FATE_LIBAVFORMAT)
@@ -284,6 +284,15 @@ fate-mov-mp4-iamf-ambisonic_1: CMD = transcode wav $(SRC) mp4 "-auto_conversion_
   -streamid 0:0 -streamid 1:1 -streamid 2:2 -streamid 3:3 -map [MONO0] -map [MONO1] -map [MONO2] -map [MONO3] -c:a flac -t 1" "-c:a copy -map 0" \
   "-show_entries stream_group=index,id,nb_streams,type:stream_group_components:stream_group_disposition:stream_group_tags:stream_group_stream=index,id:stream_group_stream_disposition"
 
+# Test looking up the samples in the sample tables instead of the full index.
+FATE_MOV_FFMPEG_FFPROBE-$(call TRANSCODE, MPEG4 FLAC, MOV, WAV_DEMUXER RAWVIDEO_DEMUXER PCM_S16LE_DECODER) += fate-mov-lazy-index
+fate-mov-lazy-index: tests/data/asynth-44100-2.wav tests/data/vsynth1.yuv
+fate-mov-lazy-index: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-mov-lazy-index: SRC2 = $(TARGET_PATH)/tests/data/vsynth1.yuv
+fate-mov-lazy-index: CMD = transcode wav $(SRC) mp4 "-map 1:v -map 0:a -c:a flac -c:v mpeg4 -bf 2 -g 10 -t 1" "-c copy" \
+  "-lazy_index 1 -show_entries packet=stream_index,pts,dts,duration,size,pos,flags" \
+  "-f rawvideo -s 352x288 -pix_fmt yuv420p -i $(SRC2)" "-lazy_index 1 -ss 0.4"
+
 FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
 FATE_FFMPEG_FFPROBE += $(FATE_MOV_FFMPEG_FFPROBE-yes)
 
@@ -37,6 +37,14 @@ fate-opus-silk-lbrr:         CMP_TARGET = 0
 fate-opus-tron.6ch.tinypkts: CMP_SHIFT = 1440
 fate-opus-tron.6ch.tinypkts: CMP_TARGET = 0
 
+# the streams of a multistream packet are coded in parallel with slice
+# threads, which must not change the output
+FATE_OPUS_ENC-$(call ALLYES, LAVFI_INDEV AEVALSRC_FILTER ARESAMPLE_FILTER OPUS_ENCODER FRAMECRC_MUXER) += fate-opus-enc-5.1-threads
+fate-opus-enc-5.1-threads: CMD = enc_threads lavfi \
+  "aevalsrc=sin(440*2*PI*t)|sin(554*2*PI*t)|sin(660*2*PI*t)|0.1*sin(55*2*PI*t)|t*sin(880*2*PI*t)|sin(1000*2*PI*t):c=5.1:s=48000:d=1" \
+  "-c:a opus -strict experimental" 4
+
+FATE_FFMPEG += $(FATE_OPUS_ENC-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_OPUS)
 fate-opus-celt: $(FATE_OPUS_CELT-yes)
 fate-opus-hybrid: $(FATE_OPUS_HYBRID-yes)